@@ -96,6 +96,19 @@ extern "C" {
         short channel;
         short host;
     } tchannel_to_host_map;
+    //Flags for prussdrv_load_image and prussdrv_load_file
+#define PRUSSDRV_LOAD_VERIFY    0x01    //Verify memories by read-back hash
+
+    typedef struct __prussdrv_load_info {
+        //Number of bytes written to the instruction and data RAM
+        unsigned int iram_bytes;
+        unsigned int dram_bytes;
+        //Time it took to load (and verify) the image in microseconds
+        unsigned int load_time_us;
+        //FNV-1a hash of the entire image as given
+        unsigned int image_hash;
+    } tprussdrv_load_info;
+
     typedef struct __pruss_intc_initdata {
         //Enabled SYSEVTs - Range:0..63
         //{-1} indicates end of list
@@ -131,6 +144,29 @@ extern "C" {
                                   unsigned int *memarea,
                                   unsigned int bytelength);
 
+    /** Compare the specified PRU memory area against the given data by
+     * reading it back and hashing both.
+     * @return 0 if the contents match, -1 otherwise */
+    int prussdrv_pru_verify_memory(unsigned int pru_ram_id,
+                                   unsigned int wordoffset,
+                                   const unsigned int *memarea,
+                                   unsigned int bytelength);
+
+    /** Load a PRU image held in memory. The image is either an ELF file as
+     * produced by the PRU code generation tools, whose executable segments
+     * go to the instruction RAM and all others to the data RAM of the PRU,
+     * or a raw binary that gets written to the instruction RAM. The PRU is
+     * disabled before loading and is left disabled. The optional info gets
+     * filled in with statistics about the load.
+     * @return 0 on success, -1 for an invalid image or failed verification */
+    int prussdrv_load_image(unsigned int prunum, const void *image,
+                            unsigned int length, unsigned int flags,
+                            tprussdrv_load_info * info);
+
+    /** Same as prussdrv_load_image but maps the image from a file. */
+    int prussdrv_load_file(unsigned int prunum, const char *filename,
+                           unsigned int flags, tprussdrv_load_info * info);
+
     int prussdrv_pruintc_init(tpruss_intc_initdata * prussintc_init_data);
 
     /** Find and return the channel a specified event is mapped to.
@@ -176,6 +212,12 @@ extern "C" {
      * @return the number of times the event has happened. */
     unsigned int prussdrv_pru_wait_event(unsigned int host_interrupt);
 
+    /** Return the file descriptor associated with the specified host
+     * interrupt. It becomes readable when the event has happened and can be
+     * used with select/poll/epoll instead of blocking in
+     * prussdrv_pru_wait_event. */
+    int prussdrv_pru_event_fd(unsigned int host_interrupt);
+
     int prussdrv_pru_send_event(unsigned int eventnum);
 
     /** Clear the specified event and re-enable the host interrupt. */
@@ -188,6 +230,8 @@ extern "C" {
 
     int prussdrv_exit(void);
 
+    /** Load a PRU image file (see prussdrv_load_image) and enable the PRU.
+     * @return 0 on success, -1 if the file can't be loaded */
     int prussdrv_exec_program(int prunum, char *filename);
 
     int prussdrv_start_irqthread(unsigned int host_interrupt, int priority,
@@ -59,6 +59,8 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 
+#include <elf.h>
+
 #include <linux/unistd.h>
 
 #define DISABLE_L3RAM_SUPPORT
@@ -75,6 +77,8 @@
 #define PRUSS_MAX_IRAM_SIZE                  8192
 
 #define AM33XX_PRUSS_IRAM_SIZE               8192
+#define AM33XX_PRUSS_DATARAM_SIZE            8192
+#define AM33XX_PRUSS_SHAREDRAM_SIZE          12288
 #define AM33XX_PRUSS_MMAP_SIZE               0x40000
 #define AM33XX_DATARAM0_PHYS_BASE            0x4a300000
 #define AM33XX_DATARAM1_PHYS_BASE            0x4a302000
@@ -94,6 +98,7 @@
 #define	AM33XX_PRUSS_MDIO_BASE               0x4a332400
 
 #define AM18XX_PRUSS_IRAM_SIZE               4096
+#define AM18XX_PRUSS_DATARAM_SIZE            512
 #define AM18XX_PRUSS_MMAP_SIZE               0x7C00
 #define AM18XX_DATARAM0_PHYS_BASE            0x01C30000
 #define AM18XX_DATARAM1_PHYS_BASE            0x01C32000
@@ -163,6 +168,19 @@
 
 #define MAX_HOSTS_SUPPORTED	10
 
+//ELF machine type of PRU images as produced by the TI PRU code generation
+//tools - not known to older C libraries
+#ifndef EM_TI_PRU
+#define EM_TI_PRU                    144
+#endif
+
+//Number of words copied per iteration when writing PRU memories
+#define PRUSS_COPY_BURST_WORDS       8
+
+//FNV-1a parameters used for the read-back verification of PRU memories
+#define PRUSS_HASH_OFFSET_BASIS      0x811C9DC5
+#define PRUSS_HASH_PRIME             0x01000193
+
 //UIO driver expects user space to map PRUSS_UIO_MAP_OFFSET_XXX to 
 //access corresponding memory regions - region offset is N*PAGE_SIZE
 
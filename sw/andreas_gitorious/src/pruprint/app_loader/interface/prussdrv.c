@@ -57,6 +57,22 @@
 
 static tprussdrv prussdrv;
 
+static int __prussdrv_ram_area(unsigned int pru_ram_id,
+                               unsigned int **pruramarea,
+                               unsigned int *ramsize);
+static unsigned int __prussdrv_hash(unsigned int hash, const void *data,
+                                    unsigned int bytelength);
+static int __prussdrv_load_segment(unsigned int pru_ram_id,
+                                   unsigned int address,
+                                   const unsigned char *data,
+                                   unsigned int filelength,
+                                   unsigned int memlength,
+                                   unsigned int flags);
+static int __prussdrv_load_elf(unsigned int prunum,
+                               const unsigned char *image,
+                               unsigned int length, unsigned int flags,
+                               tprussdrv_load_info * info);
+
 int __prussdrv_memmap_init(void)
 {
     int i, fd;
@@ -313,43 +329,285 @@ int prussdrv_pru_disable(unsigned int prunum)
 
 }
 
-int prussdrv_pru_write_memory(unsigned int pru_ram_id,
-                              unsigned int wordoffset,
-                              unsigned int *memarea,
-                              unsigned int bytelength)
+static int __prussdrv_ram_area(unsigned int pru_ram_id,
+                               unsigned int **pruramarea,
+                               unsigned int *ramsize)
 {
-    unsigned int *pruramarea, i, wordlength;
+    int v2 = prussdrv.version == PRUSS_V2;
+
     switch (pru_ram_id) {
     case PRUSS0_PRU0_IRAM:
-        pruramarea = (unsigned int *) prussdrv.pru0_iram_base;
+        *pruramarea = (unsigned int *) prussdrv.pru0_iram_base;
+        *ramsize = v2 ? AM33XX_PRUSS_IRAM_SIZE : AM18XX_PRUSS_IRAM_SIZE;
         break;
     case PRUSS0_PRU1_IRAM:
-        pruramarea = (unsigned int *) prussdrv.pru1_iram_base;
+        *pruramarea = (unsigned int *) prussdrv.pru1_iram_base;
+        *ramsize = v2 ? AM33XX_PRUSS_IRAM_SIZE : AM18XX_PRUSS_IRAM_SIZE;
         break;
     case PRUSS0_PRU0_DATARAM:
-        pruramarea = (unsigned int *) prussdrv.pru0_dataram_base;
+        *pruramarea = (unsigned int *) prussdrv.pru0_dataram_base;
+        *ramsize = v2 ? AM33XX_PRUSS_DATARAM_SIZE : AM18XX_PRUSS_DATARAM_SIZE;
         break;
     case PRUSS0_PRU1_DATARAM:
-        pruramarea = (unsigned int *) prussdrv.pru1_dataram_base;
+        *pruramarea = (unsigned int *) prussdrv.pru1_dataram_base;
+        *ramsize = v2 ? AM33XX_PRUSS_DATARAM_SIZE : AM18XX_PRUSS_DATARAM_SIZE;
         break;
     case PRUSS0_SHARED_DATARAM:
-        if (prussdrv.version != PRUSS_V2)
+        if (!v2)
             return -1;
-        pruramarea = (unsigned int *) prussdrv.pruss_sharedram_base;
+        *pruramarea = (unsigned int *) prussdrv.pruss_sharedram_base;
+        *ramsize = AM33XX_PRUSS_SHAREDRAM_SIZE;
         break;
     default:
         return -1;
     }
+    return 0;
+}
+
+int prussdrv_pru_write_memory(unsigned int pru_ram_id,
+                              unsigned int wordoffset,
+                              unsigned int *memarea,
+                              unsigned int bytelength)
+{
+    volatile unsigned int *dst;
+    const unsigned char *src = (const unsigned char *) memarea;
+    unsigned int *pruramarea, ramsize, i, wordlength, fullwords, tail;
+    unsigned int burst[PRUSS_COPY_BURST_WORDS];
 
+    if (__prussdrv_ram_area(pru_ram_id, &pruramarea, &ramsize))
+        return -1;
 
     wordlength = (bytelength + 3) >> 2; //Adjust length as multiple of 4 bytes
-    for (i = 0; i < wordlength; i++) {
-        *(pruramarea + i + wordoffset) = *(memarea + i);
+    if (wordoffset > ramsize / 4 || wordlength > ramsize / 4 - wordoffset)
+        return -1;
+
+    //The PRU memories are mapped uncached so write them using aligned 32-bit
+    //accesses only, a burst of words at a time. The source doesn't need to
+    //be aligned and is never read beyond its end.
+    dst = pruramarea + wordoffset;
+    fullwords = bytelength >> 2;
+    for (i = 0; i + PRUSS_COPY_BURST_WORDS <= fullwords;
+         i += PRUSS_COPY_BURST_WORDS) {
+        memcpy(burst, src + i * 4, sizeof(burst));
+        dst[i + 0] = burst[0];
+        dst[i + 1] = burst[1];
+        dst[i + 2] = burst[2];
+        dst[i + 3] = burst[3];
+        dst[i + 4] = burst[4];
+        dst[i + 5] = burst[5];
+        dst[i + 6] = burst[6];
+        dst[i + 7] = burst[7];
+    }
+    for (; i < fullwords; i++) {
+        memcpy(burst, src + i * 4, 4);
+        dst[i] = burst[0];
+    }
+    tail = bytelength & 3;
+    if (tail) {
+        burst[0] = 0;
+        memcpy(burst, src + i * 4, tail);
+        dst[i] = burst[0];
     }
     return wordlength;
 
 }
 
+static unsigned int __prussdrv_hash(unsigned int hash, const void *data,
+                                    unsigned int bytelength)
+{
+    const unsigned char *bytes = (const unsigned char *) data;
+    unsigned int i;
+
+    for (i = 0; i < bytelength; i++) {
+        hash ^= bytes[i];
+        hash *= PRUSS_HASH_PRIME;
+    }
+    return hash;
+}
+
+int prussdrv_pru_verify_memory(unsigned int pru_ram_id,
+                               unsigned int wordoffset,
+                               const unsigned int *memarea,
+                               unsigned int bytelength)
+{
+    volatile unsigned int *src;
+    unsigned int *pruramarea, ramsize, i, word, hash;
+
+    if (__prussdrv_ram_area(pru_ram_id, &pruramarea, &ramsize))
+        return -1;
+
+    if (wordoffset > ramsize / 4 || (bytelength + 3) / 4 > ramsize / 4 -
+        wordoffset)
+        return -1;
+
+    //Read back using aligned 32-bit accesses and hash what has been read the
+    //same way as the given data
+    src = pruramarea + wordoffset;
+    hash = PRUSS_HASH_OFFSET_BASIS;
+    for (i = 0; i < bytelength; i += 4) {
+        word = src[i / 4];
+        hash = __prussdrv_hash(hash, &word,
+                               bytelength - i < 4 ? bytelength - i : 4);
+    }
+
+    if (hash != __prussdrv_hash(PRUSS_HASH_OFFSET_BASIS, memarea, bytelength))
+        return -1;
+    return 0;
+}
+
+static int __prussdrv_load_segment(unsigned int pru_ram_id,
+                                   unsigned int address,
+                                   const unsigned char *data,
+                                   unsigned int filelength,
+                                   unsigned int memlength,
+                                   unsigned int flags)
+{
+    static const unsigned int zeros[PRUSS_COPY_BURST_WORDS];
+    unsigned int offset, chunk;
+
+    if (address & 3)
+        return -1;
+
+    if (prussdrv_pru_write_memory(pru_ram_id, address / 4,
+                                  (unsigned int *) data, filelength) < 0)
+        return -1;
+    if ((flags & PRUSSDRV_LOAD_VERIFY) &&
+        prussdrv_pru_verify_memory(pru_ram_id, address / 4,
+                                   (const unsigned int *) data, filelength))
+        return -1;
+
+    //Zero-fill whatever the segment occupies in memory beyond its file
+    //contents, starting at the next word boundary
+    for (offset = (filelength + 3) & ~3; offset < memlength; offset += chunk) {
+        chunk = memlength - offset;
+        if (chunk > sizeof(zeros))
+            chunk = sizeof(zeros);
+        if (prussdrv_pru_write_memory(pru_ram_id, (address + offset) / 4,
+                                      (unsigned int *) zeros, chunk) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+static int __prussdrv_load_elf(unsigned int prunum,
+                               const unsigned char *image,
+                               unsigned int length, unsigned int flags,
+                               tprussdrv_load_info * info)
+{
+    const Elf32_Ehdr *ehdr = (const Elf32_Ehdr *) image;
+    Elf32_Phdr phdr;
+    unsigned int i, pru_ram_id;
+
+    if (length < sizeof(Elf32_Ehdr) ||
+        ehdr->e_ident[EI_CLASS] != ELFCLASS32 ||
+        ehdr->e_ident[EI_DATA] != ELFDATA2LSB ||
+        ehdr->e_machine != EM_TI_PRU ||
+        ehdr->e_phentsize != sizeof(Elf32_Phdr) ||
+        ehdr->e_phoff > length ||
+        ehdr->e_phnum > (length - ehdr->e_phoff) / sizeof(Elf32_Phdr)) {
+        printf("Not a valid PRU ELF image\n");
+        return -1;
+    }
+
+    for (i = 0; i < ehdr->e_phnum; i++) {
+        memcpy(&phdr, image + ehdr->e_phoff + i * sizeof(Elf32_Phdr),
+               sizeof(phdr));
+        if (phdr.p_type != PT_LOAD || phdr.p_memsz == 0)
+            continue;
+        if (phdr.p_offset > length || phdr.p_filesz > length - phdr.p_offset
+            || phdr.p_filesz > phdr.p_memsz) {
+            printf("PRU ELF segment %u exceeds image\n", i);
+            return -1;
+        }
+
+        //Code goes to the instruction RAM and anything else to the data RAM
+        //of the PRU. Both are addressed starting at zero from the PRU's
+        //point of view.
+        if (phdr.p_flags & PF_X) {
+            pru_ram_id = prunum ? PRUSS0_PRU1_IRAM : PRUSS0_PRU0_IRAM;
+            info->iram_bytes += phdr.p_memsz;
+        } else {
+            pru_ram_id = prunum ? PRUSS0_PRU1_DATARAM : PRUSS0_PRU0_DATARAM;
+            info->dram_bytes += phdr.p_memsz;
+        }
+        if (__prussdrv_load_segment(pru_ram_id, phdr.p_paddr,
+                                    image + phdr.p_offset, phdr.p_filesz,
+                                    phdr.p_memsz, flags)) {
+            printf("Loading PRU ELF segment %u failed\n", i);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int prussdrv_load_image(unsigned int prunum, const void *image,
+                        unsigned int length, unsigned int flags,
+                        tprussdrv_load_info * info)
+{
+    const unsigned char *bytes = (const unsigned char *) image;
+    tprussdrv_load_info localinfo;
+    struct timespec start, end;
+    int ret;
+
+    if (prunum > 1 || length == 0)
+        return -1;
+    if (info == NULL)
+        info = &localinfo;
+    memset(info, 0, sizeof(*info));
+    info->image_hash = __prussdrv_hash(PRUSS_HASH_OFFSET_BASIS, image, length);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // Make sure PRU sub system is first disabled/reset
+    prussdrv_pru_disable(prunum);
+    if (length >= SELFMAG && !memcmp(bytes, ELFMAG, SELFMAG)) {
+        ret = __prussdrv_load_elf(prunum, bytes, length, flags, info);
+    } else {
+        info->iram_bytes = length;
+        ret = __prussdrv_load_segment(prunum ? PRUSS0_PRU1_IRAM :
+                                      PRUSS0_PRU0_IRAM, 0, bytes, length,
+                                      length, flags);
+        if (ret)
+            printf("Loading PRU binary image failed\n");
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    info->load_time_us = (end.tv_sec - start.tv_sec) * 1000000 +
+        (end.tv_nsec - start.tv_nsec) / 1000;
+
+    return ret;
+}
+
+int prussdrv_load_file(unsigned int prunum, const char *filename,
+                       unsigned int flags, tprussdrv_load_info * info)
+{
+    struct stat st;
+    void *image;
+    int fd, ret;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        printf("File %s open failed\n", filename);
+        return -1;
+    }
+    if (fstat(fd, &st) || st.st_size == 0) {
+        printf("File %s read failed\n", filename);
+        close(fd);
+        return -1;
+    }
+
+    image = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED) {
+        printf("File %s map failed\n", filename);
+        return -1;
+    }
+
+    ret = prussdrv_load_image(prunum, image, st.st_size, flags, info);
+    munmap(image, st.st_size);
+    return ret;
+}
+
 
 int prussdrv_pruintc_init(tpruss_intc_initdata * prussintc_init_data)
 {
@@ -473,6 +731,14 @@ unsigned int prussdrv_pru_wait_event(unsigned int host_interrupt)
     return event_count;
 }
 
+int prussdrv_pru_event_fd(unsigned int host_interrupt)
+{
+    if (host_interrupt < NUM_PRU_HOSTIRQS)
+        return prussdrv.fd[host_interrupt];
+    else
+        return -1;
+}
+
 int prussdrv_pru_clear_event(unsigned int host_interrupt, unsigned int sysevent)
 {
     unsigned int *pruintc_io = (unsigned int *) prussdrv.intc_base;
@@ -645,48 +911,11 @@ int prussdrv_exit()
 
 int prussdrv_exec_program(int prunum, char *filename)
 {
-    FILE *fPtr;
-    unsigned char fileDataArray[PRUSS_MAX_IRAM_SIZE];
-    int fileSize = 0;
-    unsigned int pru_ram_id;
-
-    if (prunum == 0)
-        pru_ram_id = PRUSS0_PRU0_IRAM;
-    else if (prunum == 1)
-        pru_ram_id = PRUSS0_PRU1_IRAM;
-    else
+    if (prunum != 0 && prunum != 1)
         return -1;
 
-    // Open an File from the hard drive
-    fPtr = fopen(filename, "rb");
-    if (fPtr == NULL) {
-        printf("File %s open failed\n", filename);
-    } else {
-        printf("File %s open passed\n", filename);
-    }
-    // Read file size
-    fseek(fPtr, 0, SEEK_END);
-    fileSize = ftell(fPtr);
-
-    if (fileSize == 0) {
-        printf("File read failed.. Closing program\n");
-        fclose(fPtr);
+    if (prussdrv_load_file(prunum, filename, 0, NULL))
         return -1;
-    }
-
-    fseek(fPtr, 0, SEEK_SET);
-
-    if (fileSize !=
-        fread((unsigned char *) fileDataArray, 1, fileSize, fPtr)) {
-        printf("WARNING: File Size mismatch\n");
-    }
-
-    fclose(fPtr);
-
-    // Make sure PRU sub system is first disabled/reset  
-    prussdrv_pru_disable(prunum);
-    prussdrv_pru_write_memory(pru_ram_id, 0,
-                              (unsigned int *) fileDataArray, fileSize);
     prussdrv_pru_enable(prunum);
 
     return 0;
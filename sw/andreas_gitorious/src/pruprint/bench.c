@@ -0,0 +1,953 @@
+/*
+ * bench.c
+ *
+ * Built-in benchmarks. See bench.h for details.
+ *
+ * Copyright (C) 2014 Texas Instruments Incorporated - http://www.ti.com/
+ * ALL RIGHTS RESERVED
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "bench.h"
+#include "prumem.h"
+#include "printjob.h"
+#include "session.h"
+#include "image.h"
+#include "joboptimizer.h"
+#include "linedict.h"
+#include "hash.h"
+#include "irqbench.h"
+#include "membench.h"
+
+// General helper macro - determine and return the minimum of two given values
+#define MIN(a, b)                   (((a) < (b)) ? (a) : (b))
+
+// Number of times the shared RAM queue gets filled for each transfer method
+#define SHMEM_BENCH_ROUNDS          500
+
+// Number of jobs that get round-tripped through the PRU for each sync mode
+#define SYNC_BENCH_ROUNDS           1000
+
+// Directory holding the demo images used as end-to-end workloads. It can be
+// overridden through the environment variable of the given name.
+#define E2E_BENCH_IMAGE_DIR         "demo_images"
+#define E2E_BENCH_IMAGE_DIR_ENV     "PRINTER_BENCH_IMAGE_DIR"
+
+// Number of lines of the synthetic end-to-end workloads
+#define E2E_BENCH_LINES             1024
+#define E2E_BENCH_RECEIPT_LINES     10000
+
+// Number of times each kernel gets run over its input
+#define KERNEL_BENCH_ROUNDS         200
+
+// Type of a benchmark function. Returns false in case the benchmark couldn't
+// be run.
+typedef bool (*PRINTER_BenchFunction)(const PRINTER_BenchContext *context);
+
+// Type describing a benchmark that can be selected by name
+typedef struct {
+    const char *name;
+    PRINTER_BenchFunction function;
+    const char *description;
+} PRINTER_Benchmark;
+
+// Type of a function generating a synthetic workload image. The parameter is
+// specific to the workload.
+typedef bool (*PRINTER_WorkloadFunction)(PRINTER_Image *image,
+        const uint32_t param);
+
+// Type describing an end-to-end workload. It is either read from the given
+// demo image or generated by the given function.
+typedef struct {
+    const char *name;
+    const char *fileName;
+    PRINTER_WorkloadFunction function;
+    uint32_t param;
+} PRINTER_Workload;
+
+// Input shared by the kernel micro-benchmarks. The image and the staged line
+// passes are the same on every run.
+typedef struct {
+    const PRINTER_BenchContext *context;
+    PRINTER_Image image;
+    PRINTER_Job job;
+    uint8_t *passes;
+    uint32_t passesSize;
+    const char *pngFileName;
+} PRINTER_KernelInput;
+
+// Type of a kernel micro-benchmark function. It runs the kernel over its input
+// once and returns the number of lines and bytes that were processed.
+typedef bool (*PRINTER_KernelFunction)(PRINTER_KernelInput *input,
+        uint32_t *nrOfLines, uint32_t *nrOfBytes);
+
+// Type of a method of transferring a staged batch of job items into the queue
+typedef void (*PRINTER_QueueWriteMethod)(PRINTER_Queue *queue,
+        const uint8_t items[], const uint32_t size);
+
+static bool benchSharedRamWrite(const PRINTER_BenchContext *context);
+static void writeQueueFieldByField(PRINTER_Queue *queue,
+        const uint8_t items[], const uint32_t size);
+static void writeQueueMemcpy(PRINTER_Queue *queue, const uint8_t items[],
+        const uint32_t size);
+static void writeQueueBurst(PRINTER_Queue *queue, const uint8_t items[],
+        const uint32_t size);
+static bool benchSyncLatency(const PRINTER_BenchContext *context);
+static bool benchEndToEnd(const PRINTER_BenchContext *context);
+static bool benchKernels(const PRINTER_BenchContext *context);
+static bool initKernelInput(PRINTER_KernelInput *input,
+        const PRINTER_BenchContext *context);
+static void freeKernelInput(PRINTER_KernelInput *input);
+static bool runKernelPartition(PRINTER_KernelInput *input,
+        uint32_t *nrOfLines, uint32_t *nrOfBytes);
+static bool runKernelPartitionInverse(PRINTER_KernelInput *input,
+        uint32_t *nrOfLines, uint32_t *nrOfBytes);
+static bool partitionKernelInput(PRINTER_KernelInput *input,
+        const bool inverse, uint32_t *nrOfLines, uint32_t *nrOfBytes);
+static bool runKernelRowHash(PRINTER_KernelInput *input,
+        uint32_t *nrOfLines, uint32_t *nrOfBytes);
+static bool runKernelPngDecode(PRINTER_KernelInput *input,
+        uint32_t *nrOfLines, uint32_t *nrOfBytes);
+static bool runKernelQueueFields(PRINTER_KernelInput *input,
+        uint32_t *nrOfLines, uint32_t *nrOfBytes);
+static bool runKernelQueueMemcpy(PRINTER_KernelInput *input,
+        uint32_t *nrOfLines, uint32_t *nrOfBytes);
+static bool runKernelQueueBurst(PRINTER_KernelInput *input,
+        uint32_t *nrOfLines, uint32_t *nrOfBytes);
+static int openCycleCounter(void);
+static uint64_t readCycleCounter(const int fd);
+static bool loadWorkload(const PRINTER_Workload *workload,
+        PRINTER_Image *image);
+static bool runWorkload(const PRINTER_BenchContext *context,
+        const char *name, const PRINTER_Image *image);
+static bool generateBlocks(PRINTER_Image *image, const uint32_t param);
+static bool generateNoise(PRINTER_Image *image, const uint32_t param);
+static bool generateBarcode(PRINTER_Image *image, const uint32_t param);
+static bool generateReceipt(PRINTER_Image *image, const uint32_t param);
+static void setDot(PRINTER_Image *image, const uint32_t x, const uint32_t y);
+static uint32_t getRandom(uint32_t *state);
+static int compareDurations(const void *a, const void *b);
+static uint64_t getTimeNs(void);
+static uint64_t getThreadCpuTimeNs(void);
+
+static const PRINTER_Benchmark benchmarks[] = {
+    { "shmem", benchSharedRamWrite,
+            "Write bandwidth into the shared RAM printer queue" },
+    { "sync", benchSyncLatency,
+            "Job round trip latency using interrupts vs. busy-polling" },
+    { "e2e", benchEndToEnd,
+            "Host pipeline throughput printing canonical workloads" },
+    { "kernels", benchKernels,
+            "Per-line cost of the host hot spots using fixed inputs" },
+    { "irq", benchInterruptLatency,
+            "Host to PRU to host event latency through prussdrv" },
+    { "mem", benchMemories,
+            "Host write and PRU read performance of the PRU-visible memories" }
+};
+
+// Workloads printed by the end-to-end benchmark. Their names and contents must
+// stay the same so that results can be compared across versions.
+static const PRINTER_Workload workloads[] = {
+    { "logo", "ti_logo_1bpp.png", NULL, 0 },
+    { "logo-large", "ti_logo_1bpp_large.png", NULL, 0 },
+    { "logo-double", "ti_logo_1bpp_double_height.png", NULL, 0 },
+    { "logo-right", "ti_logo_1bpp_right_side_double_height.png", NULL, 0 },
+    { "blocks", NULL, generateBlocks, E2E_BENCH_LINES },
+    { "noise-5", NULL, generateNoise, 5 },
+    { "noise-25", NULL, generateNoise, 25 },
+    { "noise-50", NULL, generateNoise, 50 },
+    { "barcode", NULL, generateBarcode, E2E_BENCH_LINES },
+    { "receipt", NULL, generateReceipt, E2E_BENCH_RECEIPT_LINES }
+};
+
+// Kernels run by the kernel micro-benchmark. The queue kernels compare the
+// ways of encoding passes into the printer queue. The field by field method is
+// what addJobItemToQueueLowLevel() does, whereas the burst method is what
+// print sessions use, which copies using NEON where available.
+static const struct {
+    const char *name;
+    PRINTER_KernelFunction function;
+} kernels[] = {
+    { "partition", runKernelPartition },
+    { "partition-inverse", runKernelPartitionInverse },
+    { "row-hash", runKernelRowHash },
+    { "png-decode", runKernelPngDecode },
+    { "queue-fields", runKernelQueueFields },
+    { "queue-memcpy", runKernelQueueMemcpy },
+    { "queue-burst", runKernelQueueBurst }
+};
+
+bool runBenchmark(const char *name, const PRINTER_BenchContext *context) {
+    uint32_t i;
+
+    for (i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++) {
+        if (!strcmp(benchmarks[i].name, name)) {
+            printf("Running benchmark %s: %s\n", benchmarks[i].name,
+                    benchmarks[i].description);
+            return benchmarks[i].function(context);
+        }
+    }
+
+    fprintf(stderr, "Unknown benchmark %s!\n", name);
+    printBenchmarksToConsole();
+
+    return false;
+}
+
+void printBenchmarksToConsole(void) {
+    uint32_t i;
+
+    printf("Available benchmarks:\n");
+    for (i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++) {
+        printf("  %-12s %s\n", benchmarks[i].name, benchmarks[i].description);
+    }
+}
+
+// Compare the different ways of getting job items into the printer queue. The
+// queue gets filled with line passes over and over again, which is what the
+// bulk of any real print job consists of.
+static bool benchSharedRamWrite(const PRINTER_BenchContext *context) {
+    static const struct {
+        const char *name;
+        PRINTER_QueueWriteMethod method;
+    } writeMethods[] = {
+        { "field by field", writeQueueFieldByField },
+        { "memcpy", writeQueueMemcpy },
+        { "burst", writeQueueBurst }
+    };
+    const uint32_t itemSize = PRINTER_JOB_ITEM_SIZE(PRINTER_BYTES_PER_LINE);
+    const uint32_t size = (sizeof(context->queue->jobItems) -
+            PRINTER_JOB_ITEM_SIZE(0)) / itemSize * itemSize;
+    PRINTER_JobItem *item;
+    PRINTER_JobItem *eosItem;
+    uint8_t *items;
+    uint64_t startTime;
+    uint64_t duration;
+    uint32_t offset;
+    uint32_t i;
+    uint32_t j;
+
+    // Stage a batch of line passes with some dot data in cached memory
+    items = (uint8_t *)malloc(size);
+    if (!items) {
+        fprintf(stderr, "Error allocating memory for benchmark!\n");
+        return false;
+    }
+    for (offset = 0; offset < size; offset += itemSize) {
+        item = (PRINTER_JobItem *)(items + offset);
+        item->command = PRINTER_CMD_PRINT_LINE;
+        item->length = PRINTER_BYTES_PER_LINE;
+        for (j = 0; j < PRINTER_BYTES_PER_LINE; j++) {
+            ((uint8_t *)item->data)[j] = (uint8_t)(offset + j);
+        }
+    }
+
+    for (i = 0; i < sizeof(writeMethods) / sizeof(writeMethods[0]); i++) {
+        startTime = getTimeNs();
+        for (j = 0; j < SHMEM_BENCH_ROUNDS; j++) {
+            writeMethods[i].method(context->queue, items, size);
+        }
+        duration = getTimeNs() - startTime;
+
+        // Make sure what ended up in the queue is actually correct
+        if (memcmp(context->queue->jobItems, items, size)) {
+            fprintf(stderr, "Queue contents mismatch using %s!\n",
+                    writeMethods[i].name);
+        }
+
+        printf("  %-16s %8u bytes x %u: %6.1f MB/s\n", writeMethods[i].name,
+                size, SHMEM_BENCH_ROUNDS,
+                (double)size * SHMEM_BENCH_ROUNDS * 1000.0 / duration);
+    }
+
+    // Leave an empty queue behind
+    eosItem = (PRINTER_JobItem *)context->queue->jobItems;
+    eosItem->command = PRINTER_CMD_EOS;
+    eosItem->length = 0;
+
+    free(items);
+
+    return true;
+}
+
+// This is how items used to get added to the queue - each field gets stored
+// individually followed by a copy of the payload
+static void writeQueueFieldByField(PRINTER_Queue *queue,
+        const uint8_t items[], const uint32_t size) {
+    const PRINTER_JobItem *item;
+    PRINTER_JobItem *jobItem = (PRINTER_JobItem *)queue->jobItems;
+    uint32_t offset;
+
+    for (offset = 0; offset < size;
+            offset += PRINTER_JOB_ITEM_SIZE(item->length)) {
+        item = (const PRINTER_JobItem *)(items + offset);
+        jobItem->command = item->command;
+        jobItem->length = item->length;
+        memcpy(jobItem->data, item->data, item->length);
+        jobItem = (PRINTER_JobItem *)((uint8_t *)jobItem +
+                PRINTER_JOB_ITEM_SIZE(item->length));
+    }
+}
+
+static void writeQueueMemcpy(PRINTER_Queue *queue, const uint8_t items[],
+        const uint32_t size) {
+    memcpy(queue->jobItems, items, size);
+}
+
+static void writeQueueBurst(PRINTER_Queue *queue, const uint8_t items[],
+        const uint32_t size) {
+    copyToPruMemory(queue->jobItems, items, size);
+    releasePruMemory();
+}
+
+// Measure how long it takes from submitting a job until its completion has
+// been noticed for each of the ways of synchronizing with the PRU. The job is
+// a loop that never gets executed so that the printer itself isn't involved
+// and all that is left is the synchronization overhead.
+static bool benchSyncLatency(const PRINTER_BenchContext *context) {
+    static const struct {
+        const char *name;
+        PRINTER_SyncMode syncMode;
+    } syncModes[] = {
+        { "interrupt", PRINTER_SYNC_INTERRUPT },
+        { "busy-poll", PRINTER_SYNC_BUSY_POLL }
+    };
+    const uint32_t nrOfIterations = 0;
+    PRINTER_Session session;
+    PRINTER_Job job;
+    uint64_t *durations;
+    uint64_t startTime;
+    uint64_t totalDuration;
+    bool success = true;
+    uint32_t i;
+    uint32_t j;
+
+    durations = (uint64_t *)malloc(SYNC_BENCH_ROUNDS * sizeof(uint64_t));
+    if (!initJob(&job)) {
+        fprintf(stderr, "Error allocating memory for benchmark!\n");
+        free(durations);
+        return false;
+    }
+    if (!durations ||
+            !addJobItem(&job, PRINTER_CMD_LOOP, sizeof(nrOfIterations),
+                    &nrOfIterations) ||
+            !addJobItem(&job, PRINTER_CMD_END_LOOP, 0, NULL)) {
+        fprintf(stderr, "Error allocating memory for benchmark!\n");
+        free(durations);
+        freeJob(&job);
+        return false;
+    }
+
+    if (!initSession(&session, context->transport, NULL, NULL)) {
+        fprintf(stderr, "Error initializing print session!\n");
+        free(durations);
+        freeJob(&job);
+        return false;
+    }
+
+    for (i = 0; success && (i < sizeof(syncModes) / sizeof(syncModes[0]));
+            i++) {
+        totalDuration = 0;
+        for (j = 0; success && (j < SYNC_BENCH_ROUNDS); j++) {
+            startTime = getTimeNs();
+            submitJobAsync(&session, &job, syncModes[i].syncMode);
+            while (success && !isSessionIdle(&session)) {
+                success = waitSession(&session, -1);
+            }
+            durations[j] = getTimeNs() - startTime;
+            totalDuration += durations[j];
+        }
+
+        if (!success) {
+            fprintf(stderr, "Error waiting for printer driver!\n");
+            break;
+        }
+
+        qsort(durations, SYNC_BENCH_ROUNDS, sizeof(uint64_t),
+                compareDurations);
+        printf("  %-16s min %7.1f us, avg %7.1f us, p99 %7.1f us, "
+                "max %7.1f us\n", syncModes[i].name, durations[0] / 1000.0,
+                totalDuration / 1000.0 / SYNC_BENCH_ROUNDS,
+                durations[SYNC_BENCH_ROUNDS * 99 / 100] / 1000.0,
+                durations[SYNC_BENCH_ROUNDS - 1] / 1000.0);
+    }
+
+    closeSession(&session);
+    free(durations);
+    freeJob(&job);
+
+    return success;
+}
+
+// Print each of the canonical workloads through the complete host pipeline,
+// from the image held in memory to the job having been processed by the PRU.
+// Each workload results in a single line of JSON on the console so that the
+// numbers can be collected by scripts and tracked across versions:
+//
+// - lines_per_s: Image lines printed per second, end to end
+// - compile_us_per_line: Host CPU time taken to turn the image into the job,
+//   including the optimizer and the line dictionary
+// - host_us_per_line: Host CPU time taken overall, also covering the
+//   streaming of the job through the printer queue
+// - refills: Number of times the host got woken up to service the queue
+// - wait_us_per_refill: Time the host spent blocked per wake-up
+// - underruns: Wake-ups that found the queue drained with the job still
+//   unfinished, meaning that PRU1 had to wait for the host
+//
+// CPU times are those of the calling thread only so that a simulated PRU
+// running on the host doesn't get accounted for.
+static bool benchEndToEnd(const PRINTER_BenchContext *context) {
+    PRINTER_Image image;
+    bool success = true;
+    uint32_t i;
+
+    for (i = 0; i < sizeof(workloads) / sizeof(workloads[0]); i++) {
+        if (!loadWorkload(&workloads[i], &image)) {
+            fprintf(stderr, "Skipping workload %s!\n", workloads[i].name);
+            continue;
+        }
+
+        success &= runWorkload(context, workloads[i].name, &image);
+        freeImage(&image);
+    }
+
+    return success;
+}
+
+static bool loadWorkload(const PRINTER_Workload *workload,
+        PRINTER_Image *image) {
+    const char *imageDir = getenv(E2E_BENCH_IMAGE_DIR_ENV);
+    char fileName[256];
+
+    if (!workload->fileName) {
+        return workload->function(image, workload->param);
+    }
+
+    if (!imageDir) {
+        imageDir = E2E_BENCH_IMAGE_DIR;
+    }
+    snprintf(fileName, sizeof(fileName), "%s/%s", imageDir,
+            workload->fileName);
+
+    return readPngImage(fileName, image);
+}
+
+static bool runWorkload(const PRINTER_BenchContext *context,
+        const char *name, const PRINTER_Image *image) {
+    PRINTER_Queue *queue = context->queue;
+    PRINTER_Session session;
+    PRINTER_Job job;
+    PRINTER_JobOptimizerStats optimizerStats;
+    PRINTER_LineDictionary lineDict;
+    struct pollfd pollFd;
+    uint64_t startTime;
+    uint64_t startCpuTime;
+    uint64_t compileCpuTime;
+    uint64_t waitStartTime;
+    uint64_t waitTime = 0;
+    uint64_t duration;
+    uint64_t cpuTime;
+    uint32_t refills = 0;
+    uint32_t underruns = 0;
+    uint32_t backlog;
+    bool success = true;
+
+    if (!initSession(&session, context->transport, NULL, NULL)) {
+        fprintf(stderr, "Error initializing print session!\n");
+        return false;
+    }
+
+    // Compile the image the same way a regular print job gets compiled
+    startTime = getTimeNs();
+    startCpuTime = getThreadCpuTimeNs();
+    if (!initJob(&job)) {
+        fprintf(stderr, "Error allocating memory for benchmark!\n");
+        closeSession(&session);
+        return false;
+    }
+    success &= addJobItem(&job, PRINTER_CMD_OPEN, 0, NULL);
+    success &= addImageLines(&job, image, 0, image->height, false);
+    success &= addJobItem(&job, PRINTER_CMD_CLOSE, 0, NULL);
+    if (success) {
+        optimizeJob(&job, &optimizerStats);
+        success = buildLineDictionary(&job, &lineDict);
+    }
+    compileCpuTime = getThreadCpuTimeNs() - startCpuTime;
+    if (!success) {
+        fprintf(stderr, "Error allocating memory for benchmark!\n");
+        freeJob(&job);
+        closeSession(&session);
+        return false;
+    }
+
+    // Stream the job through the printer queue. The session gets serviced
+    // here rather than through waitSession() so that the state of the queue
+    // can be looked at whenever the host wakes up.
+    uploadLineDictionary(&lineDict, context->pruDataRam);
+    submitJobAsync(&session, &job, PRINTER_SYNC_INTERRUPT);
+    pollFd.fd = getSessionFd(&session);
+    pollFd.events = POLLIN;
+    while (!isSessionIdle(&session)) {
+        waitStartTime = getTimeNs();
+        if (poll(&pollFd, 1, -1) < 0) {
+            fprintf(stderr, "Error waiting for printer driver!\n");
+            success = false;
+            break;
+        }
+        waitTime += getTimeNs() - waitStartTime;
+        refills++;
+
+        backlog = queue->progress.producedBytes -
+                readPruWord(&queue->progress.consumedBytes);
+        processSession(&session);
+        if (!backlog && !isSessionIdle(&session)) {
+            underruns++;
+        }
+    }
+    duration = getTimeNs() - startTime;
+    cpuTime = getThreadCpuTimeNs() - startCpuTime;
+
+    printf("{\"benchmark\": \"e2e\", \"workload\": \"%s\", "
+            "\"lines\": %u, \"job_bytes\": %u, \"seconds\": %.3f, "
+            "\"lines_per_s\": %.1f, \"compile_us_per_line\": %.2f, "
+            "\"host_us_per_line\": %.2f, \"refills\": %u, "
+            "\"wait_us_per_refill\": %.1f, \"underruns\": %u, "
+            "\"status\": %u}\n", name, image->height, job.size,
+            duration / 1e9, image->height * 1e9 / duration,
+            compileCpuTime / 1000.0 / image->height,
+            cpuTime / 1000.0 / image->height, refills,
+            refills ? waitTime / 1000.0 / refills : 0.0, underruns,
+            queue->status.all);
+
+    closeSession(&session);
+    freeJob(&job);
+
+    return success;
+}
+
+// Run each of the host kernels that sit on the per-line path over a fixed
+// input many times over. Like the end-to-end benchmark this results in a line
+// of JSON per kernel holding the time per line as well as the number of input
+// bytes processed per CPU cycle. The latter requires the CPU cycle counter to
+// be accessible through perf events and is null otherwise.
+static bool benchKernels(const PRINTER_BenchContext *context) {
+    PRINTER_KernelInput input;
+    uint64_t startTime;
+    uint64_t startCycles = 0;
+    uint64_t duration;
+    uint64_t cycles = 0;
+    uint64_t totalLines;
+    uint64_t totalBytes;
+    uint32_t nrOfLines;
+    uint32_t nrOfBytes;
+    char bytesPerCycle[16];
+    bool success = true;
+    int cycleCounterFd;
+    uint32_t i;
+    uint32_t j;
+
+    if (!initKernelInput(&input, context)) {
+        fprintf(stderr, "Error allocating memory for benchmark!\n");
+        return false;
+    }
+
+    cycleCounterFd = openCycleCounter();
+    if (cycleCounterFd < 0) {
+        fprintf(stderr, "CPU cycle counter not available!\n");
+    }
+
+    for (i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+        totalLines = 0;
+        totalBytes = 0;
+
+        // Warm up the caches and make sure the kernel can be run at all
+        if (!kernels[i].function(&input, &nrOfLines, &nrOfBytes)) {
+            fprintf(stderr, "Skipping kernel %s!\n", kernels[i].name);
+            continue;
+        }
+
+        startTime = getTimeNs();
+        if (cycleCounterFd >= 0) {
+            startCycles = readCycleCounter(cycleCounterFd);
+        }
+        for (j = 0; success && (j < KERNEL_BENCH_ROUNDS); j++) {
+            success = kernels[i].function(&input, &nrOfLines, &nrOfBytes);
+            totalLines += nrOfLines;
+            totalBytes += nrOfBytes;
+        }
+        if (cycleCounterFd >= 0) {
+            cycles = readCycleCounter(cycleCounterFd) - startCycles;
+        }
+        duration = getTimeNs() - startTime;
+
+        if (!success) {
+            fprintf(stderr, "Error running kernel %s!\n", kernels[i].name);
+            break;
+        }
+
+        if (cycles) {
+            snprintf(bytesPerCycle, sizeof(bytesPerCycle), "%.3f",
+                    (double)totalBytes / cycles);
+        }
+        else {
+            strcpy(bytesPerCycle, "null");
+        }
+        printf("{\"benchmark\": \"kernels\", \"kernel\": \"%s\", "
+                "\"lines\": %llu, \"bytes\": %llu, \"ns_per_line\": %.1f, "
+                "\"bytes_per_cycle\": %s}\n", kernels[i].name,
+                (unsigned long long)totalLines,
+                (unsigned long long)totalBytes,
+                (double)duration / totalLines, bytesPerCycle);
+    }
+
+    if (cycleCounterFd >= 0) {
+        close(cycleCounterFd);
+    }
+    freeKernelInput(&input);
+
+    return success;
+}
+
+// The lines fed to the kernels are those of the medium density noise
+// workload, which needs a couple of passes per line. The staged passes hold
+// as many of them as fit into the printer queue.
+static bool initKernelInput(PRINTER_KernelInput *input,
+        const PRINTER_BenchContext *context) {
+    const uint32_t itemSize = PRINTER_JOB_ITEM_SIZE(PRINTER_BYTES_PER_LINE);
+    PRINTER_JobItem *item;
+    uint32_t offset;
+    uint32_t y;
+
+    memset(input, 0, sizeof(*input));
+    input->context = context;
+    input->pngFileName = workloads[0].fileName;
+    input->passesSize = (sizeof(context->queue->jobItems) -
+            PRINTER_JOB_ITEM_SIZE(0)) / itemSize * itemSize;
+
+    if (!generateNoise(&input->image, 25)) {
+        return false;
+    }
+
+    input->passes = (uint8_t *)malloc(input->passesSize);
+    if (!input->passes || !initJob(&input->job)) {
+        freeKernelInput(input);
+        return false;
+    }
+
+    for (offset = 0, y = 0; offset < input->passesSize;
+            offset += itemSize, y = (y + 1) % input->image.height) {
+        item = (PRINTER_JobItem *)(input->passes + offset);
+        item->command = PRINTER_CMD_PRINT_LINE;
+        item->length = PRINTER_BYTES_PER_LINE;
+        memcpy(item->data, input->image.rowPointers[y],
+                PRINTER_BYTES_PER_LINE);
+    }
+
+    return true;
+}
+
+static void freeKernelInput(PRINTER_KernelInput *input) {
+    PRINTER_JobItem *eosItem =
+            (PRINTER_JobItem *)input->context->queue->jobItems;
+
+    // Leave an empty queue behind
+    eosItem->command = PRINTER_CMD_EOS;
+    eosItem->length = 0;
+
+    freeImage(&input->image);
+    freeJob(&input->job);
+    free(input->passes);
+}
+
+static bool runKernelPartition(PRINTER_KernelInput *input,
+        uint32_t *nrOfLines, uint32_t *nrOfBytes) {
+    return partitionKernelInput(input, false, nrOfLines, nrOfBytes);
+}
+
+// Inversion happens on the fly while partitioning, so its cost is the
+// difference to the plain partitioning
+static bool runKernelPartitionInverse(PRINTER_KernelInput *input,
+        uint32_t *nrOfLines, uint32_t *nrOfBytes) {
+    return partitionKernelInput(input, true, nrOfLines, nrOfBytes);
+}
+
+static bool partitionKernelInput(PRINTER_KernelInput *input,
+        const bool inverse, uint32_t *nrOfLines, uint32_t *nrOfBytes) {
+    bool success = true;
+    uint32_t y;
+
+    clearJob(&input->job);
+    for (y = 0; y < input->image.height; y++) {
+        success &= partitionLineAndPrint(&input->job,
+                input->image.rowPointers[y], input->image.width, inverse);
+    }
+
+    *nrOfLines = input->image.height;
+    *nrOfBytes = input->image.height * PRINTER_BYTES_PER_LINE;
+
+    return success;
+}
+
+// Hashing of rows as done to find repeated lines
+static bool runKernelRowHash(PRINTER_KernelInput *input,
+        uint32_t *nrOfLines, uint32_t *nrOfBytes) {
+    volatile uint32_t hash = 0;
+    uint32_t y;
+
+    for (y = 0; y < input->image.height; y++) {
+        hash ^= hashBytes(input->image.rowPointers[y], PRINTER_BYTES_PER_LINE);
+    }
+
+    *nrOfLines = input->image.height;
+    *nrOfBytes = input->image.height * PRINTER_BYTES_PER_LINE;
+
+    return true;
+}
+
+// Decoding of the first of the demo images. It gets read from the file every
+// time, which should come out of the page cache.
+static bool runKernelPngDecode(PRINTER_KernelInput *input,
+        uint32_t *nrOfLines, uint32_t *nrOfBytes) {
+    PRINTER_Image image;
+    const char *imageDir = getenv(E2E_BENCH_IMAGE_DIR_ENV);
+    char fileName[256];
+
+    snprintf(fileName, sizeof(fileName), "%s/%s",
+            imageDir ? imageDir : E2E_BENCH_IMAGE_DIR, input->pngFileName);
+    if (!readPngImage(fileName, &image)) {
+        return false;
+    }
+
+    *nrOfLines = image.height;
+    *nrOfBytes = image.height * ((image.width + 7) / 8);
+    freeImage(&image);
+
+    return true;
+}
+
+static bool runKernelQueueFields(PRINTER_KernelInput *input,
+        uint32_t *nrOfLines, uint32_t *nrOfBytes) {
+    writeQueueFieldByField(input->context->queue, input->passes,
+            input->passesSize);
+
+    *nrOfLines = input->passesSize /
+            PRINTER_JOB_ITEM_SIZE(PRINTER_BYTES_PER_LINE);
+    *nrOfBytes = input->passesSize;
+
+    return true;
+}
+
+static bool runKernelQueueMemcpy(PRINTER_KernelInput *input,
+        uint32_t *nrOfLines, uint32_t *nrOfBytes) {
+    writeQueueMemcpy(input->context->queue, input->passes, input->passesSize);
+
+    *nrOfLines = input->passesSize /
+            PRINTER_JOB_ITEM_SIZE(PRINTER_BYTES_PER_LINE);
+    *nrOfBytes = input->passesSize;
+
+    return true;
+}
+
+static bool runKernelQueueBurst(PRINTER_KernelInput *input,
+        uint32_t *nrOfLines, uint32_t *nrOfBytes) {
+    writeQueueBurst(input->context->queue, input->passes, input->passesSize);
+
+    *nrOfLines = input->passesSize /
+            PRINTER_JOB_ITEM_SIZE(PRINTER_BYTES_PER_LINE);
+    *nrOfBytes = input->passesSize;
+
+    return true;
+}
+
+// Solid black bands across the full width of the head separated by white
+// space. These are the worst case as far as the number of passes per line
+// goes, but lines within a band repeat.
+static bool generateBlocks(PRINTER_Image *image, const uint32_t param) {
+    uint32_t y;
+
+    if (!allocImage(image, PRINTER_DOTS_PER_LINE, param)) {
+        return false;
+    }
+
+    for (y = 0; y < param; y++) {
+        if (y % 128 < 96) {
+            memset(image->rowPointers[y], 0xff, PRINTER_BYTES_PER_LINE);
+        }
+    }
+
+    return true;
+}
+
+// Random dots with the given density in percent. No two lines are alike, so
+// neither repeated lines nor the line dictionary help.
+static bool generateNoise(PRINTER_Image *image, const uint32_t param) {
+    uint32_t state = param;
+    uint32_t x;
+    uint32_t y;
+
+    if (!allocImage(image, PRINTER_DOTS_PER_LINE, E2E_BENCH_LINES)) {
+        return false;
+    }
+
+    for (y = 0; y < E2E_BENCH_LINES; y++) {
+        for (x = 0; x < PRINTER_DOTS_PER_LINE; x++) {
+            if (getRandom(&state) % 100 < param) {
+                setDot(image, x, y);
+            }
+        }
+    }
+
+    return true;
+}
+
+// A barcode made up of bars of random width. Every line of it is the same.
+static bool generateBarcode(PRINTER_Image *image, const uint32_t param) {
+    uint32_t state = 1;
+    uint32_t width;
+    uint32_t x = 16;
+    uint32_t i;
+    uint32_t y;
+    bool black = true;
+
+    if (!allocImage(image, PRINTER_DOTS_PER_LINE, param)) {
+        return false;
+    }
+
+    while (x < PRINTER_DOTS_PER_LINE - 16) {
+        width = 3 * (getRandom(&state) % 4 + 1);
+        for (i = 0; black && (i < width) &&
+                (x + i < PRINTER_DOTS_PER_LINE - 16); i++) {
+            for (y = 0; y < param; y++) {
+                setDot(image, x + i, y);
+            }
+        }
+        x += width;
+        black = !black;
+    }
+
+    return true;
+}
+
+// Lines of text as found on a receipt. Each character is an 8x16 glyph picked
+// from a set of random glyphs, placed within a 12x24 character cell. Text
+// lines are of random length with some blank ones in between.
+static bool generateReceipt(PRINTER_Image *image, const uint32_t param) {
+    uint8_t glyphs[64][16];
+    uint32_t state = 2;
+    uint32_t nrOfChars = 0;
+    uint32_t glyph;
+    uint32_t x;
+    uint32_t y;
+    uint32_t i;
+
+    if (!allocImage(image, PRINTER_DOTS_PER_LINE, param)) {
+        return false;
+    }
+
+    for (i = 0; i < sizeof(glyphs); i++) {
+        glyphs[i / 16][i % 16] = getRandom(&state) & getRandom(&state);
+    }
+
+    for (y = 0; y < param; y++) {
+        // Pick the length of the text line at the top of each cell
+        if (y % 24 == 0) {
+            nrOfChars = getRandom(&state) % 40;
+        }
+        if ((y % 24 < 4) || (y % 24 >= 20)) {
+            continue;
+        }
+
+        // Characters are chosen by position so that all lines of a cell use
+        // the same ones. Some of them are spaces.
+        for (i = 0; i < MIN(nrOfChars, PRINTER_DOTS_PER_LINE / 12); i++) {
+            glyph = (y / 24 * 31 + i * 17) % 80;
+            if (glyph >= 64) {
+                continue;
+            }
+            for (x = 0; x < 8; x++) {
+                if (glyphs[glyph][y % 24 - 4] & (0x80 >> x)) {
+                    setDot(image, i * 12 + 2 + x, y);
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+static void setDot(PRINTER_Image *image, const uint32_t x, const uint32_t y) {
+    image->rowPointers[y][x / 8] |= 0x80 >> (x % 8);
+}
+
+// Simple linear congruential generator. The workloads need to be the same on
+// every run and every platform, which rand() doesn't guarantee.
+static uint32_t getRandom(uint32_t *state) {
+    *state = *state * 1103515245 + 12345;
+
+    return *state >> 16;
+}
+
+// Open a counter of the CPU cycles spent in user space by the calling thread.
+// Returns -1 if the kernel or the CPU doesn't provide one.
+static int openCycleCounter(void) {
+    struct perf_event_attr attr;
+    int fd;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    return fd;
+}
+
+static uint64_t readCycleCounter(const int fd) {
+    uint64_t count;
+
+    if (read(fd, &count, sizeof(count)) != sizeof(count)) {
+        return 0;
+    }
+
+    return count;
+}
+
+static int compareDurations(const void *a, const void *b) {
+    const uint64_t durationA = *(const uint64_t *)a;
+    const uint64_t durationB = *(const uint64_t *)b;
+
+    return (durationA > durationB) - (durationA < durationB);
+}
+
+static uint64_t getTimeNs(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static uint64_t getThreadCpuTimeNs(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
@@ -0,0 +1,33 @@
+/*
+ * bench.h
+ *
+ * Built-in benchmarks used to measure the performance of the host side of the
+ * printer driver on the target. Benchmarks are selected by name and print
+ * their results to the console.
+ *
+ * Copyright (C) 2014 Texas Instruments Incorporated - http://www.ti.com/
+ * ALL RIGHTS RESERVED
+ */
+
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <stdbool.h>
+
+// Interface to the PRU-based printer driver firmware "pruprinter_fw"
+#include "pruprinter.h"
+
+#include "transport.h"
+
+// Resources a benchmark may make use of. The PRU has been initialized and the
+// printer firmware is loaded and idle when a benchmark gets run.
+typedef struct {
+    PRINTER_Transport *transport;
+    PRINTER_Queue *queue;
+    void *pruDataRam;
+} PRINTER_BenchContext;
+
+bool runBenchmark(const char *name, const PRINTER_BenchContext *context);
+void printBenchmarksToConsole(void);
+
+#endif /* BENCH_H_ */
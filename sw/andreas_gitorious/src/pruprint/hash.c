@@ -0,0 +1,47 @@
+/*
+ * hash.c
+ *
+ * Simple non-cryptographic hash functions. See hash.h for details.
+ *
+ * Copyright (C) 2014 Texas Instruments Incorporated - http://www.ti.com/
+ * ALL RIGHTS RESERVED
+ */
+
+#include "hash.h"
+
+// Parameters of the 32-bit FNV-1a hash function
+#define FNV1A_32_OFFSET_BASIS       0x811C9DC5
+#define FNV1A_32_PRIME              0x01000193
+
+// Prime of the 64-bit FNV-1a hash function. The offset basis is HASH64_SEED.
+#define FNV1A_64_PRIME              0x00000100000001B3ULL
+
+uint32_t hashBytes(const void *data, const uint32_t length) {
+    const uint8_t *bytes = (const uint8_t *)data;
+    uint32_t hash = FNV1A_32_OFFSET_BASIS;
+    uint32_t i;
+
+    for (i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= FNV1A_32_PRIME;
+    }
+
+    return hash;
+}
+
+// The 64-bit variant is used where a hash identifies content across program
+// invocations. Passing in the result of a previous call as the seed allows
+// hashing data that isn't contiguous in memory.
+uint64_t hashBytes64(const void *data, const uint64_t length,
+        const uint64_t seed) {
+    const uint8_t *bytes = (const uint8_t *)data;
+    uint64_t hash = seed;
+    uint64_t i;
+
+    for (i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= FNV1A_64_PRIME;
+    }
+
+    return hash;
+}
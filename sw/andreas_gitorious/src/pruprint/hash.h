@@ -0,0 +1,23 @@
+/*
+ * hash.h
+ *
+ * Simple non-cryptographic hash functions used to quickly detect identical
+ * blocks of print data such as image rows or line passes.
+ *
+ * Copyright (C) 2014 Texas Instruments Incorporated - http://www.ti.com/
+ * ALL RIGHTS RESERVED
+ */
+
+#ifndef HASH_H_
+#define HASH_H_
+
+#include <stdint.h>
+
+uint32_t hashBytes(const void *data, const uint32_t length);
+uint64_t hashBytes64(const void *data, const uint64_t length,
+        const uint64_t seed);
+
+// Initial value to be passed into hashBytes64() when starting a new hash
+#define HASH64_SEED                 0xCBF29CE484222325ULL
+
+#endif /* HASH_H_ */
@@ -0,0 +1,327 @@
+/*
+ * image.c
+ *
+ * Monochrome image handling. See image.h for details.
+ *
+ * Copyright (C) 2014 Texas Instruments Incorporated - http://www.ti.com/
+ * ALL RIGHTS RESERVED
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <png.h>
+
+#include "image.h"
+#include "hash.h"
+#include "profile.h"
+
+// General helper macro - determine and return the minimum of two given values
+#define MIN(a, b)                   (((a) < (b)) ? (a) : (b))
+
+static bool addRepeatLineItems(PRINTER_Job *job, uint32_t nrOfRepeats);
+static uint8_t *reservePass(PRINTER_Job *job, const uint8_t byteIndex);
+static void readPngData(png_structp png_ptr, png_bytep data, png_size_t length);
+
+bool allocImage(PRINTER_Image *image, const uint32_t width,
+        const uint32_t height) {
+    uint32_t y;
+
+    image->width = width;
+    image->height = height;
+
+    // Allocate memory to hold an array of pointers that point to the
+    // respective row image data, and an individual block of memory for each
+    // row of the image. Rows start out all white.
+    image->rowPointers = (uint8_t **)calloc(height, sizeof(uint8_t *));
+    if (!image->rowPointers) {
+        return false;
+    }
+
+    for (y = 0; y < height; y++) {
+        image->rowPointers[y] = (uint8_t *)calloc(1, (width + 7) / 8);
+        if (!image->rowPointers[y]) {
+            freeImage(image);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void freeImage(PRINTER_Image *image) {
+    uint32_t y;
+
+    if (!image->rowPointers) {
+        return;
+    }
+
+    // Free the memory used for each line of image data
+    for (y = 0; y < image->height; y++) {
+        free(image->rowPointers[y]);
+    }
+
+    // Free the memory used for the array that holds the row pointers
+    free(image->rowPointers);
+    image->rowPointers = NULL;
+}
+
+bool readPngImage(const char *fileName, PRINTER_Image *image) {
+    FILE *fp;
+    unsigned char pngSignature[8];      // The PNG signature is 8 bytes long
+    PROFILE_Stage previousStage;
+    size_t signatureLength;
+    png_byte bitDepth;
+    png_structp png_ptr;
+    png_infop info_ptr = NULL;
+
+    image->rowPointers = NULL;
+
+    // Open image file
+    fp = fopen(fileName, "rb");
+    if (!fp) {
+        fprintf(stderr, "File could not be opened for reading!\n");
+        return false;
+    }
+
+    // Test image file for being a PNG by evaluating its header
+    previousStage = enterProfileStage(PROFILE_STAGE_READ);
+    signatureLength = fread(pngSignature, 1, sizeof(pngSignature), fp);
+    leaveProfileStage(previousStage);
+    if ((signatureLength != sizeof(pngSignature)) ||
+            png_sig_cmp(pngSignature, 0, sizeof(pngSignature))) {
+        fprintf(stderr, "File not recognized as a PNG file!\n");
+        fclose(fp);
+        return false;
+    }
+
+    // Initialize libpng in preparation for reading the image
+    png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    if (png_ptr) {
+        info_ptr = png_create_info_struct(png_ptr);
+    }
+    if (!info_ptr) {
+        fprintf(stderr, "Error during during PNG initialization!\n");
+        png_destroy_read_struct(&png_ptr, NULL, NULL);
+        fclose(fp);
+        return false;
+    }
+
+    // Establish an error handler for issues during the upcoming file
+    // operations. Anything allocated so far gets released again.
+    if (setjmp(png_jmpbuf(png_ptr))) {
+        fprintf(stderr, "Error reading PNG image!\n");
+        png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+        freeImage(image);
+        fclose(fp);
+        return false;
+    }
+
+    png_set_read_fn(png_ptr, fp, readPngData);
+    png_set_sig_bytes(png_ptr, 8);
+    png_read_info(png_ptr, info_ptr);
+
+    bitDepth = png_get_bit_depth(png_ptr, info_ptr);
+    if (bitDepth != 1) {
+        fprintf(stderr, "Only monochrome images (1-bit) are allowed! Provided" \
+                " image is %u bits deep.\n", bitDepth);
+        png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+        fclose(fp);
+        return false;
+    }
+
+    // Enable the interlace handling and updates the structure pointed to by
+    // info_ptr to reflect any transformations that have been requested.
+    png_set_interlace_handling(png_ptr);
+    png_read_update_info(png_ptr, info_ptr);
+
+    // Note that this assumes a 1 bit-per-pixel image. If an image is to be
+    // read with greater color depth the amount of memory that is allocated
+    // for each row needs to be increased.
+    if (!allocImage(image, png_get_image_width(png_ptr, info_ptr),
+            png_get_image_height(png_ptr, info_ptr))) {
+        fprintf(stderr, "Error allocating memory for image!\n");
+        png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+        fclose(fp);
+        return false;
+    }
+
+    // Read the entire PNG image into memory
+    png_read_image(png_ptr, image->rowPointers);
+
+    png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+    fclose(fp);
+
+    return true;
+}
+
+bool addImageLines(PRINTER_Job *job, const PRINTER_Image *image,
+        const uint32_t startLine, const uint32_t endLine, const bool inverse) {
+    bool success = true;
+    uint32_t y;
+    const uint32_t rowBytes =
+            MIN((image->width + 7) / 8, PRINTER_BYTES_PER_LINE);
+    uint32_t rowHash;
+    uint32_t prevRowHash = 0;
+    bool prevRowHasDots = false;
+    uint32_t nrOfRepeats = 0;
+    uint32_t nrOfItems;
+
+    // Generate the print job line by line. Runs of rows that are identical
+    // to the row before them (as found in double-height images, barcodes, or
+    // solid rules) don't get partitioned again. Instead the firmware gets told
+    // to repeat the line it printed last. To keep this cheap rows get compared
+    // by their hash first and only if that matches byte by byte.
+    for (y = startLine; (y < endLine) && success; y++) {
+        rowHash = hashBytes(image->rowPointers[y], rowBytes);
+        if (prevRowHasDots && (rowHash == prevRowHash) &&
+                !memcmp(image->rowPointers[y], image->rowPointers[y - 1],
+                        rowBytes)) {
+            nrOfRepeats++;
+            continue;
+        }
+
+        success &= addRepeatLineItems(job, nrOfRepeats);
+        nrOfRepeats = 0;
+
+        // Partition the line. Besides the passes holding the actual dot data
+        // this always adds a single half-step command. Only lines that ended up
+        // having passes are worth repeating, empty lines are just steps.
+        nrOfItems = job->nrOfItems;
+        success &= partitionLineAndPrint(job, image->rowPointers[y],
+                image->width, inverse);
+        prevRowHasDots = job->nrOfItems > nrOfItems + 1;
+        prevRowHash = rowHash;
+    }
+    success &= addRepeatLineItems(job, nrOfRepeats);
+
+    return success;
+}
+
+static bool addRepeatLineItems(PRINTER_Job *job, uint32_t nrOfRepeats) {
+    uint32_t count;
+
+    // Split the repeats into chunks the firmware accepts within one command
+    while (nrOfRepeats) {
+        count = MIN(nrOfRepeats, PRINTER_MAX_NR_HALF_STEPS);
+        if (!addJobItem(job, PRINTER_CMD_REPEAT_LINE, sizeof(uint32_t),
+                &count)) {
+            return false;
+        }
+        nrOfRepeats -= count;
+    }
+
+    return true;
+}
+
+// TODO: Balance number of black dots per line if line needs to be partitioned
+bool partitionLineAndPrint(PRINTER_Job *job, const uint8_t dotData[],
+        const uint16_t length, const bool inverse) {
+    const uint8_t inverseMask = inverse ? 0xff : 0x00;
+    uint8_t *passData = NULL;
+    uint8_t byteIndex;
+    uint8_t bitValue;
+    uint8_t dotByte;
+    uint8_t splitMask;
+    uint16_t blackDotCounter = 0;
+    uint16_t dotCount;
+    uint16_t dotsNeeded;
+
+    // Iterate through all bytes in one line. Each byte of pass data gets
+    // assembled in a register and is written into the job exactly once, there
+    // is no intermediate line buffer that would need to be cleared and copied.
+    for (byteIndex = 0; byteIndex < PRINTER_BYTES_PER_LINE; byteIndex++) {
+        // Fetch the next eight dots from the source data and invert if needed.
+        // Make sure that we properly print images which are smaller than
+        // PRINTER_BYTES_PER_LINE without any random garbage getting added.
+        if (byteIndex * 8 >= length) {
+            dotByte = 0x00;
+        }
+        else {
+            dotByte = dotData[byteIndex] ^ inverseMask;
+            if (length - byteIndex * 8 < 8) {
+                dotByte &= 0xff << (8 - (length - byteIndex * 8));
+            }
+        }
+        dotCount = __builtin_popcount(dotByte);
+
+        // A pass only gets added to the job once its first black dot shows up
+        if (dotByte && !passData) {
+            passData = reservePass(job, byteIndex);
+            if (!passData) {
+                return false;
+            }
+        }
+
+        // If we reach the maximum number of black dots allowed per line within
+        // this byte we split it right after the dot that fills up the pass.
+        // The pass is complete at that point. The remaining black dots will be
+        // accumulated in the next pass that is output (which will get printed
+        // into the same physical line).
+        if (passData && (blackDotCounter + dotCount >=
+                PRINTER_MAX_BLACK_DOTS_PER_LINE)) {
+            dotsNeeded = PRINTER_MAX_BLACK_DOTS_PER_LINE - blackDotCounter;
+            for (splitMask = 0x00, bitValue = 0x80; dotsNeeded;
+                    bitValue >>= 1) {
+                splitMask |= bitValue;
+                if (dotByte & bitValue) {
+                    dotsNeeded--;
+                }
+            }
+
+            passData[byteIndex] = dotByte & splitMask;
+            memset(&passData[byteIndex + 1], 0,
+                    PRINTER_BYTES_PER_LINE - byteIndex - 1);
+            passData = NULL;
+            blackDotCounter = 0;
+
+            dotByte &= ~splitMask;
+            dotCount = __builtin_popcount(dotByte);
+            if (dotByte) {
+                passData = reservePass(job, byteIndex);
+                if (!passData) {
+                    return false;
+                }
+            }
+        }
+
+        if (passData) {
+            passData[byteIndex] = dotByte;
+            blackDotCounter += dotCount;
+        }
+    }
+
+    // After all dots have been output its finally time to issue a command to
+    // advance the stepper motor to the next physical line. Consecutive steps
+    // will get combined later on by the job optimizer.
+    const uint32_t nrOfHalfSteps = 1;
+    return addJobItem(job, PRINTER_CMD_MOTOR_HALF_STEP, sizeof(uint32_t),
+            &nrOfHalfSteps);
+}
+
+static uint8_t *reservePass(PRINTER_Job *job, const uint8_t byteIndex) {
+    uint8_t *passData = (uint8_t *)reserveJobItem(job, PRINTER_CMD_PRINT_LINE,
+            PRINTER_BYTES_PER_LINE);
+
+    // Clear out the part of the pass in front of the byte that is about to be
+    // written. The caller takes care of the remainder of the pass.
+    if (passData) {
+        memset(passData, 0, byteIndex);
+    }
+
+    return passData;
+}
+
+// Read function handed to libpng in place of its default one so that the time
+// spent reading the file can be told apart from the time spent decoding it
+static void readPngData(png_structp png_ptr, png_bytep data,
+        png_size_t length) {
+    const PROFILE_Stage previousStage = enterProfileStage(PROFILE_STAGE_READ);
+    const size_t readLength = fread(data, 1, length,
+            (FILE *)png_get_io_ptr(png_ptr));
+
+    leaveProfileStage(previousStage);
+    if (readLength != length) {
+        png_error(png_ptr, "Read Error");
+    }
+}
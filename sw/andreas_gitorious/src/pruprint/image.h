@@ -0,0 +1,40 @@
+/*
+ * image.h
+ *
+ * Monochrome image handling. Images are kept in memory as 1-bit rows exactly
+ * the way libpng delivers them, the most significant bit of each byte being
+ * the leftmost dot and a set bit being a black dot. An image gets turned into
+ * print job items line by line, with each line partitioned into as many
+ * passes as it takes to stay within the number of black dots the printer head
+ * may heat at once.
+ *
+ * Copyright (C) 2014 Texas Instruments Incorporated - http://www.ti.com/
+ * ALL RIGHTS RESERVED
+ */
+
+#ifndef IMAGE_H_
+#define IMAGE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "printjob.h"
+
+// Type describing an image held in memory. Each row is allocated on its own
+// and holds (width + 7) / 8 bytes.
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    uint8_t **rowPointers;
+} PRINTER_Image;
+
+bool allocImage(PRINTER_Image *image, const uint32_t width,
+        const uint32_t height);
+void freeImage(PRINTER_Image *image);
+bool readPngImage(const char *fileName, PRINTER_Image *image);
+bool addImageLines(PRINTER_Job *job, const PRINTER_Image *image,
+        const uint32_t startLine, const uint32_t endLine, const bool inverse);
+bool partitionLineAndPrint(PRINTER_Job *job, const uint8_t dotData[],
+        const uint16_t length, const bool inverse);
+
+#endif /* IMAGE_H_ */
@@ -0,0 +1,351 @@
+/*
+ * irqbench.c
+ *
+ * Host to PRU to host event round trip latency benchmark. See irqbench.h for
+ * details.
+ *
+ * Copyright (C) 2014 Texas Instruments Incorporated - http://www.ti.com/
+ * ALL RIGHTS RESERVED
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+// PRU driver header file
+#include "prussdrv.h"
+#include "pruss_intc_mapping.h"
+
+#include "irqbench.h"
+#include "prumem.h"
+
+// Number of round trips measured for each method and CPU load
+#define IRQ_BENCH_ROUNDS            5000
+
+// Priority of the SCHED_FIFO interrupt thread
+#define IRQ_BENCH_FIFO_PRIORITY     50
+
+// Time after which a round trip is considered lost
+#define IRQ_BENCH_TIMEOUT_S         1
+
+// Number of histogram buckets. Bucket n counts the round trips that took less
+// than 2^n microseconds, the last one all that took longer.
+#define IRQ_BENCH_NR_OF_BUCKETS     12
+
+// Methods of measuring the round trip
+typedef enum {
+    IRQ_METHOD_WAIT,
+    IRQ_METHOD_IRQ_THREAD,
+    IRQ_METHOD_BUSY_POLL,
+    IRQ_NR_OF_METHODS
+} IRQ_Method;
+
+// State shared with the interrupt thread and the threads loading the CPU
+typedef struct {
+    uint64_t *durations;
+    volatile uint64_t sendTime;
+    uint32_t nrOfRounds;
+    sem_t done;
+    volatile bool stopLoad;
+} IRQ_BenchState;
+
+static const char * const methodNames[IRQ_NR_OF_METHODS] = {
+    "wait",
+    "irq-thread",
+    "busy-poll"
+};
+
+// The interrupt thread started by prussdrv doesn't take an argument
+static IRQ_BenchState state;
+
+static bool runMethod(PRINTER_Queue *queue, const IRQ_Method method);
+static bool measureRoundTrips(PRINTER_Queue *queue, const IRQ_Method method);
+static void *irqThread(void *arg);
+static void *loadThread(void *arg);
+static bool startLoad(pthread_t threads[], const uint32_t nrOfThreads);
+static void stopLoad(pthread_t threads[], const uint32_t nrOfThreads);
+static bool isFifoAllowed(void);
+static void printResults(const IRQ_Method method, const bool loaded);
+static int compareDurations(const void *a, const void *b);
+static uint64_t getTimeNs(void);
+
+bool benchInterruptLatency(const PRINTER_BenchContext *context) {
+    PRINTER_Queue *queue = context->queue;
+    PRINTER_JobItem *eosItem = (PRINTER_JobItem *)queue->jobItems;
+    const int fd = prussdrv_pru_event_fd(PRU_EVTOUT_1);
+    bool success = true;
+    uint32_t i;
+    int flags;
+
+    if (context->transport->ops != &uioTransportOps) {
+        fprintf(stderr, "Benchmark requires the uio transport!\n");
+        return false;
+    }
+
+    // The uio transport takes events without ever blocking. The methods
+    // measured here are the blocking ones though.
+    flags = fcntl(fd, F_GETFL);
+    if ((flags < 0) || (fcntl(fd, F_SETFL, flags & ~O_NONBLOCK) < 0)) {
+        fprintf(stderr, "Error configuring PRU event file descriptor!\n");
+        return false;
+    }
+
+    state.durations = (uint64_t *)malloc(IRQ_BENCH_ROUNDS * sizeof(uint64_t));
+    if (!state.durations || sem_init(&state.done, 0, 0)) {
+        fprintf(stderr, "Error allocating memory for benchmark!\n");
+        free(state.durations);
+        fcntl(fd, F_SETFL, flags);
+        return false;
+    }
+
+    // Set up the printer queue so that each job ends right away. The queue is
+    // considered published in its entirety so that PRU1 never waits for more.
+    eosItem->command = PRINTER_CMD_EOS;
+    eosItem->length = 0;
+    queue->progress.producedBytes = sizeof(queue->jobItems);
+    queue->progress.lowWatermark = 0;
+    queue->progress.keepWarmMs = 0;
+    queue->progress.linesPrinted = 0;
+    releasePruMemory();
+
+    for (i = 0; success && (i < IRQ_NR_OF_METHODS); i++) {
+        success = runMethod(queue, (IRQ_Method)i);
+    }
+
+    queue->progress.busyPoll = 0;
+    sem_destroy(&state.done);
+    free(state.durations);
+    fcntl(fd, F_SETFL, flags);
+
+    return success;
+}
+
+// Measure the given method with the CPU idle first and loaded afterwards
+static bool runMethod(PRINTER_Queue *queue, const IRQ_Method method) {
+    const long nrOfCpus = sysconf(_SC_NPROCESSORS_ONLN);
+    const uint32_t nrOfThreads = nrOfCpus > 0 ? nrOfCpus : 1;
+    pthread_t *threads;
+    bool success;
+    bool loaded;
+
+    queue->progress.busyPoll = method == IRQ_METHOD_BUSY_POLL;
+    releasePruMemory();
+
+    // The interrupt thread serves both runs. It can't be stopped other than
+    // by returning, so it gets told up front how many events to expect.
+    if (method == IRQ_METHOD_IRQ_THREAD) {
+        if (!isFifoAllowed()) {
+            fprintf(stderr, "Not permitted to use SCHED_FIFO, skipping %s!\n",
+                    methodNames[method]);
+            return true;
+        }
+        state.nrOfRounds = 2 * IRQ_BENCH_ROUNDS;
+        prussdrv_start_irqthread(PRU_EVTOUT_1, IRQ_BENCH_FIFO_PRIORITY,
+                irqThread);
+    }
+
+    success = measureRoundTrips(queue, method);
+    if (success) {
+        printResults(method, false);
+    }
+
+    // The second run takes place even if the CPU couldn't be loaded so that
+    // the interrupt thread gets all the events it is waiting for
+    threads = (pthread_t *)malloc(nrOfThreads * sizeof(pthread_t));
+    loaded = threads && startLoad(threads, nrOfThreads);
+    if (!loaded) {
+        fprintf(stderr, "Error starting threads loading the CPU!\n");
+    }
+    if (success) {
+        success = measureRoundTrips(queue, method);
+    }
+    if (loaded) {
+        stopLoad(threads, nrOfThreads);
+        if (success) {
+            printResults(method, true);
+        }
+    }
+    free(threads);
+
+    if (!success) {
+        fprintf(stderr, "Lost track of PRU events using %s!\n",
+                methodNames[method]);
+    }
+
+    return success && loaded;
+}
+
+static bool measureRoundTrips(PRINTER_Queue *queue, const IRQ_Method method) {
+    struct timespec timeout;
+    uint32_t completedJobs;
+    uint64_t startTime;
+    uint32_t i;
+
+    for (i = 0; i < IRQ_BENCH_ROUNDS; i++) {
+        // PRU1 moves on in the ring with each job, so point it back to the
+        // end-of-sequence item at the start of the queue
+        queue->progress.consumedBytes = 0;
+        releasePruMemory();
+
+        switch (method) {
+        case IRQ_METHOD_WAIT:
+            startTime = getTimeNs();
+            prussdrv_pru_send_wait_clear_event(ARM_PRU1_INTERRUPT,
+                    PRU_EVTOUT_1, PRU1_ARM_INTERRUPT);
+            state.durations[i] = getTimeNs() - startTime;
+            break;
+
+        case IRQ_METHOD_IRQ_THREAD:
+            // The interrupt thread takes the time and lets us know
+            clock_gettime(CLOCK_REALTIME, &timeout);
+            timeout.tv_sec += IRQ_BENCH_TIMEOUT_S;
+            state.sendTime = getTimeNs();
+            prussdrv_pru_send_event(ARM_PRU1_INTERRUPT);
+            while (sem_timedwait(&state.done, &timeout)) {
+                if (errno != EINTR) {
+                    return false;
+                }
+            }
+            break;
+
+        case IRQ_METHOD_BUSY_POLL:
+            completedJobs = readPruWord(&queue->progress.completedJobs);
+            startTime = getTimeNs();
+            prussdrv_pru_send_event(ARM_PRU1_INTERRUPT);
+            while (readPruWord(&queue->progress.completedJobs) ==
+                    completedJobs) {
+                if (getTimeNs() - startTime >
+                        IRQ_BENCH_TIMEOUT_S * 1000000000ULL) {
+                    return false;
+                }
+            }
+            state.durations[i] = getTimeNs() - startTime;
+            break;
+
+        default:
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Thread function handed to prussdrv_start_irqthread(). The round trip ends
+// as soon as the thread gets to run after the event came in.
+static void *irqThread(void *arg) {
+    uint32_t i;
+
+    for (i = 0; i < state.nrOfRounds; i++) {
+        prussdrv_pru_wait_event(PRU_EVTOUT_1);
+        state.durations[i % IRQ_BENCH_ROUNDS] = getTimeNs() - state.sendTime;
+        prussdrv_pru_clear_event(PRU_EVTOUT_1, PRU1_ARM_INTERRUPT);
+        sem_post(&state.done);
+    }
+
+    return NULL;
+}
+
+static void *loadThread(void *arg) {
+    volatile uint32_t counter = 0;
+
+    while (!state.stopLoad) {
+        counter++;
+    }
+
+    return NULL;
+}
+
+static bool startLoad(pthread_t threads[], const uint32_t nrOfThreads) {
+    uint32_t i;
+
+    state.stopLoad = false;
+    for (i = 0; i < nrOfThreads; i++) {
+        if (pthread_create(&threads[i], NULL, loadThread, NULL)) {
+            stopLoad(threads, i);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void stopLoad(pthread_t threads[], const uint32_t nrOfThreads) {
+    uint32_t i;
+
+    state.stopLoad = true;
+    for (i = 0; i < nrOfThreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+// prussdrv doesn't report whether it could create the interrupt thread, so
+// find out beforehand whether SCHED_FIFO may be used at all
+static bool isFifoAllowed(void) {
+    struct sched_param param;
+    struct sched_param oldParam;
+    int oldPolicy;
+
+    if (pthread_getschedparam(pthread_self(), &oldPolicy, &oldParam)) {
+        return false;
+    }
+
+    param.sched_priority = IRQ_BENCH_FIFO_PRIORITY;
+    if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param)) {
+        return false;
+    }
+    pthread_setschedparam(pthread_self(), oldPolicy, &oldParam);
+
+    return true;
+}
+
+// Print the results of a run as a line of JSON like the other benchmarks do
+static void printResults(const IRQ_Method method, const bool loaded) {
+    uint32_t buckets[IRQ_BENCH_NR_OF_BUCKETS];
+    uint32_t bucket;
+    uint32_t i;
+
+    qsort(state.durations, IRQ_BENCH_ROUNDS, sizeof(uint64_t),
+            compareDurations);
+
+    memset(buckets, 0, sizeof(buckets));
+    for (i = 0; i < IRQ_BENCH_ROUNDS; i++) {
+        for (bucket = 0; (bucket < IRQ_BENCH_NR_OF_BUCKETS - 1) &&
+                (state.durations[i] >= (1000ULL << bucket)); bucket++) {
+        }
+        buckets[bucket]++;
+    }
+
+    printf("{\"benchmark\": \"irq\", \"method\": \"%s\", \"load\": \"%s\", "
+            "\"rounds\": %u, \"p50_us\": %.1f, \"p99_us\": %.1f, "
+            "\"max_us\": %.1f, \"histogram\": [", methodNames[method],
+            loaded ? "loaded" : "idle", IRQ_BENCH_ROUNDS,
+            state.durations[IRQ_BENCH_ROUNDS / 2] / 1000.0,
+            state.durations[IRQ_BENCH_ROUNDS * 99 / 100] / 1000.0,
+            state.durations[IRQ_BENCH_ROUNDS - 1] / 1000.0);
+    for (i = 0; i < IRQ_BENCH_NR_OF_BUCKETS; i++) {
+        printf(i ? ", %u" : "%u", buckets[i]);
+    }
+    printf("]}\n");
+}
+
+static int compareDurations(const void *a, const void *b) {
+    const uint64_t durationA = *(const uint64_t *)a;
+    const uint64_t durationB = *(const uint64_t *)b;
+
+    return (durationA > durationB) - (durationA < durationB);
+}
+
+static uint64_t getTimeNs(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
@@ -0,0 +1,38 @@
+/*
+ * irqbench.h
+ *
+ * Benchmark measuring the latency of the host to PRU to host event round trip
+ * at the level of the prussdrv library, which is what the queue watermarks and
+ * the choice between interrupts and busy-polling need to be based on.
+ *
+ * The printer firmware serves as the echo firmware. With a printer queue that
+ * holds nothing but an end-of-sequence item the firmware does no more than
+ * acknowledge ARM_PRU1_INTERRUPT, bump the completion counter, and raise
+ * PRU1_ARM_INTERRUPT unless the host is busy-polling, so what gets measured
+ * is almost entirely the cost of the events themselves. The round trip is
+ * measured in the following ways:
+ *
+ *   wait           prussdrv_pru_send_wait_clear_event() on the calling thread
+ *   irq-thread     A SCHED_FIFO thread started through
+ *                  prussdrv_start_irqthread() waits for the event while the
+ *                  calling thread sleeps
+ *   busy-poll      The calling thread spins on the completion counter
+ *
+ * Each of them is run once with the CPU idle and once with a busy thread per
+ * CPU competing for it. This requires the uio transport as the other
+ * transports don't go through prussdrv.
+ *
+ * Copyright (C) 2014 Texas Instruments Incorporated - http://www.ti.com/
+ * ALL RIGHTS RESERVED
+ */
+
+#ifndef IRQBENCH_H_
+#define IRQBENCH_H_
+
+#include <stdbool.h>
+
+#include "bench.h"
+
+bool benchInterruptLatency(const PRINTER_BenchContext *context);
+
+#endif /* IRQBENCH_H_ */
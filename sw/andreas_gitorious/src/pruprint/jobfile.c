@@ -0,0 +1,309 @@
+/*
+ * jobfile.c
+ *
+ * Precompiled print job files. See jobfile.h for details.
+ *
+ * Copyright (C) 2014 Texas Instruments Incorporated - http://www.ti.com/
+ * ALL RIGHTS RESERVED
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "jobfile.h"
+#include "hash.h"
+
+static bool mapFile(const char *filename, void **mapping, size_t *size);
+static bool mapFd(const int fd, void **mapping, size_t *size);
+static bool readFd(const int fd, void **data, size_t *size);
+static bool checkJobFile(PRINTER_JobFile *jobFile);
+static bool writeAll(const int fd, const void *data, const size_t size);
+static bool isJobValid(const PRINTER_Job *job);
+
+bool saveJobFile(const char *filename, const PRINTER_Job *job,
+        const PRINTER_LineDictionary *lineDict, const uint64_t key) {
+    char tmpFilename[FILENAME_MAX];
+    bool success;
+    int fd;
+
+    // Write to a temporary file first and then move it into place. This way
+    // other processes looking at the same file (which is likely to happen
+    // with a shared cache directory) never get to see a partial file.
+    snprintf(tmpFilename, sizeof(tmpFilename), "%s.%u.tmp", filename,
+            (unsigned int)getpid());
+    fd = open(tmpFilename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    success = writeJobFile(fd, job, lineDict, key);
+    success &= !close(fd);
+    success = success && !rename(tmpFilename, filename);
+
+    if (!success) {
+        unlink(tmpFilename);
+    }
+
+    return success;
+}
+
+bool writeJobFile(const int fd, const PRINTER_Job *job,
+        const PRINTER_LineDictionary *lineDict, const uint64_t key) {
+    PRINTER_JobFileHeader header;
+    const uint32_t lineDictSize =
+            lineDict->nrOfEntries * PRINTER_BYTES_PER_LINE;
+
+    memset(&header, 0, sizeof(header));
+    header.magic = PRINTER_JOB_FILE_MAGIC;
+    header.version = PRINTER_JOB_FILE_VERSION;
+    header.headerSize = sizeof(header);
+    header.nrOfItems = job->nrOfItems;
+    header.jobSize = job->size;
+    header.nrOfLineDictEntries = lineDict->nrOfEntries;
+    header.checksum = hashBytes(&lineDict->dict, lineDictSize) ^
+            hashBytes(job->data, job->size);
+    header.key = key;
+
+    return writeAll(fd, &header, sizeof(header)) &&
+            writeAll(fd, &lineDict->dict, lineDictSize) &&
+            writeAll(fd, job->data, job->size);
+}
+
+bool openJobFile(const char *filename, PRINTER_JobFile *jobFile) {
+    bool success;
+    int fd;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        memset(jobFile, 0, sizeof(*jobFile));
+        return false;
+    }
+
+    // The mapping stays valid after the file descriptor has been closed
+    success = openJobFileFd(fd, jobFile);
+    close(fd);
+
+    return success;
+}
+
+bool openJobFileFd(const int fd, PRINTER_JobFile *jobFile) {
+    memset(jobFile, 0, sizeof(*jobFile));
+    if (!mapFd(fd, &jobFile->mapping, &jobFile->mappingSize)) {
+        jobFile->mapping = NULL;
+        return false;
+    }
+
+    if (!checkJobFile(jobFile)) {
+        closeJobFile(jobFile);
+        return false;
+    }
+
+    return true;
+}
+
+// Same as openJobFileFd() but with the file contents copied into memory of our
+// own, so that they can't change anymore once they have been checked
+bool readJobFileFd(const int fd, PRINTER_JobFile *jobFile) {
+    memset(jobFile, 0, sizeof(*jobFile));
+    if (!readFd(fd, &jobFile->mapping, &jobFile->mappingSize)) {
+        return false;
+    }
+    jobFile->isCopy = true;
+
+    if (!checkJobFile(jobFile)) {
+        closeJobFile(jobFile);
+        return false;
+    }
+
+    return true;
+}
+
+void closeJobFile(PRINTER_JobFile *jobFile) {
+    if (jobFile->isCopy) {
+        free(jobFile->mapping);
+    }
+    else if (jobFile->mapping) {
+        munmap(jobFile->mapping, jobFile->mappingSize);
+    }
+    memset(jobFile, 0, sizeof(*jobFile));
+}
+
+// Check that the file contents in memory actually are a job file we understand
+// and set up the job file to refer to them
+static bool checkJobFile(PRINTER_JobFile *jobFile) {
+    const PRINTER_JobFileHeader *header;
+    const uint8_t *lineDictData;
+    uint32_t lineDictSize;
+
+    // Check that this actually is a job file we understand and that its size
+    // matches up with what the header says
+    header = (const PRINTER_JobFileHeader *)jobFile->mapping;
+    if ((jobFile->mappingSize < sizeof(*header)) ||
+            (header->magic != PRINTER_JOB_FILE_MAGIC) ||
+            (header->version != PRINTER_JOB_FILE_VERSION) ||
+            (header->headerSize != sizeof(*header)) ||
+            (header->nrOfLineDictEntries > PRINTER_MAX_LINE_DICT_ENTRIES) ||
+            (jobFile->mappingSize != (uint64_t)sizeof(*header) +
+                    header->nrOfLineDictEntries * PRINTER_BYTES_PER_LINE +
+                    header->jobSize)) {
+        return false;
+    }
+
+    lineDictData = (const uint8_t *)jobFile->mapping + sizeof(*header);
+    lineDictSize = header->nrOfLineDictEntries * PRINTER_BYTES_PER_LINE;
+
+    // Set up the job so that it points right into the mapped file
+    jobFile->header = header;
+    jobFile->job.data = (uint8_t *)lineDictData + lineDictSize;
+    jobFile->job.size = header->jobSize;
+    jobFile->job.capacity = 0;
+    jobFile->job.nrOfItems = header->nrOfItems;
+
+    // Since the job gets handed to the PRU as is it needs to be intact
+    if ((hashBytes(lineDictData, lineDictSize) ^
+            hashBytes(jobFile->job.data, jobFile->job.size)) !=
+                    header->checksum || !isJobValid(&jobFile->job)) {
+        return false;
+    }
+
+    // The line dictionary is small so it simply gets copied
+    memcpy(&jobFile->lineDict.dict, lineDictData, lineDictSize);
+    jobFile->lineDict.nrOfEntries = header->nrOfLineDictEntries;
+    jobFile->lineDict.bytesBefore = header->jobSize;
+    jobFile->lineDict.bytesAfter = header->jobSize;
+
+    return true;
+}
+
+bool getJobCacheKey(const char *imageFile,
+        const PRINTER_JobCacheParams *params, uint64_t *key) {
+    void *mapping;
+    size_t size;
+
+    if (!mapFile(imageFile, &mapping, &size)) {
+        return false;
+    }
+
+    // Hash the raw file contents rather than the decoded image. That's all
+    // that is needed to tell images apart and avoids decoding the image.
+    *key = hashBytes64(mapping, size, HASH64_SEED);
+    *key = hashBytes64(params, sizeof(*params), *key);
+    munmap(mapping, size);
+
+    return true;
+}
+
+void getJobCacheFileName(const char *cacheDir, const uint64_t key,
+        char *filename, const size_t size) {
+    snprintf(filename, size, "%s/%016llx.prj", cacheDir,
+            (unsigned long long)key);
+}
+
+static bool mapFile(const char *filename, void **mapping, size_t *size) {
+    bool success;
+    int fd;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    // The mapping stays valid after the file descriptor has been closed
+    success = mapFd(fd, mapping, size);
+    close(fd);
+
+    return success;
+}
+
+static bool mapFd(const int fd, void **mapping, size_t *size) {
+    struct stat fileStat;
+
+    if (fstat(fd, &fileStat) || !fileStat.st_size) {
+        return false;
+    }
+
+    *size = fileStat.st_size;
+    *mapping = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    return *mapping != MAP_FAILED;
+}
+
+static bool readFd(const int fd, void **data, size_t *size) {
+    struct stat fileStat;
+    size_t bytesRead = 0;
+    ssize_t result;
+
+    if (fstat(fd, &fileStat) || !fileStat.st_size) {
+        return false;
+    }
+
+    *size = fileStat.st_size;
+    *data = malloc(*size);
+    if (!*data) {
+        return false;
+    }
+
+    // A file that got shorter in the meantime doesn't read completely
+    while (bytesRead < *size) {
+        result = pread(fd, (uint8_t *)*data + bytesRead, *size - bytesRead,
+                bytesRead);
+        if ((result < 0) && (errno == EINTR)) {
+            continue;
+        }
+        if (result <= 0) {
+            free(*data);
+            *data = NULL;
+            return false;
+        }
+        bytesRead += result;
+    }
+
+    return true;
+}
+
+static bool writeAll(const int fd, const void *data, const size_t size) {
+    const uint8_t *bytes = (const uint8_t *)data;
+    size_t written = 0;
+    ssize_t result;
+
+    while (written < size) {
+        result = write(fd, bytes + written, size - written);
+        if (result <= 0) {
+            return false;
+        }
+        written += result;
+    }
+
+    return true;
+}
+
+// Walk all items to make sure none of them extends beyond the end of the job
+// and that the number of items matches. End-of-sequence and wrap commands must
+// not be part of the job as the queue handling places its own.
+static bool isJobValid(const PRINTER_Job *job) {
+    const uint8_t *itemPtr = job->data;
+    const uint8_t *endPtr = job->data + job->size;
+    const PRINTER_JobItem *item;
+    uint32_t nrOfItems = 0;
+
+    while (itemPtr < endPtr) {
+        item = (const PRINTER_JobItem *)itemPtr;
+        if ((endPtr - itemPtr < PRINTER_JOB_ITEM_SIZE(0)) ||
+                (item->length % sizeof(uint32_t)) ||
+                (item->length > endPtr - itemPtr - PRINTER_JOB_ITEM_SIZE(0)) ||
+                (item->command == PRINTER_CMD_EOS) ||
+                (item->command == PRINTER_CMD_WRAP)) {
+            return false;
+        }
+        itemPtr += PRINTER_JOB_ITEM_SIZE(item->length);
+        nrOfItems++;
+    }
+
+    return nrOfItems == job->nrOfItems;
+}
@@ -0,0 +1,97 @@
+/*
+ * jobfile.h
+ *
+ * Precompiled print job files. A print job that has been fully processed
+ * (decoded, partitioned, optimized, and deduplicated) can be saved to disk
+ * and printed again later on without touching the source image. The file
+ * holds the line dictionary followed by the job items in the exact layout
+ * used in the printer queue so it can be mapped into memory and copied into
+ * the queue as is. All fields are stored in the byte order of the host which
+ * is the same as the one of the PRU.
+ *
+ * Job files are also the unit in which print jobs are handed to the print
+ * daemon, in which case they are passed as open file descriptors. A mapping
+ * doesn't keep the file from being modified or truncated by whoever else has
+ * it open, so the daemon reads such files into memory of its own using
+ * readJobFileFd() before checking them.
+ *
+ * Job files are also used to implement a cache of compiled jobs. Cache
+ * entries are named after a key that is derived from the contents of the
+ * source image and all options that affect the resulting job.
+ *
+ * Copyright (C) 2014 Texas Instruments Incorporated - http://www.ti.com/
+ * ALL RIGHTS RESERVED
+ */
+
+#ifndef JOBFILE_H_
+#define JOBFILE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "printjob.h"
+#include "linedict.h"
+
+// Identification of the job file format. The version needs to be incremented
+// whenever the file layout or the meaning of any printer command changes.
+// Version 2 jobs no longer end in a request to halt the PRU.
+#define PRINTER_JOB_FILE_MAGIC              0x4A525050
+#define PRINTER_JOB_FILE_VERSION            2
+
+// Value used in the cache parameters in case a start or end line wasn't given
+#define PRINTER_JOB_CACHE_LINE_DEFAULT      0xFFFFFFFF
+
+// Header located at the beginning of each job file. It is followed by the
+// line dictionary entries in use and then by the job items. The checksum
+// covers both of them.
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t nrOfItems;
+    uint32_t jobSize;
+    uint32_t nrOfLineDictEntries;
+    uint32_t checksum;
+    uint32_t reserved;
+    uint64_t key;
+} PRINTER_JobFileHeader;
+
+// All options that influence the job compiled from an image. Together with
+// the hash of the image file contents they make up the cache key.
+typedef struct {
+    uint32_t startLine;
+    uint32_t endLine;
+    uint32_t inverse;
+    uint32_t paperFeedCount;
+    uint32_t nrOfCopies;
+    int32_t headerMacroId;
+    int32_t footerMacroId;
+} PRINTER_JobCacheParams;
+
+// Type describing a job file that has been mapped or read into memory. The
+// job refers to the file contents in memory directly and must not be modified
+// or freed.
+typedef struct {
+    void *mapping;
+    size_t mappingSize;
+    bool isCopy;
+    const PRINTER_JobFileHeader *header;
+    PRINTER_Job job;
+    PRINTER_LineDictionary lineDict;
+} PRINTER_JobFile;
+
+bool saveJobFile(const char *filename, const PRINTER_Job *job,
+        const PRINTER_LineDictionary *lineDict, const uint64_t key);
+bool writeJobFile(const int fd, const PRINTER_Job *job,
+        const PRINTER_LineDictionary *lineDict, const uint64_t key);
+bool openJobFile(const char *filename, PRINTER_JobFile *jobFile);
+bool openJobFileFd(const int fd, PRINTER_JobFile *jobFile);
+bool readJobFileFd(const int fd, PRINTER_JobFile *jobFile);
+void closeJobFile(PRINTER_JobFile *jobFile);
+bool getJobCacheKey(const char *imageFile,
+        const PRINTER_JobCacheParams *params, uint64_t *key);
+void getJobCacheFileName(const char *cacheDir, const uint64_t key,
+        char *filename, const size_t size);
+
+#endif /* JOBFILE_H_ */
@@ -0,0 +1,128 @@
+/*
+ * joboptimizer.c
+ *
+ * Pass pipeline that rewrites a host-side print job into an equivalent but
+ * more compact sequence of job items. Each pass walks the job once and for
+ * every item decides whether to keep it, to drop it, or to merge it into the
+ * item that was kept right before it. The job is compacted in place.
+ *
+ * Copyright (C) 2014 Texas Instruments Incorporated - http://www.ti.com/
+ * ALL RIGHTS RESERVED
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "joboptimizer.h"
+
+// Possible outcomes of processing a single job item within an optimizer pass
+typedef enum {
+    JOB_PASS_KEEP,
+    JOB_PASS_DROP,
+    JOB_PASS_MERGED
+} PRINTER_JobPassAction;
+
+// Type of an optimizer pass. The function gets handed the item that was kept
+// last (NULL if there is none) and the item currently being looked at. If the
+// function returns JOB_PASS_MERGED it must have folded the current item into
+// the previous one by modifying the previous item's payload in place.
+typedef PRINTER_JobPassAction (*PRINTER_JobPass)(PRINTER_JobItem *prevItem,
+        const PRINTER_JobItem *item);
+
+static PRINTER_JobPassAction coalesceHalfSteps(PRINTER_JobItem *prevItem,
+        const PRINTER_JobItem *item);
+static void runJobPass(PRINTER_Job *job, const PRINTER_JobPass pass);
+static bool isHalfStep(const PRINTER_JobItem *item);
+
+// The optimizer pipeline. Passes are run in the order given here. The image
+// encoder never emits empty passes and already packs each line into as few
+// passes as possible, so only the steps between lines are left to optimize.
+static const PRINTER_JobPass jobPasses[] = {
+    coalesceHalfSteps
+};
+
+void optimizeJob(PRINTER_Job *job, PRINTER_JobOptimizerStats *stats) {
+    uint32_t i;
+
+    stats->itemsBefore = job->nrOfItems;
+    stats->bytesBefore = job->size;
+
+    for (i = 0; i < sizeof(jobPasses) / sizeof(jobPasses[0]); i++) {
+        runJobPass(job, jobPasses[i]);
+    }
+
+    stats->itemsAfter = job->nrOfItems;
+    stats->bytesAfter = job->size;
+}
+
+void printJobOptimizerStatsToConsole(const PRINTER_JobOptimizerStats *stats) {
+    printf("Job optimizer: %u items (%u bytes) -> %u items (%u bytes)\n",
+            stats->itemsBefore, stats->bytesBefore,
+            stats->itemsAfter, stats->bytesAfter);
+}
+
+static void runJobPass(PRINTER_Job *job, const PRINTER_JobPass pass) {
+    uint8_t *readPtr = job->data;
+    uint8_t *writePtr = job->data;
+    uint8_t *endPtr = job->data + job->size;
+    PRINTER_JobItem *prevItem = NULL;
+    uint32_t nrOfItems = 0;
+
+    // Walk the job while compacting it in place. Since items only ever shrink
+    // or disappear the write pointer can never overtake the read pointer.
+    while (readPtr < endPtr) {
+        const PRINTER_JobItem *item = (const PRINTER_JobItem *)readPtr;
+        const uint32_t itemSize = PRINTER_JOB_ITEM_SIZE(item->length);
+
+        switch (pass(prevItem, item)) {
+        case JOB_PASS_KEEP:
+            if (writePtr != readPtr) {
+                memmove(writePtr, readPtr, itemSize);
+            }
+            prevItem = (PRINTER_JobItem *)writePtr;
+            writePtr += itemSize;
+            nrOfItems++;
+            break;
+        case JOB_PASS_DROP:
+        case JOB_PASS_MERGED:
+            break;
+        }
+
+        readPtr += itemSize;
+    }
+
+    job->size = writePtr - job->data;
+    job->nrOfItems = nrOfItems;
+}
+
+// Consecutive steps get combined into a single step command for as long as the
+// firmware's limit for the number of half-steps per command isn't exceeded.
+// Steps that don't move the paper are a no-op for the printer and get dropped,
+// which also keeps them from separating steps that can be combined.
+static PRINTER_JobPassAction coalesceHalfSteps(PRINTER_JobItem *prevItem,
+        const PRINTER_JobItem *item) {
+    if (!isHalfStep(item)) {
+        return JOB_PASS_KEEP;
+    }
+
+    if (!item->data[0]) {
+        return JOB_PASS_DROP;
+    }
+
+    if (!prevItem || !isHalfStep(prevItem)) {
+        return JOB_PASS_KEEP;
+    }
+
+    if (prevItem->data[0] + item->data[0] > PRINTER_MAX_NR_HALF_STEPS) {
+        return JOB_PASS_KEEP;
+    }
+
+    prevItem->data[0] += item->data[0];
+
+    return JOB_PASS_MERGED;
+}
+
+static bool isHalfStep(const PRINTER_JobItem *item) {
+    return (item->command == PRINTER_CMD_MOTOR_HALF_STEP) &&
+            (item->length == sizeof(uint32_t));
+}
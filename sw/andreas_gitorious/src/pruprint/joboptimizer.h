@@ -0,0 +1,31 @@
+/*
+ * joboptimizer.h
+ *
+ * Pass pipeline that rewrites a host-side print job into an equivalent but
+ * more compact sequence of job items before it gets transferred into the PRU
+ * shared memory.
+ *
+ * Copyright (C) 2014 Texas Instruments Incorporated - http://www.ti.com/
+ * ALL RIGHTS RESERVED
+ */
+
+#ifndef JOBOPTIMIZER_H_
+#define JOBOPTIMIZER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "printjob.h"
+
+// Type holding the size of a job before and after running the optimizer
+typedef struct {
+    uint32_t itemsBefore;
+    uint32_t bytesBefore;
+    uint32_t itemsAfter;
+    uint32_t bytesAfter;
+} PRINTER_JobOptimizerStats;
+
+void optimizeJob(PRINTER_Job *job, PRINTER_JobOptimizerStats *stats);
+void printJobOptimizerStatsToConsole(const PRINTER_JobOptimizerStats *stats);
+
+#endif /* JOBOPTIMIZER_H_ */
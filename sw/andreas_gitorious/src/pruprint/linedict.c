@@ -0,0 +1,249 @@
+/*
+ * linedict.c
+ *
+ * Line dictionary support. See linedict.h for details.
+ *
+ * The dictionary is built in two sweeps over the job. The first sweep counts
+ * how often each distinct pass occurs using a content hash, after which the
+ * most frequently used passes are selected for the dictionary. The second
+ * sweep replaces runs of consecutive passes that are found in the dictionary
+ * with a single PRINTER_CMD_PRINT_LINE_REF item, compacting the job in place.
+ *
+ * Copyright (C) 2014 Texas Instruments Incorporated - http://www.ti.com/
+ * ALL RIGHTS RESERVED
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "linedict.h"
+#include "hash.h"
+#include "prumem.h"
+
+// Maximum number of line references that get packed into one job item before
+// a new item is started
+#define MAX_LINE_REFS_PER_ITEM          32
+
+// Size of the hash table used to look up dictionary entries during the second
+// sweep. Must be a power of two and at least twice the dictionary size.
+#define LINE_DICT_LOOKUP_SIZE           128
+
+// Type used to count the occurrences of a distinct pass during the first sweep
+typedef struct {
+    uint32_t hash;
+    const uint8_t *dotData;
+    uint32_t count;
+} PRINTER_LineCount;
+
+static bool isLinePass(const PRINTER_JobItem *item);
+static int compareLineCounts(const void *a, const void *b);
+static void replaceLinePasses(PRINTER_Job *job,
+        PRINTER_LineDictionary *lineDict, const int16_t lookup[]);
+static int16_t findLine(const PRINTER_LineDictionary *lineDict,
+        const int16_t lookup[], const uint8_t dotData[]);
+
+bool buildLineDictionary(PRINTER_Job *job, PRINTER_LineDictionary *lineDict) {
+    PRINTER_LineCount *lineCounts;
+    PRINTER_LineCount **candidates;
+    const PRINTER_JobItem *item;
+    uint32_t capacity = LINE_DICT_LOOKUP_SIZE;
+    uint32_t nrOfCandidates = 0;
+    uint32_t slot;
+    uint32_t hash;
+    uint32_t i;
+    int16_t lookup[LINE_DICT_LOOKUP_SIZE];
+
+    memset(lineDict, 0, sizeof(*lineDict));
+    lineDict->bytesBefore = job->size;
+    lineDict->bytesAfter = job->size;
+
+    // Size the hash table such that it is at most half full even if every
+    // single item in the job were a distinct pass.
+    while (capacity < 2 * job->nrOfItems) {
+        capacity *= 2;
+    }
+
+    lineCounts = (PRINTER_LineCount *)calloc(capacity,
+            sizeof(PRINTER_LineCount));
+    candidates = (PRINTER_LineCount **)malloc(capacity *
+            sizeof(PRINTER_LineCount *));
+    if (!lineCounts || !candidates) {
+        free(lineCounts);
+        free(candidates);
+        return false;
+    }
+
+    // First sweep - count the occurrences of each distinct pass. Identical
+    // hashes get double-checked by comparing the actual dot data.
+    for (item = getFirstJobItem(job); item; item = getNextJobItem(job, item)) {
+        if (!isLinePass(item)) {
+            continue;
+        }
+
+        hash = hashBytes(item->data, PRINTER_BYTES_PER_LINE);
+        for (slot = hash & (capacity - 1); lineCounts[slot].dotData;
+                slot = (slot + 1) & (capacity - 1)) {
+            if ((lineCounts[slot].hash == hash) &&
+                    !memcmp(lineCounts[slot].dotData, item->data,
+                            PRINTER_BYTES_PER_LINE)) {
+                break;
+            }
+        }
+
+        if (!lineCounts[slot].dotData) {
+            lineCounts[slot].hash = hash;
+            lineCounts[slot].dotData = (const uint8_t *)item->data;
+        }
+        lineCounts[slot].count++;
+    }
+
+    // Only passes that occur more than once are worth putting into the
+    // dictionary. Pick the most frequently used ones.
+    for (slot = 0; slot < capacity; slot++) {
+        if (lineCounts[slot].count > 1) {
+            candidates[nrOfCandidates++] = &lineCounts[slot];
+        }
+    }
+    qsort(candidates, nrOfCandidates, sizeof(candidates[0]),
+            compareLineCounts);
+
+    lineDict->nrOfEntries = nrOfCandidates < PRINTER_MAX_LINE_DICT_ENTRIES ?
+            nrOfCandidates : PRINTER_MAX_LINE_DICT_ENTRIES;
+
+    // Copy the selected passes into the dictionary and set up a small hash
+    // table for looking them up by content.
+    memset(lookup, 0xff, sizeof(lookup));
+    for (i = 0; i < lineDict->nrOfEntries; i++) {
+        memcpy(lineDict->dict.lines[i], candidates[i]->dotData,
+                PRINTER_BYTES_PER_LINE);
+        for (slot = candidates[i]->hash & (LINE_DICT_LOOKUP_SIZE - 1);
+                lookup[slot] >= 0;
+                slot = (slot + 1) & (LINE_DICT_LOOKUP_SIZE - 1)) {
+        }
+        lookup[slot] = i;
+    }
+
+    // The counting table points into the job so we are done with it before
+    // we start to modify the job.
+    free(lineCounts);
+    free(candidates);
+
+    // Second sweep - replace the passes with dictionary references
+    if (lineDict->nrOfEntries) {
+        replaceLinePasses(job, lineDict, lookup);
+    }
+
+    lineDict->bytesAfter = job->size;
+
+    return true;
+}
+
+void uploadLineDictionary(const PRINTER_LineDictionary *lineDict,
+        void *pruDataRam) {
+    // Only transfer the entries that are actually in use
+    copyToPruMemory((uint8_t *)pruDataRam + PRINTER_LINE_DICT_OFFSET,
+            &lineDict->dict, lineDict->nrOfEntries * PRINTER_BYTES_PER_LINE);
+}
+
+void printLineDictionaryStatsToConsole(const PRINTER_LineDictionary *lineDict) {
+    printf("Line dictionary: %u entries, %u passes referenced, %u -> %u "
+            "bytes\n", lineDict->nrOfEntries, lineDict->nrOfLineRefs,
+            lineDict->bytesBefore, lineDict->bytesAfter);
+}
+
+static void replaceLinePasses(PRINTER_Job *job,
+        PRINTER_LineDictionary *lineDict, const int16_t lookup[]) {
+    uint8_t *readPtr = job->data;
+    uint8_t *writePtr = job->data;
+    uint8_t *endPtr = job->data + job->size;
+    uint16_t lineRefs[MAX_LINE_REFS_PER_ITEM];
+    uint32_t nrOfLineRefs;
+    uint32_t nrOfItems = 0;
+    uint32_t length;
+    int16_t index;
+    PRINTER_JobItem *item;
+
+    // Since every pass that gets replaced shrinks from a full line of dot data
+    // down to a 16-bit reference the write pointer can never overtake the read
+    // pointer, even though a reference item carries a header of its own.
+    while (readPtr < endPtr) {
+        item = (PRINTER_JobItem *)readPtr;
+
+        // Collect a run of consecutive passes that are in the dictionary
+        nrOfLineRefs = 0;
+        while ((readPtr < endPtr) && (nrOfLineRefs < MAX_LINE_REFS_PER_ITEM) &&
+                isLinePass(item) &&
+                ((index = findLine(lineDict, lookup,
+                        (const uint8_t *)item->data)) >= 0)) {
+            lineRefs[nrOfLineRefs++] = index;
+            readPtr += PRINTER_JOB_ITEM_SIZE(item->length);
+            item = (PRINTER_JobItem *)readPtr;
+        }
+
+        if (nrOfLineRefs) {
+            // Pad the references to a multiple of 32 bits
+            if (nrOfLineRefs & 1) {
+                lineRefs[nrOfLineRefs] = PRINTER_LINE_REF_NONE;
+                length = (nrOfLineRefs + 1) * sizeof(uint16_t);
+            }
+            else {
+                length = nrOfLineRefs * sizeof(uint16_t);
+            }
+
+            ((PRINTER_JobItem *)writePtr)->command = PRINTER_CMD_PRINT_LINE_REF;
+            ((PRINTER_JobItem *)writePtr)->length = length;
+            memcpy(((PRINTER_JobItem *)writePtr)->data, lineRefs, length);
+            writePtr += PRINTER_JOB_ITEM_SIZE(length);
+            lineDict->nrOfLineRefs += nrOfLineRefs;
+            nrOfItems++;
+            continue;
+        }
+
+        // Any other item just gets moved
+        length = PRINTER_JOB_ITEM_SIZE(item->length);
+        if (writePtr != readPtr) {
+            memmove(writePtr, readPtr, length);
+        }
+        writePtr += length;
+        readPtr += length;
+        nrOfItems++;
+    }
+
+    job->size = writePtr - job->data;
+    job->nrOfItems = nrOfItems;
+}
+
+static int16_t findLine(const PRINTER_LineDictionary *lineDict,
+        const int16_t lookup[], const uint8_t dotData[]) {
+    uint32_t slot;
+
+    for (slot = hashBytes(dotData, PRINTER_BYTES_PER_LINE) &
+            (LINE_DICT_LOOKUP_SIZE - 1); lookup[slot] >= 0;
+            slot = (slot + 1) & (LINE_DICT_LOOKUP_SIZE - 1)) {
+        if (!memcmp(lineDict->dict.lines[lookup[slot]], dotData,
+                PRINTER_BYTES_PER_LINE)) {
+            return lookup[slot];
+        }
+    }
+
+    return -1;
+}
+
+static bool isLinePass(const PRINTER_JobItem *item) {
+    return (item->command == PRINTER_CMD_PRINT_LINE) &&
+            (item->length == PRINTER_BYTES_PER_LINE);
+}
+
+// Sort by descending number of occurrences. Ties are broken by the position
+// of the first occurrence within the job to keep the result deterministic.
+static int compareLineCounts(const void *a, const void *b) {
+    const PRINTER_LineCount *lineCountA = *(const PRINTER_LineCount **)a;
+    const PRINTER_LineCount *lineCountB = *(const PRINTER_LineCount **)b;
+
+    if (lineCountA->count != lineCountB->count) {
+        return lineCountA->count > lineCountB->count ? -1 : 1;
+    }
+
+    return lineCountA->dotData < lineCountB->dotData ? -1 : 1;
+}
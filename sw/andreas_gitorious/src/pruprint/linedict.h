@@ -0,0 +1,37 @@
+/*
+ * linedict.h
+ *
+ * Line dictionary support. Passes that occur several times throughout a print
+ * job (glyph rows, separator rules, logo lines, ...) get uploaded once into
+ * the PRU1 data RAM and are then printed by referring to their dictionary
+ * index using PRINTER_CMD_PRINT_LINE_REF instead of carrying the dot data in
+ * each job item.
+ *
+ * Copyright (C) 2014 Texas Instruments Incorporated - http://www.ti.com/
+ * ALL RIGHTS RESERVED
+ */
+
+#ifndef LINEDICT_H_
+#define LINEDICT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "printjob.h"
+
+// Host-side copy of the line dictionary along with some statistics about how
+// well the job could be deduplicated.
+typedef struct {
+    PRINTER_LineDict dict;
+    uint32_t nrOfEntries;
+    uint32_t nrOfLineRefs;
+    uint32_t bytesBefore;
+    uint32_t bytesAfter;
+} PRINTER_LineDictionary;
+
+bool buildLineDictionary(PRINTER_Job *job, PRINTER_LineDictionary *lineDict);
+void uploadLineDictionary(const PRINTER_LineDictionary *lineDict,
+        void *pruDataRam);
+void printLineDictionaryStatsToConsole(const PRINTER_LineDictionary *lineDict);
+
+#endif /* LINEDICT_H_ */
@@ -20,16 +20,30 @@
 #include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
-#include <sys/time.h>
-#include <png.h>
-
-// PRU driver header file
-#include "prussdrv.h"
-#include "pruss_intc_mapping.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 
 // Interface to the PRU-based printer driver firmware "pruprinter_fw"
 #include "pruprinter.h"
 
+// Host-side print job handling
+#include "printjob.h"
+#include "joboptimizer.h"
+#include "linedict.h"
+#include "hash.h"
+#include "jobfile.h"
+#include "prumem.h"
+#include "bench.h"
+#include "session.h"
+#include "printd.h"
+#include "transport.h"
+#include "image.h"
+#include "trace.h"
+#include "profile.h"
+
 // Include the generated PRU firmware from the "pruprinter_fw" project by
 // including the associated header files.
 #include "pruprinter_fw_iram.h"
@@ -37,22 +51,128 @@
 
 #define USAGE_STRING                                                    \
     "Usage: %s [OPTION]... FILE\n"                                      \
+    "       %s -c ID [OPTION]...\n"                                     \
+    "       %s -j JOBFILE\n"                                            \
     "       %s -f COUNT\n"                                              \
     "       %s -t\n"                                                    \
+    "       %s -b NAME\n"                                               \
+    "       %s -d [-S SOCKET] [-K MS]\n"                                \
+    "       %s --stats [-T TRANSPORT]\n"                                \
     "Prints the PNG image FILE using the PRU printer\n"                 \
     "\n"                                                                \
     "  -s START     First image row to print\n"                         \
     "  -e END       Last image row to print\n"                          \
     "  -i           Invert image while printing\n"                      \
     "  -f COUNT     Feed printer paper\n"                               \
+    "  -n COPIES    Number of copies to print\n"                        \
+    "  -m ID        Store FILE as resident job macro ID instead of\n"   \
+    "               printing it\n"                                      \
+    "  -c ID        Print resident job macro ID before FILE\n"          \
+    "  -a ID        Print resident job macro ID after FILE\n"           \
+    "  -o JOBFILE   Save compiled print job to JOBFILE instead of\n"    \
+    "               printing it\n"                                      \
+    "  -j JOBFILE   Print a previously saved print job\n"               \
+    "  -C DIR       Cache compiled print jobs in DIR\n"                 \
+    "  -p           Busy-poll the printer driver instead of waiting\n"  \
+    "               for interrupts (lower latency for short jobs)\n"    \
+    "  -b NAME      Run benchmark NAME (\"-b list\" to list them)\n"    \
+    "  -d           Run as print daemon (implied when run as\n"         \
+    "               pruprintd)\n"                                       \
+    "  -S SOCKET    Hand print jobs to the print daemon listening on\n" \
+    "               SOCKET, or listen on it when running as daemon\n"   \
+    "  -K MS        Keep the printer head powered for MS milliseconds\n"\
+    "               between jobs when running as daemon\n"              \
     "  -t           Test pattern signal generation\n"                   \
     "               CAUTION: USE ONLY WITH NO PRINTER HW CONNECTED!\n"  \
-    "  -w           Wait for ENTER before disabling PRU and exiting program\n"
+    "  -F FIRMWARE  Load the PRU firmware from FIRMWARE (ELF or raw\n"  \
+    "               binary) rather than using the built-in one\n"       \
+    "  -R           Reload the PRU firmware rather than attaching to\n" \
+    "               the one that is already running\n"                  \
+    "  -x           Disable the PRU on exit rather than leaving the\n"  \
+    "               firmware running for the next invocation\n"         \
+    "  -T TRANSPORT Talk to the PRU through TRANSPORT (\"-T list\" to\n"\
+    "               list them, default " PRINTER_DEFAULT_TRANSPORT ")\n"\
+    "  -w           Wait for ENTER before exiting program\n"            \
+    "  --stats      Show how long the phases of the PRU firmware take,\n"\
+    "               without disturbing a print in progress\n"           \
+    "  --trace FILE Write a timeline of the host and the PRU firmware\n"\
+    "               to FILE (Chrome/Perfetto trace format)\n"           \
+    "  --profile-json\n"                                                \
+    "               Show where the host spent its time as a line of\n"  \
+    "               JSON rather than as a table\n"
+
+// Value used for macro IDs in case no macro is to be used
+#define NO_MACRO                    (-1)
+
+// Time given to the running PRU firmware to prove that it is alive and idle
+// before attaching to it
+#define PRU_ATTACH_TIMEOUT_US       10000
+#define PRU_ATTACH_POLL_US          1000
+
+// Program name that makes the program run as print daemon
+#define DAEMON_PROGRAM_NAME         "pruprintd"
+
+// Value getopt_long() returns for options that come without a short form
+#define OPTION_STATS                256
+#define OPTION_TRACE                257
+#define OPTION_PROFILE_JSON         258
+
+// Clock the PRU cycle counters run at, used to convert cycles into time
+#define PRU_CLOCK_MHZ               200
+
+// Number of attempts at reading the statistics of a phase while the firmware
+// isn't updating them
+#define STATS_READ_ATTEMPTS         10
+
+// Type holding all parameters that determine how a print job gets assembled
+typedef struct {
+    uint32_t startLine;
+    uint32_t endLine;
+    bool inverse;
+    uint32_t paperFeedCount;
+    uint32_t nrOfCopies;
+    int32_t headerMacroId;
+    int32_t footerMacroId;
+} PRINTER_PrintOptions;
+
+// States the firmware found on the PRU can be in. A firmware that isn't the one
+// expected counts as missing. The expected one is busy unless it proves to be
+// sitting in its idle loop, which it doesn't while processing a job.
+typedef enum {
+    PRINTER_FW_MISSING,
+    PRINTER_FW_IDLE,
+    PRINTER_FW_BUSY
+} PRINTER_FirmwareState;
+
+// Global variable holding the transport connecting us to the PRU
+static PRINTER_Transport transport;
 
 // Global variable pointing to the printer queue that is located in the PRU
 // shared memory section
 static PRINTER_Queue *queue;
 
+// Global variable pointing to the PRU1 data RAM. Its upper half is used to
+// hold data that gets uploaded by the host such as the line dictionary.
+static void *pruDataRam;
+
+// Global variable pointing to the PRU0 data RAM which holds the resident job
+// macros.
+static PRINTER_MacroStore *macroStore;
+
+// Global variable holding how print jobs synchronize with the printer driver
+static PRINTER_SyncMode syncMode = PRINTER_SYNC_INTERRUPT;
+
+// Global variable holding the socket of the print daemon that print jobs get
+// handed to. Print jobs are printed directly using the PRU if it is NULL.
+static const char *daemonSocket;
+
+// Global variable holding the printer status as of the end of the last job
+static PRINTER_Status jobStatus;
+
+// Global variable telling whether the last job couldn't be printed at all, in
+// which case the printer status doesn't tell anything about it
+static bool jobFailed;
+
 // Global variable pointing to the next job item in the printer queue that needs
 // to be processed.
 static PRINTER_JobItem *jobItem;
@@ -60,30 +180,48 @@ static PRINTER_JobItem *jobItem;
 // Global variable pointing to the last valid memory location for job items
 static void *jobItemsMaxAddress;
 
-// Global variables for working with the image that was loaded
-static uint32_t pngImageWidth, pngImageHeight;
-static png_bytep *pngImageRowPointers;
+// Global variable holding the image that was loaded
+static PRINTER_Image pngImage;
 
 // Function prototypes
-static bool initPru(void);
+static bool initPru(const char *transportName, const bool forceReload,
+        const char *firmwareFile);
+static void *mapFirmwareFile(const char *fileName, uint32_t *length);
+static uint32_t getFirmwareImageHash(const void *image, const uint32_t length);
+static PRINTER_FirmwareState getFirmwareState(
+        const PRINTER_FirmwareInfo *info, const uint32_t imageHash);
 static void disablePru(void);
-static bool readPngImage(const char *fileName);
-static void deallocPngImage(void);
+static void detachPru(void);
+static bool printFirmwareStats(const char *transportName);
+static bool readPhaseStats(const PRINTER_PhaseStats *source,
+        PRINTER_PhaseStats *stats);
 static void initQueueJobItems(void);
-static bool queueHasJobItems(void);
 static void addJobItemToQueue(const uint32_t command, const uint32_t length,
         const uint8_t data[]);
 static bool addJobItemToQueueLowLevel(const uint32_t command,
         const uint32_t length, const uint8_t data[]);
-static void printImage(const uint32_t startLine, const uint32_t endLine,
-        const bool inverse, const uint32_t paperFeedCountAfterPrint);
-static void partitionLineAndPrint(const uint8_t dotData[],
-        const uint16_t length, const bool inverse);
-void measureDurationPrintToConsole(bool start);
+static bool compileImage(const PRINTER_PrintOptions *options,
+        PRINTER_Job *job, PRINTER_LineDictionary *lineDict);
+static void printJob(const PRINTER_Job *job,
+        const PRINTER_LineDictionary *lineDict);
+static bool printJobFile(const char *filename, const uint64_t *key);
+static bool defineImageMacro(const uint32_t macroId,
+        const PRINTER_PrintOptions *options);
+static bool isMacroDefined(const int32_t macroId);
+static void submitJob(const PRINTER_Job *job);
+static void submitJobToDaemon(const PRINTER_Job *job,
+        const PRINTER_LineDictionary *lineDict, const char *filename);
+static void flushQueue(void);
 void checkForPrinterErrorsPrintToConsole(void);
 
 // Main Linux program entry point
 int main(int argc, char *argv[]) {
+    static const struct option longOptions[] = {
+        { "stats", no_argument, NULL, OPTION_STATS },
+        { "trace", required_argument, NULL, OPTION_TRACE },
+        { "profile-json", no_argument, NULL, OPTION_PROFILE_JSON },
+        { NULL, 0, NULL, 0 }
+    };
     int opt;
     bool testFlag = false;
     bool paperFeedFlag = false;
@@ -94,11 +232,50 @@ int main(int argc, char *argv[]) {
     uint32_t endLine = 0;
     bool inverseFlag = false;
     bool waitFlag = false;
+    bool daemonFlag = false;
+    bool reloadFlag = false;
+    bool disableFlag = false;
+    bool statsFlag = false;
+    const char *traceFile = NULL;
+    bool profileJsonFlag = false;
+    const char *firmwareFile = NULL;
+    const char *transportName = PRINTER_DEFAULT_TRANSPORT;
+    uint32_t keepWarmMs = 0;
+    const char *programName;
+    uint32_t nrOfCopies = 1;
+    bool defineMacroFlag = false;
+    uint32_t defineMacroId = 0;
+    int32_t headerMacroId = NO_MACRO;
+    int32_t footerMacroId = NO_MACRO;
+    const char *outputJobFile = NULL;
+    const char *inputJobFile = NULL;
+    const char *jobCacheDir = NULL;
+    const char *benchmarkName = NULL;
+    PRINTER_BenchContext benchContext;
+    char jobCacheFile[FILENAME_MAX];
+    PRINTER_JobCacheParams jobCacheParams;
+    uint64_t jobCacheKey = 0;
+    bool jobCacheFlag = false;
+    bool jobCacheHit = false;
+    PRINTER_PrintOptions printOptions;
+    PRINTER_Job job;
+    PRINTER_LineDictionary lineDict;
+    PROFILE_Stage previousStage;
+
+    // Everything up to the first job counts towards the profile as well
+    initProfile();
+
+    // See if the program got invoked as the print daemon
+    programName = strrchr(argv[0], '/');
+    programName = programName ? programName + 1 : argv[0];
+    daemonFlag = !strcmp(programName, DAEMON_PROGRAM_NAME);
 
     // Parse the command line options and issue a simple help text in case
     // things don't match up. The columns behind the options denote that option
     // requires an argument. See getopt(3) for more info.
-    while ((opt = getopt(argc, argv, "tf:s:e:iw")) != -1) {
+    while ((opt = getopt_long(argc, argv,
+            "tf:s:e:iwn:m:c:a:o:j:C:pb:dS:K:RxF:T:", longOptions,
+            NULL)) != -1) {
         switch (opt) {
         case 't':
             testFlag = true;
@@ -121,18 +298,139 @@ int main(int argc, char *argv[]) {
         case 'w':
             waitFlag = true;
             break;
+        case 'n':
+            nrOfCopies = atoi(optarg);
+            break;
+        case 'm':
+            defineMacroId = atoi(optarg);
+            defineMacroFlag = true;
+            break;
+        case 'c':
+            headerMacroId = atoi(optarg);
+            break;
+        case 'a':
+            footerMacroId = atoi(optarg);
+            break;
+        case 'o':
+            outputJobFile = optarg;
+            break;
+        case 'j':
+            inputJobFile = optarg;
+            break;
+        case 'C':
+            jobCacheDir = optarg;
+            break;
+        case 'p':
+            syncMode = PRINTER_SYNC_BUSY_POLL;
+            break;
+        case 'b':
+            benchmarkName = optarg;
+            break;
+        case 'd':
+            daemonFlag = true;
+            break;
+        case 'S':
+            daemonSocket = optarg;
+            break;
+        case 'K':
+            keepWarmMs = atoi(optarg);
+            break;
+        case 'R':
+            reloadFlag = true;
+            break;
+        case 'x':
+            disableFlag = true;
+            break;
+        case 'F':
+            firmwareFile = optarg;
+            break;
+        case 'T':
+            transportName = optarg;
+            break;
+        case OPTION_STATS:
+            statsFlag = true;
+            break;
+        case OPTION_TRACE:
+            traceFile = optarg;
+            break;
+        case OPTION_PROFILE_JSON:
+            profileJsonFlag = true;
+            break;
         default:
             // getopt() will return '?' in case of a malformed command line in
             // which case we are printing the usage and exit the command.
-            fprintf(stderr, USAGE_STRING, argv[0], argv[0], argv[0]);
+            fprintf(stderr, USAGE_STRING, argv[0], argv[0], argv[0], argv[0],
+                argv[0], argv[0], argv[0], argv[0]);
             return EXIT_FAILURE;
         }
     }
 
+    // Listing the benchmarks doesn't require any hardware access
+    if (benchmarkName && !strcmp(benchmarkName, "list")) {
+        printBenchmarksToConsole();
+        return EXIT_SUCCESS;
+    }
+
+    // Same goes for listing the transports
+    if (!strcmp(transportName, "list")) {
+        printTransportsToConsole();
+        return EXIT_SUCCESS;
+    }
+
+    // Looking at the firmware statistics leaves the PRU alone, so it can be
+    // done while the print daemon or another invocation is printing
+    if (statsFlag) {
+        return printFirmwareStats(transportName) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // When handing print jobs to the print daemon the PRU must be left alone.
+    // Only functions that boil down to printing a job are available then.
+    if (daemonSocket && !daemonFlag &&
+            (testFlag || benchmarkName || defineMacroFlag || traceFile)) {
+        fprintf(stderr, "Option not available with the print daemon!\n");
+        return EXIT_FAILURE;
+    }
+
+    // Keeping the printer head warm only makes sense if there is going to be
+    // another job. A powered head must not be left behind on exit either.
+    if (keepWarmMs && !daemonFlag) {
+        fprintf(stderr, "Option only available when running as daemon!\n");
+        return EXIT_FAILURE;
+    }
+
+    // A trace covers a single invocation, which the print daemon never ends
+    if (traceFile && daemonFlag) {
+        fprintf(stderr, "Option not available when running as daemon!\n");
+        return EXIT_FAILURE;
+    }
+
     // Initialize the PRU and exit the program if that fails. Any errors that
     // may occur during that process will be output from within that function.
-    if (!initPru()) {
-        return EXIT_FAILURE;
+    if (!daemonSocket || daemonFlag) {
+        if (!initPru(transportName, reloadFlag, firmwareFile)) {
+            return EXIT_FAILURE;
+        }
+        if (traceFile && !startTrace(&transport)) {
+            disablePru();
+            return EXIT_FAILURE;
+        }
+    }
+
+    // See if we are supposed to run as the print daemon. In that case the PRU
+    // stays loaded for as long as the daemon runs.
+    if (daemonFlag) {
+        if (!runPrintDaemon(daemonSocket ? daemonSocket :
+                PRINTER_DAEMON_DEFAULT_SOCKET, &transport, keepWarmMs)) {
+            disablePru();
+            return EXIT_FAILURE;
+        }
+        if (disableFlag) {
+            disablePru();
+        }
+        else {
+            detachPru();
+        }
+        return EXIT_SUCCESS;
     }
 
     // See if the test mode has been activated. If that's the case we will just
@@ -145,286 +443,573 @@ int main(int argc, char *argv[]) {
         addJobItemToQueue(PRINTER_CMD_TEST_SIGNALS, 0, NULL);
         addJobItemToQueue(PRINTER_CMD_EOS, 0, NULL);
 
-        // The interrupt is mapped via INTC to channel 1
         printf("Starting PRU GPIO test pattern generation\n");
-        prussdrv_pru_send_event(ARM_PRU1_INTERRUPT);
+        releasePruMemory();
+        kickTransport(&transport);
     }
-    // See if the paper feed flag has been set AND no image filename was given.
-    // Unlike other print-related flags we want to allow the user to feed paper
-    // without needing to specify an image to print.
-    else if (paperFeedFlag && (optind >= argc)) {
+    // See if a benchmark was requested. The printer firmware is loaded but
+    // idle at this point.
+    else if (benchmarkName) {
+        benchContext.transport = &transport;
+        benchContext.queue = queue;
+        benchContext.pruDataRam = pruDataRam;
+        if (!runBenchmark(benchmarkName, &benchContext)) {
+            disablePru();
+            return EXIT_FAILURE;
+        }
+    }
+    // See if the paper feed flag has been set AND no image filename or macro
+    // was given. Unlike other print-related flags we want to allow the user to
+    // feed paper without needing to specify an image to print.
+    else if (paperFeedFlag && (optind >= argc) && !inputJobFile &&
+            (headerMacroId == NO_MACRO) && (footerMacroId == NO_MACRO)) {
         // Go ahead and create a very simple print job that simply feeds the
         // paper by the specified number of steps. Any other print-related
-        // command line option will be ignored.
-        initQueueJobItems();
-        addJobItemToQueue(PRINTER_CMD_OPEN, 0, NULL);
-        addJobItemToQueue(PRINTER_CMD_MOTOR_HALF_STEP, sizeof(uint32_t),
-                (const uint8_t *)&paperFeedCount);
-        addJobItemToQueue(PRINTER_CMD_CLOSE, 0, NULL);
-        addJobItemToQueue(PRINTER_CMD_REQUEST_PRU_HALT, 0, NULL);
-        addJobItemToQueue(PRINTER_CMD_EOS, 0, NULL);
+        // command line option will be ignored. The job doesn't make use of
+        // the line dictionary.
+        if (!initJob(&job) ||
+                !addJobItem(&job, PRINTER_CMD_OPEN, 0, NULL) ||
+                !addJobItem(&job, PRINTER_CMD_MOTOR_HALF_STEP,
+                        sizeof(uint32_t), &paperFeedCount) ||
+                !addJobItem(&job, PRINTER_CMD_CLOSE, 0, NULL)) {
+            fprintf(stderr, "Error allocating memory for print job!\n");
+            freeJob(&job);
+            return EXIT_FAILURE;
+        }
+        memset(&lineDict, 0, sizeof(lineDict));
 
-        // The interrupt is mapped via INTC to channel 1
         printf("Start feeding paper\n");
-        prussdrv_pru_send_event(ARM_PRU1_INTERRUPT);
+        printJob(&job, &lineDict);
+        freeJob(&job);
 
-        // Wait until PRU1 has finished execution and acknowledge the interrupt.
-        // The INTC config maps PRU1_ARM_INTERRUPT to EVTOUT_1.
-        printf("Waiting for paper feed completion...\n");
-        measureDurationPrintToConsole(true);
-        prussdrv_pru_wait_event(PRU_EVTOUT_1);
-        measureDurationPrintToConsole(false);
-        prussdrv_pru_clear_event(PRU_EVTOUT_1, PRU1_ARM_INTERRUPT);
+        // See if any errors occurred and output them to the console if any
+        checkForPrinterErrorsPrintToConsole();
+    }
+    // See if a previously saved print job was given. All processing has been
+    // done when the job was compiled so it just needs to be transferred.
+    else if (inputJobFile) {
+        printf("Loading print job %s, transferring into PRU shared memory, " \
+                "and starting print job\n", inputJobFile);
+        if (!printJobFile(inputJobFile, NULL)) {
+            fprintf(stderr, "Invalid print job file!\n");
+            return EXIT_FAILURE;
+        }
 
         // See if any errors occurred and output them to the console if any
         checkForPrinterErrorsPrintToConsole();
     }
     // See if we are in the normal printer operating mode which means the user
-    // has provided an image filename parameter.
-    else if (optind < argc) {
-        // Let's go ahead and print the image considering any of the other
-        // command line flags that may have been set.
-        const char *imageFile = argv[optind];
-
-        printf("Loading image %s\n", imageFile);
-        if (!readPngImage(imageFile)) {
+    // has provided an image filename parameter and/or resident job macros to
+    // print.
+    else if ((optind < argc) || (headerMacroId != NO_MACRO) ||
+            (footerMacroId != NO_MACRO)) {
+        // Collect all print-related command line flags that may have been set
+        printOptions.startLine = 0;
+        printOptions.endLine = 0;
+        printOptions.inverse = inverseFlag;
+        printOptions.paperFeedCount = paperFeedCount;
+        printOptions.nrOfCopies = nrOfCopies;
+        printOptions.headerMacroId = headerMacroId;
+        printOptions.footerMacroId = footerMacroId;
+
+        // Macros can only be printed if they were stored previously. The
+        // macros of the print daemon are out of reach and get checked by
+        // the PRU instead.
+        if (!daemonSocket && (!isMacroDefined(headerMacroId) ||
+                !isMacroDefined(footerMacroId))) {
+            fprintf(stderr, "Job macro is not defined!\n");
             return EXIT_FAILURE;
         }
 
-        // Check if a start line was given and use it if it is a valid
-        // parameter. Otherwise use the first line of the image.
-        if (startLineFlag) {
-            if ((startLine < 0) || (startLine >= pngImageHeight)) {
-                fprintf(stderr, "Invalid start line!\n");
-                return EXIT_FAILURE;
+        // See if the very same image has been printed with the very same
+        // options before in which case the compiled job can be taken from the
+        // cache. The cache key is derived from the options as given on the
+        // command line since the image hasn't been looked at yet.
+        if (jobCacheDir && (optind < argc) && !defineMacroFlag &&
+                !outputJobFile) {
+            memset(&jobCacheParams, 0, sizeof(jobCacheParams));
+            jobCacheParams.startLine = startLineFlag ?
+                    startLine : PRINTER_JOB_CACHE_LINE_DEFAULT;
+            jobCacheParams.endLine = endLineFlag ?
+                    endLine : PRINTER_JOB_CACHE_LINE_DEFAULT;
+            jobCacheParams.inverse = inverseFlag;
+            jobCacheParams.paperFeedCount = paperFeedCount;
+            jobCacheParams.nrOfCopies = nrOfCopies;
+            jobCacheParams.headerMacroId = headerMacroId;
+            jobCacheParams.footerMacroId = footerMacroId;
+
+            // The key covers the contents of the image, so it takes reading
+            // the entire file
+            previousStage = enterProfileStage(PROFILE_STAGE_READ);
+            jobCacheFlag = getJobCacheKey(argv[optind], &jobCacheParams,
+                    &jobCacheKey);
+            leaveProfileStage(previousStage);
+            if (jobCacheFlag) {
+                getJobCacheFileName(jobCacheDir, jobCacheKey, jobCacheFile,
+                        sizeof(jobCacheFile));
+                printf("Looking up print job %s\n", jobCacheFile);
+                jobCacheHit = printJobFile(jobCacheFile, &jobCacheKey);
             }
         }
-        else {
-            startLine = 0;
-        }
 
-        // Check if an end line was given and use it if it is a valid
-        // parameter. Otherwise use the last line of the image.
-        if (endLineFlag) {
-            if ((endLine < 0) || (endLine >= pngImageHeight)) {
-                fprintf(stderr, "Invalid end line!\n");
+        if ((optind < argc) && !jobCacheHit) {
+            // Let's go ahead and load the image
+            const char *imageFile = argv[optind];
+            const uint64_t traceStartNs = beginTraceSpan();
+
+            printf("Loading image %s\n", imageFile);
+            previousStage = enterProfileStage(PROFILE_STAGE_DECODE);
+            if (!readPngImage(imageFile, &pngImage)) {
                 return EXIT_FAILURE;
             }
-        }
-        else {
-            endLine = pngImageHeight - 1;
-        }
+            leaveProfileStage(previousStage);
+            endTraceSpan(TRACE_HOST_DECODE, traceStartNs, pngImage.height);
+            printf("Image width = %u\n", pngImage.width);
+            printf("Image height = %u\n", pngImage.height);
+            printf("Image loaded successfully\n");
+
+            // Check if a start line was given and use it if it is a valid
+            // parameter. Otherwise use the first line of the image.
+            if (startLineFlag) {
+                if ((startLine < 0) || (startLine >= pngImage.height)) {
+                    fprintf(stderr, "Invalid start line!\n");
+                    return EXIT_FAILURE;
+                }
+            }
+            else {
+                startLine = 0;
+            }
 
-        // Make sure the parameters actually make sense
-        if (startLine > endLine) {
-            fprintf(stderr, "The start line must not be larger than the end" \
-                    " line!\n");
-            return EXIT_FAILURE;
+            // Check if an end line was given and use it if it is a valid
+            // parameter. Otherwise use the last line of the image.
+            if (endLineFlag) {
+                if ((endLine < 0) || (endLine >= pngImage.height)) {
+                    fprintf(stderr, "Invalid end line!\n");
+                    return EXIT_FAILURE;
+                }
+            }
+            else {
+                endLine = pngImage.height - 1;
+            }
+
+            // Make sure the parameters actually make sense
+            if (startLine > endLine) {
+                fprintf(stderr, "The start line must not be larger than the " \
+                        "end line!\n");
+                return EXIT_FAILURE;
+            }
+
+            // Check the width of the image. If it's too wide we'll continue
+            // with printing anyways. We just won't output the full line.
+            if (pngImage.width > PRINTER_DOTS_PER_LINE) {
+                printf("Image width exceeds the maximum number of dots " \
+                        "allowed per line! Will only be printing the first " \
+                        "%u pixels...", PRINTER_DOTS_PER_LINE);
+            }
+
+            printOptions.startLine = startLine;
+            printOptions.endLine = endLine;
         }
 
-        // Check the width of the image. If it's too wide we'll continue with
-        // printing anyways. We just won't output the full line.
-        if (pngImageWidth > PRINTER_DOTS_PER_LINE) {
-            printf("Image width exceeds the maximum number of dots allowed" \
-                    " per line! Will only be printing the first %u pixels...",
-                    PRINTER_DOTS_PER_LINE);
+        if (defineMacroFlag) {
+            // Rather than printing the image store it as a job macro in the
+            // PRU memory so that it can be printed later on without any
+            // further processing or data transfer.
+            if (!pngImage.rowPointers) {
+                fprintf(stderr, "No image given to store as job macro!\n");
+                return EXIT_FAILURE;
+            }
+
+            printf("Processing image and storing it as job macro %u\n",
+                    defineMacroId);
+            if (!defineImageMacro(defineMacroId, &printOptions)) {
+                freeImage(&pngImage);
+                return EXIT_FAILURE;
+            }
         }
+        else if (!jobCacheHit) {
+            printf("Processing image\n");
+            if (!compileImage(&printOptions, &job, &lineDict)) {
+                fprintf(stderr, "Error allocating memory for print job!\n");
+                freeImage(&pngImage);
+                return EXIT_FAILURE;
+            }
 
-        printf("Processing image, transferring into PRU shared memory, and " \
-                "starting print job\n");
-        printImage(startLine, endLine, inverseFlag, paperFeedCount);
+            // Either save the compiled job as requested or go ahead and
+            // print it. Failing to add a job to the cache is not an error--
+            // printing can go ahead regardless.
+            if (outputJobFile) {
+                printf("Saving print job %s\n", outputJobFile);
+                if (!saveJobFile(outputJobFile, &job, &lineDict, 0)) {
+                    fprintf(stderr, "Error saving print job!\n");
+                    freeJob(&job);
+                    freeImage(&pngImage);
+                    return EXIT_FAILURE;
+                }
+            }
+            else {
+                if (jobCacheFlag) {
+                    printf("Adding print job %s to the cache\n",
+                            jobCacheFile);
+                    if (!saveJobFile(jobCacheFile, &job, &lineDict,
+                            jobCacheKey)) {
+                        fprintf(stderr, "Error saving print job!\n");
+                    }
+                }
+
+                printf("Transferring into PRU shared memory and starting " \
+                        "print job\n");
+                printJob(&job, &lineDict);
+            }
+
+            freeJob(&job);
+        }
 
         // Free the PNG image from memory. It's no longer needed-- all relevant
         // data was transferred into the PRU shared memory.
-        deallocPngImage();
+        freeImage(&pngImage);
 
         // See if any errors occurred and output them to the console if any
-        checkForPrinterErrorsPrintToConsole();
+        if (!outputJobFile) {
+            checkForPrinterErrorsPrintToConsole();
+        }
     }
     // Looks like no command line parameters or an invalid combination thereof
     // was encountered...
     else {
         // Print the usage info to the console and exit with error
-        fprintf(stderr, USAGE_STRING, argv[0], argv[0], argv[0]);
+        fprintf(stderr, USAGE_STRING, argv[0], argv[0], argv[0], argv[0],
+                argv[0], argv[0], argv[0], argv[0]);
         return EXIT_FAILURE;
     }
 
+    // Show where the time went. Benchmarks print their own results and the
+    // test pattern generation doesn't return.
+    if (!benchmarkName && !testFlag) {
+        printProfileToConsole(profileJsonFlag);
+    }
+
+    // There is no PRU to disable when the print daemon did the printing
+    if (daemonSocket) {
+        return EXIT_SUCCESS;
+    }
+
+    if (traceFile) {
+        printf("Writing trace %s\n", traceFile);
+        stopTrace(traceFile);
+    }
+
     if (waitFlag) {
-        printf("Press ENTER to disable the PRU and end the program...\n");
+        printf("Press ENTER to end the program...\n");
         getchar();
     }
 
-    disablePru();
+    // Leave the firmware running so that the next invocation can attach to it
+    // unless told otherwise. The test pattern generation never returns to the
+    // idle loop though, so the PRU is always disabled in that case.
+    if (disableFlag || testFlag) {
+        disablePru();
+    }
+    else {
+        detachPru();
+    }
 
-    return EXIT_SUCCESS;
+    return jobFailed ? EXIT_FAILURE : EXIT_SUCCESS;
 }
 
-static bool initPru(void) {
-    tpruss_intc_initdata pruss_intc_initdata = PRUSS_INTC_INITDATA;
-
+static bool initPru(const char *transportName, const bool forceReload,
+        const char *firmwareFile) {
+    PRINTER_FirmwareInfo *fwInfo;
+    PRINTER_Firmware firmware;
+    PRINTER_FirmwareLoadInfo loadInfo;
+    PRINTER_FirmwareState fwState = PRINTER_FW_MISSING;
+    void *image = NULL;
+    uint32_t imageLength = 0;
+    uint32_t imageHash;
+    bool success;
+
+    // Connect to the PRU and get pointers to its memories. The printer queue
+    // lives in the shared PRUSS memory, the line dictionary gets uploaded to
+    // the PRU1 data RAM and the resident job macros are held in the PRU0 data
+    // RAM. The transport stays locked against other processes until it gets
+    // closed again.
     printf("Initializing PRU\n");
-    prussdrv_init();
-
-    // Open PRU driver and prepare for using the interrupt on event output 1
-    if (prussdrv_open(PRU_EVTOUT_1)) {
-        fprintf(stderr, "prussdrv_open failed!\n");
+    if (!openTransport(&transport, transportName)) {
+        fprintf(stderr, "Opening transport %s failed!\n", transportName);
         return false;
     }
-
-    // Initialize the PRUSS interrupt controller
-    if (prussdrv_pruintc_init(&pruss_intc_initdata)) {
-        fprintf(stderr, "prussdrv_pruintc_init failed!\n");
-        return false;
+    queue = transport.queue;
+    pruDataRam = transport.pruDataRam;
+    macroStore = transport.macroStore;
+
+    // See if the very same firmware is already up and running, for example
+    // because it has been left behind by a previous invocation. Attaching to
+    // it saves reloading the firmware, which would reset the printer state
+    // such as the motor position and keep the printer head from staying warm.
+    fwInfo = (PRINTER_FirmwareInfo *)
+            ((uint8_t *)pruDataRam + PRINTER_FW_INFO_OFFSET);
+    if (firmwareFile) {
+        image = mapFirmwareFile(firmwareFile, &imageLength);
+        if (!image) {
+            closeTransport(&transport, false);
+            return false;
+        }
     }
+    imageHash = getFirmwareImageHash(image, imageLength);
+    if (!forceReload) {
+        fwState = getFirmwareState(fwInfo, imageHash);
+    }
+    if (fwState != PRINTER_FW_MISSING) {
+        if (image) {
+            munmap(image, imageLength);
+        }
 
-    // Get pointer to the shared PRUSS memory. On the AM355x this block is 12KB
-    // in size and located locally at 0x0001_0000 within the PRU cores and
-    // globally at 0x4A31_0000 in the MPU's memory map. The entire memory is
-    // used as our printer queue so we map the global variable to that address.
-    prussdrv_map_prumem(PRUSS0_SHARED_DATARAM, (void *)&queue);
+        // A busy firmware is in the middle of a job that was left behind by
+        // a process that went away without finishing it. Reloading would cut
+        // the job short, possibly with the printer head powered, so that is
+        // left to the user.
+        if (fwState == PRINTER_FW_BUSY) {
+            fprintf(stderr, "PRU firmware is busy with another job! Use -R " \
+                    "to reload it anyway.\n");
+            closeTransport(&transport, false);
+            return false;
+        }
 
-    // Initialize the PRU from an array in memory rather than from a file on
-    // disk. Make sure PRU sub system is first disabled/reset. Then, transfer
-    // the program into the PRU. Note that the write memory functions expect
-    // the offsets to be provided in words so we our byte-addresses by four.
+        printf("Attaching to running PRU firmware\n");
+
+        // Don't let errors of an earlier job linger around
+        queue->status.all = 0;
+        return true;
+    }
+
+    // Load the firmware with the PRU disabled and have it verified. The
+    // firmware info block gets invalidated and tagged with the hash of the
+    // image before the firmware starts up and announces itself. Unless a file
+    // image is given the firmware built into the program is loaded.
     printf("Loading PRU firmware and enabling PRU\n");
-    prussdrv_pru_disable(1);
-    prussdrv_pru_write_memory(PRUSS0_PRU1_IRAM, pruprinter_fw_iram_start / 4,
-            (unsigned int *)&pruprinter_fw_iram, pruprinter_fw_iram_length);
-    prussdrv_pru_write_memory(PRUSS0_PRU1_DATARAM, pruprinter_fw_dram_start / 4,
-            (unsigned int *)&pruprinter_fw_dram, pruprinter_fw_dram_length);
-    prussdrv_pru_enable(1);
+    memset(&firmware, 0, sizeof(firmware));
+    firmware.image = image;
+    firmware.imageLength = imageLength;
+    firmware.iram = &pruprinter_fw_iram;
+    firmware.iramStart = pruprinter_fw_iram_start;
+    firmware.iramLength = pruprinter_fw_iram_length;
+    firmware.dram = &pruprinter_fw_dram;
+    firmware.dramStart = pruprinter_fw_dram_start;
+    firmware.dramLength = pruprinter_fw_dram_length;
+    success = loadTransportFirmware(&transport, &firmware, &loadInfo);
+    if (image) {
+        munmap(image, imageLength);
+    }
+    if (!success) {
+        fprintf(stderr, "Loading PRU firmware failed!\n");
+        closeTransport(&transport, true);
+        return false;
+    }
+    printf("Loaded %u bytes of code and %u bytes of data in %u us\n",
+            loadInfo.iramBytes, loadInfo.dramBytes, loadInfo.loadTimeUs);
+    fwInfo->magic = 0;
+    fwInfo->imageHash = imageHash;
+    __sync_synchronize();
+    if (!startTransportPru(&transport)) {
+        fprintf(stderr, "Starting PRU failed!\n");
+        closeTransport(&transport, true);
+        return false;
+    }
 
     return true;
 }
 
-static void disablePru(void) {
-    printf("Disabling PRU and closing memory mapping\n");
-    prussdrv_pru_disable(1);
-    prussdrv_exit();
-}
-
-static bool readPngImage(const char *fileName) {
-    FILE *fp;
-    unsigned char pngSignature[8];      // The PNG signature is 8 bytes long
-    png_byte bitDepth;
-    png_structp png_ptr;
-    png_infop info_ptr;
-    uint32_t y;
-
-    // Open image file
-    fp = fopen(fileName, "rb");
-    if (!fp) {
-        fprintf(stderr, "File could not be opened for reading!\n");
-        return false;
+// Map a firmware image file into memory so it can be hashed and loaded
+// without copying it around
+static void *mapFirmwareFile(const char *fileName, uint32_t *length) {
+    struct stat fileStat;
+    void *image;
+    int fd;
+
+    fd = open(fileName, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Could not open firmware file %s!\n", fileName);
+        return NULL;
     }
 
-    // Test image file for being a PNG by evaluating its header
-    fread(pngSignature, 1, sizeof(pngSignature), fp);
-    if (png_sig_cmp(pngSignature, 0, sizeof(pngSignature))) {
-        fprintf(stderr, "File not recognized as a PNG file!\n");
-        return false;
+    if (fstat(fd, &fileStat) || fileStat.st_size == 0) {
+        fprintf(stderr, "Could not read firmware file %s!\n", fileName);
+        close(fd);
+        return NULL;
     }
 
-    // Initialize libpng in preparation for reading the image
-    png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-    if (!png_ptr) {
-        fprintf(stderr, "Error during during PNG initialization!\n");
-        return false;
+    image = mmap(NULL, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED) {
+        fprintf(stderr, "Could not map firmware file %s!\n", fileName);
+        return NULL;
     }
 
-    info_ptr = png_create_info_struct(png_ptr);
-    if (!info_ptr) {
-        fprintf(stderr, "Error during during PNG initialization!\n");
-        return false;
+    *length = fileStat.st_size;
+    return image;
+}
+
+// Determine the hash identifying a firmware image. If no image is given the
+// hash covers both the instruction and the data RAM image of the firmware
+// that is built into the program.
+static uint32_t getFirmwareImageHash(const void *image, const uint32_t length) {
+    uint64_t hash;
+
+    if (image) {
+        hash = hashBytes64(image, length, HASH64_SEED);
+    }
+    else {
+        hash = hashBytes64(&pruprinter_fw_iram, pruprinter_fw_iram_length,
+                HASH64_SEED);
+        hash = hashBytes64(&pruprinter_fw_dram, pruprinter_fw_dram_length,
+                hash);
     }
 
-    if (setjmp(png_jmpbuf(png_ptr))) {
-        fprintf(stderr, "Error during during PNG initialization!\n");
-        return false;
+    return (uint32_t)(hash ^ (hash >> 32));
+}
+
+// See if the firmware that is running on the PRU is the one built into the
+// program and whether it is waiting for a job. The firmware proves the latter
+// by increasing the idle count of its info block, which it only does while
+// sitting in its idle loop.
+static PRINTER_FirmwareState getFirmwareState(
+        const PRINTER_FirmwareInfo *info, const uint32_t imageHash) {
+    uint32_t idleCount;
+    uint32_t elapsedUs;
+
+    if (readPruWord(&info->magic) != PRINTER_FW_INFO_MAGIC ||
+            readPruWord(&info->buildId) != PRINTER_FW_BUILD_ID ||
+            readPruWord(&info->imageHash) != imageHash) {
+        return PRINTER_FW_MISSING;
     }
 
-    png_init_io(png_ptr, fp);
-    png_set_sig_bytes(png_ptr, 8);
-    png_read_info(png_ptr, info_ptr);
+    idleCount = readPruWord(&info->idleCount);
+    for (elapsedUs = 0; elapsedUs < PRU_ATTACH_TIMEOUT_US;
+            elapsedUs += PRU_ATTACH_POLL_US) {
+        usleep(PRU_ATTACH_POLL_US);
+        if (readPruWord(&info->idleCount) != idleCount) {
+            return PRINTER_FW_IDLE;
+        }
+    }
 
-    // Read important image parameters and store them in local/global variables
-    pngImageWidth = png_get_image_width(png_ptr, info_ptr);
-    pngImageHeight = png_get_image_height(png_ptr, info_ptr);
-    bitDepth = png_get_bit_depth(png_ptr, info_ptr);
+    return PRINTER_FW_BUSY;
+}
 
-    printf("Image width = %u\n", pngImageWidth);
-    printf("Image height = %u\n", pngImageHeight);
+static void disablePru(void) {
+    PRINTER_FirmwareInfo *fwInfo = (PRINTER_FirmwareInfo *)
+            ((uint8_t *)pruDataRam + PRINTER_FW_INFO_OFFSET);
 
-    if (bitDepth != 1) {
-        fprintf(stderr, "Only monochrome images (1-bit) are allowed! Provided" \
-                " image is %u bits deep.\n", bitDepth);
-        return false;
-    }
+    // A stopped firmware mustn't be taken for one that is busy with a job
+    printf("Disabling PRU and closing memory mapping\n");
+    fwInfo->magic = 0;
+    __sync_synchronize();
+    closeTransport(&transport, true);
+}
 
-    // Enable the interlace handling and updates the structure pointed to by
-    // info_ptr to reflect any transformations that have been requested.
-    png_set_interlace_handling(png_ptr);
-    png_read_update_info(png_ptr, info_ptr);
+// Close the memory mapping but leave the firmware running idle so that it can
+// be attached to later on
+static void detachPru(void) {
+    printf("Detaching from PRU and closing memory mapping\n");
+    closeTransport(&transport, false);
+}
 
-    // Allocate memory to hold an array of pointers that point to the respective
-    // row image data
-    if (pngImageRowPointers) {
-        fprintf(stderr, "Error allocating memory for image. Was the last " \
-                "image loaded deallocated properly?\n");
+// Print the statistics the firmware keeps about the time each phase of its
+// work takes. The PRU memories are only looked at, so the firmware doesn't
+// notice and carries on with whatever it is doing.
+static bool printFirmwareStats(const char *transportName) {
+    static const char * const phaseNames[PRINTER_NR_OF_PHASES] = {
+        "dispatch",
+        "shift-out",
+        "latch",
+        "strobe-1",
+        "strobe-23",
+        "strobe-4",
+        "strobe-56",
+        "motor-wait",
+        "thermal-check",
+        "paper-check"
+    };
+    const PRINTER_FirmwareInfo *fwInfo;
+    PRINTER_PhaseStats stats;
+    uint64_t totalCycles;
+    uint64_t stallCycles;
+    double avgCycles;
+    uint32_t i;
+
+    if (!openTransportMonitor(&transport, transportName)) {
+        fprintf(stderr, "Opening transport %s failed!\n", transportName);
         return false;
     }
-    pngImageRowPointers = (png_bytep *)malloc(sizeof(png_bytep) * pngImageHeight);
-    if (!pngImageRowPointers) {
-        fprintf(stderr, "Error allocating memory for image!\n");
+
+    // The statistics are only meaningful if they come from a firmware that
+    // lays them out the way we expect
+    fwInfo = (const PRINTER_FirmwareInfo *)
+            ((uint8_t *)transport.pruDataRam + PRINTER_FW_INFO_OFFSET);
+    if (readPruWord(&fwInfo->magic) != PRINTER_FW_INFO_MAGIC ||
+            readPruWord(&fwInfo->buildId) != PRINTER_FW_BUILD_ID) {
+        fprintf(stderr, "No matching PRU firmware is running!\n");
+        closeTransport(&transport, false);
         return false;
     }
 
-    // Allocate an individual block of memory for each row of the image. Note that
-    // this function assumes a 1 bit-per-pixel image. If an image is to be read
-    // with greater color depth the amount of memory that is allocated needs to
-    // be increased.
-    for (y = 0; y < pngImageHeight; y++) {
-        if (pngImageRowPointers[y]) {
-            fprintf(stderr, "Error allocating memory for image. Was the last " \
-                    "image loaded deallocated properly?\n");
+    printf("PRU firmware statistics (cycles at %u MHz)\n", PRU_CLOCK_MHZ);
+    printf("%-14s %10s %10s %10s %10s %10s %7s\n", "Phase", "Count", "Min",
+            "Avg", "Max", "Avg [us]", "Stall");
+    for (i = 0; i < PRINTER_NR_OF_PHASES; i++) {
+        if (!readPhaseStats(&transport.queue->stats.phases[i], &stats)) {
+            fprintf(stderr, "Statistics of phase %s keep changing!\n",
+                    phaseNames[i]);
+            closeTransport(&transport, false);
             return false;
         }
-        pngImageRowPointers[y] = (png_byte *)malloc((pngImageWidth + 7) / 8);
-        if (!pngImageRowPointers[y]) {
-            fprintf(stderr, "Error allocating memory for image!\n");
-            return false;
+
+        if (!stats.count) {
+            printf("%-14s %10u %10s %10s %10s %10s %7s\n", phaseNames[i], 0,
+                    "-", "-", "-", "-", "-");
+            continue;
         }
-    }
 
-    // Establish an error handler for issues during the upcoming file operation
-    if (setjmp(png_jmpbuf(png_ptr))) {
-           fprintf(stderr, "Error during png_read_image!\n");
-           return false;
+        totalCycles = (uint64_t)stats.totalCyclesHigh << 32 |
+                stats.totalCyclesLow;
+        stallCycles = (uint64_t)stats.stallCyclesHigh << 32 |
+                stats.stallCyclesLow;
+        avgCycles = (double)totalCycles / stats.count;
+        printf("%-14s %10u %10u %10.0f %10u %10.2f %6.1f%%\n", phaseNames[i],
+                stats.count, stats.minCycles, avgCycles, stats.maxCycles,
+                avgCycles / PRU_CLOCK_MHZ,
+                totalCycles ? 100.0 * stallCycles / totalCycles : 0.0);
     }
 
-    // Read the entire PNG image into memory
-    png_read_image(png_ptr, pngImageRowPointers);
-
-    fclose(fp);
-
-    printf("Image loaded successfully\n");
+    closeTransport(&transport, false);
 
     return true;
 }
 
-static void deallocPngImage(void) {
-    uint32_t y;
-
-    // Free the memory used for each line of image data
-    for (y = 0; y < pngImageHeight; y++) {
-        free(pngImageRowPointers[y]);
-        pngImageRowPointers[y] = NULL;
+// Read the statistics of a phase while the firmware might be updating them.
+// They are read twice in a row until both readings agree, which they don't if
+// the firmware got in between.
+static bool readPhaseStats(const PRINTER_PhaseStats *source,
+        PRINTER_PhaseStats *stats) {
+    const uint32_t nrOfWords = sizeof(PRINTER_PhaseStats) / sizeof(uint32_t);
+    uint32_t first[sizeof(PRINTER_PhaseStats) / sizeof(uint32_t)];
+    uint32_t second[sizeof(PRINTER_PhaseStats) / sizeof(uint32_t)];
+    uint32_t attempt;
+    uint32_t i;
+
+    for (attempt = 0; attempt < STATS_READ_ATTEMPTS; attempt++) {
+        for (i = 0; i < nrOfWords; i++) {
+            first[i] = readPruWord((const uint32_t *)source + i);
+        }
+        for (i = 0; i < nrOfWords; i++) {
+            second[i] = readPruWord((const uint32_t *)source + i);
+        }
+        if (!memcmp(first, second, sizeof(first))) {
+            memcpy(stats, first, sizeof(*stats));
+            return true;
+        }
     }
 
-    // Free the memory used for the array that holds the row pointers
-    free(pngImageRowPointers);
-    pngImageRowPointers = NULL;
+    return false;
 }
 
 static void initQueueJobItems(void) {
@@ -439,35 +1024,29 @@ static void initQueueJobItems(void) {
     // reserved to hold print job data.
     jobItemsMaxAddress =
             (uint8_t *)&queue->jobItems + sizeof(queue->jobItems) - 1;
-}
 
-static bool queueHasJobItems(void) {
-    // Check if there are any job items in the printer queue and return true if
-    // that's the case.
-    return jobItem != (PRINTER_JobItem *)&queue->jobItems;
+    // Items added this way are not streamed. Consider the entire queue as
+    // published so that PRU1 never waits for more, and don't have it raise
+    // any watermark events.
+    queue->progress.producedBytes = sizeof(queue->jobItems);
+    queue->progress.consumedBytes = 0;
+    queue->progress.lowWatermark = 0;
+    queue->progress.keepWarmMs = 0;
+    queue->progress.linesPrinted = 0;
+    queue->progress.busyPoll = 0;
 }
 
 static void addJobItemToQueue(const uint32_t command, const uint32_t length,
         const uint8_t data[]) {
+    const PROFILE_Stage previousStage = enterProfileStage(PROFILE_STAGE_COPY);
+
     // Add the currently requested command to the queue. If this fails (and it
     // can in case the memory is full) then we print what's currently in the
     // queue, re-initialize the queue, and try again.
     while (!addJobItemToQueueLowLevel(command, length, data)) {
-        // The interrupt is mapped via INTC to channel 1
-        printf("Initiating section printing\n");
-        prussdrv_pru_send_event(ARM_PRU1_INTERRUPT);
-
-        // Wait until PRU1 has finished execution and acknowledge the interrupt.
-        // The INTC config maps PRU1_ARM_INTERRUPT to EVTOUT_1.
-        printf("Waiting for printer driver...\n");
-        measureDurationPrintToConsole(true);
-        prussdrv_pru_wait_event(PRU_EVTOUT_1);
-        measureDurationPrintToConsole(false);
-        prussdrv_pru_clear_event(PRU_EVTOUT_1, PRU1_ARM_INTERRUPT);
-
-        // Initialize printer job item queue to be ready to be filled again
-        initQueueJobItems();
+        flushQueue();
     }
+    leaveProfileStage(previousStage);
 }
 
 static bool addJobItemToQueueLowLevel(const uint32_t command,
@@ -505,151 +1084,367 @@ static bool addJobItemToQueueLowLevel(const uint32_t command,
     return true;
 }
 
-static void printImage(const uint32_t startLine, const uint32_t endLine,
-        const bool inverse, const uint32_t paperFeedCountAfterPrint) {
-    uint32_t y;
+static bool compileImage(const PRINTER_PrintOptions *options,
+        PRINTER_Job *job, PRINTER_LineDictionary *lineDict) {
+    PRINTER_Job copyJob;
+    PRINTER_JobOptimizerStats optimizerStats;
+    PROFILE_Stage previousStage;
+    uint64_t traceStartNs;
+    bool success = true;
+    uint32_t i;
+
+    // Assemble everything that makes up a single copy in host memory first.
+    // This is the header macro, the image itself, the footer macro, and the
+    // paper feed after printing in that order.
+    if (!initJob(&copyJob)) {
+        return false;
+    }
 
-    // Initialize the printer queue and add the command to perform the low-level
-    // initializations needed before we can start printing.
-    initQueueJobItems();
-    addJobItemToQueue(PRINTER_CMD_OPEN, 0, NULL);
+    if (options->headerMacroId != NO_MACRO) {
+        success &= addJobItem(&copyJob, PRINTER_CMD_CALL_MACRO,
+                sizeof(uint32_t), &options->headerMacroId);
+    }
 
-    // Generate the print job and fill the printer queue line by line
-    for (y = startLine; y < endLine; y++) {
-        partitionLineAndPrint(pngImageRowPointers[y], pngImageWidth, inverse);
+    if (pngImage.rowPointers) {
+        previousStage = enterProfileStage(PROFILE_STAGE_PARTITION);
+        traceStartNs = beginTraceSpan();
+        success &= addImageLines(&copyJob, &pngImage, options->startLine,
+                options->endLine, options->inverse);
+        endTraceSpan(TRACE_HOST_PARTITION, traceStartNs,
+                options->endLine - options->startLine);
+        leaveProfileStage(previousStage);
     }
 
-    // See if a paper feed after printing was requested and add it to the queue
-    if (paperFeedCountAfterPrint) {
-        addJobItemToQueue(PRINTER_CMD_MOTOR_HALF_STEP, sizeof(uint32_t),
-                (const uint8_t *)&paperFeedCountAfterPrint);
+    if (options->footerMacroId != NO_MACRO) {
+        success &= addJobItem(&copyJob, PRINTER_CMD_CALL_MACRO,
+                sizeof(uint32_t), &options->footerMacroId);
     }
 
-    // Close out the print job properly including a shutdown of the PRU that
-    // is no longer needed.
-    addJobItemToQueue(PRINTER_CMD_CLOSE, 0, NULL);
-    addJobItemToQueue(PRINTER_CMD_REQUEST_PRU_HALT, 0, NULL);
-    addJobItemToQueue(PRINTER_CMD_EOS, 0, NULL);
+    // See if a paper feed after printing was requested and add it to the job
+    if (options->paperFeedCount) {
+        success &= addJobItem(&copyJob, PRINTER_CMD_MOTOR_HALF_STEP,
+                sizeof(uint32_t), &options->paperFeedCount);
+    }
 
-    // See if there are still job items in the queue and print them if that's
-    // the case (which is most likely).
-    if (queueHasJobItems()) {
-        // The interrupt is mapped via INTC to channel 1
-        printf("Initiating section printing\n");
-        prussdrv_pru_send_event(ARM_PRU1_INTERRUPT);
+    if (!success || !initJob(job)) {
+        freeJob(&copyJob);
+        return false;
+    }
 
-        // Wait until PRU1 has finished execution and acknowledge the interrupt.
-        // The INTC config maps PRU1_ARM_INTERRUPT to EVTOUT_1.
-        printf("Waiting for printer driver...\n");
-        measureDurationPrintToConsole(true);
-        prussdrv_pru_wait_event(PRU_EVTOUT_1);
-        measureDurationPrintToConsole(false);
-        prussdrv_pru_clear_event(PRU_EVTOUT_1, PRU1_ARM_INTERRUPT);
+    // Run the copy through the optimizer pipeline before it ever gets touched
+    // by the PRU.
+    optimizeJob(&copyJob, &optimizerStats);
+    printJobOptimizerStatsToConsole(&optimizerStats);
+
+    // Start out with the command to perform the low-level initializations
+    // needed before we can start printing. Then add the requested number of
+    // copies. If a copy fits into the printer queue in its entirety it gets
+    // transferred only once and the firmware loops over it. Otherwise it
+    // needs to be repeated within the job.
+    success &= addJobItem(job, PRINTER_CMD_OPEN, 0, NULL);
+    if ((options->nrOfCopies > 1) && (copyJob.size + 4 *
+            PRINTER_JOB_ITEM_SIZE(sizeof(uint32_t)) <=
+            sizeof(queue->jobItems))) {
+        success &= addJobItem(job, PRINTER_CMD_LOOP, sizeof(uint32_t),
+                &options->nrOfCopies);
+        success &= appendJob(job, &copyJob);
+        success &= addJobItem(job, PRINTER_CMD_END_LOOP, 0, NULL);
     }
+    else {
+        for (i = 0; i < options->nrOfCopies; i++) {
+            success &= appendJob(job, &copyJob);
+        }
+    }
+
+    // Close out the print job properly. The PRU is left running so that the
+    // job can be followed by others, in particular when it gets printed by
+    // the print daemon.
+    success &= addJobItem(job, PRINTER_CMD_CLOSE, 0, NULL);
+
+    freeJob(&copyJob);
+
+    if (!success) {
+        freeJob(job);
+        return false;
+    }
+
+    // Move passes that occur repeatedly into the line dictionary
+    if (!buildLineDictionary(job, lineDict)) {
+        freeJob(job);
+        return false;
+    }
+    printLineDictionaryStatsToConsole(lineDict);
+
+    return true;
 }
 
-// TODO: Balance number of black dots per line if line needs to be partitioned
-static void partitionLineAndPrint(const uint8_t dotData[],
-        const uint16_t length, const bool inverse) {
-    uint8_t byteIndex;
-    uint16_t bitIndex;
-    uint8_t bitValue;
-    bool dotValue;
-    uint16_t blackDotCounter = 0;
-    uint8_t dotBuffer[PRINTER_BYTES_PER_LINE];
-
-    // Clear out the line of of data we are about to print so that we can
-    // properly print images which are smaller than PRINTER_BYTES_PER_LINE
-    // without any random garbage getting added.
-    memset(&dotBuffer, 0, sizeof(dotBuffer));
-
-    // Iterate through all bytes in one line
-    for (byteIndex = 0, bitIndex = 0; byteIndex < PRINTER_BYTES_PER_LINE;
-            byteIndex++) {
-        // Iterate through all bits in each pixel-data byte while counting
-        // each dot that is being processed
-        for (bitValue = 0x80; (bitValue != 0x00) && (bitIndex < length);
-                bitValue >>= 1, bitIndex++) {
-            // Check for a set dot in the source data and invert if needed
-            dotValue = dotData[byteIndex] & bitValue;
-            dotValue ^= inverse;
-            // If resulting dot is set then copy source bits to the output
-            // buffer bit-by-bit.
-            if (dotValue) {
-                dotBuffer[byteIndex] |= bitValue;
-                blackDotCounter++;
-                // If we reach the maximum number of black dots allowed per
-                // line we will print out the actual line, clear the buffer, and
-                // reset the counter and continue to accumulate black dots to be
-                // printed out in the next line that is output (which will get
-                // printed into the same physical line).
-                if (blackDotCounter >= PRINTER_MAX_BLACK_DOTS_PER_LINE) {
-                    addJobItemToQueue(PRINTER_CMD_PRINT_LINE,
-                            PRINTER_BYTES_PER_LINE, (const uint8_t *)dotBuffer);
-                    memset(&dotBuffer, 0, sizeof(dotBuffer));
-                    blackDotCounter = 0;
-                }
-            }
-        }
+static void printJob(const PRINTER_Job *job,
+        const PRINTER_LineDictionary *lineDict) {
+    PROFILE_Stage previousStage;
+
+    if (daemonSocket) {
+        submitJobToDaemon(job, lineDict, NULL);
+        return;
+    }
+
+    // Upload the line dictionary and transfer the job into the printer queue
+    previousStage = enterProfileStage(PROFILE_STAGE_COPY);
+    uploadLineDictionary(lineDict, pruDataRam);
+    leaveProfileStage(previousStage);
+    submitJob(job);
+}
+
+static bool printJobFile(const char *filename, const uint64_t *key) {
+    PRINTER_JobFile jobFile;
+    PROFILE_Stage previousStage;
+    bool success;
+
+    // Map the job file and print it right out of the mapping. A key may be
+    // given to make sure the file is the one that was expected.
+    previousStage = enterProfileStage(PROFILE_STAGE_READ);
+    success = openJobFile(filename, &jobFile);
+    leaveProfileStage(previousStage);
+    if (!success) {
+        return false;
+    }
+
+    if (key && (jobFile.header->key != *key)) {
+        closeJobFile(&jobFile);
+        return false;
     }
 
-    // Check if there are any black dots that haven't been printed yet (which
-    // will most likely be the case), and if so go ahead and print them.
-    if (blackDotCounter) {
-        addJobItemToQueue(PRINTER_CMD_PRINT_LINE, PRINTER_BYTES_PER_LINE,
-                (const uint8_t *)dotBuffer);
+    // The print daemon maps the very same file on its own
+    if (daemonSocket) {
+        submitJobToDaemon(NULL, NULL, filename);
+    }
+    else {
+        printJob(&jobFile.job, &jobFile.lineDict);
     }
+    closeJobFile(&jobFile);
 
-    // After all dots have been output its finally time to issue a command to
-    // advance the stepper motor to the next physical line.
-    const uint32_t nrOfHalfSteps = 1;
-    addJobItemToQueue(PRINTER_CMD_MOTOR_HALF_STEP, sizeof(uint32_t),
-            (const uint8_t *)&nrOfHalfSteps);
+    return true;
 }
 
-void measureDurationPrintToConsole(bool start) {
-    static struct timeval startTime;
-    struct timeval endTime;
-    __time_t seconds;
-    __suseconds_t useconds;
-    uint64_t mseconds;
+static bool defineImageMacro(const uint32_t macroId,
+        const PRINTER_PrintOptions *options) {
+    PRINTER_Job bodyJob;
+    PRINTER_Job job;
+    PRINTER_JobOptimizerStats optimizerStats;
+    uint32_t *payload;
+    uint32_t availableBytes;
+    PROFILE_Stage previousStage;
+    uint64_t traceStartNs;
+    bool success = true;
+
+    if (macroId >= PRINTER_MAX_MACROS) {
+        fprintf(stderr, "Invalid job macro ID!\n");
+        return false;
+    }
+
+    // Assemble the macro body. Unlike regular jobs it doesn't get processed
+    // by the line dictionary since the dictionary only lives for the duration
+    // of one print job whereas the macro stays resident.
+    if (!initJob(&bodyJob)) {
+        fprintf(stderr, "Error allocating memory for print job!\n");
+        return false;
+    }
+    previousStage = enterProfileStage(PROFILE_STAGE_PARTITION);
+    traceStartNs = beginTraceSpan();
+    success &= addImageLines(&bodyJob, &pngImage, options->startLine,
+            options->endLine, options->inverse);
+    endTraceSpan(TRACE_HOST_PARTITION, traceStartNs,
+            options->endLine - options->startLine);
+    leaveProfileStage(previousStage);
+    if (options->paperFeedCount) {
+        success &= addJobItem(&bodyJob, PRINTER_CMD_MOTOR_HALF_STEP,
+                sizeof(uint32_t), &options->paperFeedCount);
+    }
+    if (!success) {
+        fprintf(stderr, "Error allocating memory for print job!\n");
+        freeJob(&bodyJob);
+        return false;
+    }
+    optimizeJob(&bodyJob, &optimizerStats);
+    printJobOptimizerStatsToConsole(&optimizerStats);
+
+    // Check that the body fits into the macro store next to all other macros,
+    // taking into account that the firmware terminates each body with an end-
+    // of-sequence command. Any previous definition of the same macro will be
+    // replaced and thus doesn't count.
+    availableBytes = sizeof(macroStore->bodies) - PRINTER_JOB_ITEM_SIZE(0);
+    if (macroStore->magic == PRINTER_MACRO_STORE_MAGIC) {
+        availableBytes -= macroStore->usedBytes - macroStore->length[macroId];
+    }
+    if (bodyJob.size > availableBytes) {
+        fprintf(stderr, "Job macro exceeds the available macro memory " \
+                "(%u of %u bytes)!\n", bodyJob.size, availableBytes);
+        freeJob(&bodyJob);
+        return false;
+    }
 
-    // When the start flag is set the function captures the current system time.
-    // When called again with the start flag cleared it will output the time
-    // difference from the last call to the console.
-    if (start) {
-        gettimeofday(&startTime, NULL);
+    // The payload of the define command is the macro ID followed by the body
+    payload = (uint32_t *)malloc(sizeof(uint32_t) + bodyJob.size);
+    if (!payload || !initJob(&job)) {
+        fprintf(stderr, "Error allocating memory for print job!\n");
+        free(payload);
+        freeJob(&bodyJob);
+        return false;
+    }
+    payload[0] = macroId;
+    memcpy(&payload[1], bodyJob.data, bodyJob.size);
+
+    success &= addJobItem(&job, PRINTER_CMD_DEFINE_MACRO,
+            sizeof(uint32_t) + bodyJob.size, payload);
+    if (success) {
+        submitJob(&job);
+        success = !jobFailed;
     }
     else {
-        gettimeofday(&endTime, NULL);
-        seconds = endTime.tv_sec - startTime.tv_sec;
-        useconds = endTime.tv_usec - startTime.tv_usec;
-        mseconds = (uint64_t)seconds * 1000 + useconds / 1000;
-        printf("Elapsed time: %llu ms\n", mseconds);
+        fprintf(stderr, "Error allocating memory for print job!\n");
+    }
+
+    free(payload);
+    freeJob(&bodyJob);
+    freeJob(&job);
+
+    return success;
+}
+
+static bool isMacroDefined(const int32_t macroId) {
+    // Not using a macro at all is fine, too
+    if (macroId == NO_MACRO) {
+        return true;
     }
+
+    // Look directly into the macro store the firmware maintains in the PRU0
+    // data RAM. It is only valid once the firmware has initialized it.
+    return (macroId >= 0) && (macroId < PRINTER_MAX_MACROS) &&
+            (macroStore->magic == PRINTER_MACRO_STORE_MAGIC) &&
+            macroStore->length[macroId];
+}
+
+static void submitJob(const PRINTER_Job *job) {
+    PRINTER_Session session;
+    PROFILE_Stage previousStage;
+
+    // Hand the job over to a print session which streams it through the
+    // printer queue. There is nothing else to do in the meantime so simply
+    // wait for the session until the job is done.
+    jobFailed = true;
+    if (!initSession(&session, &transport, NULL, NULL)) {
+        fprintf(stderr, "Error initializing print session!\n");
+        return;
+    }
+
+    printf("Starting print job and waiting for printer driver...\n");
+    previousStage = enterProfileStage(PROFILE_STAGE_WAIT);
+    if (!submitJobAsync(&session, job, syncMode)) {
+        fprintf(stderr, "Error starting print job!\n");
+    }
+    else {
+        jobFailed = false;
+        while (!isSessionIdle(&session)) {
+            if (!waitSession(&session, -1)) {
+                fprintf(stderr, "Error waiting for printer driver!\n");
+                jobFailed = true;
+                break;
+            }
+        }
+    }
+    leaveProfileStage(previousStage);
+
+    closeSession(&session);
+    jobStatus = queue->status;
+}
+
+static void submitJobToDaemon(const PRINTER_Job *job,
+        const PRINTER_LineDictionary *lineDict, const char *filename) {
+    PRINTER_DaemonResponse response;
+    PROFILE_Stage previousStage;
+    bool success;
+    int fd;
+
+    // Hand either the given job or the given job file over to the print
+    // daemon and wait for it to be printed. Not being able to print at all
+    // is fatal.
+    printf("Handing print job to print daemon and waiting for it...\n");
+    previousStage = enterProfileStage(PROFILE_STAGE_IDLE);
+    if (filename) {
+        fd = open(filename, O_RDONLY);
+        success = (fd >= 0) && sendJobFileToDaemon(daemonSocket, fd,
+                syncMode, &response);
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+    else {
+        success = sendJobToDaemon(daemonSocket, job, lineDict, syncMode,
+                &response);
+    }
+    leaveProfileStage(previousStage);
+
+    if (!success) {
+        fprintf(stderr, "Error communicating with print daemon at %s!\n",
+                daemonSocket);
+        exit(EXIT_FAILURE);
+    }
+
+    if (response.result != PRINTER_DAEMON_RESULT_OK) {
+        fprintf(stderr, "Print job rejected by print daemon!\n");
+        exit(EXIT_FAILURE);
+    }
+
+    jobStatus = response.status;
+}
+
+static void flushQueue(void) {
+    PROFILE_Stage previousStage;
+
+    // Terminate what's currently in the queue
+    jobItem->command = PRINTER_CMD_EOS;
+    jobItem->length = 0;
+
+    // Everything that has been copied into the PRU memories needs to have
+    // landed before the PRU gets signaled
+    releasePruMemory();
+
+    printf("Initiating section printing\n");
+    previousStage = enterProfileStage(PROFILE_STAGE_WAIT);
+    kickTransport(&transport);
+
+    // Wait until PRU1 has finished execution and acknowledge the completion
+    // event
+    printf("Waiting for printer driver...\n");
+    enterProfileStage(PROFILE_STAGE_IDLE);
+    waitTransportEvent(&transport, PRINTER_EVENT_COMPLETION);
+    leaveProfileStage(previousStage);
+
+    // Initialize printer job item queue to be ready to be filled again
+    initQueueJobItems();
 }
 
 void checkForPrinterErrorsPrintToConsole(void) {
-    // Create a variable to keep track if any error occurred. Then, go ahead
-    // and look at the various printer status bits one by one.
-    bool errorOccured = false;
+    // Create a variable to keep track if any error occurred. A job that
+    // couldn't be printed at all has had its error reported already. Then, go
+    // ahead and look at the various printer status bits one by one.
+    bool errorOccured = jobFailed;
 
-    if (queue->status.bits.illegalCommandError) {
+    if (jobStatus.bits.illegalCommandError) {
         fprintf(stderr, "Illegal command error occurred!\n");
         errorOccured = true;
     }
 
-    if (queue->status.bits.illegalParameterError) {
+    if (jobStatus.bits.illegalParameterError) {
         fprintf(stderr, "Illegal parameter error occurred!\n");
         errorOccured = true;
     }
 
-    if (queue->status.bits.paperOutError) {
+    if (jobStatus.bits.paperOutError) {
         fprintf(stderr, "Paper out error occurred!\n");
         errorOccured = true;
     }
 
-    if (queue->status.bits.thermalAlarmError) {
+    if (jobStatus.bits.thermalAlarmError) {
         fprintf(stderr, "Thermal alarm error occurred!\n");
         errorOccured = true;
     }
@@ -0,0 +1,352 @@
+/*
+ * membench.c
+ *
+ * Host and PRU memory bandwidth and latency benchmark. See membench.h for
+ * details.
+ *
+ * Copyright (C) 2014 Texas Instruments Incorporated - http://www.ti.com/
+ * ALL RIGHTS RESERVED
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+
+// PRU driver header file
+#include "prussdrv.h"
+
+#include "membench.h"
+#include "prumem.h"
+
+// Number of bytes used in each memory. This is the size of the line dictionary
+// area which is the smallest of the memories.
+#define MEM_BENCH_SIZE              PRINTER_LINE_DICT_SIZE
+
+// Number of bytes written by the host for each memory and mapping
+#define MEM_BENCH_WRITE_BYTES       (4 * 1024 * 1024)
+
+// Address of the PRU shared RAM as seen by PRU1 through C28
+#define MEM_BENCH_SHARED_RAM_PRU1_ADDRESS   0x00010000
+
+// Clock PRU1 runs at
+#define MEM_BENCH_PRU_CLOCK_MHZ     200
+
+// Value used to find out whether two mappings show the same memory
+#define MEM_BENCH_MARKER            0x4D454D42
+
+// Number of memories measured
+#define MEM_BENCH_MAX_REGIONS       5
+
+// Ways of mapping a memory into the host's address space
+typedef enum {
+    MEM_MAPPING_PRUSSDRV,
+    MEM_MAPPING_O_SYNC,
+    MEM_MAPPING_CACHED,
+    MEM_NR_OF_MAPPINGS
+} MEM_Mapping;
+
+// Type describing a memory. The memory pointer refers to the prussdrv mapping.
+// The PRU address is the one PRU1 sees the memory at, or zero if unknown.
+typedef struct {
+    const char *name;
+    uint8_t *memory;
+    uint32_t physAddress;
+    uint32_t pruAddress;
+    uint8_t *savedContents;
+} MEM_Region;
+
+static const char * const mappingNames[MEM_NR_OF_MAPPINGS] = {
+    "prussdrv",
+    "o_sync",
+    "cached"
+};
+
+static uint32_t initRegions(const PRINTER_BenchContext *context,
+        MEM_Region regions[]);
+static void addRegion(MEM_Region regions[], uint32_t *nrOfRegions,
+        const char *name, void *memory, const uint32_t pruAddress);
+static void measureHostWrites(const MEM_Region *region,
+        const uint8_t pattern[]);
+static void measureHostWrite(const MEM_Region *region,
+        const MEM_Mapping mapping, uint8_t *memory, const uint8_t pattern[]);
+static uint8_t *mapDevMem(const MEM_Region *region, const bool sync,
+        void **base, size_t *length);
+static bool measurePruReads(const PRINTER_BenchContext *context,
+        const MEM_Region regions[], const uint32_t nrOfRegions);
+static uint64_t getTimeNs(void);
+
+bool benchMemories(const PRINTER_BenchContext *context) {
+    MEM_Region regions[MEM_BENCH_MAX_REGIONS];
+    PRINTER_JobItem *eosItem;
+    uint8_t *savedContents;
+    uint8_t pattern[MEM_BENCH_SIZE];
+    uint32_t nrOfRegions;
+    bool success;
+    uint32_t i;
+
+    if (context->transport->ops != &uioTransportOps) {
+        fprintf(stderr, "Benchmark requires the uio transport!\n");
+        return false;
+    }
+
+    nrOfRegions = initRegions(context, regions);
+    savedContents = (uint8_t *)malloc(nrOfRegions * MEM_BENCH_SIZE);
+    if (!savedContents) {
+        fprintf(stderr, "Error allocating memory for benchmark!\n");
+        return false;
+    }
+
+    for (i = 0; i < sizeof(pattern); i++) {
+        pattern[i] = (uint8_t)i;
+    }
+
+    // Measure the host writes, putting back what was in each memory before
+    for (i = 0; i < nrOfRegions; i++) {
+        regions[i].savedContents = savedContents + i * MEM_BENCH_SIZE;
+        memcpy(regions[i].savedContents, regions[i].memory, MEM_BENCH_SIZE);
+
+        measureHostWrites(&regions[i], pattern);
+
+        copyToPruMemory(regions[i].memory, regions[i].savedContents,
+                MEM_BENCH_SIZE);
+        releasePruMemory();
+    }
+
+    success = measurePruReads(context, regions, nrOfRegions);
+
+    // Leave an empty queue behind
+    eosItem = (PRINTER_JobItem *)context->queue->jobItems;
+    eosItem->command = PRINTER_CMD_EOS;
+    eosItem->length = 0;
+    releasePruMemory();
+
+    free(savedContents);
+
+    return success;
+}
+
+// Determine the memories to measure. Only the parts of the PRU memories that
+// aren't used by the firmware while idle get written to. The L3 OCMC RAM and
+// the DDR buffer are seen by PRU1 at their physical addresses.
+static uint32_t initRegions(const PRINTER_BenchContext *context,
+        MEM_Region regions[]) {
+    uint32_t nrOfRegions = 0;
+    void *memory;
+
+    addRegion(regions, &nrOfRegions, "shared-ram", context->queue->jobItems,
+            MEM_BENCH_SHARED_RAM_PRU1_ADDRESS +
+            offsetof(PRINTER_Queue, jobItems));
+    addRegion(regions, &nrOfRegions, "pru1-dram",
+            (uint8_t *)context->pruDataRam + PRINTER_LINE_DICT_OFFSET,
+            PRINTER_LINE_DICT_OFFSET);
+    addRegion(regions, &nrOfRegions, "pru0-dram",
+            context->transport->macroStore, PRINTER_MACRO_STORE_PRU1_ADDRESS);
+
+    // prussdrv maps these memories only if uio_pruss provides them
+    if (!prussdrv_map_l3mem(&memory) && memory && (memory != MAP_FAILED)) {
+        addRegion(regions, &nrOfRegions, "l3-ocmc", memory, 0);
+    }
+    else {
+        fprintf(stderr, "L3 OCMC RAM not available, skipping it!\n");
+    }
+    if (!prussdrv_map_extmem(&memory) && memory && (memory != MAP_FAILED) &&
+            (prussdrv_extmem_size() >= MEM_BENCH_SIZE)) {
+        addRegion(regions, &nrOfRegions, "ddr", memory, 0);
+    }
+    else {
+        fprintf(stderr, "DDR buffer not available, skipping it!\n");
+    }
+
+    return nrOfRegions;
+}
+
+static void addRegion(MEM_Region regions[], uint32_t *nrOfRegions,
+        const char *name, void *memory, const uint32_t pruAddress) {
+    MEM_Region *region = &regions[(*nrOfRegions)++];
+
+    region->name = name;
+    region->memory = (uint8_t *)memory;
+    region->physAddress = prussdrv_get_phys_addr(memory);
+    region->pruAddress = pruAddress ? pruAddress : region->physAddress;
+    region->savedContents = NULL;
+}
+
+static void measureHostWrites(const MEM_Region *region,
+        const uint8_t pattern[]) {
+    uint8_t *memory;
+    size_t length;
+    void *base;
+    uint32_t i;
+
+    measureHostWrite(region, MEM_MAPPING_PRUSSDRV, region->memory, pattern);
+
+    for (i = MEM_MAPPING_O_SYNC; i < MEM_NR_OF_MAPPINGS; i++) {
+        memory = mapDevMem(region, i == MEM_MAPPING_O_SYNC, &base, &length);
+        if (!memory) {
+            fprintf(stderr, "Can't map %s through /dev/mem, skipping %s!\n",
+                    region->name, mappingNames[i]);
+            continue;
+        }
+
+        measureHostWrite(region, (MEM_Mapping)i, memory, pattern);
+
+        // Put back the original contents through this mapping as well so
+        // that whatever is left in the cache matches them once it gets written
+        // back at some point
+        copyToPruMemory(memory, region->savedContents, MEM_BENCH_SIZE);
+        releasePruMemory();
+        munmap(base, length);
+    }
+}
+
+static void measureHostWrite(const MEM_Region *region,
+        const MEM_Mapping mapping, uint8_t *memory, const uint8_t pattern[]) {
+    const uint32_t nrOfRounds = MEM_BENCH_WRITE_BYTES / MEM_BENCH_SIZE;
+    uint64_t startTime;
+    uint64_t duration;
+    uint32_t i;
+
+    startTime = getTimeNs();
+    for (i = 0; i < nrOfRounds; i++) {
+        copyToPruMemory(memory, pattern, MEM_BENCH_SIZE);
+        releasePruMemory();
+    }
+    duration = getTimeNs() - startTime;
+
+    printf("{\"benchmark\": \"mem\", \"test\": \"host-write\", "
+            "\"region\": \"%s\", \"mode\": \"%s\", \"bytes\": %u, "
+            "\"mb_per_s\": %.1f}\n", region->name, mappingNames[mapping],
+            nrOfRounds * MEM_BENCH_SIZE,
+            (double)nrOfRounds * MEM_BENCH_SIZE * 1000.0 / duration);
+}
+
+// Map the memory through /dev/mem. The mapping is only returned if it shows the
+// same memory as the prussdrv mapping does.
+static uint8_t *mapDevMem(const MEM_Region *region, const bool sync,
+        void **base, size_t *length) {
+    const uint32_t pageOffset =
+            region->physAddress & (sysconf(_SC_PAGESIZE) - 1);
+    uint8_t *memory;
+    int fd;
+
+    if (!region->physAddress) {
+        return NULL;
+    }
+
+    fd = open("/dev/mem", O_RDWR | (sync ? O_SYNC : 0));
+    if (fd < 0) {
+        return NULL;
+    }
+    *length = pageOffset + MEM_BENCH_SIZE;
+    *base = mmap(NULL, *length, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+            region->physAddress - pageOffset);
+    close(fd);
+    if (*base == MAP_FAILED) {
+        return NULL;
+    }
+    memory = (uint8_t *)*base + pageOffset;
+
+    *(volatile uint32_t *)region->memory = MEM_BENCH_MARKER;
+    releasePruMemory();
+    if (readPruWord(memory) != MEM_BENCH_MARKER) {
+        munmap(*base, *length);
+        return NULL;
+    }
+
+    return memory;
+}
+
+// Have PRU1 measure the reads from all memories it knows the address of in a
+// single job. The queue is considered published in its entirety so that PRU1
+// doesn't wait for more items once it is done.
+static bool measurePruReads(const PRINTER_BenchContext *context,
+        const MEM_Region regions[], const uint32_t nrOfRegions) {
+    PRINTER_Queue *queue = context->queue;
+    PRINTER_JobItem *item = (PRINTER_JobItem *)queue->jobItems;
+    PRINTER_ReadMeasurement *measurements[MEM_BENCH_MAX_REGIONS];
+    const uint32_t nrOfLoads = MEM_BENCH_SIZE / PRINTER_MEASURE_READ_BURST_SIZE;
+    uint32_t wordReadCycles;
+    uint32_t burstReadCycles;
+    uint32_t i;
+
+    for (i = 0; i < nrOfRegions; i++) {
+        if (!regions[i].pruAddress) {
+            fprintf(stderr, "Address of %s unknown, skipping PRU reads!\n",
+                    regions[i].name);
+            measurements[i] = NULL;
+            continue;
+        }
+        item->command = PRINTER_CMD_MEASURE_READ;
+        item->length = sizeof(PRINTER_ReadMeasurement);
+        measurements[i] = (PRINTER_ReadMeasurement *)item->data;
+        measurements[i]->address = regions[i].pruAddress;
+        measurements[i]->length = MEM_BENCH_SIZE;
+        measurements[i]->wordReadCycles = 0;
+        measurements[i]->burstReadCycles = 0;
+        item = (PRINTER_JobItem *)((uint8_t *)item +
+                PRINTER_JOB_ITEM_SIZE(item->length));
+    }
+    item->command = PRINTER_CMD_EOS;
+    item->length = 0;
+
+    queue->status.all = 0;
+    queue->progress.producedBytes = sizeof(queue->jobItems);
+    queue->progress.consumedBytes = 0;
+    queue->progress.lowWatermark = 0;
+    queue->progress.busyPoll = 0;
+    releasePruMemory();
+
+    kickTransport(context->transport);
+    if (!waitTransportEvent(context->transport, PRINTER_EVENT_COMPLETION)) {
+        fprintf(stderr, "Error waiting for printer driver!\n");
+        return false;
+    }
+    if (queue->status.all) {
+        fprintf(stderr, "Firmware doesn't support read measurements!\n");
+        queue->status.all = 0;
+        return false;
+    }
+
+    // The simulated firmware doesn't model the memories and reports no cycles
+    for (i = 0; i < nrOfRegions; i++) {
+        if (!measurements[i]) {
+            continue;
+        }
+        wordReadCycles = readPruWord(&measurements[i]->wordReadCycles);
+        burstReadCycles = readPruWord(&measurements[i]->burstReadCycles);
+
+        printf("{\"benchmark\": \"mem\", \"test\": \"pru-read\", "
+                "\"region\": \"%s\", \"bytes\": %u, ", regions[i].name,
+                MEM_BENCH_SIZE);
+        if (wordReadCycles && burstReadCycles) {
+            printf("\"word_cycles_per_load\": %.1f, "
+                    "\"burst_cycles_per_load\": %.1f, "
+                    "\"burst_mb_per_s\": %.1f}\n",
+                    (double)wordReadCycles / nrOfLoads,
+                    (double)burstReadCycles / nrOfLoads,
+                    (double)MEM_BENCH_SIZE * MEM_BENCH_PRU_CLOCK_MHZ /
+                    burstReadCycles);
+        }
+        else {
+            printf("\"word_cycles_per_load\": null, "
+                    "\"burst_cycles_per_load\": null, "
+                    "\"burst_mb_per_s\": null}\n");
+        }
+    }
+
+    return true;
+}
+
+static uint64_t getTimeNs(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
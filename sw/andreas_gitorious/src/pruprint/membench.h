@@ -0,0 +1,53 @@
+/*
+ * membench.h
+ *
+ * Benchmark measuring the memories the printer queue and the line data could
+ * be placed in, both from the host's and from PRU1's point of view, so that
+ * decisions about where they should live can be based on actual numbers.
+ *
+ * The memories measured are the PRU shared RAM (the job item area of the
+ * printer queue), the PRU1 data RAM (the line dictionary area), the PRU0 data
+ * RAM (the macro store), the L3 OCMC RAM and the DDR buffer of uio_pruss. The
+ * latter two are skipped if prussdrv can't map them. The same number of bytes
+ * is used for all of them, which is what fits into the smallest PRU memory, so
+ * that the results compare on equal terms.
+ *
+ * The host writes into each memory the same way job items get published, using
+ * copyToPruMemory() followed by a release barrier, through each of the
+ * following mappings:
+ *
+ *   prussdrv   The mapping prussdrv sets up, which uio_pruss makes uncached
+ *   o_sync     /dev/mem opened with O_SYNC, which is uncached as well but
+ *              lets the kernel allow write-combining for the DDR
+ *   cached     /dev/mem opened without O_SYNC. The barrier orders the writes
+ *              but doesn't write back the cache, so this is an upper bound of
+ *              what a cached queue could achieve rather than a working way of
+ *              publishing data to the PRU.
+ *
+ * The /dev/mem mappings are only used after making sure that they show the
+ * same memory as the prussdrv mapping. The memories are in use by the host and
+ * by the firmware, so their contents get restored afterwards.
+ *
+ * PRU1 reads each memory using PRINTER_CMD_MEASURE_READ, timed by its cycle
+ * counter, once with single 32-bit loads to get the latency and once with
+ * 32-byte bursts to get the bandwidth. The shared RAM is accessed through C28,
+ * the data RAMs locally, and the L3 OCMC RAM and the DDR through their global
+ * addresses, which is where C30 and C31 point to.
+ *
+ * Each measurement prints a line of JSON. This requires the uio transport as
+ * the other transports don't go through prussdrv.
+ *
+ * Copyright (C) 2014 Texas Instruments Incorporated - http://www.ti.com/
+ * ALL RIGHTS RESERVED
+ */
+
+#ifndef MEMBENCH_H_
+#define MEMBENCH_H_
+
+#include <stdbool.h>
+
+#include "bench.h"
+
+bool benchMemories(const PRINTER_BenchContext *context);
+
+#endif /* MEMBENCH_H_ */
@@ -0,0 +1,571 @@
+/*
+ * printd.c
+ *
+ * Resident print daemon. See printd.h for details.
+ *
+ * Copyright (C) 2014 Texas Instruments Incorporated - http://www.ti.com/
+ * ALL RIGHTS RESERVED
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "printd.h"
+#include "jobfile.h"
+
+// Type describing a client connected to the daemon. A client is busy while
+// its job is waiting in the queue or printing. Clients that hang up while
+// busy are only dropped once their job is done.
+typedef struct {
+    int fd;
+    bool busy;
+    bool hungUp;
+    PRINTER_SyncMode syncMode;
+    PRINTER_JobFile jobFile;
+} PRINTER_DaemonClient;
+
+// Type holding the state of the daemon. Queued jobs are kept as indices into
+// the client table in the order they were received.
+typedef struct {
+    int listenFd;
+    PRINTER_Queue *queue;
+    void *pruDataRam;
+    PRINTER_Session session;
+    PRINTER_DaemonClient clients[PRINTER_DAEMON_MAX_CLIENTS];
+    uint32_t queuedJobs[PRINTER_DAEMON_MAX_QUEUED_JOBS];
+    uint32_t nrOfQueuedJobs;
+    int32_t printingClient;
+} PRINTER_Daemon;
+
+static volatile sig_atomic_t stopRequested;
+
+static void handleStopSignal(int signalNumber);
+static int openListenSocket(const char *socketPath);
+static int connectToDaemon(const char *socketPath);
+static void acceptClient(PRINTER_Daemon *daemon);
+static void receiveRequest(PRINTER_Daemon *daemon, const uint32_t index);
+static bool isJobAcceptable(const PRINTER_Job *job);
+static bool isMacroAcceptable(const PRINTER_JobItem *item);
+static bool isCommandAcceptable(const uint32_t command);
+static void startNextJob(PRINTER_Daemon *daemon);
+static void onJobDone(PRINTER_Session *session, const PRINTER_Job *job,
+        void *userData);
+static void sendResponse(PRINTER_Daemon *daemon, const uint32_t index,
+        const uint32_t result);
+static void dropClient(PRINTER_Daemon *daemon, const uint32_t index);
+static void powerDownPrinter(PRINTER_Daemon *daemon);
+
+bool runPrintDaemon(const char *socketPath, PRINTER_Transport *transport,
+        const uint32_t keepWarmMs) {
+    static const PRINTER_SessionCallbacks callbacks = { NULL, onJobDone };
+    struct pollfd fds[PRINTER_DAEMON_MAX_CLIENTS + 2];
+    uint32_t clientIndex[PRINTER_DAEMON_MAX_CLIENTS + 2];
+    struct sigaction action;
+    PRINTER_Daemon daemon;
+    bool success = true;
+    bool busyPolling;
+    nfds_t nrOfFds;
+    uint32_t i;
+
+    memset(&daemon, 0, sizeof(daemon));
+    daemon.queue = transport->queue;
+    daemon.pruDataRam = transport->pruDataRam;
+    daemon.printingClient = -1;
+    for (i = 0; i < PRINTER_DAEMON_MAX_CLIENTS; i++) {
+        daemon.clients[i].fd = -1;
+    }
+
+    // Terminate cleanly on the usual signals. The handler is installed
+    // without SA_RESTART so that it interrupts poll().
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handleStopSignal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    daemon.listenFd = openListenSocket(socketPath);
+    if (daemon.listenFd < 0) {
+        fprintf(stderr, "Error listening on %s!\n", socketPath);
+        return false;
+    }
+
+    if (!initSession(&daemon.session, transport, &callbacks, &daemon)) {
+        fprintf(stderr, "Error initializing print session!\n");
+        close(daemon.listenFd);
+        unlink(socketPath);
+        return false;
+    }
+    setSessionKeepWarm(&daemon.session, keepWarmMs);
+
+    printf("Print daemon listening on %s\n", socketPath);
+    while (!stopRequested) {
+        // Only accept clients while there is room for them, and only read
+        // requests while there is room for another job. Hang-ups of busy
+        // clients still get noticed since poll() always reports them.
+        nrOfFds = 0;
+        if (daemon.listenFd >= 0) {
+            fds[nrOfFds].fd = daemon.listenFd;
+            fds[nrOfFds].events = POLLIN;
+            clientIndex[nrOfFds++] = PRINTER_DAEMON_MAX_CLIENTS;
+        }
+        fds[nrOfFds].fd = getSessionFd(&daemon.session);
+        fds[nrOfFds].events = POLLIN;
+        clientIndex[nrOfFds++] = PRINTER_DAEMON_MAX_CLIENTS;
+        for (i = 0; i < PRINTER_DAEMON_MAX_CLIENTS; i++) {
+            if ((daemon.clients[i].fd >= 0) && !daemon.clients[i].hungUp) {
+                fds[nrOfFds].fd = daemon.clients[i].fd;
+                fds[nrOfFds].events = (!daemon.clients[i].busy &&
+                        (daemon.nrOfQueuedJobs <
+                                PRINTER_DAEMON_MAX_QUEUED_JOBS)) ? POLLIN : 0;
+                clientIndex[nrOfFds++] = i;
+            }
+        }
+
+        // A job in busy-poll mode doesn't signal anything through the session
+        // file descriptor. Only glance at the sockets in that case and then
+        // spend a little time polling the job.
+        busyPolling = (daemon.printingClient >= 0) &&
+                (daemon.clients[daemon.printingClient].syncMode ==
+                        PRINTER_SYNC_BUSY_POLL);
+        if (poll(fds, nrOfFds, busyPolling ? 0 : -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "Error waiting for print daemon events!\n");
+            success = false;
+            break;
+        }
+
+        if (busyPolling) {
+            waitSession(&daemon.session, 1);
+        }
+
+        // Clients may have been dropped while handling earlier entries
+        for (i = 0; i < nrOfFds; i++) {
+            if (!fds[i].revents ||
+                    ((clientIndex[i] < PRINTER_DAEMON_MAX_CLIENTS) &&
+                            (daemon.clients[clientIndex[i]].fd != fds[i].fd))) {
+                continue;
+            }
+            if (fds[i].fd == daemon.listenFd) {
+                acceptClient(&daemon);
+            }
+            else if (clientIndex[i] == PRINTER_DAEMON_MAX_CLIENTS) {
+                processSession(&daemon.session);
+            }
+            else if (fds[i].revents & POLLIN) {
+                receiveRequest(&daemon, clientIndex[i]);
+            }
+            else {
+                dropClient(&daemon, clientIndex[i]);
+            }
+        }
+
+        startNextJob(&daemon);
+    }
+
+    // Let the job that is currently printing finish since aborting it would
+    // leave the printer in an undefined state. Queued jobs are dropped.
+    printf("Stopping print daemon\n");
+    close(daemon.listenFd);
+    unlink(socketPath);
+    while (!isSessionIdle(&daemon.session) &&
+            waitSession(&daemon.session, -1)) {
+    }
+    if (keepWarmMs) {
+        powerDownPrinter(&daemon);
+    }
+    closeSession(&daemon.session);
+    for (i = 0; i < PRINTER_DAEMON_MAX_CLIENTS; i++) {
+        if (daemon.clients[i].busy) {
+            sendResponse(&daemon, i, PRINTER_DAEMON_RESULT_ERROR);
+        }
+        if (daemon.clients[i].fd >= 0) {
+            dropClient(&daemon, i);
+        }
+    }
+
+    return success;
+}
+
+bool sendJobToDaemon(const char *socketPath, const PRINTER_Job *job,
+        const PRINTER_LineDictionary *lineDict,
+        const PRINTER_SyncMode syncMode, PRINTER_DaemonResponse *response) {
+    char filename[] = "/tmp/pruprint.XXXXXX";
+    bool success;
+    int fd;
+
+    // Write the job into an anonymous temporary file which the daemon maps
+    // through the file descriptor that gets passed to it
+    fd = mkstemp(filename);
+    if (fd < 0) {
+        return false;
+    }
+    unlink(filename);
+
+    success = writeJobFile(fd, job, lineDict, 0) &&
+            sendJobFileToDaemon(socketPath, fd, syncMode, response);
+    close(fd);
+
+    return success;
+}
+
+bool sendJobFileToDaemon(const char *socketPath, const int jobFileFd,
+        const PRINTER_SyncMode syncMode, PRINTER_DaemonResponse *response) {
+    PRINTER_DaemonRequest request;
+    char control[CMSG_SPACE(sizeof(int))];
+    struct msghdr message;
+    struct cmsghdr *controlMessage;
+    struct iovec iov;
+    ssize_t result;
+    size_t received = 0;
+    int fd;
+
+    fd = connectToDaemon(socketPath);
+    if (fd < 0) {
+        return false;
+    }
+
+    memset(&request, 0, sizeof(request));
+    request.magic = PRINTER_DAEMON_MAGIC;
+    request.command = PRINTER_DAEMON_CMD_PRINT_JOB;
+    request.syncMode = syncMode;
+
+    // The file descriptor of the job file travels as ancillary data
+    memset(&message, 0, sizeof(message));
+    memset(control, 0, sizeof(control));
+    iov.iov_base = &request;
+    iov.iov_len = sizeof(request);
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    controlMessage = CMSG_FIRSTHDR(&message);
+    controlMessage->cmsg_level = SOL_SOCKET;
+    controlMessage->cmsg_type = SCM_RIGHTS;
+    controlMessage->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(controlMessage), &jobFileFd, sizeof(int));
+
+    if (sendmsg(fd, &message, 0) != sizeof(request)) {
+        close(fd);
+        return false;
+    }
+
+    // The response only arrives once the job has been printed
+    while (received < sizeof(*response)) {
+        result = read(fd, (uint8_t *)response + received,
+                sizeof(*response) - received);
+        if ((result < 0) && (errno == EINTR)) {
+            continue;
+        }
+        if (result <= 0) {
+            close(fd);
+            return false;
+        }
+        received += result;
+    }
+    close(fd);
+
+    return response->magic == PRINTER_DAEMON_MAGIC;
+}
+
+static void handleStopSignal(int signalNumber) {
+    stopRequested = 1;
+}
+
+static int openListenSocket(const char *socketPath) {
+    struct sockaddr_un address;
+    int fd;
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(address.sun_path)) {
+        return -1;
+    }
+    strcpy(address.sun_path, socketPath);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    // A socket left behind by a previous instance would make bind() fail
+    unlink(socketPath);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) ||
+            listen(fd, PRINTER_DAEMON_MAX_CLIENTS)) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static int connectToDaemon(const char *socketPath) {
+    struct sockaddr_un address;
+    int fd;
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(address.sun_path)) {
+        return -1;
+    }
+    strcpy(address.sun_path, socketPath);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address))) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static void acceptClient(PRINTER_Daemon *daemon) {
+    uint32_t i;
+    int fd;
+
+    fd = accept(daemon->listenFd, NULL, NULL);
+    if (fd < 0) {
+        return;
+    }
+
+    for (i = 0; i < PRINTER_DAEMON_MAX_CLIENTS; i++) {
+        if (daemon->clients[i].fd < 0) {
+            memset(&daemon->clients[i], 0, sizeof(daemon->clients[i]));
+            daemon->clients[i].fd = fd;
+            return;
+        }
+    }
+
+    // Out of client slots. The client will notice the connection closing
+    // before it ever got an answer.
+    close(fd);
+}
+
+static void receiveRequest(PRINTER_Daemon *daemon, const uint32_t index) {
+    PRINTER_DaemonClient *client = &daemon->clients[index];
+    PRINTER_DaemonRequest request;
+    char control[CMSG_SPACE(sizeof(int))];
+    struct msghdr message;
+    struct cmsghdr *controlMessage;
+    struct iovec iov;
+    ssize_t result;
+    int jobFileFd = -1;
+
+    memset(&message, 0, sizeof(message));
+    iov.iov_base = &request;
+    iov.iov_len = sizeof(request);
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    result = recvmsg(client->fd, &message, 0);
+    if (result <= 0) {
+        dropClient(daemon, index);
+        return;
+    }
+
+    controlMessage = CMSG_FIRSTHDR(&message);
+    if (controlMessage && (controlMessage->cmsg_level == SOL_SOCKET) &&
+            (controlMessage->cmsg_type == SCM_RIGHTS)) {
+        memcpy(&jobFileFd, CMSG_DATA(controlMessage), sizeof(int));
+    }
+
+    // Read the job file right away. The client may still write to the file,
+    // so it gets copied before being checked rather than being mapped. The
+    // file descriptor isn't needed anymore after that.
+    client->busy = true;
+    if ((result != sizeof(request)) ||
+            (request.magic != PRINTER_DAEMON_MAGIC) ||
+            (request.command != PRINTER_DAEMON_CMD_PRINT_JOB) ||
+            (jobFileFd < 0) ||
+            !readJobFileFd(jobFileFd, &client->jobFile) ||
+            !isJobAcceptable(&client->jobFile.job)) {
+        if (jobFileFd >= 0) {
+            close(jobFileFd);
+        }
+        sendResponse(daemon, index, PRINTER_DAEMON_RESULT_INVALID);
+        return;
+    }
+    close(jobFileFd);
+
+    client->syncMode = (request.syncMode == PRINTER_SYNC_BUSY_POLL) ?
+            PRINTER_SYNC_BUSY_POLL : PRINTER_SYNC_INTERRUPT;
+    daemon->queuedJobs[daemon->nrOfQueuedJobs++] = index;
+}
+
+// Jobs may only consist of the commands needed for printing, both on their own
+// and within the bodies of the macros they define
+static bool isJobAcceptable(const PRINTER_Job *job) {
+    const PRINTER_JobItem *item;
+
+    for (item = getFirstJobItem(job); item; item = getNextJobItem(job, item)) {
+        if (!isCommandAcceptable(item->command) ||
+                ((item->command == PRINTER_CMD_DEFINE_MACRO) &&
+                        !isMacroAcceptable(item))) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// The macro body following the macro ID needs to consist of whole items, none
+// of which may define a macro of its own
+static bool isMacroAcceptable(const PRINTER_JobItem *item) {
+    const PRINTER_JobItem *bodyItem;
+    uint32_t offset = sizeof(uint32_t);
+    uint32_t remaining;
+
+    if (item->length < sizeof(uint32_t)) {
+        return false;
+    }
+
+    while (offset < item->length) {
+        remaining = item->length - offset;
+        bodyItem = (const PRINTER_JobItem *)((const uint8_t *)item->data +
+                offset);
+        if ((remaining < PRINTER_JOB_ITEM_SIZE(0)) ||
+                (bodyItem->length > remaining - PRINTER_JOB_ITEM_SIZE(0)) ||
+                (bodyItem->command == PRINTER_CMD_DEFINE_MACRO) ||
+                !isCommandAcceptable(bodyItem->command)) {
+            return false;
+        }
+        offset += PRINTER_JOB_ITEM_SIZE(bodyItem->length);
+    }
+
+    return true;
+}
+
+// The PRU needs to stay up and responsive for the next job. A job therefore
+// must not halt it or have it generate the signal test pattern, which never
+// ends and keeps the printer head driven. It must not read PRU memories on
+// the client's behalf either. Commands the daemon doesn't know about are
+// refused as well.
+static bool isCommandAcceptable(const uint32_t command) {
+    switch (command) {
+    case PRINTER_CMD_OPEN:
+    case PRINTER_CMD_PRINT_LINE:
+    case PRINTER_CMD_MOTOR_HALF_STEP:
+    case PRINTER_CMD_CLOSE:
+    case PRINTER_CMD_REPEAT_LINE:
+    case PRINTER_CMD_PRINT_LINE_REF:
+    case PRINTER_CMD_DEFINE_MACRO:
+    case PRINTER_CMD_CALL_MACRO:
+    case PRINTER_CMD_LOOP:
+    case PRINTER_CMD_END_LOOP:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Start the job at the head of the queue once the printer is idle. Jobs are
+// not overlapped since each of them comes with its own line dictionary which
+// can't be replaced while the previous job is still using it.
+static void startNextJob(PRINTER_Daemon *daemon) {
+    PRINTER_DaemonClient *client;
+    uint32_t index;
+
+    if (!daemon->nrOfQueuedJobs || !isSessionIdle(&daemon->session)) {
+        return;
+    }
+
+    index = daemon->queuedJobs[0];
+    daemon->nrOfQueuedJobs--;
+    memmove(&daemon->queuedJobs[0], &daemon->queuedJobs[1],
+            daemon->nrOfQueuedJobs * sizeof(daemon->queuedJobs[0]));
+    client = &daemon->clients[index];
+
+    // Errors are reported per job so start out with a clean status. PRU1 is
+    // idle so it is safe to change it.
+    daemon->queue->status.all = 0;
+    uploadLineDictionary(&client->jobFile.lineDict, daemon->pruDataRam);
+    daemon->printingClient = index;
+    if (!submitJobAsync(&daemon->session, &client->jobFile.job,
+            client->syncMode)) {
+        daemon->printingClient = -1;
+        sendResponse(daemon, index, PRINTER_DAEMON_RESULT_INVALID);
+    }
+}
+
+static void onJobDone(PRINTER_Session *session, const PRINTER_Job *job,
+        void *userData) {
+    PRINTER_Daemon *daemon = (PRINTER_Daemon *)userData;
+    const int32_t index = daemon->printingClient;
+
+    daemon->printingClient = -1;
+    if (index >= 0) {
+        sendResponse(daemon, index, PRINTER_DAEMON_RESULT_OK);
+    }
+}
+
+// Answer the request of a client, which makes it available for the next
+// request. The client gets dropped in case it has gone away in the meantime.
+static void sendResponse(PRINTER_Daemon *daemon, const uint32_t index,
+        const uint32_t result) {
+    PRINTER_DaemonClient *client = &daemon->clients[index];
+    PRINTER_DaemonResponse response;
+
+    memset(&response, 0, sizeof(response));
+    response.magic = PRINTER_DAEMON_MAGIC;
+    response.result = result;
+    if (result == PRINTER_DAEMON_RESULT_OK) {
+        response.status = daemon->queue->status;
+        response.linesPrinted = daemon->queue->progress.linesPrinted;
+    }
+
+    closeJobFile(&client->jobFile);
+    client->busy = false;
+
+    if (client->hungUp || (send(client->fd, &response, sizeof(response),
+            MSG_NOSIGNAL) != sizeof(response))) {
+        dropClient(daemon, index);
+    }
+}
+
+// Run a job that does nothing but close the printer without keeping it warm so
+// that the printer head doesn't stay powered after the daemon is gone
+static void powerDownPrinter(PRINTER_Daemon *daemon) {
+    PRINTER_Job job;
+
+    if (!initJob(&job)) {
+        return;
+    }
+
+    setSessionKeepWarm(&daemon->session, 0);
+    if (addJobItem(&job, PRINTER_CMD_CLOSE, 0, NULL) &&
+            submitJobAsync(&daemon->session, &job, PRINTER_SYNC_INTERRUPT)) {
+        while (!isSessionIdle(&daemon->session) &&
+                waitSession(&daemon->session, -1)) {
+        }
+    }
+
+    freeJob(&job);
+}
+
+static void dropClient(PRINTER_Daemon *daemon, const uint32_t index) {
+    PRINTER_DaemonClient *client = &daemon->clients[index];
+
+    // A client that has a job in flight is kept around until it completes
+    if (client->busy) {
+        client->hungUp = true;
+        return;
+    }
+
+    close(client->fd);
+    client->fd = -1;
+    client->hungUp = false;
+}
@@ -0,0 +1,83 @@
+/*
+ * printd.h
+ *
+ * Resident print daemon. The daemon keeps the PRU loaded and the PRU memories
+ * mapped across any number of print jobs, which it accepts from clients over
+ * a local Unix socket. This saves each print job the overhead of initializing
+ * the PRU subsystem and loading the firmware. The PRU is never halted between
+ * jobs.
+ *
+ * Print jobs are handed over as job files (see jobfile.h). A request is sent
+ * along with an open file descriptor of the job file and gets answered once
+ * the job has been printed, so a client simply blocks until then. The daemon
+ * queues only a limited number of jobs and stops reading requests while its
+ * queue is full, which in turn makes further clients block.
+ *
+ * The daemon can have the printer head kept powered between jobs so that
+ * back-to-back jobs don't need to wait for the head supplies to settle. The
+ * head gets powered down once the printer has been idle for a while, and when
+ * the daemon stops.
+ *
+ * Copyright (C) 2014 Texas Instruments Incorporated - http://www.ti.com/
+ * ALL RIGHTS RESERVED
+ */
+
+#ifndef PRINTD_H_
+#define PRINTD_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Interface to the PRU-based printer driver firmware "pruprinter_fw"
+#include "pruprinter.h"
+
+#include "printjob.h"
+#include "linedict.h"
+#include "session.h"
+
+// Socket the daemon listens on unless told otherwise
+#define PRINTER_DAEMON_DEFAULT_SOCKET       "/tmp/pruprintd.sock"
+
+// Limits of the daemon. Each client can have a single job printing or waiting
+// to be printed at any given time.
+#define PRINTER_DAEMON_MAX_CLIENTS          16
+#define PRINTER_DAEMON_MAX_QUEUED_JOBS      4
+
+// Identification of the messages exchanged with the daemon
+#define PRINTER_DAEMON_MAGIC                0x44505250
+
+// Requests a client can send to the daemon
+#define PRINTER_DAEMON_CMD_PRINT_JOB        0x01
+
+// Results of a request
+#define PRINTER_DAEMON_RESULT_OK            0x00
+#define PRINTER_DAEMON_RESULT_INVALID       0x01
+#define PRINTER_DAEMON_RESULT_ERROR         0x02
+
+// Request sent to the daemon. A print job request carries the file descriptor
+// of the job file as ancillary data.
+typedef struct {
+    uint32_t magic;
+    uint32_t command;
+    uint32_t syncMode;
+    uint32_t reserved;
+} PRINTER_DaemonRequest;
+
+// Response sent back to the client once a request has been completed. It
+// carries the printer status and progress as of the end of the job.
+typedef struct {
+    uint32_t magic;
+    uint32_t result;
+    PRINTER_Status status;
+    uint32_t linesPrinted;
+} PRINTER_DaemonResponse;
+
+bool runPrintDaemon(const char *socketPath, PRINTER_Transport *transport,
+        const uint32_t keepWarmMs);
+bool sendJobToDaemon(const char *socketPath, const PRINTER_Job *job,
+        const PRINTER_LineDictionary *lineDict,
+        const PRINTER_SyncMode syncMode, PRINTER_DaemonResponse *response);
+bool sendJobFileToDaemon(const char *socketPath, const int jobFileFd,
+        const PRINTER_SyncMode syncMode, PRINTER_DaemonResponse *response);
+
+#endif /* PRINTD_H_ */
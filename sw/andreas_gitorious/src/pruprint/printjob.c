@@ -0,0 +1,137 @@
+/*
+ * printjob.c
+ *
+ * Host-side print job buffer. See printjob.h for details.
+ *
+ * Copyright (C) 2014 Texas Instruments Incorporated - http://www.ti.com/
+ * ALL RIGHTS RESERVED
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "printjob.h"
+
+// Initial amount of memory to allocate for a job. Typical jobs are larger
+// than that and the buffer simply gets doubled in size as needed.
+#define PRINTER_JOB_INITIAL_CAPACITY    (64 * 1024)
+
+static bool growJob(PRINTER_Job *job, const uint32_t minCapacity);
+
+bool initJob(PRINTER_Job *job) {
+    job->data = NULL;
+    job->size = 0;
+    job->capacity = 0;
+    job->nrOfItems = 0;
+
+    return growJob(job, PRINTER_JOB_INITIAL_CAPACITY);
+}
+
+void freeJob(PRINTER_Job *job) {
+    free(job->data);
+    job->data = NULL;
+    job->size = 0;
+    job->capacity = 0;
+    job->nrOfItems = 0;
+}
+
+void clearJob(PRINTER_Job *job) {
+    // Simply forget about the items while keeping the memory allocated so that
+    // it can be reused for the next job.
+    job->size = 0;
+    job->nrOfItems = 0;
+}
+
+bool addJobItem(PRINTER_Job *job, const uint32_t command,
+        const uint32_t length, const void *data) {
+    void *payload = reserveJobItem(job, command, length);
+
+    if (!payload) {
+        return false;
+    }
+
+    if (length) {
+        memcpy(payload, data, length);
+    }
+
+    return true;
+}
+
+void *reserveJobItem(PRINTER_Job *job, const uint32_t command,
+        const uint32_t length) {
+    PRINTER_JobItem *item;
+
+    // Make sure there is enough room to hold the new item
+    if (!growJob(job, job->size + PRINTER_JOB_ITEM_SIZE(length))) {
+        return NULL;
+    }
+
+    // Append the item using the same layout as used in the printer queue but
+    // leave it up to the caller to fill in the payload. This allows payload
+    // data to be generated in place rather than being copied. The returned
+    // pointer is only valid until the next item gets added to the job.
+    item = (PRINTER_JobItem *)(job->data + job->size);
+    item->command = command;
+    item->length = length;
+
+    job->size += PRINTER_JOB_ITEM_SIZE(length);
+    job->nrOfItems++;
+
+    return item->data;
+}
+
+bool appendJob(PRINTER_Job *job, const PRINTER_Job *otherJob) {
+    // Make sure there is enough room to hold all items of the other job
+    if (!growJob(job, job->size + otherJob->size)) {
+        return false;
+    }
+
+    // Both jobs share the same layout so the items can simply be copied over
+    memcpy(job->data + job->size, otherJob->data, otherJob->size);
+    job->size += otherJob->size;
+    job->nrOfItems += otherJob->nrOfItems;
+
+    return true;
+}
+
+PRINTER_JobItem *getFirstJobItem(const PRINTER_Job *job) {
+    return job->size ? (PRINTER_JobItem *)job->data : NULL;
+}
+
+PRINTER_JobItem *getNextJobItem(const PRINTER_Job *job,
+        const PRINTER_JobItem *item) {
+    // Advance across the static fields and the payload of the current item the
+    // same way the PRU firmware does it. Return NULL once we reach the end.
+    const uint8_t *next = (const uint8_t *)item +
+            PRINTER_JOB_ITEM_SIZE(item->length);
+
+    if (next >= job->data + job->size) {
+        return NULL;
+    }
+
+    return (PRINTER_JobItem *)next;
+}
+
+static bool growJob(PRINTER_Job *job, const uint32_t minCapacity) {
+    uint32_t newCapacity;
+    uint8_t *newData;
+
+    if (minCapacity <= job->capacity) {
+        return true;
+    }
+
+    newCapacity = job->capacity ? job->capacity : PRINTER_JOB_INITIAL_CAPACITY;
+    while (newCapacity < minCapacity) {
+        newCapacity *= 2;
+    }
+
+    newData = (uint8_t *)realloc(job->data, newCapacity);
+    if (!newData) {
+        return false;
+    }
+
+    job->data = newData;
+    job->capacity = newCapacity;
+
+    return true;
+}
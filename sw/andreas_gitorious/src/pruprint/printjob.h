@@ -0,0 +1,46 @@
+/*
+ * printjob.h
+ *
+ * Host-side print job buffer. A print job is assembled in regular (cached)
+ * memory using exactly the same back-to-back PRINTER_JobItem layout that the
+ * low-level PRU printer firmware parses out of the printer queue. This allows
+ * the job to get post-processed as a whole before it is being transferred
+ * into the PRU shared memory.
+ *
+ * Copyright (C) 2014 Texas Instruments Incorporated - http://www.ti.com/
+ * ALL RIGHTS RESERVED
+ */
+
+#ifndef PRINTJOB_H_
+#define PRINTJOB_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Interface to the PRU-based printer driver firmware "pruprinter_fw"
+#include "pruprinter.h"
+
+// Type describing a print job that is kept in host memory. The data field
+// points to a dynamically grown memory area that holds the job items back-to-
+// back, size denotes how many bytes of that area are in use, and capacity
+// denotes how many bytes have been allocated.
+typedef struct {
+    uint8_t *data;
+    uint32_t size;
+    uint32_t capacity;
+    uint32_t nrOfItems;
+} PRINTER_Job;
+
+bool initJob(PRINTER_Job *job);
+void freeJob(PRINTER_Job *job);
+void clearJob(PRINTER_Job *job);
+bool addJobItem(PRINTER_Job *job, const uint32_t command,
+        const uint32_t length, const void *data);
+void *reserveJobItem(PRINTER_Job *job, const uint32_t command,
+        const uint32_t length);
+bool appendJob(PRINTER_Job *job, const PRINTER_Job *otherJob);
+PRINTER_JobItem *getFirstJobItem(const PRINTER_Job *job);
+PRINTER_JobItem *getNextJobItem(const PRINTER_Job *job,
+        const PRINTER_JobItem *item);
+
+#endif /* PRINTJOB_H_ */
@@ -0,0 +1,144 @@
+/*
+ * profile.c
+ *
+ * Breakdown of where the host spends its time while handling print jobs. See
+ * profile.h for details.
+ *
+ * Copyright (C) 2014 Texas Instruments Incorporated - http://www.ti.com/
+ * ALL RIGHTS RESERVED
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "profile.h"
+
+// Time accumulated by a stage and the number of times it was entered
+typedef struct {
+    uint64_t wallNs;
+    uint64_t cpuNs;
+    uint32_t count;
+} PROFILE_StageTimes;
+
+// State of the profile. The times of the current stage are accumulated up to
+// the time of the last stage switch.
+typedef struct {
+    bool started;
+    PROFILE_Stage currentStage;
+    uint64_t switchWallNs;
+    uint64_t switchCpuNs;
+    PROFILE_StageTimes stages[PROFILE_NR_OF_STAGES];
+} PROFILE_State;
+
+static const char * const stageNames[PROFILE_NR_OF_STAGES] = {
+    "other",
+    "read",
+    "decode",
+    "partition",
+    "copy",
+    "wait",
+    "idle"
+};
+
+static PROFILE_State profile;
+
+static void switchStage(const PROFILE_Stage stage);
+static uint64_t getClockNs(const clockid_t clock);
+
+void initProfile(void) {
+    memset(&profile, 0, sizeof(profile));
+    profile.currentStage = PROFILE_STAGE_OTHER;
+    profile.stages[PROFILE_STAGE_OTHER].count = 1;
+    profile.switchWallNs = getClockNs(CLOCK_MONOTONIC);
+    profile.switchCpuNs = getClockNs(CLOCK_THREAD_CPUTIME_ID);
+    profile.started = true;
+}
+
+PROFILE_Stage enterProfileStage(const PROFILE_Stage stage) {
+    const PROFILE_Stage previousStage = profile.currentStage;
+
+    if (!profile.started) {
+        return previousStage;
+    }
+
+    // Entering the stage we are in already doesn't need the clocks
+    if (stage != previousStage) {
+        switchStage(stage);
+    }
+    profile.stages[stage].count++;
+
+    return previousStage;
+}
+
+void leaveProfileStage(const PROFILE_Stage previousStage) {
+    if (profile.started && (previousStage != profile.currentStage)) {
+        switchStage(previousStage);
+    }
+}
+
+// Print the breakdown of the time spent so far, either as a table or as a line
+// of JSON like the benchmarks do
+void printProfileToConsole(const bool json) {
+    PROFILE_StageTimes total;
+    const PROFILE_StageTimes *times;
+    uint32_t i;
+
+    if (!profile.started) {
+        return;
+    }
+
+    // Account for the current stage up to now without leaving it
+    switchStage(profile.currentStage);
+
+    memset(&total, 0, sizeof(total));
+    for (i = 0; i < PROFILE_NR_OF_STAGES; i++) {
+        total.wallNs += profile.stages[i].wallNs;
+        total.cpuNs += profile.stages[i].cpuNs;
+    }
+
+    if (json) {
+        printf("{\"profile\": \"host\"");
+        for (i = 0; i < PROFILE_NR_OF_STAGES; i++) {
+            times = &profile.stages[i];
+            printf(", \"%s\": {\"count\": %u, \"wall_us\": %.1f, "
+                    "\"cpu_us\": %.1f}", stageNames[i], times->count,
+                    times->wallNs / 1000.0, times->cpuNs / 1000.0);
+        }
+        printf(", \"total\": {\"wall_us\": %.1f, \"cpu_us\": %.1f}}\n",
+                total.wallNs / 1000.0, total.cpuNs / 1000.0);
+        return;
+    }
+
+    printf("Host time    count    wall ms     cpu ms   wall %%\n");
+    for (i = 0; i < PROFILE_NR_OF_STAGES; i++) {
+        times = &profile.stages[i];
+        printf("  %-9s %7u %10.3f %10.3f %7.1f%%\n", stageNames[i],
+                times->count, times->wallNs / 1000000.0,
+                times->cpuNs / 1000000.0, total.wallNs ?
+                100.0 * times->wallNs / total.wallNs : 0.0);
+    }
+    printf("  %-9s %7s %10.3f %10.3f\n", "total", "",
+            total.wallNs / 1000000.0, total.cpuNs / 1000000.0);
+}
+
+static void switchStage(const PROFILE_Stage stage) {
+    const uint64_t wallNs = getClockNs(CLOCK_MONOTONIC);
+    const uint64_t cpuNs = getClockNs(CLOCK_THREAD_CPUTIME_ID);
+    PROFILE_StageTimes *times = &profile.stages[profile.currentStage];
+
+    times->wallNs += wallNs - profile.switchWallNs;
+    times->cpuNs += cpuNs - profile.switchCpuNs;
+    profile.switchWallNs = wallNs;
+    profile.switchCpuNs = cpuNs;
+    profile.currentStage = stage;
+}
+
+static uint64_t getClockNs(const clockid_t clock) {
+    struct timespec now;
+
+    clock_gettime(clock, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
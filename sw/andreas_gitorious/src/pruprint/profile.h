@@ -0,0 +1,50 @@
+/*
+ * profile.h
+ *
+ * Breakdown of where the host spends its time while handling print jobs. The
+ * time of the main thread is split into the following stages, each of which
+ * accumulates the wall time (CLOCK_MONOTONIC) and the CPU time of the thread
+ * (CLOCK_THREAD_CPUTIME_ID) spent in it:
+ *
+ *   read       Reading the image file or mapping a saved print job
+ *   decode     Decoding the PNG image, not counting the reading
+ *   partition  Turning the image rows into job items
+ *   copy       Copying job items and the line dictionary into PRU memory
+ *   wait       Waiting for a job to complete from the doorbell onwards while
+ *              not copying or idle, which includes handling the events of the
+ *              firmware and busy-polling
+ *   idle       Being blocked waiting for an event of the firmware or the
+ *              print daemon
+ *   other      Everything else, such as starting up and loading the firmware
+ *
+ * The stages don't overlap. Entering a stage suspends the current one until
+ * the stage is left again, so stages can be entered from within each other.
+ * A stage switch costs two clock reads, which keeps the profile cheap enough
+ * to be always on.
+ *
+ * Copyright (C) 2014 Texas Instruments Incorporated - http://www.ti.com/
+ * ALL RIGHTS RESERVED
+ */
+
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+#include <stdbool.h>
+
+typedef enum {
+    PROFILE_STAGE_OTHER,
+    PROFILE_STAGE_READ,
+    PROFILE_STAGE_DECODE,
+    PROFILE_STAGE_PARTITION,
+    PROFILE_STAGE_COPY,
+    PROFILE_STAGE_WAIT,
+    PROFILE_STAGE_IDLE,
+    PROFILE_NR_OF_STAGES
+} PROFILE_Stage;
+
+void initProfile(void);
+PROFILE_Stage enterProfileStage(const PROFILE_Stage stage);
+void leaveProfileStage(const PROFILE_Stage previousStage);
+void printProfileToConsole(const bool json);
+
+#endif /* PROFILE_H_ */
@@ -0,0 +1,74 @@
+/*
+ * prumem.c
+ *
+ * Transfer of data into the PRU memories. See prumem.h for details.
+ *
+ * Copyright (C) 2014 Texas Instruments Incorporated - http://www.ti.com/
+ * ALL RIGHTS RESERVED
+ */
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define PRUMEM_USE_NEON
+#endif
+
+#include "prumem.h"
+
+// Number of bytes written per burst. Bursts are aligned to this size in the
+// destination memory. Device memory doesn't tolerate unaligned accesses.
+#define PRUMEM_BURST_SIZE           32
+
+// Copy a block of 32-bit words into PRU memory. Both addresses and the size
+// need to be multiples of four bytes, which is always the case for job items
+// and line dictionary entries. The copy is not guaranteed to be visible to
+// the PRU until releasePruMemory() has been called.
+void copyToPruMemory(void *dst, const void *src, const uint32_t size) {
+    volatile uint32_t *dstWords = (volatile uint32_t *)dst;
+    const uint32_t *srcWords = (const uint32_t *)src;
+    uint32_t nrOfWords = size / sizeof(uint32_t);
+
+    // Write single words until the destination is aligned for bursts
+    while (nrOfWords &&
+            ((uintptr_t)dstWords & (PRUMEM_BURST_SIZE - 1))) {
+        *dstWords++ = *srcWords++;
+        nrOfWords--;
+    }
+
+#ifdef PRUMEM_USE_NEON
+    // Move the bulk of the data using two 128-bit NEON registers at a time.
+    // The source is in cached memory and doesn't need to be aligned.
+    while (nrOfWords >= PRUMEM_BURST_SIZE / sizeof(uint32_t)) {
+        const uint32x4_t low = vld1q_u32(srcWords);
+        const uint32x4_t high = vld1q_u32(srcWords + 4);
+        vst1q_u32((uint32_t *)dstWords, low);
+        vst1q_u32((uint32_t *)dstWords + 4, high);
+        dstWords += PRUMEM_BURST_SIZE / sizeof(uint32_t);
+        srcWords += PRUMEM_BURST_SIZE / sizeof(uint32_t);
+        nrOfWords -= PRUMEM_BURST_SIZE / sizeof(uint32_t);
+    }
+#endif
+
+    // Write whatever is left word by word
+    while (nrOfWords) {
+        *dstWords++ = *srcWords++;
+        nrOfWords--;
+    }
+}
+
+// Make sure all previous writes into PRU memory have completed before any
+// subsequent write (such as the one triggering the PRU system event) is
+// performed.
+void releasePruMemory(void) {
+    __sync_synchronize();
+}
+
+// Read a word the PRU may be changing at any time. The value is loaded from
+// the device every time, and nothing the PRU has written before the word gets
+// read any earlier than the word itself.
+uint32_t readPruWord(const void *address) {
+    const uint32_t value = *(const volatile uint32_t *)address;
+
+    __sync_synchronize();
+
+    return value;
+}
@@ -0,0 +1,26 @@
+/*
+ * prumem.h
+ *
+ * Transfer of data into the PRU memories. The PRU memories are mapped through
+ * the UIO driver which makes them uncached device memory on the host side so
+ * each individual store results in a separate bus transaction. Data therefore
+ * gets assembled in regular (cached) memory first and is then published in
+ * bursts of wide, aligned stores. A single release barrier makes everything
+ * that has been published visible to the PRU before it gets signaled. Words
+ * the PRU updates while running are read back through readPruWord() so that
+ * they can be polled.
+ *
+ * Copyright (C) 2014 Texas Instruments Incorporated - http://www.ti.com/
+ * ALL RIGHTS RESERVED
+ */
+
+#ifndef PRUMEM_H_
+#define PRUMEM_H_
+
+#include <stdint.h>
+
+void copyToPruMemory(void *dst, const void *src, const uint32_t size);
+void releasePruMemory(void);
+uint32_t readPruWord(const void *address);
+
+#endif /* PRUMEM_H_ */
@@ -0,0 +1,691 @@
+/*
+ * prussdrvmock.c
+ *
+ * Drop-in replacement for app_loader/interface/prussdrv.c that lets the host
+ * application run end to end on a Linux machine without any PRU, for example
+ * to measure its CPU usage, queue flush stalls and throughput. It gets built
+ * instead of prussdrv.c by the "Mock" build configuration.
+ *
+ * The PRUSS memory map is backed by a memfd laid out like the one of the
+ * AM335x. Enabling PRU1 starts the simulated printer driver (see queuesim.h)
+ * on the shared RAM, which drains the printer queue with the timing of the
+ * real printer. Setting the environment variable PRUSSDRV_MOCK_FAST makes it
+ * run as fast as possible instead. The simulation is a hand-written stub of
+ * the firmware's queue protocol that needs to be kept in step with the
+ * firmware, so firmware changes are best checked using "pruprinter_sim" too.
+ *
+ * The interrupt controller is modeled at the level of system events, their
+ * channel and host mapping as set up through prussdrv_pruintc_init() and the
+ * host interrupt enables. System event ARM_PRU1_INTERRUPT rings the doorbell
+ * of the simulation, an eventfd, and the simulation's completion and
+ * watermark eventfds raise PRU1_ARM_INTERRUPT and PRU0_ARM_INTERRUPT. Just
+ * like the uio_pruss driver, a host interrupt disables itself when it fires
+ * until prussdrv_pru_clear_event() re-enables it, and its file descriptor
+ * delivers the interrupt count as a 32-bit value. As eventfds can only be
+ * read 64 bits at a time, those file descriptors are pipes.
+ *
+ * Images are written to the instruction RAM as they are, as far as they fit
+ * and without looking into ELF files, as the simulation doesn't execute them.
+ *
+ * Copyright (C) 2014 Texas Instruments Incorporated - http://www.ti.com/
+ * ALL RIGHTS RESERVED
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+
+// PRU driver header file
+#include "prussdrv.h"
+#include "pruss_intc_mapping.h"
+
+#include "queuesim.h"
+
+// Layout of the AM335x PRUSS memory map
+#define MOCK_PRUSS_PHYS_BASE        0x4a300000
+#define MOCK_PRUSS_MMAP_SIZE        0x40000
+#define MOCK_DATARAM0_OFFSET        0x00000
+#define MOCK_DATARAM1_OFFSET        0x02000
+#define MOCK_SHAREDRAM_OFFSET       0x10000
+#define MOCK_INTC_OFFSET            0x20000
+#define MOCK_CFG_OFFSET             0x26000
+#define MOCK_UART_OFFSET            0x28000
+#define MOCK_IEP_OFFSET             0x2e000
+#define MOCK_ECAP_OFFSET            0x30000
+#define MOCK_MIIRT_OFFSET           0x32000
+#define MOCK_MDIO_OFFSET            0x32400
+#define MOCK_IRAM0_OFFSET           0x34000
+#define MOCK_IRAM1_OFFSET           0x38000
+#define MOCK_DATARAM_SIZE           0x2000
+#define MOCK_SHAREDRAM_SIZE         0x3000
+#define MOCK_IRAM_SIZE              0x2000
+
+// Host interrupts 0 and 1 go to the PRUs, 2 to 9 are PRU_EVTOUT0 to 7
+#define MOCK_FIRST_EVTOUT_HOST      2
+
+// FNV-1a parameters used for the image hash
+#define MOCK_HASH_OFFSET_BASIS      0x811C9DC5
+#define MOCK_HASH_PRIME             0x01000193
+
+typedef struct {
+    int memFd;
+    uint8_t *pruss;
+    int readFd[NUM_PRU_HOSTIRQS];
+    int writeFd[NUM_PRU_HOSTIRQS];
+    unsigned int hostCount[NUM_PRU_HOSTIRQS];
+    bool hostEnabled[NUM_PRU_HOSTIRQS];
+    pthread_t irqThread[NUM_PRU_HOSTIRQS];
+    pthread_mutex_t intcLock;
+    tpruss_intc_initdata intcData;
+    uint64_t sysEvtEnabled;
+    uint64_t sysEvtStatus;
+    PRINTER_QueueSim sim;
+    bool pru1Enabled;
+    pthread_t bridgeThread;
+    int bridgeStopFd;
+} MOCK_State;
+
+static MOCK_State mock = {
+    .memFd = -1,
+    .intcLock = PTHREAD_MUTEX_INITIALIZER,
+    .bridgeStopFd = -1
+};
+
+static bool mapPruss(void);
+static uint8_t *getRamArea(const unsigned int pru_ram_id, uint32_t *size);
+static void raiseSysEvent(const unsigned int sysevent);
+static void fireHostInterrupts(void);
+static void *runBridge(void *arg);
+static void stopPru1(void);
+static unsigned int hashBytes(unsigned int hash, const void *data,
+        const unsigned int length);
+
+int prussdrv_init(void) {
+    unsigned int i;
+
+    for (i = 0; i < NUM_PRU_HOSTIRQS; i++) {
+        mock.readFd[i] = -1;
+        mock.writeFd[i] = -1;
+    }
+
+    return 0;
+}
+
+int prussdrv_open(unsigned int host_interrupt) {
+    int fds[2];
+
+    if ((host_interrupt >= NUM_PRU_HOSTIRQS) || !mapPruss()) {
+        return -1;
+    }
+
+    if (mock.readFd[host_interrupt] >= 0) {
+        return 0;
+    }
+
+    // Firing a host interrupt must never block
+    if (pipe2(fds, O_CLOEXEC)) {
+        return -1;
+    }
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+
+    pthread_mutex_lock(&mock.intcLock);
+    mock.readFd[host_interrupt] = fds[0];
+    mock.writeFd[host_interrupt] = fds[1];
+    mock.hostEnabled[host_interrupt] = true;
+    pthread_mutex_unlock(&mock.intcLock);
+
+    return 0;
+}
+
+int prussdrv_version(void) {
+    return PRUSS_V2;
+}
+
+const char *prussdrv_strversion(int version) {
+    return (version == PRUSS_V2) ? "AM33XX (mock)" : "UNKNOWN";
+}
+
+int prussdrv_pru_reset(unsigned int prunum) {
+    return prussdrv_pru_disable(prunum);
+}
+
+int prussdrv_pru_enable(unsigned int prunum) {
+    const bool realTime = !getenv("PRUSSDRV_MOCK_FAST");
+
+    // Only PRU1 runs something, the simulated printer driver
+    if ((prunum != 1) || mock.pru1Enabled) {
+        return (prunum > 1) ? -1 : 0;
+    }
+
+    if (!mock.pruss) {
+        return -1;
+    }
+
+    if (!startQueueSim(&mock.sim,
+            (PRINTER_Queue *)(mock.pruss + MOCK_SHAREDRAM_OFFSET),
+            mock.pruss + MOCK_DATARAM1_OFFSET,
+            (PRINTER_MacroStore *)(mock.pruss + MOCK_DATARAM0_OFFSET),
+            realTime)) {
+        return -1;
+    }
+
+    mock.bridgeStopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if ((mock.bridgeStopFd < 0) ||
+            pthread_create(&mock.bridgeThread, NULL, runBridge, NULL)) {
+        if (mock.bridgeStopFd >= 0) {
+            close(mock.bridgeStopFd);
+            mock.bridgeStopFd = -1;
+        }
+        stopQueueSim(&mock.sim);
+        return -1;
+    }
+    mock.pru1Enabled = true;
+
+    return 0;
+}
+
+int prussdrv_pru_disable(unsigned int prunum) {
+    if (prunum > 1) {
+        return -1;
+    }
+
+    if (prunum == 1) {
+        stopPru1();
+    }
+
+    return 0;
+}
+
+int prussdrv_pru_write_memory(unsigned int pru_ram_id,
+        unsigned int wordoffset, unsigned int *memarea,
+        unsigned int bytelength) {
+    uint32_t size;
+    uint8_t *area = getRamArea(pru_ram_id, &size);
+
+    if (!area || (wordoffset * 4 + bytelength > size)) {
+        return -1;
+    }
+    memcpy(area + wordoffset * 4, memarea, bytelength);
+
+    return (bytelength + 3) / 4;
+}
+
+int prussdrv_pru_verify_memory(unsigned int pru_ram_id,
+        unsigned int wordoffset, const unsigned int *memarea,
+        unsigned int bytelength) {
+    uint32_t size;
+    const uint8_t *area = getRamArea(pru_ram_id, &size);
+
+    if (!area || (wordoffset * 4 + bytelength > size) ||
+            memcmp(area + wordoffset * 4, memarea, bytelength)) {
+        return -1;
+    }
+
+    return 0;
+}
+
+int prussdrv_load_image(unsigned int prunum, const void *image,
+        unsigned int length, unsigned int flags,
+        tprussdrv_load_info *info) {
+    struct timespec startTime;
+    struct timespec endTime;
+    const unsigned int ramId = prunum ? PRUSS0_PRU1_IRAM : PRUSS0_PRU0_IRAM;
+    const unsigned int iramBytes = (length < MOCK_IRAM_SIZE) ? length :
+            MOCK_IRAM_SIZE;
+
+    clock_gettime(CLOCK_MONOTONIC, &startTime);
+    if ((prunum > 1) || !length) {
+        return -1;
+    }
+    prussdrv_pru_disable(prunum);
+    if ((prussdrv_pru_write_memory(ramId, 0, (unsigned int *)image,
+                iramBytes) < 0) ||
+            ((flags & PRUSSDRV_LOAD_VERIFY) &&
+                prussdrv_pru_verify_memory(ramId, 0, image, iramBytes))) {
+        return -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &endTime);
+
+    if (info) {
+        info->iram_bytes = iramBytes;
+        info->dram_bytes = 0;
+        info->load_time_us = (endTime.tv_sec - startTime.tv_sec) * 1000000 +
+                (endTime.tv_nsec - startTime.tv_nsec) / 1000;
+        info->image_hash = hashBytes(MOCK_HASH_OFFSET_BASIS, image, length);
+    }
+
+    return 0;
+}
+
+int prussdrv_load_file(unsigned int prunum, const char *filename,
+        unsigned int flags, tprussdrv_load_info *info) {
+    struct stat fileStat;
+    void *image;
+    int fd;
+    int result;
+
+    fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(fd, &fileStat) || !fileStat.st_size) {
+        close(fd);
+        return -1;
+    }
+
+    image = mmap(NULL, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED) {
+        return -1;
+    }
+
+    result = prussdrv_load_image(prunum, image, fileStat.st_size, flags,
+            info);
+    munmap(image, fileStat.st_size);
+
+    return result;
+}
+
+int prussdrv_pruintc_init(tpruss_intc_initdata *prussintc_init_data) {
+    unsigned int i;
+
+    pthread_mutex_lock(&mock.intcLock);
+    mock.intcData = *prussintc_init_data;
+    mock.sysEvtEnabled = 0;
+    mock.sysEvtStatus = 0;
+    for (i = 0; (i < NUM_PRU_SYS_EVTS) &&
+            (prussintc_init_data->sysevts_enabled[i] >= 0); i++) {
+        mock.sysEvtEnabled |= 1ULL << prussintc_init_data->sysevts_enabled[i];
+    }
+    pthread_mutex_unlock(&mock.intcLock);
+
+    return 0;
+}
+
+short prussdrv_get_event_to_channel_map(unsigned int eventnum) {
+    unsigned int i;
+
+    for (i = 0; (i < NUM_PRU_SYS_EVTS) &&
+            (mock.intcData.sysevt_to_channel_map[i].sysevt != -1); i++) {
+        if (mock.intcData.sysevt_to_channel_map[i].sysevt == eventnum) {
+            return mock.intcData.sysevt_to_channel_map[i].channel;
+        }
+    }
+
+    return -1;
+}
+
+short prussdrv_get_channel_to_host_map(unsigned int channel) {
+    unsigned int i;
+
+    for (i = 0; (i < NUM_PRU_CHANNELS) &&
+            (mock.intcData.channel_to_host_map[i].channel != -1); i++) {
+        if (mock.intcData.channel_to_host_map[i].channel == channel) {
+            return mock.intcData.channel_to_host_map[i].host;
+        }
+    }
+
+    return -1;
+}
+
+short prussdrv_get_event_to_host_map(unsigned int eventnum) {
+    const short channel = prussdrv_get_event_to_channel_map(eventnum);
+
+    return (channel < 0) ? -1 : prussdrv_get_channel_to_host_map(channel);
+}
+
+int prussdrv_map_l3mem(void **address) {
+    *address = NULL;
+    return -1;
+}
+
+int prussdrv_map_extmem(void **address) {
+    *address = NULL;
+    return -1;
+}
+
+unsigned int prussdrv_extmem_size(void) {
+    return 0;
+}
+
+int prussdrv_map_prumem(unsigned int pru_ram_id, void **address) {
+    uint32_t size;
+
+    switch (pru_ram_id) {
+    case PRUSS0_PRU0_DATARAM:
+    case PRUSS0_PRU1_DATARAM:
+    case PRUSS0_SHARED_DATARAM:
+        *address = getRamArea(pru_ram_id, &size);
+        return *address ? 0 : -1;
+    default:
+        *address = NULL;
+        return -1;
+    }
+}
+
+int prussdrv_map_peripheral_io(unsigned int per_id, void **address) {
+    static const uint32_t offsets[] = {
+        MOCK_CFG_OFFSET,
+        MOCK_UART_OFFSET,
+        MOCK_IEP_OFFSET,
+        MOCK_ECAP_OFFSET,
+        MOCK_MIIRT_OFFSET,
+        MOCK_MDIO_OFFSET
+    };
+
+    if (!mock.pruss || (per_id < PRUSS0_CFG) || (per_id > PRUSS0_MDIO)) {
+        *address = NULL;
+        return -1;
+    }
+    *address = mock.pruss + offsets[per_id - PRUSS0_CFG];
+
+    return 0;
+}
+
+unsigned int prussdrv_get_phys_addr(void *address) {
+    const uint8_t *byteAddress = address;
+
+    if (!mock.pruss || (byteAddress < mock.pruss) ||
+            (byteAddress >= mock.pruss + MOCK_PRUSS_MMAP_SIZE)) {
+        return 0;
+    }
+
+    return MOCK_PRUSS_PHYS_BASE + (byteAddress - mock.pruss);
+}
+
+void *prussdrv_get_virt_addr(unsigned int phyaddr) {
+    if (!mock.pruss || (phyaddr < MOCK_PRUSS_PHYS_BASE) ||
+            (phyaddr >= MOCK_PRUSS_PHYS_BASE + MOCK_PRUSS_MMAP_SIZE)) {
+        return NULL;
+    }
+
+    return mock.pruss + (phyaddr - MOCK_PRUSS_PHYS_BASE);
+}
+
+unsigned int prussdrv_pru_wait_event(unsigned int host_interrupt) {
+    unsigned int eventCount = 0;
+
+    if (host_interrupt < NUM_PRU_HOSTIRQS) {
+        read(mock.readFd[host_interrupt], &eventCount, sizeof(eventCount));
+    }
+
+    return eventCount;
+}
+
+int prussdrv_pru_event_fd(unsigned int host_interrupt) {
+    return (host_interrupt < NUM_PRU_HOSTIRQS) ?
+            mock.readFd[host_interrupt] : -1;
+}
+
+int prussdrv_pru_send_event(unsigned int eventnum) {
+    if (eventnum >= NUM_PRU_SYS_EVTS) {
+        return -1;
+    }
+
+    // The firmware picks up its interrupt right away while it is running,
+    // which clears the event again
+    if ((eventnum == ARM_PRU1_INTERRUPT) && mock.pru1Enabled) {
+        ringQueueSimDoorbell(&mock.sim);
+        return 0;
+    }
+
+    raiseSysEvent(eventnum);
+
+    return 0;
+}
+
+int prussdrv_pru_clear_event(unsigned int host_interrupt,
+        unsigned int sysevent) {
+    if ((host_interrupt >= NUM_PRU_HOSTIRQS) ||
+            (sysevent >= NUM_PRU_SYS_EVTS)) {
+        return -1;
+    }
+
+    // Re-enable the host interrupt after clearing the event. Should another
+    // event mapped to it be pending it fires again right away.
+    pthread_mutex_lock(&mock.intcLock);
+    mock.sysEvtStatus &= ~(1ULL << sysevent);
+    mock.hostEnabled[host_interrupt] = true;
+    fireHostInterrupts();
+    pthread_mutex_unlock(&mock.intcLock);
+
+    return 0;
+}
+
+int prussdrv_pru_send_wait_clear_event(unsigned int send_eventnum,
+        unsigned int host_interrupt, unsigned int ack_eventnum) {
+    prussdrv_pru_send_event(send_eventnum);
+    prussdrv_pru_wait_event(host_interrupt);
+    prussdrv_pru_clear_event(host_interrupt, ack_eventnum);
+
+    return 0;
+}
+
+int prussdrv_exit(void) {
+    unsigned int i;
+
+    stopPru1();
+
+    for (i = 0; i < NUM_PRU_HOSTIRQS; i++) {
+        if (mock.readFd[i] >= 0) {
+            close(mock.readFd[i]);
+            close(mock.writeFd[i]);
+        }
+        mock.readFd[i] = -1;
+        mock.writeFd[i] = -1;
+        mock.hostCount[i] = 0;
+        mock.hostEnabled[i] = false;
+    }
+
+    if (mock.pruss) {
+        munmap(mock.pruss, MOCK_PRUSS_MMAP_SIZE);
+        mock.pruss = NULL;
+    }
+    if (mock.memFd >= 0) {
+        close(mock.memFd);
+        mock.memFd = -1;
+    }
+
+    return 0;
+}
+
+int prussdrv_exec_program(int prunum, char *filename) {
+    if (prussdrv_load_file(prunum, filename, 0, NULL)) {
+        return -1;
+    }
+
+    return prussdrv_pru_enable(prunum);
+}
+
+int prussdrv_start_irqthread(unsigned int host_interrupt, int priority,
+        prussdrv_function_handler irqhandler) {
+    pthread_attr_t attr;
+    struct sched_param param;
+    int result;
+
+    if (host_interrupt >= NUM_PRU_HOSTIRQS) {
+        return -1;
+    }
+
+    pthread_attr_init(&attr);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+    param.sched_priority = priority;
+    pthread_attr_setschedparam(&attr, &param);
+
+    result = pthread_create(&mock.irqThread[host_interrupt], &attr,
+            irqhandler, NULL);
+    pthread_attr_destroy(&attr);
+
+    return result;
+}
+
+// Create the memfd backing the PRUSS memory map unless it already exists.
+// Like the PRU memories it starts out cleared.
+static bool mapPruss(void) {
+    void *pruss;
+
+    if (mock.pruss) {
+        return true;
+    }
+
+    mock.memFd = memfd_create("pruss", MFD_CLOEXEC);
+    if (mock.memFd < 0) {
+        return false;
+    }
+
+    if (ftruncate(mock.memFd, MOCK_PRUSS_MMAP_SIZE)) {
+        close(mock.memFd);
+        mock.memFd = -1;
+        return false;
+    }
+
+    pruss = mmap(NULL, MOCK_PRUSS_MMAP_SIZE, PROT_READ | PROT_WRITE,
+            MAP_SHARED, mock.memFd, 0);
+    if (pruss == MAP_FAILED) {
+        close(mock.memFd);
+        mock.memFd = -1;
+        return false;
+    }
+    mock.pruss = pruss;
+
+    return true;
+}
+
+static uint8_t *getRamArea(const unsigned int pru_ram_id, uint32_t *size) {
+    if (!mock.pruss) {
+        return NULL;
+    }
+
+    switch (pru_ram_id) {
+    case PRUSS0_PRU0_DATARAM:
+        *size = MOCK_DATARAM_SIZE;
+        return mock.pruss + MOCK_DATARAM0_OFFSET;
+    case PRUSS0_PRU1_DATARAM:
+        *size = MOCK_DATARAM_SIZE;
+        return mock.pruss + MOCK_DATARAM1_OFFSET;
+    case PRUSS0_PRU0_IRAM:
+        *size = MOCK_IRAM_SIZE;
+        return mock.pruss + MOCK_IRAM0_OFFSET;
+    case PRUSS0_PRU1_IRAM:
+        *size = MOCK_IRAM_SIZE;
+        return mock.pruss + MOCK_IRAM1_OFFSET;
+    case PRUSS0_SHARED_DATARAM:
+        *size = MOCK_SHAREDRAM_SIZE;
+        return mock.pruss + MOCK_SHAREDRAM_OFFSET;
+    default:
+        return NULL;
+    }
+}
+
+static void raiseSysEvent(const unsigned int sysevent) {
+    pthread_mutex_lock(&mock.intcLock);
+    mock.sysEvtStatus |= 1ULL << sysevent;
+    fireHostInterrupts();
+    pthread_mutex_unlock(&mock.intcLock);
+}
+
+// Fire each enabled host interrupt that has an enabled system event pending.
+// Must be called with the INTC lock held.
+static void fireHostInterrupts(void) {
+    const uint64_t pending = mock.sysEvtStatus & mock.sysEvtEnabled;
+    unsigned int sysevent;
+    short host;
+    unsigned int i;
+
+    for (sysevent = 0; sysevent < NUM_PRU_SYS_EVTS; sysevent++) {
+        if (!(pending & (1ULL << sysevent))) {
+            continue;
+        }
+
+        host = prussdrv_get_event_to_host_map(sysevent);
+        if ((host < MOCK_FIRST_EVTOUT_HOST) ||
+                !(mock.intcData.host_enable_bitmask & (1 << host))) {
+            continue;
+        }
+
+        i = host - MOCK_FIRST_EVTOUT_HOST;
+        if ((i >= NUM_PRU_HOSTIRQS) || !mock.hostEnabled[i] ||
+                (mock.writeFd[i] < 0)) {
+            continue;
+        }
+
+        mock.hostEnabled[i] = false;
+        mock.hostCount[i]++;
+        write(mock.writeFd[i], &mock.hostCount[i], sizeof(mock.hostCount[i]));
+    }
+}
+
+// Thread passing the events the simulated printer driver signals on to the
+// interrupt controller
+static void *runBridge(void *arg) {
+    struct pollfd pollFds[3];
+    uint64_t count;
+
+    pollFds[0].fd = mock.sim.completionFd;
+    pollFds[0].events = POLLIN;
+    pollFds[1].fd = mock.sim.watermarkFd;
+    pollFds[1].events = POLLIN;
+    pollFds[2].fd = mock.bridgeStopFd;
+    pollFds[2].events = POLLIN;
+
+    while (true) {
+        if ((poll(pollFds, 3, -1) < 0) && (errno != EINTR)) {
+            break;
+        }
+        if (pollFds[2].revents) {
+            break;
+        }
+        if (read(mock.sim.completionFd, &count, sizeof(count)) ==
+                sizeof(count)) {
+            raiseSysEvent(PRU1_ARM_INTERRUPT);
+        }
+        if (read(mock.sim.watermarkFd, &count, sizeof(count)) ==
+                sizeof(count)) {
+            raiseSysEvent(PRU0_ARM_INTERRUPT);
+        }
+    }
+
+    return NULL;
+}
+
+static void stopPru1(void) {
+    const uint64_t increment = 1;
+
+    if (!mock.pru1Enabled) {
+        return;
+    }
+
+    if (write(mock.bridgeStopFd, &increment, sizeof(increment)) ==
+            sizeof(increment)) {
+        pthread_join(mock.bridgeThread, NULL);
+    }
+    close(mock.bridgeStopFd);
+    mock.bridgeStopFd = -1;
+    stopQueueSim(&mock.sim);
+    mock.pru1Enabled = false;
+}
+
+static unsigned int hashBytes(unsigned int hash, const void *data,
+        const unsigned int length) {
+    const uint8_t *bytes = data;
+    unsigned int i;
+
+    for (i = 0; i < length; i++) {
+        hash = (hash ^ bytes[i]) * MOCK_HASH_PRIME;
+    }
+
+    return hash;
+}
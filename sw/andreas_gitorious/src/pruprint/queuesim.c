@@ -0,0 +1,729 @@
+/*
+ * queuesim.c
+ *
+ * Simulated printer driver. See queuesim.h for details.
+ *
+ * Copyright (C) 2014 Texas Instruments Incorporated - http://www.ti.com/
+ * ALL RIGHTS RESERVED
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/eventfd.h>
+
+#include "queuesim.h"
+
+// Pacing doesn't bother sleeping for less than this many nanoseconds
+#define QUEUESIM_MIN_SLEEP_NS       100000
+
+static void *runQueueSim(void *arg);
+static bool waitForDoorbell(PRINTER_QueueSim *sim);
+static void processPrintJob(PRINTER_QueueSim *sim);
+static void printPass(PRINTER_QueueSim *sim, const uint8_t dotData[]);
+static void storeLinePass(PRINTER_QueueSim *sim);
+static void repeatLine(PRINTER_QueueSim *sim);
+static void advanceMotorHalfStep(PRINTER_QueueSim *sim);
+static void measureRead(PRINTER_ReadMeasurement *measurement);
+static void printLineRefs(PRINTER_QueueSim *sim, const PRINTER_JobItem *item);
+static void initMacroStore(PRINTER_QueueSim *sim);
+static bool defineMacro(PRINTER_QueueSim *sim, const uint32_t macroId,
+        const uint32_t body[], const uint32_t length);
+static void removeMacro(PRINTER_QueueSim *sim, const uint32_t macroId);
+static bool isInsideMacro(const PRINTER_QueueSim *sim);
+static const PRINTER_JobItem *findLoopEnd(const PRINTER_JobItem *item);
+static bool waitForQueueItems(PRINTER_QueueSim *sim);
+static void updateQueueProgress(PRINTER_QueueSim *sim,
+        const PRINTER_JobItem *currentItem, const PRINTER_JobItem *nextItem);
+static void checkQueueWatermark(PRINTER_QueueSim *sim);
+static void signalEvent(const int fd);
+static void traceEvent(PRINTER_QueueSim *sim, const uint32_t type,
+        const uint32_t arg);
+static void spendTime(PRINTER_QueueSim *sim, const uint64_t timeNs);
+static void resetPacing(PRINTER_QueueSim *sim);
+static bool isStopRequested(const PRINTER_QueueSim *sim);
+static uint64_t getTimeNs(void);
+
+bool startQueueSim(PRINTER_QueueSim *sim, PRINTER_Queue *queue,
+        void *pruDataRam, PRINTER_MacroStore *macroStore, const bool realTime) {
+    memset(sim, 0, sizeof(*sim));
+    sim->queue = queue;
+    sim->pruDataRam = pruDataRam;
+    sim->macroStore = macroStore;
+    sim->realTime = realTime;
+
+    sim->doorbellFd = eventfd(0, EFD_NONBLOCK);
+    sim->completionFd = eventfd(0, EFD_NONBLOCK);
+    sim->watermarkFd = eventfd(0, EFD_NONBLOCK);
+    sim->stopFd = eventfd(0, EFD_NONBLOCK);
+    if ((sim->doorbellFd < 0) || (sim->completionFd < 0) ||
+            (sim->watermarkFd < 0) || (sim->stopFd < 0) ||
+            pthread_create(&sim->thread, NULL, runQueueSim, sim)) {
+        stopQueueSim(sim);
+        return false;
+    }
+    sim->threadStarted = true;
+
+    return true;
+}
+
+void stopQueueSim(PRINTER_QueueSim *sim) {
+    if (sim->threadStarted) {
+        signalEvent(sim->stopFd);
+        pthread_join(sim->thread, NULL);
+        sim->threadStarted = false;
+    }
+
+    if (sim->doorbellFd >= 0) {
+        close(sim->doorbellFd);
+    }
+    if (sim->completionFd >= 0) {
+        close(sim->completionFd);
+    }
+    if (sim->watermarkFd >= 0) {
+        close(sim->watermarkFd);
+    }
+    if (sim->stopFd >= 0) {
+        close(sim->stopFd);
+    }
+    sim->doorbellFd = -1;
+    sim->completionFd = -1;
+    sim->watermarkFd = -1;
+    sim->stopFd = -1;
+}
+
+void ringQueueSimDoorbell(PRINTER_QueueSim *sim) {
+    signalEvent(sim->doorbellFd);
+}
+
+// Get the time the real printer would have spent processing the commands so
+// far. Time spent waiting for the host isn't included.
+uint64_t getQueueSimTimeNs(const PRINTER_QueueSim *sim) {
+    return __atomic_load_n(&sim->simulatedTimeNs, __ATOMIC_RELAXED);
+}
+
+// Thread standing in for the firmware's main()
+static void *runQueueSim(void *arg) {
+    PRINTER_QueueSim *sim = arg;
+    PRINTER_FirmwareInfo *firmwareInfo = (PRINTER_FirmwareInfo *)
+            ((uint8_t *)sim->pruDataRam + PRINTER_FW_INFO_OFFSET);
+
+    // Nothing gets timed here, so the statistics don't show any phases
+    sim->queue->status.all = 0;
+    memset(&sim->queue->stats, 0, sizeof(sim->queue->stats));
+    ((PRINTER_TraceRing *)((uint8_t *)sim->pruDataRam +
+            PRINTER_TRACE_OFFSET))->writeCount = 0;
+    initMacroStore(sim);
+    firmwareInfo->buildId = PRINTER_FW_BUILD_ID;
+    firmwareInfo->idleCount = 0;
+    firmwareInfo->magic = PRINTER_FW_INFO_MAGIC;
+
+    while (!sim->queue->status.bits.pruHaltRequested &&
+            waitForDoorbell(sim)) {
+        processPrintJob(sim);
+        if (sim->stopped) {
+            break;
+        }
+
+        // Start the keep-warm timer and let the host know the job is done
+        sim->keepWarmDeadlineNs = getTimeNs() +
+                (uint64_t)sim->queue->progress.keepWarmMs * 1000000;
+        __sync_synchronize();
+        sim->queue->progress.completedJobs++;
+        __sync_synchronize();
+        if (!sim->queue->progress.busyPoll) {
+            signalEvent(sim->completionFd);
+        }
+    }
+
+    sim->headPowered = false;
+    firmwareInfo->magic = 0;
+
+    return NULL;
+}
+
+// Wait for the host to ring the doorbell, powering the head down once the
+// keep-warm time is up. Returns false if the simulation is to be stopped.
+static bool waitForDoorbell(PRINTER_QueueSim *sim) {
+    struct pollfd pollFds[2];
+    uint64_t count;
+    uint64_t now;
+    int timeout;
+
+    pollFds[0].fd = sim->doorbellFd;
+    pollFds[0].events = POLLIN;
+    pollFds[1].fd = sim->stopFd;
+    pollFds[1].events = POLLIN;
+
+    while (read(sim->doorbellFd, &count, sizeof(count)) != sizeof(count)) {
+        timeout = -1;
+        if (sim->headPowered && sim->queue->progress.keepWarmMs) {
+            now = getTimeNs();
+            if (now >= sim->keepWarmDeadlineNs) {
+                sim->headPowered = false;
+                continue;
+            }
+            timeout = (sim->keepWarmDeadlineNs - now + 999999) / 1000000;
+        }
+
+        if ((poll(pollFds, 2, timeout) < 0) && (errno != EINTR)) {
+            return false;
+        }
+        if (pollFds[1].revents) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void processPrintJob(PRINTER_QueueSim *sim) {
+    PRINTER_Queue *queue = sim->queue;
+    PRINTER_MacroStore *macroStore = sim->macroStore;
+    const PRINTER_JobItem *currentItem =
+            (const PRINTER_JobItem *)queue->jobItems;
+    const PRINTER_JobItem *nextItem;
+    uint32_t i;
+    bool endJob = false;
+
+    // Loops and macro calls never carry over from one print job to the next.
+    // The host resets the progress counters before kicking off a job.
+    sim->nestingLevel = 0;
+    sim->ringItem = currentItem;
+    sim->signaledProducedBytes = 0;
+    sim->signaledBacklog = 0;
+    resetPacing(sim);
+    traceEvent(sim, PRINTER_TRACE_JOB_START, queue->progress.completedJobs);
+
+    while (!endJob) {
+        // Items located in the printer queue may not have been published by
+        // the host yet. Items inside loops and macros are always available.
+        if (!sim->nestingLevel && !waitForQueueItems(sim)) {
+            sim->stopped = true;
+            return;
+        }
+        traceEvent(sim, PRINTER_TRACE_ITEM_START, currentItem->command);
+
+        nextItem = (const PRINTER_JobItem *)((const uint8_t *)currentItem +
+                PRINTER_JOB_ITEM_SIZE(currentItem->length));
+
+        switch (currentItem->command) {
+        case PRINTER_CMD_OPEN:
+            // Power up the printer head unless it was kept warm
+            if (!sim->headPowered) {
+                spendTime(sim, QUEUESIM_POWER_UP_NS);
+                sim->headPowered = true;
+            }
+            sim->motorStepIndex = 0;
+            sim->nrOfLinePasses = 0;
+            sim->linePassesOverflow = false;
+            sim->lineCompleted = false;
+            break;
+        case PRINTER_CMD_PRINT_LINE:
+            if (currentItem->length == PRINTER_BYTES_PER_LINE) {
+                printPass(sim, (const uint8_t *)currentItem->data);
+                storeLinePass(sim);
+            }
+            break;
+        case PRINTER_CMD_PRINT_LINE_REF:
+            printLineRefs(sim, currentItem);
+            break;
+        case PRINTER_CMD_MOTOR_HALF_STEP:
+            if (currentItem->length == sizeof(uint32_t)) {
+                if (currentItem->data[0] <= PRINTER_MAX_NR_HALF_STEPS) {
+                    for (i = 0; i < currentItem->data[0]; i++) {
+                        advanceMotorHalfStep(sim);
+                    }
+                    // Once the paper moved, the next pass starts a new line
+                    if (currentItem->data[0]) {
+                        if (sim->nrOfLinePasses && !sim->lineCompleted) {
+                            queue->progress.linesPrinted++;
+                        }
+                        sim->lineCompleted = true;
+                    }
+                }
+                else {
+                    queue->status.bits.illegalParameterError = true;
+                }
+            }
+            break;
+        case PRINTER_CMD_REPEAT_LINE:
+            if (currentItem->length == sizeof(uint32_t)) {
+                if ((currentItem->data[0] <= PRINTER_MAX_NR_HALF_STEPS) &&
+                        !sim->linePassesOverflow) {
+                    for (i = 0; i < currentItem->data[0]; i++) {
+                        repeatLine(sim);
+                    }
+                }
+                else {
+                    queue->status.bits.illegalParameterError = true;
+                }
+            }
+            break;
+        case PRINTER_CMD_TEST_SIGNALS:
+            // The test pattern generation never returns, so there is nothing
+            // left to do but to wait for the simulation to be stopped
+            while (!isStopRequested(sim)) {
+                usleep(QUEUESIM_POLL_NS / 1000);
+            }
+            sim->stopped = true;
+            return;
+        case PRINTER_CMD_CLOSE:
+            spendTime(sim, QUEUESIM_CLOSE_NS);
+            sim->motorStepIndex = 0;
+            if (!queue->progress.keepWarmMs) {
+                sim->headPowered = false;
+            }
+            break;
+        case PRINTER_CMD_REQUEST_PRU_HALT:
+            queue->status.bits.pruHaltRequested = true;
+            break;
+        case PRINTER_CMD_DEFINE_MACRO:
+            if ((currentItem->length < sizeof(uint32_t)) ||
+                    isInsideMacro(sim) ||
+                    !defineMacro(sim, currentItem->data[0],
+                            &currentItem->data[1],
+                            currentItem->length - sizeof(uint32_t))) {
+                queue->status.bits.illegalParameterError = true;
+            }
+            break;
+        case PRINTER_CMD_CALL_MACRO:
+            if ((currentItem->length == sizeof(uint32_t)) &&
+                    (currentItem->data[0] < PRINTER_MAX_MACROS) &&
+                    macroStore->length[currentItem->data[0]] &&
+                    (sim->nestingLevel < PRINTER_MAX_NESTING_LEVEL)) {
+                sim->frames[sim->nestingLevel].item = nextItem;
+                sim->frames[sim->nestingLevel].isMacroCall = true;
+                sim->nestingLevel++;
+                nextItem = (const PRINTER_JobItem *)
+                        ((const uint8_t *)macroStore->bodies +
+                        macroStore->offset[currentItem->data[0]]);
+            }
+            else {
+                queue->status.bits.illegalParameterError = true;
+            }
+            break;
+        case PRINTER_CMD_LOOP:
+            if ((currentItem->length == sizeof(uint32_t)) &&
+                    (sim->nestingLevel < PRINTER_MAX_NESTING_LEVEL)) {
+                if (currentItem->data[0]) {
+                    sim->frames[sim->nestingLevel].item = nextItem;
+                    sim->frames[sim->nestingLevel].remainingIterations =
+                            currentItem->data[0];
+                    sim->frames[sim->nestingLevel].isMacroCall = false;
+                    sim->nestingLevel++;
+                }
+                else {
+                    nextItem = findLoopEnd(nextItem);
+                    if (!nextItem) {
+                        queue->status.bits.illegalCommandError = true;
+                        endJob = true;
+                    }
+                }
+            }
+            else {
+                queue->status.bits.illegalParameterError = true;
+                endJob = true;
+            }
+            break;
+        case PRINTER_CMD_END_LOOP:
+            if (sim->nestingLevel &&
+                    !sim->frames[sim->nestingLevel - 1].isMacroCall) {
+                if (--sim->frames[sim->nestingLevel - 1].remainingIterations) {
+                    nextItem = sim->frames[sim->nestingLevel - 1].item;
+                }
+                else {
+                    sim->nestingLevel--;
+                }
+            }
+            else {
+                queue->status.bits.illegalCommandError = true;
+                endJob = true;
+            }
+            break;
+        case PRINTER_CMD_WRAP:
+            if (!sim->nestingLevel) {
+                nextItem = (const PRINTER_JobItem *)queue->jobItems;
+            }
+            else {
+                queue->status.bits.illegalCommandError = true;
+                endJob = true;
+            }
+            break;
+        case PRINTER_CMD_MEASURE_READ:
+            if (currentItem->length == sizeof(PRINTER_ReadMeasurement)) {
+                measureRead((PRINTER_ReadMeasurement *)currentItem->data);
+            }
+            else {
+                queue->status.bits.illegalParameterError = true;
+            }
+            break;
+        case PRINTER_CMD_EOS:
+            if (sim->nestingLevel &&
+                    sim->frames[sim->nestingLevel - 1].isMacroCall) {
+                sim->nestingLevel--;
+                nextItem = sim->frames[sim->nestingLevel].item;
+            }
+            else {
+                endJob = true;
+            }
+            break;
+        default:
+            queue->status.bits.illegalCommandError = true;
+            endJob = true;
+        }
+        traceEvent(sim, PRINTER_TRACE_ITEM_END, currentItem->command);
+
+        // Let the host know how far we got with processing the queue
+        if (!sim->nestingLevel && nextItem) {
+            updateQueueProgress(sim, currentItem, nextItem);
+        }
+
+        if (!endJob) {
+            currentItem = nextItem;
+        }
+    }
+
+    traceEvent(sim, PRINTER_TRACE_JOB_END, queue->progress.completedJobs);
+}
+
+// Account for shifting out a pass and strobing it, applying the same black
+// dot limit the firmware does
+static void printPass(PRINTER_QueueSim *sim, const uint8_t dotData[]) {
+    uint32_t blackDots = 0;
+    uint32_t i;
+
+    for (i = 0; i < PRINTER_BYTES_PER_LINE; i++) {
+        blackDots += __builtin_popcount(dotData[i]);
+    }
+    if (blackDots > PRINTER_MAX_BLACK_DOTS_PER_LINE) {
+        sim->queue->status.bits.tooManyBlackDotsError = true;
+    }
+
+    spendTime(sim, QUEUESIM_PASS_SHIFT_NS);
+    traceEvent(sim, PRINTER_TRACE_STROBE_START, 0);
+    spendTime(sim, QUEUESIM_STROBE_NS);
+    traceEvent(sim, PRINTER_TRACE_STROBE_END, 0);
+}
+
+// Keep track of the passes of the current line. Only their number matters
+// for the simulation.
+static void storeLinePass(PRINTER_QueueSim *sim) {
+    if (sim->lineCompleted) {
+        sim->nrOfLinePasses = 0;
+        sim->linePassesOverflow = false;
+        sim->lineCompleted = false;
+    }
+
+    if (sim->nrOfLinePasses >= PRINTER_MAX_PASSES_PER_LINE) {
+        sim->linePassesOverflow = true;
+        return;
+    }
+    sim->nrOfLinePasses++;
+}
+
+// A line consisting of a single pass is still held in the head's latch and
+// only needs to be strobed again, otherwise all passes get shifted out again
+static void repeatLine(PRINTER_QueueSim *sim) {
+    if (sim->nrOfLinePasses == 1) {
+        spendTime(sim, QUEUESIM_STROBE_NS);
+    }
+    else {
+        spendTime(sim, sim->nrOfLinePasses *
+                (QUEUESIM_PASS_SHIFT_NS + QUEUESIM_STROBE_NS));
+    }
+
+    sim->queue->progress.linesPrinted++;
+    advanceMotorHalfStep(sim);
+}
+
+// Take a half-step once the minimum half-step interval has passed. The motor
+// phase the step ends up in gets traced the same way the firmware does it.
+static void advanceMotorHalfStep(PRINTER_QueueSim *sim) {
+    spendTime(sim, QUEUESIM_HALF_STEP_NS);
+    traceEvent(sim, PRINTER_TRACE_STEP, sim->motorStepIndex);
+    if (++sim->motorStepIndex >= QUEUESIM_NR_OF_MOTOR_PHASES) {
+        sim->motorStepIndex = 0;
+    }
+}
+
+// Report the cycles the firmware's two read passes would take if the memory
+// was the PRU's own data RAM. Other memories aren't modeled, so the results
+// only show the loads and their loop overhead.
+static void measureRead(PRINTER_ReadMeasurement *measurement) {
+    const uint32_t nrOfLoads = measurement->length /
+            PRINTER_MEASURE_READ_BURST_SIZE;
+
+    measurement->wordReadCycles = nrOfLoads *
+            (QUEUESIM_READ_LOOP_CYCLES + QUEUESIM_WORD_READ_CYCLES);
+    measurement->burstReadCycles = nrOfLoads *
+            (QUEUESIM_READ_LOOP_CYCLES + QUEUESIM_BURST_READ_CYCLES);
+}
+
+static void printLineRefs(PRINTER_QueueSim *sim, const PRINTER_JobItem *item) {
+    const PRINTER_LineDict *lineDict = (const PRINTER_LineDict *)
+            ((const uint8_t *)sim->pruDataRam + PRINTER_LINE_DICT_OFFSET);
+    const uint16_t *lineRefs = (const uint16_t *)item->data;
+    const uint32_t nrOfLineRefs = item->length / sizeof(uint16_t);
+    uint32_t i;
+
+    for (i = 0; i < nrOfLineRefs; i++) {
+        if (lineRefs[i] == PRINTER_LINE_REF_NONE) {
+            continue;
+        }
+
+        if (lineRefs[i] >= PRINTER_MAX_LINE_DICT_ENTRIES) {
+            sim->queue->status.bits.illegalParameterError = true;
+            continue;
+        }
+
+        printPass(sim, (const uint8_t *)lineDict->lines[lineRefs[i]]);
+        storeLinePass(sim);
+    }
+}
+
+// The macro store is handled exactly like the firmware does it so that the
+// host finds it in the same state
+static void initMacroStore(PRINTER_QueueSim *sim) {
+    PRINTER_MacroStore *macroStore = sim->macroStore;
+
+    if (macroStore->magic == PRINTER_MACRO_STORE_MAGIC) {
+        return;
+    }
+
+    memset(macroStore->offset, 0, sizeof(macroStore->offset));
+    memset(macroStore->length, 0, sizeof(macroStore->length));
+    macroStore->usedBytes = 0;
+    macroStore->magic = PRINTER_MACRO_STORE_MAGIC;
+}
+
+static bool defineMacro(PRINTER_QueueSim *sim, const uint32_t macroId,
+        const uint32_t body[], const uint32_t length) {
+    PRINTER_MacroStore *macroStore = sim->macroStore;
+    PRINTER_JobItem *eosItem;
+    uint8_t *dst;
+
+    if ((macroId >= PRINTER_MAX_MACROS) || (length % sizeof(uint32_t))) {
+        return false;
+    }
+
+    removeMacro(sim, macroId);
+    if (macroStore->usedBytes + PRINTER_JOB_ITEM_SIZE(length) >
+            sizeof(macroStore->bodies)) {
+        return false;
+    }
+
+    dst = (uint8_t *)macroStore->bodies + macroStore->usedBytes;
+    memcpy(dst, body, length);
+    eosItem = (PRINTER_JobItem *)(dst + length);
+    eosItem->command = PRINTER_CMD_EOS;
+    eosItem->length = 0;
+
+    macroStore->offset[macroId] = macroStore->usedBytes;
+    macroStore->length[macroId] = PRINTER_JOB_ITEM_SIZE(length);
+    macroStore->usedBytes += PRINTER_JOB_ITEM_SIZE(length);
+
+    return true;
+}
+
+static void removeMacro(PRINTER_QueueSim *sim, const uint32_t macroId) {
+    PRINTER_MacroStore *macroStore = sim->macroStore;
+    const uint32_t offset = macroStore->offset[macroId];
+    const uint32_t length = macroStore->length[macroId];
+    uint32_t i;
+
+    if (!length) {
+        return;
+    }
+
+    memmove((uint8_t *)macroStore->bodies + offset,
+            (uint8_t *)macroStore->bodies + offset + length,
+            macroStore->usedBytes - offset - length);
+
+    for (i = 0; i < PRINTER_MAX_MACROS; i++) {
+        if (macroStore->length[i] && (macroStore->offset[i] > offset)) {
+            macroStore->offset[i] -= length;
+        }
+    }
+
+    macroStore->length[macroId] = 0;
+    macroStore->usedBytes -= length;
+}
+
+static bool isInsideMacro(const PRINTER_QueueSim *sim) {
+    uint8_t i;
+
+    for (i = 0; i < sim->nestingLevel; i++) {
+        if (sim->frames[i].isMacroCall) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static const PRINTER_JobItem *findLoopEnd(const PRINTER_JobItem *item) {
+    uint8_t level = 0;
+
+    while (item->command != PRINTER_CMD_EOS) {
+        if (item->command == PRINTER_CMD_LOOP) {
+            level++;
+        }
+        else if (item->command == PRINTER_CMD_END_LOOP) {
+            if (!level) {
+                return (const PRINTER_JobItem *)((const uint8_t *)item +
+                        PRINTER_JOB_ITEM_SIZE(item->length));
+            }
+            level--;
+        }
+        item = (const PRINTER_JobItem *)((const uint8_t *)item +
+                PRINTER_JOB_ITEM_SIZE(item->length));
+    }
+
+    return NULL;
+}
+
+// Wait until the host has published at least one more item, keeping an eye
+// on the watermark. Returns false if the simulation is to be stopped.
+static bool waitForQueueItems(PRINTER_QueueSim *sim) {
+    const volatile PRINTER_Progress *progress = &sim->queue->progress;
+    const struct timespec pollTime = { 0, QUEUESIM_POLL_NS };
+    bool waited = false;
+
+    while (progress->consumedBytes == progress->producedBytes) {
+        if (!waited) {
+            traceEvent(sim, PRINTER_TRACE_UNDERRUN_START, 0);
+        }
+        checkQueueWatermark(sim);
+        if (isStopRequested(sim)) {
+            return false;
+        }
+        nanosleep(&pollTime, NULL);
+        waited = true;
+    }
+    __sync_synchronize();
+
+    // Time spent waiting for the host doesn't count as printing time
+    if (waited) {
+        traceEvent(sim, PRINTER_TRACE_UNDERRUN_END, 0);
+        resetPacing(sim);
+    }
+
+    return true;
+}
+
+static void updateQueueProgress(PRINTER_QueueSim *sim,
+        const PRINTER_JobItem *currentItem, const PRINTER_JobItem *nextItem) {
+    PRINTER_Queue *queue = sim->queue;
+    uint32_t consumedBytes;
+
+    if (currentItem->command == PRINTER_CMD_WRAP) {
+        consumedBytes = (const uint8_t *)queue->jobItems +
+                sizeof(queue->jobItems) - (const uint8_t *)sim->ringItem;
+    }
+    else {
+        consumedBytes = (const uint8_t *)nextItem -
+                (const uint8_t *)sim->ringItem;
+    }
+    sim->ringItem = nextItem;
+
+    // Everything the host sees as consumed may be overwritten right away
+    __sync_synchronize();
+    ((volatile PRINTER_Progress *)&queue->progress)->consumedBytes +=
+            consumedBytes;
+
+    checkQueueWatermark(sim);
+}
+
+static void checkQueueWatermark(PRINTER_QueueSim *sim) {
+    const volatile PRINTER_Progress *progress = &sim->queue->progress;
+    const uint32_t producedBytes = progress->producedBytes;
+    const uint32_t backlog = producedBytes - progress->consumedBytes;
+
+    if (progress->busyPoll || !progress->lowWatermark ||
+            (backlog >= progress->lowWatermark)) {
+        return;
+    }
+
+    if ((producedBytes != sim->signaledProducedBytes) ||
+            (!backlog && sim->signaledBacklog)) {
+        signalEvent(sim->watermarkFd);
+        sim->signaledProducedBytes = producedBytes;
+        sim->signaledBacklog = backlog;
+    }
+}
+
+static void signalEvent(const int fd) {
+    const uint64_t increment = 1;
+
+    if (write(fd, &increment, sizeof(increment)) != sizeof(increment)) {
+        fprintf(stderr, "Error signaling simulated PRU event!\n");
+    }
+}
+
+// Advance the modeled time and, when running in real time, sleep until the
+// wall clock has caught up with it
+// Record an event into the trace ring. The entry needs to have landed before
+// the write count tells the host about it.
+static void traceEvent(PRINTER_QueueSim *sim, const uint32_t type,
+        const uint32_t arg) {
+    PRINTER_TraceRing *traceRing = (PRINTER_TraceRing *)
+            ((uint8_t *)sim->pruDataRam + PRINTER_TRACE_OFFSET);
+    PRINTER_TraceEntry *entry = &traceRing->entries[traceRing->writeCount %
+            PRINTER_TRACE_NR_OF_ENTRIES];
+
+    entry->timestamp = (uint32_t)(getTimeNs() * QUEUESIM_IEP_CLOCK_MHZ / 1000);
+    entry->event = PRINTER_TRACE_EVENT(type, arg);
+    __sync_synchronize();
+    traceRing->writeCount++;
+}
+
+static void spendTime(PRINTER_QueueSim *sim, const uint64_t timeNs) {
+    struct timespec deadline;
+    uint64_t deadlineNs;
+
+    __atomic_store_n(&sim->simulatedTimeNs, sim->simulatedTimeNs + timeNs,
+            __ATOMIC_RELAXED);
+    if (!sim->realTime) {
+        return;
+    }
+
+    deadlineNs = sim->paceWallTimeNs +
+            (sim->simulatedTimeNs - sim->paceSimulatedTimeNs);
+    if (deadlineNs < getTimeNs() + QUEUESIM_MIN_SLEEP_NS) {
+        return;
+    }
+
+    deadline.tv_sec = deadlineNs / 1000000000;
+    deadline.tv_nsec = deadlineNs % 1000000000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) ==
+            EINTR) {
+    }
+}
+
+// Make the wall clock and the modeled time line up again after the
+// simulation has been idle
+static void resetPacing(PRINTER_QueueSim *sim) {
+    sim->paceWallTimeNs = getTimeNs();
+    sim->paceSimulatedTimeNs = sim->simulatedTimeNs;
+}
+
+static bool isStopRequested(const PRINTER_QueueSim *sim) {
+    struct pollfd pollFd;
+
+    pollFd.fd = sim->stopFd;
+    pollFd.events = POLLIN;
+
+    return poll(&pollFd, 1, 0) > 0;
+}
+
+static uint64_t getTimeNs(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
@@ -0,0 +1,125 @@
+/*
+ * queuesim.h
+ *
+ * Simulated printer driver. The simulation is a model of the printer firmware
+ * running in a thread of the host application, with regular memory standing
+ * in for the PRU memories. It processes the printer queue the same way the
+ * firmware does, following the queue protocol (progress counters, watermark
+ * and completion events, busy-poll mode, wrap items, loops and macros) and
+ * reproducing the effect of the commands on the printer status and on the
+ * lines printed counter. It doesn't generate any signals though.
+ *
+ * The simulation is a protocol stub rather than a build of the firmware, which
+ * the "pruprinter_sim" project runs cycle by cycle. Any change to the commands,
+ * the queue protocol, the firmware info or the trace events of the firmware
+ * needs to be mirrored here, otherwise the mock silently drifts away from the
+ * firmware. The firmware can't take its place as it waits for the host by
+ * spinning on the progress counters in the shared RAM, which the PRU
+ * simulation can't pace against a host running concurrently.
+ *
+ * The time each command would take on the real printer is modeled after the
+ * timing parameters of the firmware. The simulation either paces itself to
+ * match that timing or runs as fast as possible, keeping track of the modeled
+ * time either way.
+ *
+ * The host rings the doorbell to kick off a job. The completion and watermark
+ * events are signaled through eventfds which count the number of times the
+ * respective event has been raised.
+ *
+ * Jobs, items, strobes, motor steps and underruns get recorded into the trace
+ * ring the way the firmware does it, with CLOCK_MONOTONIC converted into IEP
+ * counts as timestamps. There are no sensors, so alarms never occur.
+ *
+ * The phases of the firmware's work aren't timed, so the statistics stay at
+ * zero. Memory read measurements report the cycles the loads would take from
+ * the PRU's own data RAM, whichever memory they are made on.
+ *
+ * Copyright (C) 2014 Texas Instruments Incorporated - http://www.ti.com/
+ * ALL RIGHTS RESERVED
+ */
+
+#ifndef QUEUESIM_H_
+#define QUEUESIM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+// Interface to the PRU-based printer driver firmware "pruprinter_fw"
+#include "pruprinter.h"
+
+// Time the commands take on the real printer. Shifting out a pass and
+// latching it takes 384 clock cycles of about 130ns each, strobing the four
+// sections of the head 1ms plus the setup and driver delays each. Powering up
+// the head takes 105ms and closing the printer 5ms.
+#define QUEUESIM_PASS_SHIFT_NS      50500
+#define QUEUESIM_STROBE_NS          4013200
+#define QUEUESIM_HALF_STEP_NS       1041667
+#define QUEUESIM_POWER_UP_NS        105000000
+#define QUEUESIM_CLOSE_NS           5000000
+
+// Number of motor phases a half-step moves through, as in the firmware's
+// phase table
+#define QUEUESIM_NR_OF_MOTOR_PHASES 8
+
+// Cycles the firmware's memory read measurement takes per load when reading
+// from the PRU's own data RAM. A 32-bit load takes three cycles and each
+// additional word of a burst one more. The loop adds a few cycles to either.
+#define QUEUESIM_READ_LOOP_CYCLES   4
+#define QUEUESIM_WORD_READ_CYCLES   3
+#define QUEUESIM_BURST_READ_CYCLES  10
+
+// Interval at which the simulation checks for newly published items while it
+// is waiting for the host
+#define QUEUESIM_POLL_NS            20000
+
+// Clock the IEP counts of the trace ring are based on
+#define QUEUESIM_IEP_CLOCK_MHZ      200
+
+// Size of the memory standing in for the PRU1 data RAM
+#define QUEUESIM_DATARAM_SIZE       0x2000
+
+// Type describing a loop or macro call that is being executed
+typedef struct {
+    const PRINTER_JobItem *item;
+    uint32_t remainingIterations;
+    bool isMacroCall;
+} PRINTER_QueueSimFrame;
+
+// Type holding the state of a simulation. The memories and file descriptors
+// may be used by the host, everything else is private to the simulation.
+typedef struct {
+    PRINTER_Queue *queue;
+    void *pruDataRam;
+    PRINTER_MacroStore *macroStore;
+    int doorbellFd;
+    int completionFd;
+    int watermarkFd;
+    int stopFd;
+    bool realTime;
+    bool threadStarted;
+    pthread_t thread;
+    uint64_t simulatedTimeNs;
+    uint64_t paceWallTimeNs;
+    uint64_t paceSimulatedTimeNs;
+    PRINTER_QueueSimFrame frames[PRINTER_MAX_NESTING_LEVEL];
+    uint8_t nestingLevel;
+    const PRINTER_JobItem *ringItem;
+    uint32_t signaledProducedBytes;
+    uint32_t signaledBacklog;
+    uint8_t motorStepIndex;
+    uint8_t nrOfLinePasses;
+    bool linePassesOverflow;
+    bool lineCompleted;
+    bool headPowered;
+    uint64_t keepWarmDeadlineNs;
+    bool stopped;
+} PRINTER_QueueSim;
+
+bool startQueueSim(PRINTER_QueueSim *sim, PRINTER_Queue *queue,
+        void *pruDataRam, PRINTER_MacroStore *macroStore, const bool realTime);
+void stopQueueSim(PRINTER_QueueSim *sim);
+void ringQueueSimDoorbell(PRINTER_QueueSim *sim);
+uint64_t getQueueSimTimeNs(const PRINTER_QueueSim *sim);
+
+#endif /* QUEUESIM_H_ */
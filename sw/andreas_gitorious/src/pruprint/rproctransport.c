@@ -0,0 +1,521 @@
+/*
+ * rproctransport.c
+ *
+ * Transport driving the PRU through the remoteproc framework of current
+ * kernels. See transport.h for details.
+ *
+ * The firmware gets written to the firmware directory as an ELF image, which
+ * is what remoteproc expects, and gets booted by remoteproc. The printer
+ * firmware doesn't come with a resource table and doesn't speak rpmsg, so the
+ * PRU memories and the PRU interrupt controller (INTC) are mapped through
+ * /dev/mem and the INTC is set up the same way the uio transport does it. The
+ * doorbell is rung by setting the system event in the INTC directly. As there
+ * is no driver delivering PRU interrupts to user space the firmware events
+ * are detected by polling the raw status of their system events, driven by a
+ * periodic timer per event. Busy-poll mode avoids the added latency.
+ *
+ * Copyright (C) 2014 Texas Instruments Incorporated - http://www.ti.com/
+ * ALL RIGHTS RESERVED
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <dirent.h>
+#include <time.h>
+#include <elf.h>
+#include <sys/mman.h>
+#include <sys/timerfd.h>
+
+// PRU interrupt mapping definitions
+#include "pruss_intc_mapping.h"
+
+#include "transport.h"
+
+// Location of the remoteproc instances in sysfs and the device name prefix of
+// the instance that owns PRU1 of the AM335x PRUSS
+#define RPROC_SYSFS_DIR             "/sys/class/remoteproc"
+#define RPROC_PRU1_DEVICE_NAME      "4a338000.pru"
+
+// Where remoteproc loads firmware from and the name the printer firmware gets
+// stored under
+#define RPROC_FIRMWARE_DIR          "/lib/firmware"
+#define RPROC_FIRMWARE_NAME         "pruprinter-fw.elf"
+
+// Location of the AM335x PRUSS in the MPU's memory map and the offsets of the
+// memories and the INTC within it
+#define RPROC_PRUSS_BASE            0x4A300000
+#define RPROC_PRUSS_SIZE            0x40000
+#define RPROC_PRU0_DATARAM_OFFSET   0x00000
+#define RPROC_PRU1_DATARAM_OFFSET   0x02000
+#define RPROC_SHARED_DATARAM_OFFSET 0x10000
+#define RPROC_INTC_OFFSET           0x20000
+
+// INTC registers used, given as word offsets
+#define INTC_GER                    (0x010 / 4)
+#define INTC_SICR                   (0x024 / 4)
+#define INTC_EISR                   (0x028 / 4)
+#define INTC_HIEISR                 (0x034 / 4)
+#define INTC_SRSR0                  (0x200 / 4)
+#define INTC_CMR0                   (0x400 / 4)
+#define INTC_HMR0                   (0x800 / 4)
+
+// Rate at which the raw status of the firmware events gets polled
+#define RPROC_EVENT_POLL_NS         1000000
+
+// ELF machine type of PRU images, not known to older C libraries
+#ifndef EM_TI_PRU
+#define EM_TI_PRU                   144
+#endif
+
+// Type holding the state of the transport
+typedef struct {
+    char rprocDir[FILENAME_MAX];
+    int memFd;
+    uint8_t *pruss;
+    volatile uint32_t *intc;
+    int timerFds[PRINTER_NR_OF_EVENTS];
+} RPROC_State;
+
+// Type holding the headers of an ELF image built from separate instruction
+// and data RAM images
+typedef struct {
+    Elf32_Ehdr header;
+    Elf32_Phdr segments[2];
+} RPROC_ElfHeaders;
+
+static bool openRproc(PRINTER_Transport *transport);
+static bool openRprocMonitor(PRINTER_Transport *transport);
+static void closeRproc(PRINTER_Transport *transport, const bool stopPru);
+static bool loadRprocFirmware(PRINTER_Transport *transport,
+        const PRINTER_Firmware *firmware, PRINTER_FirmwareLoadInfo *loadInfo);
+static bool startRprocPru(PRINTER_Transport *transport);
+static void kickRproc(PRINTER_Transport *transport);
+static int getRprocEventFd(const PRINTER_Transport *transport,
+        const PRINTER_Event event);
+static bool takeRprocEvent(PRINTER_Transport *transport,
+        const PRINTER_Event event);
+static bool waitRprocEvent(PRINTER_Transport *transport,
+        const PRINTER_Event event);
+static bool findRproc(RPROC_State *state);
+static bool readRprocAttribute(const RPROC_State *state, const char *name,
+        char value[], const uint32_t size);
+static bool writeRprocAttribute(const RPROC_State *state, const char *name,
+        const char *value);
+static bool makePath(char path[], const size_t size, const char *dir,
+        const char *name);
+static void initIntc(RPROC_State *state);
+static bool writeFirmwareFile(const PRINTER_Firmware *firmware);
+static bool writeAll(const int fd, const void *data, const uint32_t size);
+
+const PRINTER_TransportOps rprocTransportOps = {
+    "rproc",
+    "PRU driven through remoteproc and /dev/mem (current kernels)",
+    PRINTER_TRANSPORT_LOCK_FILE,
+    openRproc,
+    openRprocMonitor,
+    closeRproc,
+    loadRprocFirmware,
+    startRprocPru,
+    kickRproc,
+    getRprocEventFd,
+    takeRprocEvent,
+    waitRprocEvent
+};
+
+// System events the firmware events are raised on
+static const uint32_t rprocEvents[PRINTER_NR_OF_EVENTS] = {
+    PRU1_ARM_INTERRUPT,
+    PRU0_ARM_INTERRUPT
+};
+
+static RPROC_State rprocState;
+
+static bool openRproc(PRINTER_Transport *transport) {
+    RPROC_State *state = &rprocState;
+    const struct itimerspec pollTime = {
+        { 0, RPROC_EVENT_POLL_NS }, { 0, RPROC_EVENT_POLL_NS }
+    };
+    uint32_t i;
+
+    if (!openRprocMonitor(transport)) {
+        return false;
+    }
+
+    for (i = 0; i < PRINTER_NR_OF_EVENTS; i++) {
+        state->timerFds[i] = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+        if ((state->timerFds[i] < 0) ||
+                timerfd_settime(state->timerFds[i], 0, &pollTime, NULL)) {
+            fprintf(stderr, "Error creating event poll timer!\n");
+            closeRproc(transport, false);
+            return false;
+        }
+    }
+
+    initIntc(state);
+
+    return true;
+}
+
+// Map the PRU memories without initializing the INTC or setting up the event
+// poll timers. This is all it takes to look at the PRU memories.
+static bool openRprocMonitor(PRINTER_Transport *transport) {
+    RPROC_State *state = &rprocState;
+    uint32_t i;
+
+    memset(state, 0, sizeof(*state));
+    state->memFd = -1;
+    state->pruss = MAP_FAILED;
+    for (i = 0; i < PRINTER_NR_OF_EVENTS; i++) {
+        state->timerFds[i] = -1;
+    }
+    transport->state = state;
+
+    if (!findRproc(state)) {
+        fprintf(stderr, "No remoteproc instance found for PRU1!\n");
+        return false;
+    }
+
+    state->memFd = open("/dev/mem", O_RDWR | O_SYNC);
+    if (state->memFd >= 0) {
+        state->pruss = mmap(NULL, RPROC_PRUSS_SIZE, PROT_READ | PROT_WRITE,
+                MAP_SHARED, state->memFd, RPROC_PRUSS_BASE);
+    }
+    if (state->pruss == MAP_FAILED) {
+        fprintf(stderr, "Error mapping the PRUSS through /dev/mem!\n");
+        closeRproc(transport, false);
+        return false;
+    }
+
+    transport->queue = (PRINTER_Queue *)
+            (state->pruss + RPROC_SHARED_DATARAM_OFFSET);
+    transport->pruDataRam = state->pruss + RPROC_PRU1_DATARAM_OFFSET;
+    transport->macroStore = (PRINTER_MacroStore *)
+            (state->pruss + RPROC_PRU0_DATARAM_OFFSET);
+    state->intc = (volatile uint32_t *)(state->pruss + RPROC_INTC_OFFSET);
+
+    return true;
+}
+
+static void closeRproc(PRINTER_Transport *transport, const bool stopPru) {
+    RPROC_State *state = transport->state;
+    uint32_t i;
+
+    if (stopPru) {
+        writeRprocAttribute(state, "state", "stop");
+    }
+
+    for (i = 0; i < PRINTER_NR_OF_EVENTS; i++) {
+        if (state->timerFds[i] >= 0) {
+            close(state->timerFds[i]);
+        }
+    }
+
+    if (state->pruss != MAP_FAILED) {
+        munmap(state->pruss, RPROC_PRUSS_SIZE);
+    }
+
+    if (state->memFd >= 0) {
+        close(state->memFd);
+    }
+}
+
+static bool loadRprocFirmware(PRINTER_Transport *transport,
+        const PRINTER_Firmware *firmware, PRINTER_FirmwareLoadInfo *loadInfo) {
+    RPROC_State *state = transport->state;
+    struct timespec startTime;
+    struct timespec endTime;
+    char stateValue[32];
+
+    clock_gettime(CLOCK_MONOTONIC, &startTime);
+
+    // The firmware can only be changed while the PRU is stopped
+    if (!readRprocAttribute(state, "state", stateValue, sizeof(stateValue))) {
+        return false;
+    }
+    if (!strncmp(stateValue, "running", strlen("running")) &&
+            !writeRprocAttribute(state, "state", "stop")) {
+        return false;
+    }
+
+    if (!writeFirmwareFile(firmware) ||
+            !writeRprocAttribute(state, "firmware", RPROC_FIRMWARE_NAME)) {
+        return false;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &endTime);
+
+    // The image only gets copied into the PRU once it gets started
+    loadInfo->iramBytes = firmware->image ? firmware->imageLength :
+            firmware->iramLength;
+    loadInfo->dramBytes = firmware->image ? 0 : firmware->dramLength;
+    loadInfo->loadTimeUs = (endTime.tv_sec - startTime.tv_sec) * 1000000 +
+            (endTime.tv_nsec - startTime.tv_nsec) / 1000;
+
+    return true;
+}
+
+static bool startRprocPru(PRINTER_Transport *transport) {
+    return writeRprocAttribute(transport->state, "state", "start");
+}
+
+static void kickRproc(PRINTER_Transport *transport) {
+    const RPROC_State *state = transport->state;
+
+    // The system event is mapped via INTC to channel 1 and host 1, which is
+    // what PRU1 watches in R31
+    state->intc[INTC_SRSR0] = 1 << ARM_PRU1_INTERRUPT;
+}
+
+static int getRprocEventFd(const PRINTER_Transport *transport,
+        const PRINTER_Event event) {
+    const RPROC_State *state = transport->state;
+
+    return state->timerFds[event];
+}
+
+static bool takeRprocEvent(PRINTER_Transport *transport,
+        const PRINTER_Event event) {
+    const RPROC_State *state = transport->state;
+    uint64_t expirations;
+
+    // Drain the poll timer, then see if the system event has been raised. The
+    // raw status doesn't depend on the event being routed anywhere.
+    if ((read(state->timerFds[event], &expirations, sizeof(expirations)) < 0)
+            && (errno != EAGAIN)) {
+        return false;
+    }
+
+    if (!(state->intc[INTC_SRSR0] & (1 << rprocEvents[event]))) {
+        return false;
+    }
+    state->intc[INTC_SICR] = rprocEvents[event];
+
+    return true;
+}
+
+static bool waitRprocEvent(PRINTER_Transport *transport,
+        const PRINTER_Event event) {
+    const RPROC_State *state = transport->state;
+    struct pollfd pollFd;
+
+    pollFd.fd = state->timerFds[event];
+    pollFd.events = POLLIN;
+
+    while (!takeRprocEvent(transport, event)) {
+        if ((poll(&pollFd, 1, -1) < 0) && (errno != EINTR)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Find the remoteproc instance owning PRU1 by its device name
+static bool findRproc(RPROC_State *state) {
+    struct dirent *entry;
+    char name[64];
+    DIR *dir;
+    bool found = false;
+
+    dir = opendir(RPROC_SYSFS_DIR);
+    if (!dir) {
+        return false;
+    }
+
+    while (!found && (entry = readdir(dir))) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        if (!makePath(state->rprocDir, sizeof(state->rprocDir),
+                RPROC_SYSFS_DIR, entry->d_name)) {
+            continue;
+        }
+        found = readRprocAttribute(state, "name", name, sizeof(name)) &&
+                !strncmp(name, RPROC_PRU1_DEVICE_NAME,
+                        strlen(RPROC_PRU1_DEVICE_NAME));
+    }
+
+    closedir(dir);
+
+    return found;
+}
+
+static bool readRprocAttribute(const RPROC_State *state, const char *name,
+        char value[], const uint32_t size) {
+    char path[FILENAME_MAX];
+    FILE *fp;
+    bool success;
+
+    if (!makePath(path, sizeof(path), state->rprocDir, name)) {
+        return false;
+    }
+    fp = fopen(path, "r");
+    if (!fp) {
+        return false;
+    }
+
+    success = fgets(value, size, fp) != NULL;
+    fclose(fp);
+
+    return success;
+}
+
+static bool writeRprocAttribute(const RPROC_State *state, const char *name,
+        const char *value) {
+    char path[FILENAME_MAX];
+    FILE *fp;
+    bool success;
+
+    if (!makePath(path, sizeof(path), state->rprocDir, name)) {
+        fprintf(stderr, "Path of %s is too long!\n", name);
+        return false;
+    }
+    fp = fopen(path, "w");
+    if (!fp) {
+        fprintf(stderr, "Error opening %s!\n", path);
+        return false;
+    }
+
+    success = fputs(value, fp) >= 0;
+    success = !fclose(fp) && success;
+    if (!success) {
+        fprintf(stderr, "Error writing %s to %s!\n", value, path);
+    }
+
+    return success;
+}
+
+// Put together the path of the given file in the given directory. Returns
+// false rather than truncating the path if it doesn't fit into the buffer.
+static bool makePath(char path[], const size_t size, const char *dir,
+        const char *name) {
+    const int length = snprintf(path, size, "%s/%s", dir, name);
+
+    return (length >= 0) && ((size_t)length < size);
+}
+
+// Route the doorbell to PRU1 and the firmware events to the host event
+// outputs in the same way as PRUSS_INTC_INITDATA does. Only the events and
+// channels used are touched since the kernel may be using others.
+static void initIntc(RPROC_State *state) {
+    static const struct {
+        uint8_t sysEvent;
+        uint8_t channel;
+        uint8_t host;
+    } routes[] = {
+        { ARM_PRU1_INTERRUPT, CHANNEL1, PRU1 },
+        { PRU0_ARM_INTERRUPT, CHANNEL2, PRU_EVTOUT0 },
+        { PRU1_ARM_INTERRUPT, CHANNEL3, PRU_EVTOUT1 }
+    };
+    volatile uint32_t *intc = state->intc;
+    uint32_t shift;
+    uint32_t i;
+
+    for (i = 0; i < sizeof(routes) / sizeof(routes[0]); i++) {
+        // Each channel and host map register holds four byte-wide entries
+        shift = (routes[i].sysEvent % 4) * 8;
+        intc[INTC_CMR0 + routes[i].sysEvent / 4] =
+                (intc[INTC_CMR0 + routes[i].sysEvent / 4] & ~(0xFF << shift)) |
+                (routes[i].channel << shift);
+        shift = (routes[i].channel % 4) * 8;
+        intc[INTC_HMR0 + routes[i].channel / 4] =
+                (intc[INTC_HMR0 + routes[i].channel / 4] & ~(0xFF << shift)) |
+                (routes[i].host << shift);
+
+        intc[INTC_SICR] = routes[i].sysEvent;
+        intc[INTC_EISR] = routes[i].sysEvent;
+        intc[INTC_HIEISR] = routes[i].host;
+    }
+
+    intc[INTC_GER] = 1;
+}
+
+// Store the firmware where remoteproc can find it. File images are stored as
+// they are if they are ELF images already. Anything else gets wrapped into an
+// ELF image with one loadable segment per PRU memory, the executable one
+// going to the instruction RAM.
+static bool writeFirmwareFile(const PRINTER_Firmware *firmware) {
+    const char *path = RPROC_FIRMWARE_DIR "/" RPROC_FIRMWARE_NAME;
+    RPROC_ElfHeaders headers;
+    const void *iram = firmware->image ? firmware->image : firmware->iram;
+    const uint32_t iramStart = firmware->image ? 0 : firmware->iramStart;
+    const uint32_t iramLength = firmware->image ? firmware->imageLength :
+            firmware->iramLength;
+    const uint32_t dramLength = firmware->image ? 0 : firmware->dramLength;
+    bool success;
+    int fd;
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Error creating %s!\n", path);
+        return false;
+    }
+
+    if (firmware->image && (firmware->imageLength >= SELFMAG) &&
+            !memcmp(firmware->image, ELFMAG, SELFMAG)) {
+        success = writeAll(fd, firmware->image, firmware->imageLength);
+        return !close(fd) && success;
+    }
+
+    memset(&headers, 0, sizeof(headers));
+    memcpy(headers.header.e_ident, ELFMAG, SELFMAG);
+    headers.header.e_ident[EI_CLASS] = ELFCLASS32;
+    headers.header.e_ident[EI_DATA] = ELFDATA2LSB;
+    headers.header.e_ident[EI_VERSION] = EV_CURRENT;
+    headers.header.e_type = ET_EXEC;
+    headers.header.e_machine = EM_TI_PRU;
+    headers.header.e_version = EV_CURRENT;
+    headers.header.e_entry = iramStart;
+    headers.header.e_phoff = sizeof(headers.header);
+    headers.header.e_ehsize = sizeof(headers.header);
+    headers.header.e_phentsize = sizeof(headers.segments[0]);
+    headers.header.e_phnum = dramLength ? 2 : 1;
+
+    headers.segments[0].p_type = PT_LOAD;
+    headers.segments[0].p_offset = sizeof(headers);
+    headers.segments[0].p_vaddr = iramStart;
+    headers.segments[0].p_paddr = iramStart;
+    headers.segments[0].p_filesz = iramLength;
+    headers.segments[0].p_memsz = iramLength;
+    headers.segments[0].p_flags = PF_R | PF_X;
+    headers.segments[0].p_align = sizeof(uint32_t);
+
+    headers.segments[1].p_type = PT_LOAD;
+    headers.segments[1].p_offset = sizeof(headers) + iramLength;
+    headers.segments[1].p_vaddr = firmware->dramStart;
+    headers.segments[1].p_paddr = firmware->dramStart;
+    headers.segments[1].p_filesz = dramLength;
+    headers.segments[1].p_memsz = dramLength;
+    headers.segments[1].p_flags = PF_R | PF_W;
+    headers.segments[1].p_align = sizeof(uint32_t);
+
+    success = writeAll(fd, &headers, sizeof(headers)) &&
+            writeAll(fd, iram, iramLength) &&
+            writeAll(fd, firmware->dram, dramLength);
+
+    return !close(fd) && success;
+}
+
+static bool writeAll(const int fd, const void *data, const uint32_t size) {
+    const uint8_t *bytes = data;
+    uint32_t written = 0;
+    ssize_t result;
+
+    while (written < size) {
+        result = write(fd, bytes + written, size - written);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        written += result;
+    }
+
+    return true;
+}
@@ -0,0 +1,467 @@
+/*
+ * session.c
+ *
+ * Asynchronous print job submission. See session.h for details.
+ *
+ * Copyright (C) 2014 Texas Instruments Incorporated - http://www.ti.com/
+ * ALL RIGHTS RESERVED
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "session.h"
+#include "prumem.h"
+#include "trace.h"
+#include "profile.h"
+
+static bool isJobStreamable(const PRINTER_Job *job);
+static void startJob(PRINTER_Session *session, const PRINTER_Job *job,
+        const PRINTER_SyncMode syncMode);
+static bool pollQueue(PRINTER_Session *session);
+static bool waitQueue(PRINTER_Session *session, const int timeout);
+static uint64_t getTimeNs(void);
+static void refillQueue(PRINTER_Session *session);
+static void publishRun(PRINTER_Session *session, const uint32_t size);
+static void writeControlItem(PRINTER_Session *session, const uint32_t command);
+static uint32_t getUnitSize(const PRINTER_Job *job,
+        const PRINTER_JobItem *item);
+static void completeJob(PRINTER_Session *session);
+
+bool initSession(PRINTER_Session *session, PRINTER_Transport *transport,
+        const PRINTER_SessionCallbacks *callbacks, void *userData) {
+    struct epoll_event event;
+    uint32_t i;
+
+    memset(session, 0, sizeof(*session));
+    session->transport = transport;
+    session->queue = transport->queue;
+    session->userData = userData;
+    session->lowWatermark = SESSION_DEFAULT_LOW_WATERMARK;
+    session->epollFd = -1;
+    session->completionFd = -1;
+    if (callbacks) {
+        session->callbacks = *callbacks;
+    }
+
+    session->epollFd = epoll_create(1);
+    session->completionFd = eventfd(0, EFD_NONBLOCK);
+    if ((session->epollFd < 0) || (session->completionFd < 0)) {
+        closeSession(session);
+        return false;
+    }
+
+    // The completion event file descriptor of the transport becomes readable
+    // once PRU1 has reached the end of the job. The watermark one becomes
+    // readable whenever PRU1 runs low on items.
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    for (i = 0; i < PRINTER_NR_OF_EVENTS; i++) {
+        event.data.fd = getTransportEventFd(transport, i);
+        if (epoll_ctl(session->epollFd, EPOLL_CTL_ADD, event.data.fd,
+                &event)) {
+            closeSession(session);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void closeSession(PRINTER_Session *session) {
+    if (session->epollFd >= 0) {
+        close(session->epollFd);
+    }
+
+    if (session->completionFd >= 0) {
+        close(session->completionFd);
+    }
+
+    session->epollFd = -1;
+    session->completionFd = -1;
+}
+
+int getSessionFd(const PRINTER_Session *session) {
+    return session->epollFd;
+}
+
+int getSessionCompletionFd(const PRINTER_Session *session) {
+    return session->completionFd;
+}
+
+void setSessionLowWatermark(PRINTER_Session *session,
+        const uint32_t lowWatermark) {
+    // A watermark of zero would keep the PRU from ever asking for more items,
+    // so the least we do is to have it ask once it has run out of items. The
+    // new watermark takes effect with the next job that gets started.
+    session->lowWatermark = lowWatermark ? lowWatermark : 1;
+}
+
+void setSessionKeepWarm(PRINTER_Session *session, const uint32_t keepWarmMs) {
+    // Have the printer head kept powered for the given number of milliseconds
+    // after each job (zero turns it off right away). This takes effect with
+    // the next job that gets started.
+    session->keepWarmMs = keepWarmMs;
+}
+
+bool canSubmitJob(const PRINTER_Session *session) {
+    return !session->pendingJob;
+}
+
+bool isSessionIdle(const PRINTER_Session *session) {
+    return !session->currentJob && !session->pendingJob;
+}
+
+bool submitJobAsync(PRINTER_Session *session, const PRINTER_Job *job,
+        const PRINTER_SyncMode syncMode) {
+    if (!isJobStreamable(job)) {
+        return false;
+    }
+
+    // Start printing right away if the printer is idle. Otherwise keep the job
+    // around to be started once the current job completes.
+    if (!session->currentJob) {
+        startJob(session, job, syncMode);
+    }
+    else if (!session->pendingJob) {
+        session->pendingJob = job;
+        session->pendingSyncMode = syncMode;
+    }
+    else {
+        return false;
+    }
+
+    return true;
+}
+
+void processSession(PRINTER_Session *session) {
+    // A job in busy-poll mode doesn't raise any interrupts
+    if (session->currentJob &&
+            (session->currentSyncMode == PRINTER_SYNC_BUSY_POLL)) {
+        pollQueue(session);
+        return;
+    }
+
+    // See if PRU1 is running low on items. Taking an event never blocks, so
+    // this returns right away if not. The ring gets topped up with as much of
+    // the current job as there is space for.
+    if (takeTransportEvent(session->transport, PRINTER_EVENT_WATERMARK)) {
+        if (session->currentJob) {
+            refillQueue(session);
+        }
+    }
+
+    // See if PRU1 has reached the end of the current job
+    if (takeTransportEvent(session->transport, PRINTER_EVENT_COMPLETION)) {
+        if (session->currentJob) {
+            completeJob(session);
+        }
+    }
+}
+
+bool waitSession(PRINTER_Session *session, const int timeout) {
+    PROFILE_Stage previousStage;
+    struct epoll_event event;
+    int result;
+
+    if (session->currentJob &&
+            (session->currentSyncMode == PRINTER_SYNC_BUSY_POLL)) {
+        return waitQueue(session, timeout);
+    }
+
+    // Block for up to the given number of milliseconds (or indefinitely in
+    // case of a negative timeout) until the session needs servicing
+    previousStage = enterProfileStage(PROFILE_STAGE_IDLE);
+    do {
+        result = epoll_wait(session->epollFd, &event, 1, timeout);
+    } while ((result < 0) && (errno == EINTR));
+    leaveProfileStage(previousStage);
+
+    if (result < 0) {
+        return false;
+    }
+
+    if (result) {
+        traceHostEvent(TRACE_HOST_WAKEUP, 0);
+        processSession(session);
+    }
+
+    return true;
+}
+
+static bool isJobStreamable(const PRINTER_Job *job) {
+    const PRINTER_JobItem *item;
+
+    for (item = getFirstJobItem(job); item; item = getNextJobItem(job, item)) {
+        // Wrap and end-of-sequence items move PRU1 around in the ring, so
+        // only refillQueue() may place them. Coming from the job they would
+        // get PRU1 out of step with where the items actually are.
+        if ((item->command == PRINTER_CMD_WRAP) ||
+                (item->command == PRINTER_CMD_EOS)) {
+            fprintf(stderr, "Print job contains a queue control item!\n");
+            return false;
+        }
+
+        // Each unit needs to fit into the ring alongside a wrap item. Checking
+        // this up front is what keeps refillQueue() from waiting forever for
+        // space that never frees up, or from splitting a loop across a wrap.
+        if (getUnitSize(job, item) + PRINTER_JOB_ITEM_SIZE(0) >
+                PRINTER_MAX_JOB_SIZE) {
+            if (item->command == PRINTER_CMD_LOOP) {
+                fprintf(stderr, "Print job contains a loop too large for " \
+                        "the queue!\n");
+            }
+            else {
+                fprintf(stderr, "Print job contains an item too large for " \
+                        "the queue!\n");
+            }
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void startJob(PRINTER_Session *session, const PRINTER_Job *job,
+        const PRINTER_SyncMode syncMode) {
+    PRINTER_Queue *queue = session->queue;
+
+    session->currentJob = job;
+    session->currentSyncMode = syncMode;
+    session->currentOffset = 0;
+    session->writeOffset = 0;
+    session->jobTerminated = false;
+
+    // An empty job completes right away. It still gets signaled through the
+    // completion file descriptor once the event loop gets around to it.
+    if (!job->size) {
+        completeJob(session);
+        return;
+    }
+
+    // PRU1 is idle, so the progress can be safely reset before it gets
+    // kicked off. The ring starts out empty.
+    queue->progress.producedBytes = 0;
+    queue->progress.consumedBytes = 0;
+    queue->progress.lowWatermark = session->lowWatermark;
+    queue->progress.keepWarmMs = session->keepWarmMs;
+    queue->progress.linesPrinted = 0;
+    queue->progress.busyPoll = syncMode == PRINTER_SYNC_BUSY_POLL;
+    session->completedJobs = queue->progress.completedJobs;
+
+    refillQueue(session);
+
+    // Everything that has been copied into the PRU memories needs to have
+    // landed before the PRU gets signaled
+    releasePruMemory();
+    traceHostEvent(TRACE_HOST_DOORBELL, session->completedJobs);
+    kickTransport(session->transport);
+}
+
+// Check on the progress of a job in busy-poll mode. Returns true if anything
+// happened, that is, if the ring got refilled or the job completed.
+static bool pollQueue(PRINTER_Session *session) {
+    PRINTER_Queue *queue = session->queue;
+    const uint32_t producedBytes = queue->progress.producedBytes;
+
+    if (readPruWord(&queue->progress.completedJobs) !=
+            session->completedJobs) {
+        completeJob(session);
+        return true;
+    }
+
+    // Top up the ring as soon as the PRU made room since there is no
+    // watermark event telling us when to
+    if (!session->jobTerminated) {
+        refillQueue(session);
+    }
+
+    return queue->progress.producedBytes != producedBytes;
+}
+
+// Poll a job in busy-poll mode until anything happens or the given number of
+// milliseconds elapsed (never in case of a negative timeout). The PRU is
+// polled back to back at first, and in short sleeps once the spin time is up.
+static bool waitQueue(PRINTER_Session *session, const int timeout) {
+    const struct timespec sleepTime = { 0, SESSION_BUSY_POLL_SLEEP_NS };
+    const uint64_t startTime = getTimeNs();
+    uint64_t elapsedTime;
+
+    while (!pollQueue(session)) {
+        elapsedTime = getTimeNs() - startTime;
+        if ((timeout >= 0) && (elapsedTime >= (uint64_t)timeout * 1000000)) {
+            break;
+        }
+        if (elapsedTime >= SESSION_BUSY_POLL_SPIN_NS) {
+            nanosleep(&sleepTime, NULL);
+        }
+    }
+
+    return true;
+}
+
+static uint64_t getTimeNs(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// Publish as much of the current job as there is free space in the ring. The
+// job gets published unit by unit, with a unit being either a single item or
+// an entire loop which must never be split up as the firmware jumps back to
+// its beginning. Consecutive units are copied in runs. A wrap item is placed
+// whenever the next unit plus another wrap item wouldn't fit in front of the
+// end of the ring anymore. The end of the job gets terminated by an EOS item.
+static void refillQueue(PRINTER_Session *session) {
+    const PRINTER_Job *job = session->currentJob;
+    PRINTER_Queue *queue = session->queue;
+    const uint32_t ringSize = sizeof(queue->jobItems);
+    const uint64_t traceStartNs = beginTraceSpan();
+    uint32_t producedBytes = queue->progress.producedBytes;
+    uint32_t freeBytes = ringSize -
+            (producedBytes - readPruWord(&queue->progress.consumedBytes));
+    uint32_t runSize = 0;
+    uint32_t unitSize;
+    uint32_t wrapSize;
+    uint32_t jobOffset;
+    bool endOfJob;
+
+    while (!session->jobTerminated) {
+        jobOffset = session->currentOffset + runSize;
+        endOfJob = jobOffset >= job->size;
+        unitSize = endOfJob ? PRINTER_JOB_ITEM_SIZE(0) : getUnitSize(job,
+                (const PRINTER_JobItem *)(job->data + jobOffset));
+
+        // The wrap item may go in ahead of the unit following it as it only
+        // needs the space up to the end of the ring, which is always free
+        // once the PRU got there
+        wrapSize = ringSize - (session->writeOffset + runSize);
+        if (unitSize + PRINTER_JOB_ITEM_SIZE(0) > wrapSize) {
+            if (freeBytes < wrapSize) {
+                break;
+            }
+            publishRun(session, runSize);
+            runSize = 0;
+            writeControlItem(session, PRINTER_CMD_WRAP);
+            session->writeOffset = 0;
+            producedBytes += wrapSize;
+            freeBytes -= wrapSize;
+        }
+
+        if (freeBytes < unitSize) {
+            break;
+        }
+
+        if (endOfJob) {
+            publishRun(session, runSize);
+            runSize = 0;
+            writeControlItem(session, PRINTER_CMD_EOS);
+            session->writeOffset += unitSize;
+            session->jobTerminated = true;
+        }
+        else {
+            runSize += unitSize;
+        }
+        producedBytes += unitSize;
+        freeBytes -= unitSize;
+    }
+
+    publishRun(session, runSize);
+
+    // The items need to have landed before PRU1 gets to see them
+    if (producedBytes != queue->progress.producedBytes) {
+        releasePruMemory();
+        endTraceSpan(TRACE_HOST_COPY, traceStartNs,
+                producedBytes - queue->progress.producedBytes);
+        queue->progress.producedBytes = producedBytes;
+    }
+}
+
+static void publishRun(PRINTER_Session *session, const uint32_t size) {
+    PROFILE_Stage previousStage;
+
+    // Busy-polling tries to refill the ring all the time, mostly without
+    // anything to publish, which shouldn't cost any clock reads
+    if (!size) {
+        return;
+    }
+
+    previousStage = enterProfileStage(PROFILE_STAGE_COPY);
+    copyToPruMemory((uint8_t *)session->queue->jobItems + session->writeOffset,
+            session->currentJob->data + session->currentOffset, size);
+    leaveProfileStage(previousStage);
+    session->writeOffset += size;
+    session->currentOffset += size;
+}
+
+static void writeControlItem(PRINTER_Session *session, const uint32_t command) {
+    PRINTER_JobItem *item = (PRINTER_JobItem *)
+            ((uint8_t *)session->queue->jobItems + session->writeOffset);
+
+    item->command = command;
+    item->length = 0;
+}
+
+static uint32_t getUnitSize(const PRINTER_Job *job,
+        const PRINTER_JobItem *item) {
+    const PRINTER_JobItem *loopItem = item;
+    uint32_t size = 0;
+    uint32_t level = 0;
+
+    if (item->command != PRINTER_CMD_LOOP) {
+        return PRINTER_JOB_ITEM_SIZE(item->length);
+    }
+
+    // Add up the sizes of all items from the loop command up to and including
+    // the matching end of the loop
+    for (item = loopItem; item; item = getNextJobItem(job, item)) {
+        size += PRINTER_JOB_ITEM_SIZE(item->length);
+        if (item->command == PRINTER_CMD_LOOP) {
+            level++;
+        }
+        else if ((item->command == PRINTER_CMD_END_LOOP) && !--level) {
+            break;
+        }
+    }
+
+    return size;
+}
+
+static void completeJob(PRINTER_Session *session) {
+    const PRINTER_Job *job = session->currentJob;
+    const uint64_t increment = 1;
+
+    // An empty job never made it to the PRU
+    if (job->size) {
+        traceHostEvent(TRACE_HOST_COMPLETION, session->completedJobs);
+    }
+
+    // Start the pending job first so that the printer keeps going while the
+    // callbacks are being processed
+    session->currentJob = NULL;
+    if (session->pendingJob) {
+        const PRINTER_Job *pendingJob = session->pendingJob;
+        session->pendingJob = NULL;
+        startJob(session, pendingJob, session->pendingSyncMode);
+    }
+
+    if (write(session->completionFd, &increment, sizeof(increment)) !=
+            sizeof(increment)) {
+        fprintf(stderr, "Error signaling print job completion!\n");
+    }
+
+    if (session->callbacks.jobDone) {
+        session->callbacks.jobDone(session, job, session->userData);
+    }
+
+    if (session->callbacks.spaceAvailable && canSubmitJob(session)) {
+        session->callbacks.spaceAvailable(session, session->userData);
+    }
+}
@@ -0,0 +1,103 @@
+/*
+ * session.h
+ *
+ * Asynchronous print job submission. A print session streams print jobs
+ * through the printer queue, which is operated as a ring buffer, without ever
+ * blocking the caller. The PRU raises a watermark event whenever the ring
+ * runs low so that it can be refilled while the PRU keeps printing, and a
+ * completion event once it has reached the end of the job. Both are detected
+ * through the event file descriptors of the transport connecting us to the
+ * PRU (see transport.h), which are watched using epoll. The session
+ * exposes a single file descriptor that becomes readable whenever
+ * processSession() needs to be called so that it can be integrated into the
+ * caller's own event loop, plus an eventfd that counts completed jobs.
+ *
+ * Alternatively a job can be submitted in busy-poll mode, in which case the
+ * PRU doesn't raise any interrupts. Instead the host spins on the completion
+ * counter and the queue backlog in the PRU shared memory for a bounded amount
+ * of time, and then falls back to polling in short sleeps. This saves the
+ * scheduler latency of the interrupt round trip, which dominates for short
+ * jobs, at the expense of CPU time. The session file descriptor doesn't become
+ * readable for such jobs, so waitSession() or regular calls of
+ * processSession() need to drive them.
+ *
+ * One job can be pending while another one is being printed. The pending job
+ * is started right after the current one completes so that the printer never
+ * has to wait for the host to process the next job.
+ *
+ * Copyright (C) 2014 Texas Instruments Incorporated - http://www.ti.com/
+ * ALL RIGHTS RESERVED
+ */
+
+#ifndef SESSION_H_
+#define SESSION_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "printjob.h"
+#include "transport.h"
+
+// Default number of bytes of job items waiting in the ring below which the PRU
+// asks for more. Half the ring leaves plenty of time to refill it.
+#define SESSION_DEFAULT_LOW_WATERMARK   (PRINTER_MAX_JOB_SIZE / 2)
+
+// Busy-poll mode spins for this many nanoseconds before it starts sleeping
+// between polls, and this is how long each of these sleeps lasts
+#define SESSION_BUSY_POLL_SPIN_NS       200000
+#define SESSION_BUSY_POLL_SLEEP_NS      50000
+
+// Ways of synchronizing with the PRU, selectable per job
+typedef enum {
+    PRINTER_SYNC_INTERRUPT,
+    PRINTER_SYNC_BUSY_POLL
+} PRINTER_SyncMode;
+
+typedef struct PRINTER_Session PRINTER_Session;
+
+// Callbacks invoked from within processSession(). Any of them may be NULL.
+// The space available callback is invoked whenever another job can be
+// submitted. The job done callback is invoked once the PRU has processed all
+// items of a job, at which point the job may be freed.
+typedef struct {
+    void (*spaceAvailable)(PRINTER_Session *session, void *userData);
+    void (*jobDone)(PRINTER_Session *session, const PRINTER_Job *job,
+            void *userData);
+} PRINTER_SessionCallbacks;
+
+// Type describing a print session. All fields are private to the session.
+struct PRINTER_Session {
+    PRINTER_Transport *transport;
+    PRINTER_Queue *queue;
+    int epollFd;
+    int completionFd;
+    PRINTER_SessionCallbacks callbacks;
+    void *userData;
+    const PRINTER_Job *currentJob;
+    const PRINTER_Job *pendingJob;
+    PRINTER_SyncMode currentSyncMode;
+    PRINTER_SyncMode pendingSyncMode;
+    uint32_t completedJobs;
+    uint32_t currentOffset;
+    uint32_t writeOffset;
+    uint32_t lowWatermark;
+    uint32_t keepWarmMs;
+    bool jobTerminated;
+};
+
+bool initSession(PRINTER_Session *session, PRINTER_Transport *transport,
+        const PRINTER_SessionCallbacks *callbacks, void *userData);
+void closeSession(PRINTER_Session *session);
+int getSessionFd(const PRINTER_Session *session);
+int getSessionCompletionFd(const PRINTER_Session *session);
+void setSessionLowWatermark(PRINTER_Session *session,
+        const uint32_t lowWatermark);
+void setSessionKeepWarm(PRINTER_Session *session, const uint32_t keepWarmMs);
+bool canSubmitJob(const PRINTER_Session *session);
+bool isSessionIdle(const PRINTER_Session *session);
+bool submitJobAsync(PRINTER_Session *session, const PRINTER_Job *job,
+        const PRINTER_SyncMode syncMode);
+void processSession(PRINTER_Session *session);
+bool waitSession(PRINTER_Session *session, const int timeout);
+
+#endif /* SESSION_H_ */
@@ -0,0 +1,215 @@
+/*
+ * simtransport.c
+ *
+ * Transports connecting the host application to a simulated printer driver
+ * rather than the PRU. "sim" paces the simulation to match the timing of the
+ * real printer while "simfast" runs it as fast as possible. See transport.h
+ * and queuesim.h for details.
+ *
+ * Copyright (C) 2014 Texas Instruments Incorporated - http://www.ti.com/
+ * ALL RIGHTS RESERVED
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+
+#include "transport.h"
+#include "queuesim.h"
+
+// Alignment of the memories standing in for the PRU memories
+#define SIM_MEMORY_ALIGNMENT        32
+
+typedef struct {
+    PRINTER_QueueSim sim;
+    bool realTime;
+    bool started;
+} SIM_State;
+
+static bool openSim(PRINTER_Transport *transport);
+static bool openSimFast(PRINTER_Transport *transport);
+static bool openSimWithPacing(PRINTER_Transport *transport,
+        const bool realTime);
+static void *allocSimMemory(const size_t size);
+static void closeSim(PRINTER_Transport *transport, const bool stopPru);
+static bool loadSimFirmware(PRINTER_Transport *transport,
+        const PRINTER_Firmware *firmware, PRINTER_FirmwareLoadInfo *loadInfo);
+static bool startSimPru(PRINTER_Transport *transport);
+static void kickSim(PRINTER_Transport *transport);
+static int getSimEventFd(const PRINTER_Transport *transport,
+        const PRINTER_Event event);
+static bool takeSimEvent(PRINTER_Transport *transport,
+        const PRINTER_Event event);
+static bool waitSimEvent(PRINTER_Transport *transport,
+        const PRINTER_Event event);
+
+const PRINTER_TransportOps simTransportOps = {
+    "sim",
+    "Simulated printer driver running at the speed of the real printer",
+    NULL,
+    openSim,
+    NULL,
+    closeSim,
+    loadSimFirmware,
+    startSimPru,
+    kickSim,
+    getSimEventFd,
+    takeSimEvent,
+    waitSimEvent
+};
+
+const PRINTER_TransportOps simFastTransportOps = {
+    "simfast",
+    "Simulated printer driver running as fast as possible",
+    NULL,
+    openSimFast,
+    NULL,
+    closeSim,
+    loadSimFirmware,
+    startSimPru,
+    kickSim,
+    getSimEventFd,
+    takeSimEvent,
+    waitSimEvent
+};
+
+static bool openSim(PRINTER_Transport *transport) {
+    return openSimWithPacing(transport, true);
+}
+
+static bool openSimFast(PRINTER_Transport *transport) {
+    return openSimWithPacing(transport, false);
+}
+
+static bool openSimWithPacing(PRINTER_Transport *transport,
+        const bool realTime) {
+    SIM_State *state = calloc(1, sizeof(SIM_State));
+
+    if (!state) {
+        fprintf(stderr, "Error allocating simulation state!\n");
+        return false;
+    }
+    state->realTime = realTime;
+    state->sim.doorbellFd = -1;
+    state->sim.completionFd = -1;
+    state->sim.watermarkFd = -1;
+    state->sim.stopFd = -1;
+    transport->state = state;
+
+    // The memories live as long as the transport. Like the PRU memories they
+    // don't get cleared when the simulated firmware is (re-)started.
+    transport->queue = allocSimMemory(sizeof(PRINTER_Queue));
+    transport->pruDataRam = allocSimMemory(QUEUESIM_DATARAM_SIZE);
+    transport->macroStore = allocSimMemory(sizeof(PRINTER_MacroStore));
+    if (!transport->queue || !transport->pruDataRam ||
+            !transport->macroStore) {
+        fprintf(stderr, "Error allocating simulated PRU memories!\n");
+        closeSim(transport, true);
+        return false;
+    }
+
+    return true;
+}
+
+static void *allocSimMemory(const size_t size) {
+    void *memory;
+
+    if (posix_memalign(&memory, SIM_MEMORY_ALIGNMENT, size)) {
+        return NULL;
+    }
+    memset(memory, 0, size);
+
+    return memory;
+}
+
+static void closeSim(PRINTER_Transport *transport, const bool stopPru) {
+    SIM_State *state = transport->state;
+
+    // There is nothing to leave running once the process goes away
+    if (state->started) {
+        stopQueueSim(&state->sim);
+    }
+
+    free(transport->queue);
+    free(transport->pruDataRam);
+    free(transport->macroStore);
+    free(state);
+    transport->queue = NULL;
+    transport->pruDataRam = NULL;
+    transport->macroStore = NULL;
+    transport->state = NULL;
+}
+
+static bool loadSimFirmware(PRINTER_Transport *transport,
+        const PRINTER_Firmware *firmware, PRINTER_FirmwareLoadInfo *loadInfo) {
+    SIM_State *state = transport->state;
+
+    // The simulation always behaves like the firmware it was built with. All
+    // that is left to do is stopping a previously started simulation.
+    if (state->started) {
+        stopQueueSim(&state->sim);
+        state->started = false;
+    }
+
+    loadInfo->iramBytes = firmware->image ? firmware->imageLength :
+            firmware->iramLength;
+    loadInfo->dramBytes = firmware->image ? 0 : firmware->dramLength;
+
+    return true;
+}
+
+static bool startSimPru(PRINTER_Transport *transport) {
+    SIM_State *state = transport->state;
+
+    if (state->started) {
+        return true;
+    }
+
+    state->started = startQueueSim(&state->sim, transport->queue,
+            transport->pruDataRam, transport->macroStore, state->realTime);
+
+    return state->started;
+}
+
+static void kickSim(PRINTER_Transport *transport) {
+    SIM_State *state = transport->state;
+
+    ringQueueSimDoorbell(&state->sim);
+}
+
+static int getSimEventFd(const PRINTER_Transport *transport,
+        const PRINTER_Event event) {
+    const SIM_State *state = transport->state;
+
+    return (event == PRINTER_EVENT_COMPLETION) ? state->sim.completionFd :
+            state->sim.watermarkFd;
+}
+
+static bool takeSimEvent(PRINTER_Transport *transport,
+        const PRINTER_Event event) {
+    uint64_t eventCount;
+
+    // Several events may have been raised in the meantime. Just like with the
+    // PRU interrupts they get taken all at once.
+    return read(getSimEventFd(transport, event), &eventCount,
+            sizeof(eventCount)) == sizeof(eventCount);
+}
+
+static bool waitSimEvent(PRINTER_Transport *transport,
+        const PRINTER_Event event) {
+    struct pollfd pollFd;
+
+    pollFd.fd = getSimEventFd(transport, event);
+    pollFd.events = POLLIN;
+
+    while (!takeSimEvent(transport, event)) {
+        if ((poll(&pollFd, 1, -1) < 0) && (errno != EINTR)) {
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,542 @@
+/*
+ * trace.c
+ *
+ * Timeline tracing of print jobs across the host and the PRU. See trace.h for
+ * details.
+ *
+ * Copyright (C) 2014 Texas Instruments Incorporated - http://www.ti.com/
+ * ALL RIGHTS RESERVED
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "trace.h"
+#include "prumem.h"
+
+// Clock of the IEP timer the firmware time-stamps its events with
+#define TRACE_IEP_CLOCK_MHZ         200
+
+// Interval at which the trace ring gets collected. The ring holds a few
+// milliseconds worth of events while printing.
+#define TRACE_POLL_INTERVAL_NS      1000000
+
+// Number of records the buffers initially make room for
+#define TRACE_INITIAL_RECORDS       1024
+
+// Process IDs the host and the PRU show up as in the trace
+#define TRACE_HOST_PID              1
+#define TRACE_PRU_PID               2
+
+// Event recorded by the host. Instant events have a duration of zero.
+typedef struct {
+    uint64_t timeNs;
+    uint64_t durationNs;
+    TRACE_HostEvent event;
+    uint32_t arg;
+} TRACE_HostRecord;
+
+// Event collected from the trace ring, the IEP count extended to 64 bits
+typedef struct {
+    uint64_t timestamp;
+    uint32_t event;
+} TRACE_PruRecord;
+
+// Buffer of records that grows as needed
+typedef struct {
+    void *records;
+    uint32_t nrOfRecords;
+    uint32_t capacity;
+} TRACE_Buffer;
+
+// Alignment of the IEP count with CLOCK_MONOTONIC. A PRU time in nanoseconds
+// plus the offset gives the host time. The window tells by how much larger the
+// offset could be, or is negative if the jobs contradict each other.
+typedef struct {
+    int64_t offsetNs;
+    int64_t windowNs;
+    uint32_t nrOfJobs;
+} TRACE_ClockSync;
+
+// State of the trace. The host records get written by the thread recording
+// the events, the PRU records by the collecting thread only.
+typedef struct {
+    bool active;
+    volatile bool stopCollecting;
+    pthread_t thread;
+    const PRINTER_TraceRing *ring;
+    uint64_t startNs;
+    uint32_t readCount;
+    uint64_t lastTimestamp;
+    uint32_t lostEvents;
+    bool outOfMemory;
+    TRACE_Buffer hostBuffer;
+    TRACE_Buffer pruBuffer;
+} TRACE_State;
+
+static const char * const hostEventNames[TRACE_NR_OF_HOST_EVENTS] = {
+    "decode",
+    "partition",
+    "copy",
+    "doorbell",
+    "wakeup",
+    "completion"
+};
+
+static const char * const hostArgNames[TRACE_NR_OF_HOST_EVENTS] = {
+    "rows",
+    "rows",
+    "bytes",
+    "job",
+    NULL,
+    "job"
+};
+
+// Names of the job items indexed by command
+static const char * const commandNames[] = {
+    NULL,
+    "open",
+    "print-line",
+    "motor-half-step",
+    "test-signals",
+    "close",
+    "repeat-line",
+    "print-line-ref",
+    "define-macro",
+    "call-macro",
+    "loop",
+    "end-loop",
+    "wrap",
+    "measure-read"
+};
+
+static TRACE_State trace;
+
+static void *collectThread(void *arg);
+static void collectPruEvents(void);
+static void *addRecord(TRACE_Buffer *buffer, const size_t recordSize);
+static void syncClocks(TRACE_ClockSync *sync);
+static bool writeTrace(const char *fileName, const TRACE_ClockSync *sync);
+static void writeHostEvents(FILE *file);
+static void writePruEvents(FILE *file, const TRACE_ClockSync *sync);
+static void writeSpan(FILE *file, const uint32_t pid, const char *name,
+        const uint64_t startNs, const uint64_t endNs, const char *argName,
+        const uint32_t arg);
+static void writeInstant(FILE *file, const uint32_t pid, const char *name,
+        const uint64_t timeNs, const char *argName, const uint32_t arg);
+static void writeItemSpan(FILE *file, const uint64_t startNs,
+        const uint64_t endNs, const uint32_t command);
+static uint64_t getTimeNs(void);
+
+bool startTrace(const PRINTER_Transport *transport) {
+    if (trace.active) {
+        return false;
+    }
+
+    memset(&trace, 0, sizeof(trace));
+    trace.ring = (const PRINTER_TraceRing *)
+            ((uint8_t *)transport->pruDataRam + PRINTER_TRACE_OFFSET);
+    trace.readCount = readPruWord(&trace.ring->writeCount);
+    trace.startNs = getTimeNs();
+
+    if (pthread_create(&trace.thread, NULL, collectThread, NULL)) {
+        fprintf(stderr, "Error starting trace thread!\n");
+        return false;
+    }
+    trace.active = true;
+
+    return true;
+}
+
+bool stopTrace(const char *fileName) {
+    TRACE_ClockSync sync;
+    bool success;
+
+    if (!trace.active) {
+        return false;
+    }
+
+    trace.stopCollecting = true;
+    pthread_join(trace.thread, NULL);
+    trace.active = false;
+
+    // Pick up what the firmware recorded since the thread last looked
+    collectPruEvents();
+
+    if (trace.outOfMemory) {
+        fprintf(stderr, "Out of memory while tracing, trace is incomplete!\n");
+    }
+
+    syncClocks(&sync);
+    success = writeTrace(fileName, &sync);
+
+    free(trace.hostBuffer.records);
+    free(trace.pruBuffer.records);
+    memset(&trace, 0, sizeof(trace));
+
+    return success;
+}
+
+uint64_t beginTraceSpan(void) {
+    return trace.active ? getTimeNs() : 0;
+}
+
+void endTraceSpan(const TRACE_HostEvent event, const uint64_t startNs,
+        const uint32_t arg) {
+    TRACE_HostRecord *record;
+
+    // Spans that began before the trace started are left out
+    if (!trace.active || !startNs) {
+        return;
+    }
+
+    record = (TRACE_HostRecord *)
+            addRecord(&trace.hostBuffer, sizeof(TRACE_HostRecord));
+    if (record) {
+        record->timeNs = startNs;
+        record->durationNs = getTimeNs() - startNs;
+        record->event = event;
+        record->arg = arg;
+    }
+}
+
+void traceHostEvent(const TRACE_HostEvent event, const uint32_t arg) {
+    TRACE_HostRecord *record;
+
+    if (!trace.active) {
+        return;
+    }
+
+    record = (TRACE_HostRecord *)
+            addRecord(&trace.hostBuffer, sizeof(TRACE_HostRecord));
+    if (record) {
+        record->timeNs = getTimeNs();
+        record->durationNs = 0;
+        record->event = event;
+        record->arg = arg;
+    }
+}
+
+static void *collectThread(void *arg) {
+    const struct timespec interval = {0, TRACE_POLL_INTERVAL_NS};
+
+    while (!trace.stopCollecting) {
+        collectPruEvents();
+        nanosleep(&interval, NULL);
+    }
+
+    return NULL;
+}
+
+// Copy the entries the firmware wrote since we last looked out of the trace
+// ring. Entries the firmware may have overwritten in the meantime, including
+// while they were being read, are counted as lost.
+static void collectPruEvents(void) {
+    const PRINTER_TraceRing *ring = trace.ring;
+    const uint32_t writeCount = readPruWord(&ring->writeCount);
+    PRINTER_TraceEntry entries[PRINTER_TRACE_NR_OF_ENTRIES];
+    const PRINTER_TraceEntry *entry;
+    TRACE_PruRecord *record;
+    uint32_t firstCount;
+    uint32_t validCount;
+    uint32_t count;
+
+    if (writeCount - trace.readCount > PRINTER_TRACE_NR_OF_ENTRIES) {
+        trace.lostEvents += writeCount - trace.readCount -
+                PRINTER_TRACE_NR_OF_ENTRIES;
+        trace.readCount = writeCount - PRINTER_TRACE_NR_OF_ENTRIES;
+    }
+    firstCount = trace.readCount;
+
+    for (count = firstCount; count != writeCount; count++) {
+        entry = &ring->entries[count % PRINTER_TRACE_NR_OF_ENTRIES];
+        entries[count - firstCount].timestamp = readPruWord(&entry->timestamp);
+        entries[count - firstCount].event = readPruWord(&entry->event);
+    }
+
+    // The entry the firmware is about to write next reuses the slot of the
+    // oldest one, so only the entries after that can be trusted
+    validCount = readPruWord(&ring->writeCount) - PRINTER_TRACE_NR_OF_ENTRIES +
+            1;
+    for (count = firstCount; count != writeCount; count++) {
+        if ((int32_t)(count - validCount) < 0) {
+            trace.lostEvents++;
+            continue;
+        }
+
+        record = (TRACE_PruRecord *)
+                addRecord(&trace.pruBuffer, sizeof(TRACE_PruRecord));
+        if (!record) {
+            continue;
+        }
+
+        // The events come in the order they happened, so the distance to the
+        // previous one tells how often the IEP count wrapped around, unless
+        // it was more than once
+        entry = &entries[count - firstCount];
+        trace.lastTimestamp += (uint32_t)(entry->timestamp -
+                (uint32_t)trace.lastTimestamp);
+        record->timestamp = trace.lastTimestamp;
+        record->event = entry->event;
+    }
+    trace.readCount = writeCount;
+}
+
+static void *addRecord(TRACE_Buffer *buffer, const size_t recordSize) {
+    uint32_t capacity;
+    void *records;
+
+    if (buffer->nrOfRecords == buffer->capacity) {
+        capacity = buffer->capacity ? 2 * buffer->capacity :
+                TRACE_INITIAL_RECORDS;
+        records = realloc(buffer->records, capacity * recordSize);
+        if (!records) {
+            trace.outOfMemory = true;
+            return NULL;
+        }
+        buffer->records = records;
+        buffer->capacity = capacity;
+    }
+
+    return (uint8_t *)buffer->records + recordSize * buffer->nrOfRecords++;
+}
+
+// Align the clocks using the jobs both sides know about, matched by the number
+// of jobs completed before them. Without any such job the first firmware
+// event gets placed at the start of the trace.
+static void syncClocks(TRACE_ClockSync *sync) {
+    const TRACE_HostRecord *hostRecords =
+            (const TRACE_HostRecord *)trace.hostBuffer.records;
+    const TRACE_PruRecord *pruRecords =
+            (const TRACE_PruRecord *)trace.pruBuffer.records;
+    int64_t minOffsetNs = INT64_MIN;
+    int64_t maxOffsetNs = INT64_MAX;
+    const TRACE_HostRecord *host;
+    uint64_t pruNs;
+    uint32_t type;
+    uint32_t job;
+    uint32_t i;
+    uint32_t j;
+
+    sync->nrOfJobs = 0;
+    for (i = 0; i < trace.pruBuffer.nrOfRecords; i++) {
+        type = PRINTER_TRACE_TYPE(pruRecords[i].event);
+        job = PRINTER_TRACE_ARG(pruRecords[i].event);
+        pruNs = pruRecords[i].timestamp * 1000 / TRACE_IEP_CLOCK_MHZ;
+
+        for (j = 0; j < trace.hostBuffer.nrOfRecords; j++) {
+            host = &hostRecords[j];
+            if (PRINTER_TRACE_ARG(host->arg) != job) {
+                continue;
+            }
+            if ((type == PRINTER_TRACE_JOB_START) &&
+                    (host->event == TRACE_HOST_DOORBELL)) {
+                if ((int64_t)(host->timeNs - pruNs) > minOffsetNs) {
+                    minOffsetNs = host->timeNs - pruNs;
+                }
+                sync->nrOfJobs++;
+            }
+            else if ((type == PRINTER_TRACE_JOB_END) &&
+                    (host->event == TRACE_HOST_COMPLETION)) {
+                if ((int64_t)(host->timeNs - pruNs) < maxOffsetNs) {
+                    maxOffsetNs = host->timeNs - pruNs;
+                }
+            }
+        }
+    }
+
+    if (sync->nrOfJobs) {
+        sync->offsetNs = minOffsetNs;
+        sync->windowNs = maxOffsetNs == INT64_MAX ? -1 :
+                maxOffsetNs - minOffsetNs;
+    }
+    else {
+        sync->offsetNs = trace.pruBuffer.nrOfRecords ? trace.startNs -
+                pruRecords[0].timestamp * 1000 / TRACE_IEP_CLOCK_MHZ : 0;
+        sync->windowNs = -1;
+    }
+}
+
+static bool writeTrace(const char *fileName, const TRACE_ClockSync *sync) {
+    FILE *file = fopen(fileName, "w");
+
+    if (!file) {
+        fprintf(stderr, "Error opening trace file %s!\n", fileName);
+        return false;
+    }
+
+    fprintf(file, "{\"traceEvents\": [\n");
+    fprintf(file, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %u, "
+            "\"args\": {\"name\": \"host\"}},\n", TRACE_HOST_PID);
+    fprintf(file, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %u, "
+            "\"args\": {\"name\": \"PRU1\"}}", TRACE_PRU_PID);
+    writeHostEvents(file);
+    writePruEvents(file, sync);
+    fprintf(file, "\n],\n\"displayTimeUnit\": \"ns\",\n");
+    fprintf(file, "\"otherData\": {\"clock_offset_ns\": %lld, "
+            "\"sync_jobs\": %u, \"sync_window_ns\": %lld, "
+            "\"lost_events\": %u}}\n", (long long)sync->offsetNs,
+            sync->nrOfJobs, (long long)sync->windowNs, trace.lostEvents);
+
+    if (fclose(file)) {
+        fprintf(stderr, "Error writing trace file %s!\n", fileName);
+        return false;
+    }
+
+    return true;
+}
+
+static void writeHostEvents(FILE *file) {
+    const TRACE_HostRecord *records =
+            (const TRACE_HostRecord *)trace.hostBuffer.records;
+    const TRACE_HostRecord *record;
+    uint32_t i;
+
+    for (i = 0; i < trace.hostBuffer.nrOfRecords; i++) {
+        record = &records[i];
+        if (record->durationNs) {
+            writeSpan(file, TRACE_HOST_PID, hostEventNames[record->event],
+                    record->timeNs, record->timeNs + record->durationNs,
+                    hostArgNames[record->event], record->arg);
+        }
+        else {
+            writeInstant(file, TRACE_HOST_PID, hostEventNames[record->event],
+                    record->timeNs, hostArgNames[record->event], record->arg);
+        }
+    }
+}
+
+// Turn the firmware events into spans by matching the start and end events of
+// each type. Since those never nest within their own type, a start event that
+// is followed by another one of the same type lost its end event, and an end
+// event without a start event lost the latter. Both get dropped.
+static void writePruEvents(FILE *file, const TRACE_ClockSync *sync) {
+    const TRACE_PruRecord *records =
+            (const TRACE_PruRecord *)trace.pruBuffer.records;
+    uint64_t startNs[PRINTER_TRACE_ALARM + 1];
+    uint32_t startArg[PRINTER_TRACE_ALARM + 1];
+    bool started[PRINTER_TRACE_ALARM + 1];
+    uint64_t timeNs;
+    uint32_t type;
+    uint32_t arg;
+    uint32_t i;
+
+    memset(started, 0, sizeof(started));
+    for (i = 0; i < trace.pruBuffer.nrOfRecords; i++) {
+        type = PRINTER_TRACE_TYPE(records[i].event);
+        arg = PRINTER_TRACE_ARG(records[i].event);
+        timeNs = records[i].timestamp * 1000 / TRACE_IEP_CLOCK_MHZ +
+                sync->offsetNs;
+
+        switch (type) {
+        case PRINTER_TRACE_JOB_START:
+        case PRINTER_TRACE_ITEM_START:
+        case PRINTER_TRACE_STROBE_START:
+        case PRINTER_TRACE_UNDERRUN_START:
+            startNs[type] = timeNs;
+            startArg[type] = arg;
+            started[type] = true;
+            break;
+
+        case PRINTER_TRACE_JOB_END:
+        case PRINTER_TRACE_ITEM_END:
+        case PRINTER_TRACE_STROBE_END:
+        case PRINTER_TRACE_UNDERRUN_END:
+            // Each end event directly follows its start event in numbering
+            if (!started[type - 1]) {
+                break;
+            }
+            started[type - 1] = false;
+            if (type == PRINTER_TRACE_JOB_END) {
+                writeSpan(file, TRACE_PRU_PID, "job", startNs[type - 1],
+                        timeNs, "job", startArg[type - 1]);
+            }
+            else if (type == PRINTER_TRACE_ITEM_END) {
+                writeItemSpan(file, startNs[type - 1], timeNs,
+                        startArg[type - 1]);
+            }
+            else if (type == PRINTER_TRACE_STROBE_END) {
+                writeSpan(file, TRACE_PRU_PID, "strobe", startNs[type - 1],
+                        timeNs, NULL, 0);
+            }
+            else {
+                writeSpan(file, TRACE_PRU_PID, "underrun", startNs[type - 1],
+                        timeNs, NULL, 0);
+            }
+            break;
+
+        case PRINTER_TRACE_STEP:
+            writeInstant(file, TRACE_PRU_PID, "step", timeNs, "index", arg);
+            break;
+
+        case PRINTER_TRACE_ALARM:
+            writeInstant(file, TRACE_PRU_PID, arg ? "paper-out" :
+                    "thermal-alarm", timeNs, NULL, 0);
+            break;
+
+        default:
+            break;
+        }
+    }
+}
+
+// Write a complete event. Times are given in microseconds from the start of
+// the trace.
+static void writeSpan(FILE *file, const uint32_t pid, const char *name,
+        const uint64_t startNs, const uint64_t endNs, const char *argName,
+        const uint32_t arg) {
+    fprintf(file, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": %u, "
+            "\"tid\": 1, \"ts\": %.3f, \"dur\": %.3f", name, pid,
+            (int64_t)(startNs - trace.startNs) / 1000.0,
+            (int64_t)(endNs - startNs) / 1000.0);
+    if (argName) {
+        fprintf(file, ", \"args\": {\"%s\": %u}", argName, arg);
+    }
+    fprintf(file, "}");
+}
+
+static void writeInstant(FILE *file, const uint32_t pid, const char *name,
+        const uint64_t timeNs, const char *argName, const uint32_t arg) {
+    fprintf(file, ",\n{\"name\": \"%s\", \"ph\": \"i\", \"s\": \"t\", "
+            "\"pid\": %u, \"tid\": 1, \"ts\": %.3f", name, pid,
+            (int64_t)(timeNs - trace.startNs) / 1000.0);
+    if (argName) {
+        fprintf(file, ", \"args\": {\"%s\": %u}", argName, arg);
+    }
+    fprintf(file, "}");
+}
+
+static void writeItemSpan(FILE *file, const uint64_t startNs,
+        const uint64_t endNs, const uint32_t command) {
+    const uint32_t nrOfNames = sizeof(commandNames) / sizeof(commandNames[0]);
+    const char *name = NULL;
+    char unknownName[16];
+
+    if (command < nrOfNames) {
+        name = commandNames[command];
+    }
+    else if (command == PRINTER_CMD_REQUEST_PRU_HALT) {
+        name = "request-pru-halt";
+    }
+    else if (command == PRINTER_CMD_EOS) {
+        name = "eos";
+    }
+
+    if (!name) {
+        snprintf(unknownName, sizeof(unknownName), "item-0x%02x", command);
+        name = unknownName;
+    }
+    writeSpan(file, TRACE_PRU_PID, name, startNs, endNs, NULL, 0);
+}
+
+static uint64_t getTimeNs(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
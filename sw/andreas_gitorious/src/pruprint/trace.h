@@ -0,0 +1,68 @@
+/*
+ * trace.h
+ *
+ * Timeline tracing of print jobs across the host and the PRU. While a trace is
+ * running the host records its own events, time-stamped using CLOCK_MONOTONIC,
+ * and a thread collects the events the firmware records into the trace ring
+ * in the PRU1 data RAM (see pruprinter.h), time-stamped using the IEP count.
+ * Stopping the trace writes both into a single file in the Chrome trace event
+ * format (JSON) that Perfetto and chrome://tracing open as they are, with the
+ * host and PRU1 showing up as separate processes. The host events are:
+ *
+ *   decode       Reading and decoding the PNG image
+ *   partition    Turning the image rows into job items
+ *   copy         Copying job items into the printer queue
+ *   doorbell     Kicking off a job on the PRU
+ *   wakeup       Being woken up by an event of the firmware
+ *   completion   Noticing that a job has completed
+ *
+ * The two clocks get aligned using the jobs. A job can't start on the PRU
+ * before the host rang the doorbell, and the host can't notice its completion
+ * before the job ended on the PRU. The offset between the clocks is taken to
+ * be the smallest one that satisfies the former for all jobs, which assumes
+ * the doorbell to take no time at all. The latter limits how far off that can
+ * be. Both are written along with the trace.
+ *
+ * The trace ring holds the most recent PRINTER_TRACE_NR_OF_ENTRIES events, so
+ * events that get overwritten before the thread gets to them are lost. Their
+ * number is written along with the trace as well. The IEP count wraps around
+ * every 21 seconds, so firmware events that are further apart than that end
+ * up misplaced.
+ *
+ * Recording an event takes a clock read and a store into a buffer that grows
+ * as needed. Without a running trace nothing gets recorded.
+ *
+ * Copyright (C) 2014 Texas Instruments Incorporated - http://www.ti.com/
+ * ALL RIGHTS RESERVED
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "transport.h"
+
+// Events recorded by the host. The argument of decode and partition is the
+// number of rows, of copy the number of bytes, and of doorbell and completion
+// the number of jobs completed before the job, which is how they get matched
+// with the jobs of the firmware.
+typedef enum {
+    TRACE_HOST_DECODE,
+    TRACE_HOST_PARTITION,
+    TRACE_HOST_COPY,
+    TRACE_HOST_DOORBELL,
+    TRACE_HOST_WAKEUP,
+    TRACE_HOST_COMPLETION,
+    TRACE_NR_OF_HOST_EVENTS
+} TRACE_HostEvent;
+
+bool startTrace(const PRINTER_Transport *transport);
+bool stopTrace(const char *fileName);
+uint64_t beginTraceSpan(void);
+void endTraceSpan(const TRACE_HostEvent event, const uint64_t startNs,
+        const uint32_t arg);
+void traceHostEvent(const TRACE_HostEvent event, const uint32_t arg);
+
+#endif /* TRACE_H_ */
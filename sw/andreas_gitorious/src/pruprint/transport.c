@@ -0,0 +1,176 @@
+/*
+ * transport.c
+ *
+ * Selection of the transport connecting the host application to the PRU. See
+ * transport.h for details.
+ *
+ * Copyright (C) 2014 Texas Instruments Incorporated - http://www.ti.com/
+ * ALL RIGHTS RESERVED
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/file.h>
+
+#include "transport.h"
+
+static const PRINTER_TransportOps *transports[] = {
+    &uioTransportOps,
+    &rprocTransportOps,
+    &simTransportOps,
+    &simFastTransportOps
+};
+
+static const PRINTER_TransportOps *findTransport(const char *name);
+static bool lockTransport(PRINTER_Transport *transport);
+static void unlockTransport(PRINTER_Transport *transport);
+
+bool openTransport(PRINTER_Transport *transport, const char *name) {
+    memset(transport, 0, sizeof(*transport));
+    transport->lockFd = -1;
+
+    transport->ops = findTransport(name);
+    if (!transport->ops) {
+        return false;
+    }
+    if (!lockTransport(transport)) {
+        transport->ops = NULL;
+        return false;
+    }
+    if (!transport->ops->open(transport)) {
+        unlockTransport(transport);
+        transport->ops = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+// Open the transport for looking at the PRU memories only. See transport.h for
+// what that entails.
+bool openTransportMonitor(PRINTER_Transport *transport, const char *name) {
+    memset(transport, 0, sizeof(*transport));
+    transport->lockFd = -1;
+
+    transport->ops = findTransport(name);
+    if (!transport->ops) {
+        return false;
+    }
+    if (!transport->ops->openMonitor) {
+        fprintf(stderr, "Transport %s can't be monitored!\n", name);
+        transport->ops = NULL;
+        return false;
+    }
+    if (!transport->ops->openMonitor(transport)) {
+        transport->ops = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+void closeTransport(PRINTER_Transport *transport, const bool stopPru) {
+    if (transport->ops) {
+        transport->ops->close(transport, stopPru);
+        unlockTransport(transport);
+        transport->ops = NULL;
+    }
+}
+
+bool loadTransportFirmware(PRINTER_Transport *transport,
+        const PRINTER_Firmware *firmware, PRINTER_FirmwareLoadInfo *loadInfo) {
+    memset(loadInfo, 0, sizeof(*loadInfo));
+
+    return transport->ops->loadFirmware(transport, firmware, loadInfo);
+}
+
+bool startTransportPru(PRINTER_Transport *transport) {
+    return transport->ops->startPru(transport);
+}
+
+void kickTransport(PRINTER_Transport *transport) {
+    transport->ops->kick(transport);
+}
+
+int getTransportEventFd(const PRINTER_Transport *transport,
+        const PRINTER_Event event) {
+    return transport->ops->getEventFd(transport, event);
+}
+
+bool takeTransportEvent(PRINTER_Transport *transport,
+        const PRINTER_Event event) {
+    return transport->ops->takeEvent(transport, event);
+}
+
+bool waitTransportEvent(PRINTER_Transport *transport,
+        const PRINTER_Event event) {
+    return transport->ops->waitEvent(transport, event);
+}
+
+static const PRINTER_TransportOps *findTransport(const char *name) {
+    uint32_t i;
+
+    for (i = 0; i < sizeof(transports) / sizeof(transports[0]); i++) {
+        if (!strcmp(transports[i]->name, name)) {
+            return transports[i];
+        }
+    }
+
+    fprintf(stderr, "Unknown transport %s!\n", name);
+    printTransportsToConsole();
+
+    return NULL;
+}
+
+// Take the lock file of the transport, if it has one. The lock is never waited
+// for since whoever holds it may keep the PRU busy for as long as it runs, as
+// the print daemon does. The file is opened read-only as that's all flock()
+// needs, which lets other users take the lock once it has been created.
+static bool lockTransport(PRINTER_Transport *transport) {
+    const char *lockFile = transport->ops->lockFile;
+
+    if (!lockFile) {
+        return true;
+    }
+
+    transport->lockFd = open(lockFile, O_RDONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (transport->lockFd < 0) {
+        fprintf(stderr, "Error opening lock file %s!\n", lockFile);
+        return false;
+    }
+
+    while (flock(transport->lockFd, LOCK_EX | LOCK_NB)) {
+        if (errno != EINTR) {
+            if (errno == EWOULDBLOCK) {
+                fprintf(stderr, "PRU is in use by another process!\n");
+            }
+            else {
+                fprintf(stderr, "Error locking %s!\n", lockFile);
+            }
+            unlockTransport(transport);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void unlockTransport(PRINTER_Transport *transport) {
+    if (transport->lockFd >= 0) {
+        close(transport->lockFd);
+        transport->lockFd = -1;
+    }
+}
+
+void printTransportsToConsole(void) {
+    uint32_t i;
+
+    printf("Available transports:\n");
+    for (i = 0; i < sizeof(transports) / sizeof(transports[0]); i++) {
+        printf("  %-12s %s\n", transports[i]->name,
+                transports[i]->description);
+    }
+}
@@ -0,0 +1,143 @@
+/*
+ * transport.h
+ *
+ * Transports connect the host application to the PRU running the printer
+ * firmware. A transport maps the PRU memories, loads and starts the firmware,
+ * kicks off print jobs by ringing the PRU's doorbell and reports the events
+ * the firmware raises towards the host. Each event comes with a file
+ * descriptor that becomes readable when the event may have happened so that
+ * it can be watched using poll/epoll. The following transports are available:
+ *
+ *   uio       The PRU is driven through the prussdrv library and the uio_pruss
+ *             kernel driver of the 2014 SDK. Events are delivered as UIO
+ *             interrupts.
+ *   rproc     The PRU is owned by the remoteproc framework of current kernels.
+ *             The firmware gets booted through remoteproc, the PRU memories
+ *             and the interrupt controller are mapped through /dev/mem. As
+ *             the firmware doesn't speak rpmsg, events are detected by
+ *             polling the interrupt controller at a fixed rate.
+ *   sim       The PRU gets simulated in-process on regular memory by a model
+ *             of the firmware that processes the printer queue with the
+ *             timing of the real printer (see queuesim.h). This allows the
+ *             entire host application to run on a Linux workstation.
+ *   simfast   Same as sim but processes the printer queue as fast as possible
+ *
+ * Copyright (C) 2014 Texas Instruments Incorporated - http://www.ti.com/
+ * ALL RIGHTS RESERVED
+ */
+
+#ifndef TRANSPORT_H_
+#define TRANSPORT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Interface to the PRU-based printer driver firmware "pruprinter_fw"
+#include "pruprinter.h"
+
+// Transport used unless told otherwise
+#define PRINTER_DEFAULT_TRANSPORT           "uio"
+
+// Lock file the transports driving the actual PRU-ICSS hold for as long as
+// they are open, so that only one process at a time can load the firmware or
+// hand it jobs. It is shared by all such transports as they drive the same
+// hardware, and lives in /run/lock since /dev is no place for creating files.
+#define PRINTER_TRANSPORT_LOCK_FILE         "/run/lock/pruss.lock"
+
+// Events raised by the firmware. The completion event signals the end of a
+// print job, the watermark event that the printer queue runs low.
+typedef enum {
+    PRINTER_EVENT_COMPLETION,
+    PRINTER_EVENT_WATERMARK,
+    PRINTER_NR_OF_EVENTS
+} PRINTER_Event;
+
+// Type describing a firmware image. The image is either given as a file image
+// (an ELF file or a raw instruction RAM binary) or, if that is NULL, as
+// separate instruction and data RAM images. Start addresses are given in bytes
+// from the beginning of the respective PRU memory.
+typedef struct {
+    const void *image;
+    uint32_t imageLength;
+    const void *iram;
+    uint32_t iramStart;
+    uint32_t iramLength;
+    const void *dram;
+    uint32_t dramStart;
+    uint32_t dramLength;
+} PRINTER_Firmware;
+
+// Statistics about loading a firmware image
+typedef struct {
+    uint32_t iramBytes;
+    uint32_t dramBytes;
+    uint32_t loadTimeUs;
+} PRINTER_FirmwareLoadInfo;
+
+typedef struct PRINTER_Transport PRINTER_Transport;
+
+// Type describing the implementation of a transport. The firmware gets loaded
+// with the PRU stopped and is only started once startPru() gets called, which
+// leaves the host a chance to initialize the PRU memories in between. The
+// takeEvent() function returns right away, telling whether the event has
+// happened and acknowledging it if so, whereas waitEvent() blocks until the
+// event happens. The openMonitor() function does no more than map the PRU
+// memories, leaving the PRU and its interrupt controller alone so that a
+// firmware that is in use by someone else can be looked at. A transport that
+// only works within a single process leaves it NULL. A transport opened that
+// way may only be closed again without stopping the PRU. The lock file is
+// taken before the transport gets opened other than for monitoring, which a
+// transport whose PRU lives within the process doesn't need and leaves NULL.
+typedef struct {
+    const char *name;
+    const char *description;
+    const char *lockFile;
+    bool (*open)(PRINTER_Transport *transport);
+    bool (*openMonitor)(PRINTER_Transport *transport);
+    void (*close)(PRINTER_Transport *transport, const bool stopPru);
+    bool (*loadFirmware)(PRINTER_Transport *transport,
+            const PRINTER_Firmware *firmware,
+            PRINTER_FirmwareLoadInfo *loadInfo);
+    bool (*startPru)(PRINTER_Transport *transport);
+    void (*kick)(PRINTER_Transport *transport);
+    int (*getEventFd)(const PRINTER_Transport *transport,
+            const PRINTER_Event event);
+    bool (*takeEvent)(PRINTER_Transport *transport, const PRINTER_Event event);
+    bool (*waitEvent)(PRINTER_Transport *transport, const PRINTER_Event event);
+} PRINTER_TransportOps;
+
+// Type describing an open transport. The memory pointers refer to the PRU
+// shared RAM holding the printer queue, the PRU1 data RAM and the PRU0 data
+// RAM holding the macro store. The lock file descriptor is -1 unless the lock
+// file is held. The state is private to the implementation.
+struct PRINTER_Transport {
+    const PRINTER_TransportOps *ops;
+    int lockFd;
+    PRINTER_Queue *queue;
+    void *pruDataRam;
+    PRINTER_MacroStore *macroStore;
+    void *state;
+};
+
+// Transport implementations
+extern const PRINTER_TransportOps uioTransportOps;
+extern const PRINTER_TransportOps rprocTransportOps;
+extern const PRINTER_TransportOps simTransportOps;
+extern const PRINTER_TransportOps simFastTransportOps;
+
+bool openTransport(PRINTER_Transport *transport, const char *name);
+bool openTransportMonitor(PRINTER_Transport *transport, const char *name);
+void closeTransport(PRINTER_Transport *transport, const bool stopPru);
+bool loadTransportFirmware(PRINTER_Transport *transport,
+        const PRINTER_Firmware *firmware, PRINTER_FirmwareLoadInfo *loadInfo);
+bool startTransportPru(PRINTER_Transport *transport);
+void kickTransport(PRINTER_Transport *transport);
+int getTransportEventFd(const PRINTER_Transport *transport,
+        const PRINTER_Event event);
+bool takeTransportEvent(PRINTER_Transport *transport,
+        const PRINTER_Event event);
+bool waitTransportEvent(PRINTER_Transport *transport,
+        const PRINTER_Event event);
+void printTransportsToConsole(void);
+
+#endif /* TRANSPORT_H_ */
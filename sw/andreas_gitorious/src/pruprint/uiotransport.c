@@ -0,0 +1,246 @@
+/*
+ * uiotransport.c
+ *
+ * Transport driving the PRU through the prussdrv library and the uio_pruss
+ * kernel driver. See transport.h for details.
+ *
+ * Copyright (C) 2014 Texas Instruments Incorporated - http://www.ti.com/
+ * ALL RIGHTS RESERVED
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+
+// PRU driver header file
+#include "prussdrv.h"
+#include "pruss_intc_mapping.h"
+
+#include "transport.h"
+
+// Lock file of the transport. Built against the prussdrv mock (the 'Mock'
+// build configuration defines PRUSSDRV_MOCK) every process drives a simulated
+// PRU of its own, so there is nothing to lock.
+#ifdef PRUSSDRV_MOCK
+#define UIO_LOCK_FILE                       NULL
+#else
+#define UIO_LOCK_FILE                       PRINTER_TRANSPORT_LOCK_FILE
+#endif
+
+static bool openUio(PRINTER_Transport *transport);
+static bool openUioMonitor(PRINTER_Transport *transport);
+static void closeUio(PRINTER_Transport *transport, const bool stopPru);
+static bool loadUioFirmware(PRINTER_Transport *transport,
+        const PRINTER_Firmware *firmware, PRINTER_FirmwareLoadInfo *loadInfo);
+static bool startUioPru(PRINTER_Transport *transport);
+static void kickUio(PRINTER_Transport *transport);
+static int getUioEventFd(const PRINTER_Transport *transport,
+        const PRINTER_Event event);
+static bool takeUioEvent(PRINTER_Transport *transport,
+        const PRINTER_Event event);
+static bool waitUioEvent(PRINTER_Transport *transport,
+        const PRINTER_Event event);
+static void mapUioMemories(PRINTER_Transport *transport);
+
+const PRINTER_TransportOps uioTransportOps = {
+    "uio",
+    "PRU driven through prussdrv and the uio_pruss kernel driver",
+    UIO_LOCK_FILE,
+    openUio,
+    openUioMonitor,
+    closeUio,
+    loadUioFirmware,
+    startUioPru,
+    kickUio,
+    getUioEventFd,
+    takeUioEvent,
+    waitUioEvent
+};
+
+// Host interrupts and system events the firmware events are delivered on. The
+// INTC config maps PRU1_ARM_INTERRUPT to EVTOUT_1 and PRU0_ARM_INTERRUPT,
+// which the firmware raises as its watermark interrupt, to EVTOUT_0.
+static const struct {
+    unsigned int hostInterrupt;
+    unsigned int sysEvent;
+} uioEvents[PRINTER_NR_OF_EVENTS] = {
+    { PRU_EVTOUT_1, PRU1_ARM_INTERRUPT },
+    { PRU_EVTOUT_0, PRU0_ARM_INTERRUPT }
+};
+
+static bool openUio(PRINTER_Transport *transport) {
+    tpruss_intc_initdata pruss_intc_initdata = PRUSS_INTC_INITDATA;
+    uint32_t i;
+    int fd;
+    int flags;
+
+    prussdrv_init();
+
+    // Open PRU driver and prepare for using the interrupts on event outputs 1
+    // and 0
+    if (prussdrv_open(PRU_EVTOUT_1) || prussdrv_open(PRU_EVTOUT_0)) {
+        fprintf(stderr, "prussdrv_open failed!\n");
+        return false;
+    }
+
+    // Initialize the PRUSS interrupt controller
+    if (prussdrv_pruintc_init(&pruss_intc_initdata)) {
+        fprintf(stderr, "prussdrv_pruintc_init failed!\n");
+        prussdrv_exit();
+        return false;
+    }
+
+    // Switch the UIO file descriptors to non-blocking mode so that events can
+    // be taken without ever waiting. Waiting is done using poll() instead.
+    for (i = 0; i < PRINTER_NR_OF_EVENTS; i++) {
+        fd = prussdrv_pru_event_fd(uioEvents[i].hostInterrupt);
+        flags = fcntl(fd, F_GETFL);
+        if ((flags < 0) || (fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)) {
+            fprintf(stderr, "Error configuring PRU event file descriptor!\n");
+            prussdrv_exit();
+            return false;
+        }
+    }
+
+    mapUioMemories(transport);
+
+    return true;
+}
+
+// Open the PRU driver for mapping the PRU memories only. Opening any one event
+// output gives access to the memories. The interrupt controller is left
+// alone, and so are the event file descriptors which get shared with whoever
+// else has the PRU driver open.
+static bool openUioMonitor(PRINTER_Transport *transport) {
+    prussdrv_init();
+
+    if (prussdrv_open(PRU_EVTOUT_1)) {
+        fprintf(stderr, "prussdrv_open failed!\n");
+        return false;
+    }
+
+    mapUioMemories(transport);
+
+    return true;
+}
+
+static void closeUio(PRINTER_Transport *transport, const bool stopPru) {
+    if (stopPru) {
+        prussdrv_pru_disable(1);
+    }
+    prussdrv_exit();
+}
+
+static bool loadUioFirmware(PRINTER_Transport *transport,
+        const PRINTER_Firmware *firmware, PRINTER_FirmwareLoadInfo *loadInfo) {
+    tprussdrv_load_info prussdrvLoadInfo;
+    struct timespec startTime;
+    struct timespec endTime;
+
+    // File images are taken apart by prussdrv which also verifies them
+    if (firmware->image) {
+        if (prussdrv_load_image(1, firmware->image, firmware->imageLength,
+                PRUSSDRV_LOAD_VERIFY, &prussdrvLoadInfo)) {
+            return false;
+        }
+        loadInfo->iramBytes = prussdrvLoadInfo.iram_bytes;
+        loadInfo->dramBytes = prussdrvLoadInfo.dram_bytes;
+        loadInfo->loadTimeUs = prussdrvLoadInfo.load_time_us;
+        return true;
+    }
+
+    // Make sure PRU sub system is first disabled/reset. Then, transfer the
+    // program into the PRU and verify it. Note that the write memory functions
+    // expect the offsets to be provided in words so we our byte-addresses by
+    // four.
+    clock_gettime(CLOCK_MONOTONIC, &startTime);
+    prussdrv_pru_disable(1);
+    if (prussdrv_pru_write_memory(PRUSS0_PRU1_IRAM, firmware->iramStart / 4,
+                (unsigned int *)firmware->iram, firmware->iramLength) < 0 ||
+            prussdrv_pru_write_memory(PRUSS0_PRU1_DATARAM,
+                firmware->dramStart / 4, (unsigned int *)firmware->dram,
+                firmware->dramLength) < 0) {
+        return false;
+    }
+    if (prussdrv_pru_verify_memory(PRUSS0_PRU1_IRAM, firmware->iramStart / 4,
+                (const unsigned int *)firmware->iram, firmware->iramLength) ||
+            prussdrv_pru_verify_memory(PRUSS0_PRU1_DATARAM,
+                firmware->dramStart / 4, (const unsigned int *)firmware->dram,
+                firmware->dramLength)) {
+        return false;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &endTime);
+
+    loadInfo->iramBytes = firmware->iramLength;
+    loadInfo->dramBytes = firmware->dramLength;
+    loadInfo->loadTimeUs = (endTime.tv_sec - startTime.tv_sec) * 1000000 +
+            (endTime.tv_nsec - startTime.tv_nsec) / 1000;
+
+    return true;
+}
+
+static bool startUioPru(PRINTER_Transport *transport) {
+    return !prussdrv_pru_enable(1);
+}
+
+static void kickUio(PRINTER_Transport *transport) {
+    // The interrupt is mapped via INTC to channel 1
+    prussdrv_pru_send_event(ARM_PRU1_INTERRUPT);
+}
+
+static int getUioEventFd(const PRINTER_Transport *transport,
+        const PRINTER_Event event) {
+    return prussdrv_pru_event_fd(uioEvents[event].hostInterrupt);
+}
+
+static bool takeUioEvent(PRINTER_Transport *transport,
+        const PRINTER_Event event) {
+    unsigned int eventCount;
+
+    // The UIO file descriptor is readable once the host interrupt fired. The
+    // system event needs to be cleared and the host interrupt re-enabled
+    // before it can fire again.
+    if (read(prussdrv_pru_event_fd(uioEvents[event].hostInterrupt),
+            &eventCount, sizeof(eventCount)) != sizeof(eventCount)) {
+        return false;
+    }
+    prussdrv_pru_clear_event(uioEvents[event].hostInterrupt,
+            uioEvents[event].sysEvent);
+
+    return true;
+}
+
+static bool waitUioEvent(PRINTER_Transport *transport,
+        const PRINTER_Event event) {
+    struct pollfd pollFd;
+
+    pollFd.fd = prussdrv_pru_event_fd(uioEvents[event].hostInterrupt);
+    pollFd.events = POLLIN;
+
+    while (!takeUioEvent(transport, event)) {
+        if ((poll(&pollFd, 1, -1) < 0) && (errno != EINTR)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void mapUioMemories(PRINTER_Transport *transport) {
+    // Get pointer to the shared PRUSS memory. On the AM355x this block is 12KB
+    // in size and located locally at 0x0001_0000 within the PRU cores and
+    // globally at 0x4A31_0000 in the MPU's memory map. The entire memory is
+    // used as our printer queue.
+    prussdrv_map_prumem(PRUSS0_SHARED_DATARAM, (void **)&transport->queue);
+
+    // Get pointer to the PRU1 data RAM which is where the line dictionary
+    // gets uploaded to.
+    prussdrv_map_prumem(PRUSS0_PRU1_DATARAM, &transport->pruDataRam);
+
+    // Get pointer to the PRU0 data RAM which holds the resident job macros
+    prussdrv_map_prumem(PRUSS0_PRU0_DATARAM, (void **)&transport->macroStore);
+}
@@ -0,0 +1,238 @@
+/*
+ * printdtest.c
+ *
+ * Test of the print daemon's job checks. The daemon is run on the simulated
+ * printer driver ("simfast" transport) in a child process, and gets handed a
+ * job for each of the commands a client must not be able to get the PRU to
+ * execute, both on its own and within a macro body. Each of them needs to be
+ * answered with a result other than PRINTER_DAEMON_RESULT_OK. A regular job
+ * is handed to the daemon as well to make sure it still gets printed. A daemon
+ * that doesn't answer in time, for example because it got stuck on one of the
+ * jobs, fails the test as well.
+ *
+ * The program exits with EXIT_SUCCESS if all checks passed.
+ *
+ * Copyright (C) 2014 Texas Instruments Incorporated - http://www.ti.com/
+ * ALL RIGHTS RESERVED
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+
+#include "transport.h"
+#include "printjob.h"
+#include "linedict.h"
+#include "printd.h"
+
+// Socket the daemon under test listens on, and how long to wait for it
+#define TEST_SOCKET                 "/tmp/printdtest.sock"
+#define TEST_CONNECT_ATTEMPTS       100
+#define TEST_CONNECT_INTERVAL_US    20000
+
+// Time the whole test may take
+#define TEST_TIMEOUT_S              30
+
+// Command that isn't known to the firmware
+#define TEST_CMD_UNKNOWN            0x42
+
+// Commands that must not be accepted by the daemon
+static const uint32_t rejectedCommands[] = {
+    PRINTER_CMD_TEST_SIGNALS,
+    PRINTER_CMD_MEASURE_READ,
+    PRINTER_CMD_REQUEST_PRU_HALT,
+    PRINTER_CMD_WRAP,
+    PRINTER_CMD_EOS,
+    TEST_CMD_UNKNOWN
+};
+
+static void handleTimeout(int signal);
+static pid_t startDaemon(void);
+static void stopDaemon(const pid_t pid);
+static bool buildCommandJob(PRINTER_Job *job, const uint32_t command,
+        const bool inMacro);
+static bool buildPrintJob(PRINTER_Job *job);
+static bool checkJob(const char *name, const PRINTER_Job *job,
+        const bool expectOk);
+
+int main(void) {
+    PRINTER_Job job;
+    char name[64];
+    bool success = true;
+    pid_t pid;
+    uint32_t i;
+
+    signal(SIGALRM, handleTimeout);
+    alarm(TEST_TIMEOUT_S);
+
+    pid = startDaemon();
+    if (pid < 0) {
+        return EXIT_FAILURE;
+    }
+
+    if (!initJob(&job)) {
+        stopDaemon(pid);
+        return EXIT_FAILURE;
+    }
+
+    for (i = 0; i < sizeof(rejectedCommands) / sizeof(rejectedCommands[0]);
+            i++) {
+        snprintf(name, sizeof(name), "command 0x%02X", rejectedCommands[i]);
+        success &= buildCommandJob(&job, rejectedCommands[i], false) &&
+                checkJob(name, &job, false);
+        snprintf(name, sizeof(name), "command 0x%02X in macro",
+                rejectedCommands[i]);
+        success &= buildCommandJob(&job, rejectedCommands[i], true) &&
+                checkJob(name, &job, false);
+    }
+    success &= buildCommandJob(&job, PRINTER_CMD_DEFINE_MACRO, true) &&
+            checkJob("macro defined in macro", &job, false);
+
+    // The checks must not get in the way of printing
+    success &= buildPrintJob(&job) && checkJob("print job", &job, true);
+
+    freeJob(&job);
+    stopDaemon(pid);
+
+    printf("%s\n", success ? "All checks passed" : "Some checks FAILED");
+
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// The daemon gets killed along with the test, see startDaemon()
+static void handleTimeout(int signal) {
+    static const char message[] = "Print daemon didn't answer in time!\n";
+
+    write(STDERR_FILENO, message, sizeof(message) - 1);
+    _exit(EXIT_FAILURE);
+}
+
+// Run the daemon in a child process and wait for it to accept connections
+static pid_t startDaemon(void) {
+    static const PRINTER_Firmware firmware;
+    PRINTER_FirmwareLoadInfo loadInfo;
+    PRINTER_Transport transport;
+    PRINTER_DaemonResponse response;
+    PRINTER_Job job;
+    PRINTER_LineDictionary lineDict;
+    bool connected = false;
+    pid_t pid;
+    uint32_t i;
+
+    unlink(TEST_SOCKET);
+    pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "Error starting the print daemon!\n");
+        return -1;
+    }
+
+    // A daemon that got stuck can't be relied upon to terminate when asked
+    // to, so it gets killed once the test goes away
+    if (!pid) {
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        if (!openTransport(&transport, "simfast")) {
+            _exit(EXIT_FAILURE);
+        }
+        if (!loadTransportFirmware(&transport, &firmware, &loadInfo) ||
+                !startTransportPru(&transport) ||
+                !runPrintDaemon(TEST_SOCKET, &transport, 0)) {
+            closeTransport(&transport, true);
+            _exit(EXIT_FAILURE);
+        }
+        closeTransport(&transport, true);
+        _exit(EXIT_SUCCESS);
+    }
+
+    // An empty job makes for a harmless way of finding out whether the
+    // daemon is up yet
+    memset(&lineDict, 0, sizeof(lineDict));
+    if (initJob(&job)) {
+        for (i = 0; !connected && (i < TEST_CONNECT_ATTEMPTS); i++) {
+            connected = sendJobToDaemon(TEST_SOCKET, &job, &lineDict,
+                    PRINTER_SYNC_INTERRUPT, &response);
+            if (!connected) {
+                usleep(TEST_CONNECT_INTERVAL_US);
+            }
+        }
+        freeJob(&job);
+    }
+
+    if (!connected) {
+        fprintf(stderr, "Print daemon didn't come up!\n");
+        stopDaemon(pid);
+        return -1;
+    }
+
+    return pid;
+}
+
+static void stopDaemon(const pid_t pid) {
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    unlink(TEST_SOCKET);
+}
+
+// Build a job consisting of the given command, either on its own or as the
+// body of a macro that gets defined by the job. Commands get a payload of the
+// size the firmware expects.
+static bool buildCommandJob(PRINTER_Job *job, const uint32_t command,
+        const bool inMacro) {
+    uint32_t macro[1 + (PRINTER_JOB_ITEM_SIZE(sizeof(PRINTER_ReadMeasurement)) /
+            sizeof(uint32_t))];
+    PRINTER_JobItem *bodyItem = (PRINTER_JobItem *)&macro[1];
+    uint32_t length = 0;
+
+    if (command == PRINTER_CMD_MEASURE_READ) {
+        length = sizeof(PRINTER_ReadMeasurement);
+    }
+
+    clearJob(job);
+    if (!inMacro) {
+        return reserveJobItem(job, command, length) != NULL;
+    }
+
+    memset(macro, 0, sizeof(macro));
+    bodyItem->command = command;
+    bodyItem->length = length;
+
+    return addJobItem(job, PRINTER_CMD_DEFINE_MACRO,
+            sizeof(uint32_t) + PRINTER_JOB_ITEM_SIZE(length), macro);
+}
+
+// Build a job feeding a bit of paper using a macro
+static bool buildPrintJob(PRINTER_Job *job) {
+    const uint32_t macro[] = { 0, PRINTER_CMD_MOTOR_HALF_STEP,
+            sizeof(uint32_t), 2 };
+    const uint32_t macroId = 0;
+    bool success = true;
+
+    clearJob(job);
+    success &= addJobItem(job, PRINTER_CMD_DEFINE_MACRO, sizeof(macro),
+            macro);
+    success &= addJobItem(job, PRINTER_CMD_OPEN, 0, NULL);
+    success &= addJobItem(job, PRINTER_CMD_CALL_MACRO, sizeof(macroId),
+            &macroId);
+    success &= addJobItem(job, PRINTER_CMD_CLOSE, 0, NULL);
+
+    return success;
+}
+
+static bool checkJob(const char *name, const PRINTER_Job *job,
+        const bool expectOk) {
+    PRINTER_LineDictionary lineDict;
+    PRINTER_DaemonResponse response;
+    bool success;
+
+    memset(&lineDict, 0, sizeof(lineDict));
+    success = sendJobToDaemon(TEST_SOCKET, job, &lineDict,
+            PRINTER_SYNC_INTERRUPT, &response) &&
+            ((response.result == PRINTER_DAEMON_RESULT_OK) == expectOk);
+    printf("  %-32s %s\n", name, success ? "OK" : "FAILED");
+    fflush(stdout);
+
+    return success;
+}
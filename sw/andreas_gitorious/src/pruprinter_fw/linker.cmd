@@ -35,7 +35,7 @@ MEMORY
     PAGE 0:
       PRUIMEM   : org = 0x00000000, len = 0x00002000  /* 8KB PRU Instruction RAM */
     PAGE 1:
-      PRUDMEM   : org = 0x00000000, len = 0x00002000  /* 8KB PRU Data RAM */
+      PRUDMEM   : org = 0x00000000, len = 0x00001000  /* Lower 4KB of the 8KB PRU Data RAM, upper half reserved for the host (see pruprinter.h) */
       SHAREDMEM : org = 0x00010000, len = 0x00003000  /* 12KB Shared RAM */
     PAGE 2:
       C0_INTC   : org = 0x00020000, len = 0x00001504, cregister = 0
@@ -17,6 +17,7 @@
 
 // TODO: Add functionality to monitor the printer activity duty cycle
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include "pru.h"
@@ -35,6 +36,17 @@
 // back to the host.
 #define PRINTER_USE_PAPER_SENSOR
 
+// Activate below definition to let the firmware time the phases of its work
+// using the PRU cycle and stall counters and accumulate the results in the
+// statistics block of the printer queue for the host to read. Each phase that
+// gets timed costs a few additional cycles.
+#define PRINTER_COLLECT_STATS
+
+// Activate below definition to let the firmware record the events of a print
+// job, such as items, strobes and motor steps, into the trace ring for the host
+// to turn into a timeline. Each event costs a few additional cycles.
+#define PRINTER_COLLECT_TRACE
+
 // Interface to the printer circuitry. The bits defined here map to bits in
 // PRU 1 core register R30 for outputs and to bits in R31 for inputs.
 #define PRINTER_OUT_PAPER_SENSE     (1 << 0)    // BB P8.45 - Powers the paper-sense circuit
@@ -68,6 +80,7 @@
 // General PRU-timing related definitions. Note that for the delay definitions
 // to work the PRU core frequency must have been defined correctly.
 #define F_PRU_OCP_CLK_HZ            ((uint32_t)200E06)
+#define DELAY_1_MS                  ((uint32_t)(F_PRU_OCP_CLK_HZ * 0.001))
 #define DELAY_5_MS                  ((uint32_t)(F_PRU_OCP_CLK_HZ * 0.005))
 #define DELAY_100_MS                ((uint32_t)(F_PRU_OCP_CLK_HZ * 0.100))
 #define DELAY_500_MS                ((uint32_t)(F_PRU_OCP_CLK_HZ * 0.500))
@@ -102,22 +115,113 @@
 // for easier access.
 volatile far PRINTER_Queue queue __attribute__((cregister("C28_SHARED_RAM", far), peripheral));
 
+// Map the line dictionary that gets uploaded by the host into the upper half of
+// our data RAM.
+#define lineDict \
+        (*(volatile PRINTER_LineDict *) \
+        (PRU_LOCAL_DATARAM_BASE + PRINTER_LINE_DICT_OFFSET))
+
+// Map the firmware info block that lets the host attach to the running firmware
+#define firmwareInfo \
+        (*(volatile PRINTER_FirmwareInfo *) \
+        (PRU_LOCAL_DATARAM_BASE + PRINTER_FW_INFO_OFFSET))
+
+// Map the trace ring that fills up the rest of our data RAM
+#define traceRing \
+        (*(volatile PRINTER_TraceRing *) \
+        (PRU_LOCAL_DATARAM_BASE + PRINTER_TRACE_OFFSET))
+
+// Map the job macro store residing in the PRU0 data RAM
+#define macroStore \
+        (*(volatile PRINTER_MacroStore *) \
+        (PRU_LOCAL_DATARAM_BASE + PRINTER_MACRO_STORE_PRU1_ADDRESS))
+
+// Type of an entry of the control flow stack that is used to keep track of
+// PRINTER_CMD_LOOP blocks and macro calls. For loops the item field points to
+// the first item of the loop body, for macro calls it points to the item where
+// execution continues after the macro returns.
+typedef struct {
+    PRINTER_JobItem *item;
+    uint32_t remainingIterations;
+    bool isMacroCall;
+} ControlFrame;
+
+static ControlFrame controlFrames[PRINTER_MAX_NESTING_LEVEL];
+static uint8_t nestingLevel;
+
+// Keeps track of the queue progress. The ring item is the item in the printer
+// queue that was last processed on the outermost level, that is, not within a
+// loop or a macro. The other two variables remember the state of the queue
+// when the watermark event was raised last.
+static PRINTER_JobItem *ringItem;
+static uint32_t signaledProducedBytes;
+static uint32_t signaledBacklog;
+
 // Keeps track of the current state of the stepper motor
 static uint8_t motorStepIndex;
 
+// Keeps track of whether the printer head and the paper sensor are powered,
+// and for how many more milliseconds they are kept powered while idle
+static bool headPowered;
+static uint32_t keepWarmRemainingMs;
+
+// Keeps a copy of all passes that were printed into the current physical line
+// so that the line can be re-printed using PRINTER_CMD_REPEAT_LINE without the
+// host needing to transfer the dot data again. The passes of a new line will
+// replace the stored ones once the paper got advanced.
+static uint32_t linePassData[PRINTER_MAX_PASSES_PER_LINE]
+                            [PRINTER_BYTES_PER_LINE / sizeof(uint32_t)];
+static uint8_t nrOfLinePasses;
+static bool linePassesOverflow;
+static bool lineCompleted;
+
+// Index of the trace ring entry that gets written next. It is the write count
+// of the ring modulo its number of entries, kept separately so that it doesn't
+// need to be calculated for every event.
+static uint8_t traceIndex;
+
+// Cycle and stall counts of the phase that is suspended while the handler of a
+// print job item runs, which may time phases of its own
+static uint32_t suspendedCycles;
+static uint32_t suspendedStalls;
+
 // Init and test functions
 static void initPRU(void);
 static void initIEP(void);
 static void setIepCompareEvent0(const uint32_t count);
 static void waitForIepCompareEvent0(void);
+static void setIepCompareEvent1(const uint32_t count);
+static bool checkIepCompareEvent1(void);
 static void initPrinterStatusRegister(void);
+static void initStats(void);
+static void initTrace(void);
+static void initFirmwareInfo(void);
 static void initPrinterOutputSignals(void);
 static void testPrinterOutputSignals(void);
 
 // Functions used for printing
 static void processPrintJob(const PRINTER_JobItem *job);
 static void printLine(const uint8_t dotData[]);
+static void strobeLine(void);
 static void printerStrobe(const uint32_t strobeSignal);
+static void storeLinePass(const uint32_t dotData[]);
+static bool repeatLine(void);
+static void printLineRefs(const PRINTER_JobItem *item);
+
+// Job macro and control flow handling
+static void initMacroStore(void);
+static bool defineMacro(const uint32_t macroId, const uint32_t body[],
+        const uint32_t length);
+static void removeMacro(const uint32_t macroId);
+static bool isInsideMacro(void);
+static PRINTER_JobItem *findLoopEnd(PRINTER_JobItem *item);
+
+// Printer queue progress tracking
+static void initQueueProgress(const PRINTER_JobItem *job);
+static void waitForQueueItems(void);
+static void updateQueueProgress(const PRINTER_JobItem *currentItem,
+        const PRINTER_JobItem *nextItem);
+static void checkQueueWatermark(void);
 
 // Functions for controlling the stepper motor
 static bool initMotor(void);
@@ -127,13 +231,35 @@ static bool checkThermalAlarm(void);
 // Paper management
 static bool checkPaperSensor(void);
 
+// Printer head power management
+static void powerUpHead(void);
+static void powerDownHead(void);
+static void startKeepWarmTimer(void);
+static void checkKeepWarmTimer(void);
+
+// Timing and tracing of the firmware's work and measurement of the memory read
+// performance
+static void beginPhase(void);
+static void endPhase(const uint8_t phase);
+static void suspendPhase(void);
+static void resumePhase(void);
+static void traceEvent(const uint32_t type, const uint32_t arg);
+static void measureRead(volatile PRINTER_ReadMeasurement *measurement);
+static void restartCycleCounter(void);
+static void readWord(const uint32_t address);
+static void readBurst(const uint32_t address);
+
 // Program entry point and event processing loop
 int main(void) {
     // Perform various PRU and printer-related initialization
     initPRU();
     initIEP();
     initPrinterStatusRegister();
+    initStats();
+    initTrace();
     initPrinterOutputSignals();
+    initMacroStore();
+    initFirmwareInfo();
 
     // Process print jobs which get started through ARM-to-PRU interrupts until
     // during processing a command to shutdown the PRU is encountered. This will
@@ -145,6 +271,8 @@ int main(void) {
         // For this to work the interrupt must have been enabled by the host
         // driver as well (via ESR0 or ESR1 registers).
         while ((__R31 & 0x80000000) == 0) {
+            firmwareInfo.idleCount++;
+            checkKeepWarmTimer();
         }
 
         // Clear status of system interrupt 22 event (ARM_PRU1_INTERRUPT) in
@@ -158,11 +286,15 @@ int main(void) {
         // printing the other. processPrintJob() already supports such a scheme
         // through the use of a the pointer to the first print job item.
         processPrintJob((PRINTER_JobItem *)queue.jobItems);
-
-        // Interrupt Host for print job completion. At this point (and only
-        // then!) the host can/should also read out the printer driver's
-        // status register.
-        __R31 = PRU1_ARM_INTERRUPT;
+        startKeepWarmTimer();
+
+        // Interrupt Host for print job completion unless it is busy-polling
+        // the completion counter. At this point (and only then!) the host
+        // can/should also read out the printer driver's status register.
+        queue.progress.completedJobs++;
+        if (!queue.progress.busyPoll) {
+            __R31 = PRU1_ARM_INTERRUPT;
+        }
     }
 
     // Before proceeding to power down the PRU let's wait for a little bit to
@@ -170,6 +302,11 @@ int main(void) {
     // will be disabling all the interrupts in the next step.
     __delay_cycles(DELAY_500_MS);
 
+    // Don't leave the printer head powered in case it was kept warm, and
+    // don't let the host attach to a firmware that is gone
+    powerDownHead();
+    firmwareInfo.magic = 0;
+
     // Halt PRU core. Before that, clear all system interrupts as required to
     // allow the PRU to power down. Note that because of the call to __halt()
     // the main() function will actually never return.
@@ -246,10 +383,56 @@ static void waitForIepCompareEvent0(void) {
     CT_IEP.cmp_cfg &= ~(0x01 << 1);
 }
 
+static void setIepCompareEvent1(const uint32_t count) {
+    // Same as for compare block 0 but using compare block 1
+    CT_IEP.cmp_cfg |= (0x02 << 1);
+    CT_IEP.cmp1 = CT_IEP.count + count;
+    CT_IEP.cmp_status = 0x02;
+}
+
+static bool checkIepCompareEvent1(void) {
+    // Check for a compare match without waiting for it. Compare block 1 gets
+    // disabled once the match occurred.
+    if (!(CT_IEP.cmp_status & 0x02)) {
+        return false;
+    }
+
+    CT_IEP.cmp_cfg &= ~(0x02 << 1);
+
+    return true;
+}
+
 static void initPrinterStatusRegister(void) {
     queue.status.all = 0;
 }
 
+static void initStats(void) {
+    uint8_t i;
+
+    for (i = 0; i < PRINTER_NR_OF_PHASES; i++) {
+        queue.stats.phases[i].count = 0;
+        queue.stats.phases[i].minCycles = 0xFFFFFFFF;
+        queue.stats.phases[i].maxCycles = 0;
+        queue.stats.phases[i].totalCyclesLow = 0;
+        queue.stats.phases[i].totalCyclesHigh = 0;
+        queue.stats.phases[i].stallCyclesLow = 0;
+        queue.stats.phases[i].stallCyclesHigh = 0;
+    }
+}
+
+static void initTrace(void) {
+    traceIndex = 0;
+    traceRing.writeCount = 0;
+}
+
+// Announce that the firmware is up and running. The image hash is left alone
+// as it has been written by the host.
+static void initFirmwareInfo(void) {
+    firmwareInfo.buildId = PRINTER_FW_BUILD_ID;
+    firmwareInfo.idleCount = 0;
+    firmwareInfo.magic = PRINTER_FW_INFO_MAGIC;
+}
+
 // Initializes all thermal printer signals to put the printer into a safe and
 // unpowered mode (which should ideally have happened already through U-Boot
 // or the Kernel configuration). Note that the signals with inverse logic '_N'
@@ -307,27 +490,50 @@ static void testPrinterOutputSignals(void) {
 
 static void processPrintJob(const PRINTER_JobItem *job) {
     PRINTER_JobItem *currentItem = (PRINTER_JobItem *)job;
+    PRINTER_JobItem *nextItem;
     bool endJob = false;
 
+    // Loops and macro calls never carry over from one print job to the next
+    nestingLevel = 0;
+    initQueueProgress(job);
+    traceEvent(PRINTER_TRACE_JOB_START, queue.progress.completedJobs);
+
     while (!endJob) {
+        // Items located in the printer queue may not have been published by
+        // the host yet. Items inside loops and macros are always available.
+        if (!nestingLevel) {
+            waitForQueueItems();
+        }
+
+        // The dispatch phase covers all of the work done for the item other
+        // than executing it. It gets suspended while the item's handler runs,
+        // so that the phases timed by the handler don't end up in it.
+        beginPhase();
+        traceEvent(PRINTER_TRACE_ITEM_START, currentItem->command);
+
+        // Determine where the next item in the print job is located. This is
+        // done by moving the pointer across the static command and length
+        // fields of the current print job item and then further moving it over
+        // all of its associated payload (if any). Control flow commands may
+        // redirect the processing to a different item.
+        nextItem = (PRINTER_JobItem *)((uint8_t *)currentItem +
+                2 * sizeof(uint32_t) + currentItem->length);
+
+        suspendPhase();
         switch (currentItem->command) {
         case PRINTER_CMD_OPEN:
-            // (Re-)Initialize all printer output signals to a known-safe state.
-            initPrinterOutputSignals();
-            __delay_cycles(DELAY_5_MS);
-            // Turn on the printer head control logic and the end-of-paper
-            // sensor supply. Then, wait a predetermined amount of time for the
-            // voltages to settle. This amount can likely be made much shorter
-            // however let's be conservative for now until the final demo
-            // hardware been designed.
-            PRU_OUT_CLR(PRINTER_OUT_PWR_N);
-            PRU_OUT_SET(PRINTER_OUT_PAPER_SENSE);
-            __delay_cycles(DELAY_100_MS);
+            // Power up the printer head unless it was kept warm since the
+            // previous job
+            powerUpHead();
             // Initialize the stepper motor. In case the initialization fails we
             // are going to end the print job right away.
             if (!initMotor()) {
                 endJob = true;
             }
+            // Forget about any line that was printed during a previous job
+            nrOfLinePasses = 0;
+            linePassesOverflow = false;
+            lineCompleted = false;
             break;
         case PRINTER_CMD_PRINT_LINE:
             // Before printing the line do a sanity check on the supplied print
@@ -336,8 +542,15 @@ static void processPrintJob(const PRINTER_JobItem *job) {
             // garbage.
             if (currentItem->length == PRINTER_BYTES_PER_LINE) {
                 printLine((uint8_t *)currentItem->data);
+                storeLinePass(currentItem->data);
             }
             break;
+        case PRINTER_CMD_PRINT_LINE_REF:
+            // Print one or more passes out of the line dictionary. The payload
+            // consists of 16-bit indexes and is padded to a multiple of 32
+            // bits.
+            printLineRefs(currentItem);
+            break;
         case PRINTER_CMD_MOTOR_HALF_STEP:
             // Before advancing the paper do a sanity check that the payload
             // size field denoting how far to advance has the proper size, and
@@ -354,6 +567,13 @@ static void processPrintJob(const PRINTER_JobItem *job) {
                             endJob = true;
                         }
                     }
+                    // Once the paper moved, the next pass starts a new line
+                    if (numberOfHalfSteps) {
+                        if (nrOfLinePasses && !lineCompleted) {
+                            queue.progress.linesPrinted++;
+                        }
+                        lineCompleted = true;
+                    }
                 }
                 else {
                     // The host tried to issue a step command with a parameter
@@ -363,6 +583,27 @@ static void processPrintJob(const PRINTER_JobItem *job) {
                 }
             }
             break;
+        case PRINTER_CMD_REPEAT_LINE:
+            // Re-print the passes of the line that was printed last, each time
+            // followed by a half-step. We can only do this if we were able to
+            // remember all of the line's passes, otherwise we would be printing
+            // an incomplete line.
+            if (currentItem->length == sizeof(uint32_t)) {
+                uint32_t numberOfRepeats = (currentItem->data)[0];
+                if ((numberOfRepeats <= PRINTER_MAX_NR_HALF_STEPS) &&
+                        !linePassesOverflow) {
+                    uint32_t i;
+                    for (i = 0; (i < numberOfRepeats) && !endJob; i++) {
+                        if (!repeatLine()) {
+                            endJob = true;
+                        }
+                    }
+                }
+                else {
+                    queue.status.bits.illegalParameterError = true;
+                }
+            }
+            break;
         case PRINTER_CMD_TEST_SIGNALS:
             // Repeatedly send out the signal test vector. Note that this
             // function will never return.
@@ -374,9 +615,11 @@ static void processPrintJob(const PRINTER_JobItem *job) {
             __delay_cycles(DELAY_5_MS);
             initMotor();
             // Turn off the end-of-paper sensor supply and the printer head
-            // control logic
-            PRU_OUT_CLR(PRINTER_OUT_PAPER_SENSE);
-            PRU_OUT_SET(PRINTER_OUT_PWR_N);
+            // control logic unless the host wants them to be kept warm for a
+            // follow-up job. The keep-warm timer takes care of them then.
+            if (!queue.progress.keepWarmMs) {
+                powerDownHead();
+            }
             break;
         case PRINTER_CMD_REQUEST_PRU_HALT:
             // The host has requested a shut-down of the PRU after this print
@@ -384,25 +627,128 @@ static void processPrintJob(const PRINTER_JobItem *job) {
             // through with the print job.
             queue.status.bits.pruHaltRequested = true;
             break;
+        case PRINTER_CMD_DEFINE_MACRO:
+            // Store the macro body that follows the macro ID in the payload.
+            // Macros can't be (re-)defined from within a macro as this may
+            // move the macro body that is currently being executed.
+            if ((currentItem->length < sizeof(uint32_t)) || isInsideMacro() ||
+                    !defineMacro(currentItem->data[0], &currentItem->data[1],
+                            currentItem->length - sizeof(uint32_t))) {
+                queue.status.bits.illegalParameterError = true;
+            }
+            break;
+        case PRINTER_CMD_CALL_MACRO:
+            // Continue processing with the first item of the macro body after
+            // remembering where to return to once its end has been reached.
+            if ((currentItem->length == sizeof(uint32_t)) &&
+                    (currentItem->data[0] < PRINTER_MAX_MACROS) &&
+                    macroStore.length[currentItem->data[0]] &&
+                    (nestingLevel < PRINTER_MAX_NESTING_LEVEL)) {
+                controlFrames[nestingLevel].item = nextItem;
+                controlFrames[nestingLevel].isMacroCall = true;
+                nestingLevel++;
+                nextItem = (PRINTER_JobItem *)((uint8_t *)macroStore.bodies +
+                        macroStore.offset[currentItem->data[0]]);
+            }
+            else {
+                queue.status.bits.illegalParameterError = true;
+            }
+            break;
+        case PRINTER_CMD_LOOP:
+            // Execute the items up to the matching PRINTER_CMD_END_LOOP the
+            // given number of times. A loop that isn't executed at all gets
+            // skipped entirely.
+            if ((currentItem->length == sizeof(uint32_t)) &&
+                    (nestingLevel < PRINTER_MAX_NESTING_LEVEL)) {
+                if (currentItem->data[0]) {
+                    controlFrames[nestingLevel].item = nextItem;
+                    controlFrames[nestingLevel].remainingIterations =
+                            currentItem->data[0];
+                    controlFrames[nestingLevel].isMacroCall = false;
+                    nestingLevel++;
+                }
+                else {
+                    nextItem = findLoopEnd(nextItem);
+                    if (!nextItem) {
+                        queue.status.bits.illegalCommandError = true;
+                        endJob = true;
+                    }
+                }
+            }
+            else {
+                queue.status.bits.illegalParameterError = true;
+                endJob = true;
+            }
+            break;
+        case PRINTER_CMD_END_LOOP:
+            // Jump back to the beginning of the loop body until all iterations
+            // are done. An unmatched end of a loop is a malformed job.
+            if (nestingLevel && !controlFrames[nestingLevel - 1].isMacroCall) {
+                if (--controlFrames[nestingLevel - 1].remainingIterations) {
+                    nextItem = controlFrames[nestingLevel - 1].item;
+                }
+                else {
+                    nestingLevel--;
+                }
+            }
+            else {
+                queue.status.bits.illegalCommandError = true;
+                endJob = true;
+            }
+            break;
+        case PRINTER_CMD_WRAP:
+            // Continue with the item at the beginning of the printer queue.
+            // Wrapping around is only allowed on the outermost level.
+            if (!nestingLevel) {
+                nextItem = (PRINTER_JobItem *)queue.jobItems;
+            }
+            else {
+                queue.status.bits.illegalCommandError = true;
+                endJob = true;
+            }
+            break;
+        case PRINTER_CMD_MEASURE_READ:
+            // Measure how fast the given memory can be read and report the
+            // results back through the payload of the item itself
+            if (currentItem->length == sizeof(PRINTER_ReadMeasurement)) {
+                measureRead((PRINTER_ReadMeasurement *)currentItem->data);
+            }
+            else {
+                queue.status.bits.illegalParameterError = true;
+            }
+            break;
         case PRINTER_CMD_EOS:
-            // Exit the print job processing loop
-            endJob = true;
+            // Reaching the end of a macro body returns to the item following
+            // the macro call. Otherwise exit the print job processing loop.
+            if (nestingLevel && controlFrames[nestingLevel - 1].isMacroCall) {
+                nestingLevel--;
+                nextItem = controlFrames[nestingLevel].item;
+            }
+            else {
+                endJob = true;
+            }
             break;
         default:
             // We should not get here. Exit the print job processing loop.
             queue.status.bits.illegalCommandError = true;
             endJob = true;
         }
+        resumePhase();
+        traceEvent(PRINTER_TRACE_ITEM_END, currentItem->command);
+
+        // Let the host know how far we got with processing the queue
+        if (!nestingLevel) {
+            updateQueueProgress(currentItem, nextItem);
+        }
 
         if (!endJob) {
-            // Advance to the next item in the print job. This is done by moving
-            // the pointer across the static command and length fields of the
-            // current print job item and then further moving it over all of its
-            // associated payload (if any).
-            currentItem = (PRINTER_JobItem *)((uint8_t *)currentItem +
-                    2 * sizeof(uint32_t) + currentItem->length);
+            // Advance to the next item in the print job
+            currentItem = nextItem;
         }
+        endPhase(PRINTER_PHASE_DISPATCH);
     }
+
+    traceEvent(PRINTER_TRACE_JOB_END, queue.progress.completedJobs);
 }
 
 static void printLine(const uint8_t dotData[]) {
@@ -411,6 +757,7 @@ static void printLine(const uint8_t dotData[]) {
     uint16_t blackDotCounter = 0;
 
     // Iterate through all bytes in one line
+    beginPhase();
     for (byteIndex = 0; byteIndex < PRINTER_BYTES_PER_LINE; byteIndex++) {
         // Iterate through all bits in each pixel-data byte
         for (bitValue = 0x80; bitValue != 0x00; bitValue >>= 1) {
@@ -449,23 +796,40 @@ static void printLine(const uint8_t dotData[]) {
             PRU_OUT_CLR(PRINTER_OUT_CLK);
         }
     }
+    endPhase(PRINTER_PHASE_SHIFT_OUT);
 
     // Toggle the latch signal to accept the serial data into the printer head
     // internal buffer.
+    beginPhase();
     __delay_cycles(DELAY_TSETUP_LAT);
     PRU_OUT_CLR(PRINTER_OUT_LAT_N);
     __delay_cycles(DELAY_TW_LAT);
     PRU_OUT_SET(PRINTER_OUT_LAT_N);
     __delay_cycles(DELAY_THOLD_LAT);
+    endPhase(PRINTER_PHASE_LATCH);
 
+    strobeLine();
+}
+
+static void strobeLine(void) {
     // Toggle all strobe signals, one after another. This will actually print
-    // the image. There is some room for optimization here to intelligently only
-    // toggle the strobe lines that have actual black dots in their associated
-    // sections.
+    // the data that is currently held in the printer head's latch. There is
+    // some room for optimization here to intelligently only toggle the strobe
+    // lines that have actual black dots in their associated sections.
+    traceEvent(PRINTER_TRACE_STROBE_START, 0);
+    beginPhase();
     printerStrobe(PRINTER_OUT_STB1_N);
+    endPhase(PRINTER_PHASE_STROBE_1);
+    beginPhase();
     printerStrobe(PRINTER_OUT_STB23_N);
+    endPhase(PRINTER_PHASE_STROBE_23);
+    beginPhase();
     printerStrobe(PRINTER_OUT_STB4_N);
+    endPhase(PRINTER_PHASE_STROBE_4);
+    beginPhase();
     printerStrobe(PRINTER_OUT_STB56_N);
+    endPhase(PRINTER_PHASE_STROBE_56);
+    traceEvent(PRINTER_TRACE_STROBE_END, 0);
 }
 
 static void printerStrobe(const uint32_t strobeSignal) {
@@ -482,6 +846,291 @@ static void printerStrobe(const uint32_t strobeSignal) {
     __delay_cycles(DELAY_TD1);
 }
 
+static void storeLinePass(const uint32_t dotData[]) {
+    uint16_t i;
+
+    // The first pass after the paper was advanced starts a new line
+    if (lineCompleted) {
+        nrOfLinePasses = 0;
+        linePassesOverflow = false;
+        lineCompleted = false;
+    }
+
+    if (nrOfLinePasses >= PRINTER_MAX_PASSES_PER_LINE) {
+        linePassesOverflow = true;
+        return;
+    }
+
+    for (i = 0; i < PRINTER_BYTES_PER_LINE / sizeof(uint32_t); i++) {
+        linePassData[nrOfLinePasses][i] = dotData[i];
+    }
+    nrOfLinePasses++;
+}
+
+static bool repeatLine(void) {
+    uint8_t i;
+
+    // If the line consists of a single pass then its dot data is still held
+    // in the printer head's latch and we can skip shifting it out again.
+    // Otherwise all passes need to be re-transferred one after another.
+    if (nrOfLinePasses == 1) {
+        strobeLine();
+    }
+    else {
+        for (i = 0; i < nrOfLinePasses; i++) {
+            printLine((uint8_t *)linePassData[i]);
+        }
+    }
+
+    // Advance to the next physical line. Note that the stored passes remain
+    // valid since they are what we are going to repeat next.
+    queue.progress.linesPrinted++;
+    return advanceMotorHalfStep();
+}
+
+static void printLineRefs(const PRINTER_JobItem *item) {
+    const uint16_t *lineRefs = (const uint16_t *)item->data;
+    uint32_t nrOfLineRefs = item->length / sizeof(uint16_t);
+    uint32_t i;
+
+    for (i = 0; i < nrOfLineRefs; i++) {
+        if (lineRefs[i] == PRINTER_LINE_REF_NONE) {
+            continue;
+        }
+
+        // Don't print anything that is outside of the dictionary and let the
+        // host know about it.
+        if (lineRefs[i] >= PRINTER_MAX_LINE_DICT_ENTRIES) {
+            queue.status.bits.illegalParameterError = true;
+            continue;
+        }
+
+        printLine((uint8_t *)lineDict.lines[lineRefs[i]]);
+        storeLinePass((uint32_t *)lineDict.lines[lineRefs[i]]);
+    }
+}
+
+// The macro store retains its contents as long as the PRU subsystem is powered.
+// Only initialize it if it doesn't contain valid data yet.
+static void initMacroStore(void) {
+    uint16_t i;
+
+    if (macroStore.magic == PRINTER_MACRO_STORE_MAGIC) {
+        return;
+    }
+
+    for (i = 0; i < PRINTER_MAX_MACROS; i++) {
+        macroStore.offset[i] = 0;
+        macroStore.length[i] = 0;
+    }
+    macroStore.usedBytes = 0;
+    macroStore.magic = PRINTER_MACRO_STORE_MAGIC;
+}
+
+static bool defineMacro(const uint32_t macroId, const uint32_t body[],
+        const uint32_t length) {
+    volatile uint32_t *dst;
+    PRINTER_JobItem *eosItem;
+    uint32_t i;
+
+    if ((macroId >= PRINTER_MAX_MACROS) || (length % sizeof(uint32_t))) {
+        return false;
+    }
+
+    // Get rid of any previous definition first to free up its memory. Then
+    // make sure the new body plus a terminating end-of-sequence command fits.
+    removeMacro(macroId);
+    if (macroStore.usedBytes + PRINTER_JOB_ITEM_SIZE(length) >
+            sizeof(macroStore.bodies)) {
+        return false;
+    }
+
+    // Append the body to the end of the macro store and terminate it
+    dst = (uint32_t *)((uint8_t *)macroStore.bodies + macroStore.usedBytes);
+    for (i = 0; i < length / sizeof(uint32_t); i++) {
+        dst[i] = body[i];
+    }
+    eosItem = (PRINTER_JobItem *)&dst[i];
+    eosItem->command = PRINTER_CMD_EOS;
+    eosItem->length = 0;
+
+    macroStore.offset[macroId] = macroStore.usedBytes;
+    macroStore.length[macroId] = PRINTER_JOB_ITEM_SIZE(length);
+    macroStore.usedBytes += PRINTER_JOB_ITEM_SIZE(length);
+
+    return true;
+}
+
+static void removeMacro(const uint32_t macroId) {
+    const uint32_t offset = macroStore.offset[macroId];
+    const uint32_t length = macroStore.length[macroId];
+    uint32_t i;
+
+    if (!length) {
+        return;
+    }
+
+    // Close the gap by moving all bodies located after the macro down
+    for (i = offset / sizeof(uint32_t);
+            i < (macroStore.usedBytes - length) / sizeof(uint32_t); i++) {
+        macroStore.bodies[i] = macroStore.bodies[i + length / sizeof(uint32_t)];
+    }
+
+    for (i = 0; i < PRINTER_MAX_MACROS; i++) {
+        if (macroStore.length[i] && (macroStore.offset[i] > offset)) {
+            macroStore.offset[i] -= length;
+        }
+    }
+
+    macroStore.length[macroId] = 0;
+    macroStore.usedBytes -= length;
+}
+
+static bool isInsideMacro(void) {
+    uint8_t i;
+
+    for (i = 0; i < nestingLevel; i++) {
+        if (controlFrames[i].isMacroCall) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Find the item following the PRINTER_CMD_END_LOOP that matches the loop
+// whose body starts at the given item. Returns NULL in case the end of the
+// job is reached first.
+static PRINTER_JobItem *findLoopEnd(PRINTER_JobItem *item) {
+    uint8_t level = 0;
+
+    while (item->command != PRINTER_CMD_EOS) {
+        if (item->command == PRINTER_CMD_LOOP) {
+            level++;
+        }
+        else if (item->command == PRINTER_CMD_END_LOOP) {
+            if (!level) {
+                return (PRINTER_JobItem *)((uint8_t *)item +
+                        PRINTER_JOB_ITEM_SIZE(item->length));
+            }
+            level--;
+        }
+        item = (PRINTER_JobItem *)((uint8_t *)item +
+                PRINTER_JOB_ITEM_SIZE(item->length));
+    }
+
+    return NULL;
+}
+
+static void initQueueProgress(const PRINTER_JobItem *job) {
+    // The host resets the counters before kicking off a job
+    ringItem = (PRINTER_JobItem *)job;
+    signaledProducedBytes = 0;
+    signaledBacklog = 0;
+}
+
+static void waitForQueueItems(void) {
+    // Spin until the host has published at least one more item. Keep checking
+    // the watermark as the host may need to be told that we ran dry.
+    if (queue.progress.consumedBytes != queue.progress.producedBytes) {
+        return;
+    }
+
+    traceEvent(PRINTER_TRACE_UNDERRUN_START, 0);
+    while (queue.progress.consumedBytes == queue.progress.producedBytes) {
+        checkQueueWatermark();
+    }
+    traceEvent(PRINTER_TRACE_UNDERRUN_END, 0);
+}
+
+static void updateQueueProgress(const PRINTER_JobItem *currentItem,
+        const PRINTER_JobItem *nextItem) {
+    // Everything from the item last processed on the outermost level up to
+    // the next item is done with. This covers entire loops and macro calls.
+    // A wrap item also consumes the unused remainder of the queue.
+    if (currentItem->command == PRINTER_CMD_WRAP) {
+        queue.progress.consumedBytes += (uint8_t *)queue.jobItems +
+                sizeof(queue.jobItems) - (uint8_t *)ringItem;
+    }
+    else {
+        queue.progress.consumedBytes += (uint8_t *)nextItem -
+                (uint8_t *)ringItem;
+    }
+    ringItem = (PRINTER_JobItem *)nextItem;
+
+    checkQueueWatermark();
+}
+
+static void checkQueueWatermark(void) {
+    const uint32_t producedBytes = queue.progress.producedBytes;
+    const uint32_t backlog = producedBytes - queue.progress.consumedBytes;
+
+    if (queue.progress.busyPoll || !queue.progress.lowWatermark ||
+            (backlog >= queue.progress.lowWatermark)) {
+        return;
+    }
+
+    // Signal the host once each time it published new items, and once more
+    // when we run out of items in case the host couldn't refill in time
+    if ((producedBytes != signaledProducedBytes) ||
+            (!backlog && signaledBacklog)) {
+        __R31 = PRU1_ARM_WATERMARK_INTERRUPT;
+        signaledProducedBytes = producedBytes;
+        signaledBacklog = backlog;
+    }
+}
+
+static void powerUpHead(void) {
+    // Nothing to do if the head has been kept warm. It stays powered until
+    // it gets closed again.
+    keepWarmRemainingMs = 0;
+    if (headPowered) {
+        return;
+    }
+
+    // (Re-)Initialize all printer output signals to a known-safe state.
+    initPrinterOutputSignals();
+    __delay_cycles(DELAY_5_MS);
+
+    // Turn on the printer head control logic and the end-of-paper sensor
+    // supply. Then, wait a predetermined amount of time for the voltages to
+    // settle. This amount can likely be made much shorter however let's be
+    // conservative for now until the final demo hardware been designed.
+    PRU_OUT_CLR(PRINTER_OUT_PWR_N);
+    PRU_OUT_SET(PRINTER_OUT_PAPER_SENSE);
+    __delay_cycles(DELAY_100_MS);
+    headPowered = true;
+}
+
+static void powerDownHead(void) {
+    PRU_OUT_CLR(PRINTER_OUT_PAPER_SENSE);
+    PRU_OUT_SET(PRINTER_OUT_PWR_N);
+    headPowered = false;
+    keepWarmRemainingMs = 0;
+}
+
+static void startKeepWarmTimer(void) {
+    // Count down the idle time in steps of a millisecond as the IEP counter
+    // would wrap around after about 21 seconds
+    if (headPowered && queue.progress.keepWarmMs) {
+        keepWarmRemainingMs = queue.progress.keepWarmMs;
+        setIepCompareEvent1(DELAY_1_MS);
+    }
+}
+
+static void checkKeepWarmTimer(void) {
+    if (!keepWarmRemainingMs || !checkIepCompareEvent1()) {
+        return;
+    }
+
+    if (--keepWarmRemainingMs) {
+        setIepCompareEvent1(DELAY_1_MS);
+    }
+    else {
+        powerDownHead();
+    }
+}
+
 static bool initMotor(void) {
     PRU_OUT_CLR(PRINTER_OUT_A1 | PRINTER_OUT_A2 | PRINTER_OUT_B1 | PRINTER_OUT_B2);
     motorStepIndex = 0;
@@ -515,19 +1164,25 @@ static bool advanceMotorHalfStep(void) {
     };
 
 #ifdef PRINTER_USE_THERMAL_SENSOR
-    if (checkThermalAlarm()) {
+    beginPhase();
+    const bool thermalAlarm = checkThermalAlarm();
+    endPhase(PRINTER_PHASE_THERMAL_CHECK);
+    if (thermalAlarm) {
         // Immediately turn off motor in case of any error to let the system
         // cool down.
         initMotor();
         // Report error back to the host and exit here
         queue.status.bits.thermalAlarmError = true;
+        traceEvent(PRINTER_TRACE_ALARM, 0);
         return false;
     }
 #endif
 
     // Make sure the required time has passed since the last half step to not
     // exceed the maximum paper feed speed.
+    beginPhase();
     waitForIepCompareEvent0();
+    endPhase(PRINTER_PHASE_MOTOR_WAIT);
 
     // Activate the output lines according to the next step to take. Here, we
     // chose to access the core register R30 directly (rather than using our
@@ -536,6 +1191,7 @@ static bool advanceMotorHalfStep(void) {
     uint32_t r30tmp = __R30 &
         ~(PRINTER_OUT_A1 | PRINTER_OUT_A2 | PRINTER_OUT_B1 | PRINTER_OUT_B2);
     __R30 = r30tmp | phaseTable[motorStepIndex];
+    traceEvent(PRINTER_TRACE_STEP, motorStepIndex);
 
     // Now that the new step was taken let's set a new timer event determining
     // the minimum wait time after which the next step can be taken upon re-
@@ -548,11 +1204,15 @@ static bool advanceMotorHalfStep(void) {
     }
 
 #ifdef PRINTER_USE_PAPER_SENSOR
-    if (checkPaperSensor()) {
+    beginPhase();
+    const bool paperOut = checkPaperSensor();
+    endPhase(PRINTER_PHASE_PAPER_CHECK);
+    if (paperOut) {
         // Immediately turn off motor in case of any error. We don't want to
         // keep the windings energized when there is no paper.
         initMotor();
         queue.status.bits.paperOutError = true;
+        traceEvent(PRINTER_TRACE_ALARM, 1);
         return false;
     }
 #endif
@@ -573,3 +1233,130 @@ static bool checkPaperSensor(void) {
     // be open and the output signal to get pulled high.
     return PRU_IN(PRINTER_IN_PAPER_OUT);
 }
+
+// Start timing a phase by restarting the cycle and stall counters. Restarting
+// them each time rather than taking the difference of two readings keeps them
+// from saturating, which they do instead of wrapping around.
+static void beginPhase(void) {
+#ifdef PRINTER_COLLECT_STATS
+    restartCycleCounter();
+#endif
+}
+
+// Stop timing a phase and add the cycles it took to its statistics. The
+// counters stay enabled, but nothing looks at them until the next phase
+// begins.
+static void endPhase(const uint8_t phase) {
+#ifdef PRINTER_COLLECT_STATS
+    const uint32_t cycles = PRU_CTRL.cycle;
+    const uint32_t stalls = PRU_CTRL.stall;
+    volatile PRINTER_PhaseStats *stats = &queue.stats.phases[phase];
+    uint32_t total;
+
+    stats->count++;
+    if (cycles < stats->minCycles) {
+        stats->minCycles = cycles;
+    }
+    if (cycles > stats->maxCycles) {
+        stats->maxCycles = cycles;
+    }
+
+    // Propagate the carry of the low words into the high words
+    total = stats->totalCyclesLow + cycles;
+    if (total < cycles) {
+        stats->totalCyclesHigh++;
+    }
+    stats->totalCyclesLow = total;
+    total = stats->stallCyclesLow + stalls;
+    if (total < stalls) {
+        stats->stallCyclesHigh++;
+    }
+    stats->stallCyclesLow = total;
+#endif
+}
+
+// Suspend the phase that is being timed, so that other phases can be timed in
+// the meantime. Only a single phase can be suspended at any time.
+static void suspendPhase(void) {
+#ifdef PRINTER_COLLECT_STATS
+    suspendedCycles = PRU_CTRL.cycle;
+    suspendedStalls = PRU_CTRL.stall;
+#endif
+}
+
+// Resume timing the suspended phase by putting its counts back into the
+// counters. They can only be written while they are disabled.
+static void resumePhase(void) {
+#ifdef PRINTER_COLLECT_STATS
+    PRU_CTRL.ctrl &= ~PRU_CTRL_COUNTER_ENABLE;
+    PRU_CTRL.cycle = suspendedCycles;
+    PRU_CTRL.stall = suspendedStalls;
+    PRU_CTRL.ctrl |= PRU_CTRL_COUNTER_ENABLE;
+#endif
+}
+
+// Record an event into the trace ring, time-stamped with the IEP count. The
+// entry is complete by the time the write count tells the host about it.
+static void traceEvent(const uint32_t type, const uint32_t arg) {
+#ifdef PRINTER_COLLECT_TRACE
+    traceRing.entries[traceIndex].timestamp = CT_IEP.count;
+    traceRing.entries[traceIndex].event = PRINTER_TRACE_EVENT(type, arg);
+    if (++traceIndex >= PRINTER_TRACE_NR_OF_ENTRIES) {
+        traceIndex = 0;
+    }
+    traceRing.writeCount++;
+#endif
+}
+
+// Read the memory described by the measurement twice, first one word out of
+// every burst and then in bursts, and store the number of cycles each of the
+// two passes took. Both passes have the same number of loads and the same loop
+// overhead so that the difference between them is down to the burst size.
+static void measureRead(volatile PRINTER_ReadMeasurement *measurement) {
+    const uint32_t address = measurement->address;
+    const uint32_t length = measurement->length &
+            ~(PRINTER_MEASURE_READ_BURST_SIZE - 1);
+    uint32_t startCycle;
+    uint32_t offset;
+
+    // A pass over the largest memory takes well below a millisecond, so there
+    // is no need to worry about the counter running out
+    restartCycleCounter();
+
+    startCycle = PRU_CTRL.cycle;
+    for (offset = 0; offset < length;
+            offset += PRINTER_MEASURE_READ_BURST_SIZE) {
+        readWord(address + offset);
+    }
+    measurement->wordReadCycles = PRU_CTRL.cycle - startCycle;
+
+    startCycle = PRU_CTRL.cycle;
+    for (offset = 0; offset < length;
+            offset += PRINTER_MEASURE_READ_BURST_SIZE) {
+        readBurst(address + offset);
+    }
+    measurement->burstReadCycles = PRU_CTRL.cycle - startCycle;
+}
+
+// Start counting cycles and stall cycles from zero. The counters need to be
+// disabled while they get written.
+static void restartCycleCounter(void) {
+    PRU_CTRL.ctrl &= ~PRU_CTRL_COUNTER_ENABLE;
+    PRU_CTRL.cycle = 0;
+    PRU_CTRL.stall = 0;
+    PRU_CTRL.ctrl |= PRU_CTRL_COUNTER_ENABLE;
+}
+
+// Load a single word or a 32-byte burst from the given address using LBBO. The
+// address arrives in R14 as the first argument and the data goes to R20 and up
+// which the calling convention leaves to the callee, so the functions must not
+// get inlined. The data itself is discarded.
+#pragma FUNC_CANNOT_INLINE(readWord)
+static void readWord(const uint32_t address) {
+    __asm("        LBBO      &r20, r14, 0, 4");
+}
+
+#pragma FUNC_CANNOT_INLINE(readBurst)
+static void readBurst(const uint32_t address) {
+    __asm("        LBBO      &r20, r14, 0, 32");
+}
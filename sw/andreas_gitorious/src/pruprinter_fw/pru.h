@@ -19,9 +19,40 @@
  */
 #define PRU1_ARM_INTERRUPT      (20 - 16 + 32)
 
+/*
+ * This is the interrupt used to signal the printer queue low watermark. Since
+ * PRU0 is not in use we borrow its PRU0-to-ARM system interrupt 19 (PRU-
+ * generated vector #3) which the host sees on PRU_EVTOUT_0.
+ */
+#define PRU1_ARM_WATERMARK_INTERRUPT    (19 - 16 + 32)
+
+/*
+ * Base of the PRU-local data memory map. The PRU's own data RAM is located at
+ * offset 0x0000 and the data RAM of the other PRU at offset 0x2000.
+ */
+#define PRU_LOCAL_DATARAM_BASE  0x00000000
+
 /* PRU constant table programmable pointer register 0 */
 #define CTPPR0                  (*(volatile uint32_t *)(0x00024000 + 0x28))
 
+/*
+ * PRU1 control register set, located at 0x0002_4000 in the PRU-local memory
+ * map. The cycle and stall counters only count while the counter enable bit
+ * is set in CTRL. They stop once they reach 0xFFFFFFFF and can only be written
+ * while counting is disabled.
+ */
+#define PRU_CTRL_COUNTER_ENABLE (1 << 3)
+
+typedef struct {
+    uint32_t ctrl;      // 0x0
+    uint32_t sts;       // 0x4
+    uint32_t wakeup_en; // 0x8
+    uint32_t cycle;     // 0xC
+    uint32_t stall;     // 0x10
+} pruCtrl;
+
+#define PRU_CTRL                (*(volatile pruCtrl *)0x00024000)
+
 /* PRU INTC register set */
 typedef struct {
     uint32_t revid;     // 0x0
@@ -21,6 +21,14 @@
 #define PRINTER_CMD_MOTOR_HALF_STEP         0x03
 #define PRINTER_CMD_TEST_SIGNALS            0x04
 #define PRINTER_CMD_CLOSE                   0x05
+#define PRINTER_CMD_REPEAT_LINE             0x06
+#define PRINTER_CMD_PRINT_LINE_REF          0x07
+#define PRINTER_CMD_DEFINE_MACRO            0x08
+#define PRINTER_CMD_CALL_MACRO              0x09
+#define PRINTER_CMD_LOOP                    0x0A
+#define PRINTER_CMD_END_LOOP                0x0B
+#define PRINTER_CMD_WRAP                    0x0C
+#define PRINTER_CMD_MEASURE_READ            0x0D
 #define PRINTER_CMD_REQUEST_PRU_HALT        0xFE
 #define PRINTER_CMD_EOS                     0xFF
 
@@ -33,14 +41,111 @@
 #define PRINTER_MAX_BLACK_DOTS_PER_LINE     64
 
 // This parameter limits how many half-steps we can advance the printer motor
-// when using the PRINTER_CMD_MOTOR_HALF_STEP command.
+// when using the PRINTER_CMD_MOTOR_HALF_STEP command. It also limits how often
+// a line can be repeated using a single PRINTER_CMD_REPEAT_LINE command.
 #define PRINTER_MAX_NR_HALF_STEPS           1000
 
+// Maximum number of passes a single physical line gets partitioned into by the
+// host so that no pass exceeds PRINTER_MAX_BLACK_DOTS_PER_LINE. This is also
+// the number of passes the firmware remembers for PRINTER_CMD_REPEAT_LINE.
+#define PRINTER_MAX_PASSES_PER_LINE         \
+        (PRINTER_DOTS_PER_LINE / PRINTER_MAX_BLACK_DOTS_PER_LINE)
+
+// The PRU1 data RAM is 8KB in size. Its lower half is used by the firmware
+// for its own variables and stack (see linker.cmd) while the upper half is
+// reserved for data that gets uploaded directly by the host. The line
+// dictionary holds passes that get printed by PRINTER_CMD_PRINT_LINE_REF by
+// referring to their dictionary index rather than carrying the dot data.
+// Offsets are given in bytes from the beginning of the PRU1 data RAM.
+#define PRINTER_LINE_DICT_OFFSET            0x1000
+#define PRINTER_LINE_DICT_SIZE              0x0C00
+#define PRINTER_MAX_LINE_DICT_ENTRIES       \
+        (PRINTER_LINE_DICT_SIZE / PRINTER_BYTES_PER_LINE)
+
+// The firmware info block resides right behind the line dictionary. It lets
+// the host find out whether the firmware it is about to load is already up and
+// running so that it can attach to it rather than reloading it, which would
+// reset the printer state. The build ID needs to be changed whenever the
+// interface between the host and the firmware changes.
+#define PRINTER_FW_INFO_OFFSET              0x1C00
+#define PRINTER_FW_INFO_MAGIC               0x46575550
+#define PRINTER_FW_BUILD_ID                 0x00000029
+
+// The trace ring resides right behind the firmware info block, filling up the
+// rest of the data RAM. The firmware records events into it along with the IEP
+// count at the time they happened, overwriting the oldest entries once it is
+// full. Each event carries its type in the upper eight bits and an argument in
+// the lower 24 bits. Start and end events come in pairs that never nest within
+// pairs of the same type.
+#define PRINTER_TRACE_OFFSET                0x1C10
+#define PRINTER_TRACE_NR_OF_ENTRIES         120
+#define PRINTER_TRACE_EVENT(type, arg)      \
+        (((type) << 24) | ((arg) & 0xFFFFFF))
+#define PRINTER_TRACE_TYPE(event)           ((event) >> 24)
+#define PRINTER_TRACE_ARG(event)            ((event) & 0xFFFFFF)
+
+// Events recorded into the trace ring. Jobs carry the number of jobs completed
+// before them as argument, items their command, and alarms zero for a thermal
+// alarm and one for the paper running out. An underrun lasts for as long as
+// the firmware waits for the host to publish more items.
+#define PRINTER_TRACE_JOB_START             0x01
+#define PRINTER_TRACE_JOB_END               0x02
+#define PRINTER_TRACE_ITEM_START            0x03
+#define PRINTER_TRACE_ITEM_END              0x04
+#define PRINTER_TRACE_STROBE_START          0x05
+#define PRINTER_TRACE_STROBE_END            0x06
+#define PRINTER_TRACE_STEP                  0x07
+#define PRINTER_TRACE_UNDERRUN_START        0x08
+#define PRINTER_TRACE_UNDERRUN_END          0x09
+#define PRINTER_TRACE_ALARM                 0x0A
+
+// The payload of PRINTER_CMD_PRINT_LINE_REF is an array of 16-bit dictionary
+// indexes that get printed one after another. Since the payload length always
+// needs to be a multiple of 32 bits unused slots are padded with this value.
+#define PRINTER_LINE_REF_NONE               0xFFFF
+
+// Job macros are kept resident in the PRU0 data RAM which is otherwise unused
+// since the printer is driven by PRU1 only. The memory retains its contents
+// across print jobs and firmware reloads. It is seen by PRU1 at the local
+// address given below and is accessible by the host through the PRU0 data RAM
+// mapping. A macro body consists of regular job items. It gets defined using
+// PRINTER_CMD_DEFINE_MACRO with the macro ID in the first 32-bit word of the
+// payload followed by the body, and executed using PRINTER_CMD_CALL_MACRO.
+#define PRINTER_MACRO_STORE_PRU1_ADDRESS    0x00002000
+#define PRINTER_MACRO_STORE_SIZE            0x2000
+#define PRINTER_MACRO_STORE_MAGIC           0x4D414352
+#define PRINTER_MAX_MACROS                  16
+
+// This parameter limits how deeply PRINTER_CMD_LOOP blocks and macro calls can
+// be nested within each other.
+#define PRINTER_MAX_NESTING_LEVEL           4
+
 // This parameter denotes the maximum amount of job data we can store. It is
 // derived from the size of the PRU memory we dedicate to our print queue (the
 // PRU shared memory which is 12KB in size) less the amount of of memory used
-// to keep the printer status.
-#define PRINTER_MAX_JOB_SIZE                (12 * 1024 - sizeof(PRINTER_Status))
+// to keep the printer status, the firmware statistics and the queue progress.
+#define PRINTER_MAX_JOB_SIZE                \
+        (12 * 1024 - sizeof(PRINTER_Status) - sizeof(PRINTER_Stats) - \
+        sizeof(PRINTER_Progress))
+
+// Phases of the firmware's work that get timed for the firmware statistics.
+// Dispatch is the bookkeeping the firmware does for each item other than
+// executing it, that is, decoding the item, reporting the queue progress and
+// moving on to the next item. Shift-out and latch cover the transfer of a pass
+// into the printer head, and each strobe the printing of one of the head's
+// sections. The motor wait is the time spent waiting for the minimum half-step
+// interval to pass, and the sensor checks are done with every half-step.
+#define PRINTER_PHASE_DISPATCH              0
+#define PRINTER_PHASE_SHIFT_OUT             1
+#define PRINTER_PHASE_LATCH                 2
+#define PRINTER_PHASE_STROBE_1              3
+#define PRINTER_PHASE_STROBE_23             4
+#define PRINTER_PHASE_STROBE_4              5
+#define PRINTER_PHASE_STROBE_56             6
+#define PRINTER_PHASE_MOTOR_WAIT            7
+#define PRINTER_PHASE_THERMAL_CHECK         8
+#define PRINTER_PHASE_PAPER_CHECK           9
+#define PRINTER_NR_OF_PHASES                10
 
 // Type containing the current status of the printer so that it can be read by
 // the host processor. It is mapped to the PRU shared memory that is used as
@@ -57,6 +162,89 @@ typedef union {
     uint32_t all;
 } PRINTER_Status;
 
+// Type of the firmware info block. The firmware sets the magic and the build ID
+// once it is initialized and keeps increasing the idle count while waiting for
+// a job. The image hash is written by the host when it loads the firmware and
+// identifies the exact image that got loaded.
+typedef struct {
+    uint32_t magic;
+    uint32_t buildId;
+    uint32_t imageHash;
+    uint32_t idleCount;
+} PRINTER_FirmwareInfo;
+
+// Type of an entry of the trace ring
+typedef struct {
+    uint32_t timestamp;
+    uint32_t event;
+} PRINTER_TraceEntry;
+
+// Type of the trace ring. The write count is the running total of entries
+// written, the next entry getting written at the write count modulo the number
+// of entries. It is increased after the entry has been written.
+typedef struct {
+    uint32_t writeCount;
+    PRINTER_TraceEntry entries[PRINTER_TRACE_NR_OF_ENTRIES];
+} PRINTER_TraceRing;
+
+// Type accumulating the timing of a single firmware phase, measured using the
+// PRU1 cycle and stall counters. The totals are 64-bit values split into two
+// words. The minimum starts out as 0xFFFFFFFF and all other fields as zero.
+typedef struct {
+    uint32_t count;
+    uint32_t minCycles;
+    uint32_t maxCycles;
+    uint32_t totalCyclesLow;
+    uint32_t totalCyclesHigh;
+    uint32_t stallCyclesLow;
+    uint32_t stallCyclesHigh;
+} PRINTER_PhaseStats;
+
+// Type of the firmware statistics. They are collected since the firmware was
+// started and are located next to the printer status so that the host can read
+// them at any time, even while a job is being printed. A phase may be caught
+// in the middle of being updated though.
+typedef struct {
+    PRINTER_PhaseStats phases[PRINTER_NR_OF_PHASES];
+} PRINTER_Stats;
+
+// Type used to stream job items through the printer queue which is operated as
+// a ring buffer. All counters are running totals of bytes since the host
+// kicked off the job and are only ever increased. The host publishes items by
+// writing them into the ring and then increasing producedBytes, and the PRU
+// reports the items it is done with through consumedBytes. The difference is
+// the backlog of items still waiting to be processed. Whenever the backlog
+// drops below lowWatermark (a value of zero disables this) the PRU raises a
+// separate watermark event so that the host can refill the ring right in time.
+// The same event is raised when the PRU runs out of items.
+//
+// Items never wrap around the end of the ring. Instead the host places a
+// PRINTER_CMD_WRAP item which makes the PRU continue at the beginning of the
+// ring. The unused remainder of the ring behind the wrap item counts as
+// produced and consumed. Loops need to be published in one piece and must not
+// contain a wrap item. The PRU only counts a loop or a macro call as consumed
+// once it is entirely done with it. The linesPrinted counter gets increased
+// each time the paper is advanced after printing a line.
+//
+// The completedJobs counter gets increased by the PRU after each job and is
+// never reset. In case busyPoll is set the PRU won't raise any interrupts for
+// the job. Instead the host is expected to spin on completedJobs and the queue
+// backlog, trading CPU time for the latency of the interrupt path.
+//
+// A non-zero keepWarmMs makes PRINTER_CMD_CLOSE leave the printer head and the
+// paper sensor powered so that a PRINTER_CMD_OPEN of a follow-up job doesn't
+// need to wait for the supplies to settle again. The PRU powers them down on
+// its own once it has been idle for the given number of milliseconds.
+typedef struct {
+    uint32_t producedBytes;
+    uint32_t consumedBytes;
+    uint32_t lowWatermark;
+    uint32_t linesPrinted;
+    uint32_t completedJobs;
+    uint32_t busyPoll;
+    uint32_t keepWarmMs;
+} PRINTER_Progress;
+
 // Type containing a single job item. A print job consists of a series of job
 // items. A job item's command field comprises the specific action to take.
 // the length field denotes how much payload data is associated with a the
@@ -71,15 +259,57 @@ typedef struct {
     uint32_t data[];
 } PRINTER_JobItem;
 
+// Type describing the line dictionary located in the PRU1 data RAM at offset
+// PRINTER_LINE_DICT_OFFSET. Each entry holds the dot data of a single pass.
+typedef struct {
+    uint32_t lines[PRINTER_MAX_LINE_DICT_ENTRIES]
+                  [PRINTER_BYTES_PER_LINE / sizeof(uint32_t)];
+} PRINTER_LineDict;
+
+// Type describing the macro store located in the PRU0 data RAM. Macro bodies
+// are kept back-to-back in the bodies area, each terminated by an end-of-
+// sequence command. A length of zero denotes an undefined macro. All offsets
+// and lengths are given in bytes.
+typedef struct {
+    uint32_t magic;
+    uint32_t usedBytes;
+    uint32_t offset[PRINTER_MAX_MACROS];
+    uint32_t length[PRINTER_MAX_MACROS];
+    uint32_t bodies[(PRINTER_MACRO_STORE_SIZE - (2 + 2 * PRINTER_MAX_MACROS) *
+                     sizeof(uint32_t)) / sizeof(uint32_t)];
+} PRINTER_MacroStore;
+
+// Type of the payload of PRINTER_CMD_MEASURE_READ which measures how fast PRU1
+// can read from the memory at the given address as seen by PRU1. The given
+// number of bytes gets read twice, once using a single 32-bit load out of
+// every 32 bytes and once using a 32-byte burst load for every 32 bytes. The
+// firmware stores the number of PRU cycles each of the two passes took into
+// the payload, including a few cycles of loop overhead per load. The length
+// needs to be a multiple of PRINTER_MEASURE_READ_BURST_SIZE.
+#define PRINTER_MEASURE_READ_BURST_SIZE     32
+
+typedef struct {
+    uint32_t address;
+    uint32_t length;
+    uint32_t wordReadCycles;
+    uint32_t burstReadCycles;
+} PRINTER_ReadMeasurement;
+
+// Determine the number of bytes a job item occupies given its payload length.
+// This is the static command and length fields plus the payload itself.
+#define PRINTER_JOB_ITEM_SIZE(length)       (2 * sizeof(uint32_t) + (length))
+
 // Type that describes the overarching print job queue. It will get mapped to
 // the beginning of the PRU shared memory and will use as much of that memory
-// as possible for storage (up to the combined size of the status register and
-// PRINTER_MAX_JOB_SIZE). Note the actual type of each printer job item is
-// PRINTER_JobItem but we are not using this here in this declaration since each
-// item's size varies. Instead, we use uint32_t to maintain flexibility while
-// ensuring alignment.
+// as possible for storage (up to the combined size of the status register, the
+// statistics, the progress and PRINTER_MAX_JOB_SIZE). Note the actual type of
+// each printer job item is PRINTER_JobItem but we are not using this here in
+// this declaration since each item's size varies. Instead, we use uint32_t to
+// maintain flexibility while ensuring alignment.
 typedef struct {
     PRINTER_Status status;
+    PRINTER_Stats stats;
+    PRINTER_Progress progress;
     uint32_t jobItems[PRINTER_MAX_JOB_SIZE / 4];
 } PRINTER_Queue;
 
@@ -0,0 +1,41 @@
+/*
+ * fwsim.c
+ *
+ * Native build of the printer firmware. See fwsim.h for details.
+ *
+ * Copyright (C) 2014 Texas Instruments Incorporated - http://www.ti.com/
+ * ALL RIGHTS RESERVED
+ */
+
+#include "fwsim.h"
+
+// The stand-in PRU register header needs to be included ahead of the firmware
+// source so that it takes the place of the original one. The firmware entry
+// point gets renamed so that it doesn't clash with the one of the program.
+#include "pru.h"
+#define main runPrinterFirmware
+#include "../pruprinter_fw/main.c"
+#undef main
+
+const PRINTER_FwSignals printerFwSignals = {
+    F_PRU_OCP_CLK_HZ,
+    PRINTER_OUT_PAPER_SENSE,
+    {
+        PRINTER_OUT_STB1_N,
+        PRINTER_OUT_STB23_N,
+        PRINTER_OUT_STB4_N,
+        PRINTER_OUT_STB56_N
+    },
+    PRINTER_OUT_CLK,
+    PRINTER_OUT_LAT_N,
+    PRINTER_OUT_MOSI,
+    PRINTER_OUT_A1 | PRINTER_OUT_A2 | PRINTER_OUT_B1 | PRINTER_OUT_B2,
+    PRINTER_OUT_PWR_N,
+    PRINTER_IN_ALARM_N,
+    PRINTER_IN_PAPER_OUT
+};
+
+// The printer queue is the firmware's view of the PRU shared RAM
+PRINTER_Queue *getPrinterFirmwareQueue(void) {
+    return (PRINTER_Queue *)&queue;
+}
@@ -0,0 +1,43 @@
+/*
+ * fwsim.h
+ *
+ * Native build of the printer firmware of the "pruprinter_fw" project, to be
+ * run by the PRU simulation (see prusim.h). The firmware gets compiled as is
+ * against the stand-in PRU register header of this project.
+ *
+ * Copyright (C) 2014 Texas Instruments Incorporated - http://www.ti.com/
+ * ALL RIGHTS RESERVED
+ */
+
+#ifndef FWSIM_H_
+#define FWSIM_H_
+
+#include <stdint.h>
+
+// Interface to the PRU-based printer driver firmware "pruprinter_fw"
+#include "pruprinter.h"
+
+// Number of strobe signals of the printer head
+#define PRINTER_FW_NR_OF_STROBES    4
+
+// Printer interface signals as bits in R30 (outputs) and R31 (inputs), and
+// the PRU clock the firmware timing is based on, as defined by the firmware
+typedef struct {
+    uint32_t clockHz;
+    uint32_t paperSense;
+    uint32_t strobeN[PRINTER_FW_NR_OF_STROBES];
+    uint32_t clk;
+    uint32_t latN;
+    uint32_t mosi;
+    uint32_t motor;
+    uint32_t powerN;
+    uint32_t alarmN;
+    uint32_t paperOut;
+} PRINTER_FwSignals;
+
+extern const PRINTER_FwSignals printerFwSignals;
+
+int runPrinterFirmware(void);
+PRINTER_Queue *getPrinterFirmwareQueue(void);
+
+#endif /* FWSIM_H_ */
@@ -0,0 +1,339 @@
+/*
+ * headmodel.c
+ *
+ * Model of the FTP-628 thermal printer head. See headmodel.h for details.
+ *
+ * Copyright (C) 2014 Texas Instruments Incorporated - http://www.ti.com/
+ * ALL RIGHTS RESERVED
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <png.h>
+
+#include "headmodel.h"
+
+// Time stamp of an edge that didn't occur yet
+#define HEAD_NEVER                  UINT64_MAX
+
+// Number of paper lines to grow the paper by at a time
+#define HEAD_PAPER_CHUNK_LINES      256
+
+// Sections of the head in bytes of line data, in the order of the strobe
+// signals in PRINTER_FwSignals
+static const struct {
+    uint8_t firstByte;
+    uint8_t nrOfBytes;
+} strobeSections[PRINTER_FW_NR_OF_STROBES] = {
+    { 320 / 8, 64 / 8 },                // STB1: Dots 321 to 384
+    { 192 / 8, 128 / 8 },               // STB23: Dots 193 to 320
+    { 128 / 8, 64 / 8 },                // STB4: Dots 129 to 192
+    { 0 / 8, 128 / 8 }                  // STB56: Dots 1 to 128
+};
+
+static const struct {
+    const char *name;
+    double limit;
+    const char *unit;
+} checks[HEAD_NR_OF_CHECKS] = {
+    { "tW(CLK)", HEAD_MIN_TW_CLK_NS, "ns" },
+    { "tSETUP(DI)", HEAD_MIN_TSETUP_DI_NS, "ns" },
+    { "tHOLD(DI)", HEAD_MIN_THOLD_DI_NS, "ns" },
+    { "tSETUP(LAT)", HEAD_MIN_TSETUP_LAT_NS, "ns" },
+    { "tW(LAT)", HEAD_MIN_TW_LAT_NS, "ns" },
+    { "tSETUP(STB)", HEAD_MIN_TSETUP_STB_NS, "ns" },
+    { "Black dots", PRINTER_MAX_BLACK_DOTS_PER_LINE, "dots" }
+};
+
+static void shiftInDot(HEAD_Model *model, const bool dot);
+static bool burnDots(HEAD_Model *model, const uint64_t cycle);
+static void checkMinTime(HEAD_Model *model, const HEAD_Check check,
+        const uint64_t cycle, const uint64_t sinceCycle);
+static void reportViolation(HEAD_Model *model, const HEAD_Check check,
+        const uint64_t cycle, const double value);
+
+bool initHeadModel(HEAD_Model *model, const uint32_t clockHz,
+        const uint32_t outputs, FILE *reportFile) {
+    memset(model, 0, sizeof(*model));
+    model->clockHz = clockHz;
+    model->reportFile = reportFile;
+    model->outputs = outputs;
+
+    // The paper is blank to begin with and no edges were seen so far
+    model->paper = calloc(HEAD_PAPER_CHUNK_LINES, PRINTER_BYTES_PER_LINE);
+    if (!model->paper) {
+        fprintf(stderr, "Error allocating memory for the printed paper!\n");
+        return false;
+    }
+    model->paperCapacity = HEAD_PAPER_CHUNK_LINES;
+    model->clkRiseCycle = HEAD_NEVER;
+    model->clkFallCycle = HEAD_NEVER;
+    model->mosiChangeCycle = HEAD_NEVER;
+    model->latFallCycle = HEAD_NEVER;
+    model->latRiseCycle = HEAD_NEVER;
+
+    return true;
+}
+
+void freeHeadModel(HEAD_Model *model) {
+    free(model->paper);
+    model->paper = NULL;
+}
+
+// Apply a change of the printer interface outputs that took place at the given
+// cycle. Returns false if the printed paper could not be grown.
+bool updateHeadModel(HEAD_Model *model, const uint64_t cycle,
+        const uint32_t outputs) {
+    const uint32_t changed = model->outputs ^ outputs;
+    const uint32_t risen = changed & outputs;
+    const uint32_t fallen = changed & ~outputs;
+    uint32_t i;
+
+    model->outputs = outputs;
+
+    // Data must not change too soon after it was clocked in and must be
+    // stable for a while before it gets clocked in
+    if (changed & printerFwSignals.mosi) {
+        checkMinTime(model, HEAD_CHECK_THOLD_DI, cycle, model->clkRiseCycle);
+        model->mosiChangeCycle = cycle;
+    }
+
+    if (risen & printerFwSignals.clk) {
+        checkMinTime(model, HEAD_CHECK_TSETUP_DI, cycle,
+                model->mosiChangeCycle);
+        checkMinTime(model, HEAD_CHECK_TW_CLK, cycle, model->clkFallCycle);
+        shiftInDot(model, outputs & printerFwSignals.mosi);
+        model->clkRiseCycle = cycle;
+    }
+    else if (fallen & printerFwSignals.clk) {
+        checkMinTime(model, HEAD_CHECK_TW_CLK, cycle, model->clkRiseCycle);
+        model->clkFallCycle = cycle;
+    }
+
+    // The latch setup time gets taken from the end of the last clock pulse,
+    // which is a little stricter than the datasheet requires
+    if (fallen & printerFwSignals.latN) {
+        checkMinTime(model, HEAD_CHECK_TSETUP_LAT, cycle,
+                model->clkFallCycle);
+        model->latFallCycle = cycle;
+    }
+    else if (risen & printerFwSignals.latN) {
+        checkMinTime(model, HEAD_CHECK_TW_LAT, cycle, model->latFallCycle);
+        model->latRiseCycle = cycle;
+    }
+
+    // The latch is transparent while LAT_N is low
+    if (!(outputs & printerFwSignals.latN)) {
+        memcpy(model->latch, model->shiftRegister, sizeof(model->latch));
+    }
+
+    for (i = 0; i < PRINTER_FW_NR_OF_STROBES; i++) {
+        if (fallen & printerFwSignals.strobeN[i]) {
+            checkMinTime(model, HEAD_CHECK_TSETUP_STB, cycle,
+                    model->latRiseCycle);
+        }
+    }
+
+    // A half step of the motor is any change of the motor phases other than
+    // turning them all off
+    if ((changed & printerFwSignals.motor) &&
+            (outputs & printerFwSignals.motor)) {
+        model->paperLine++;
+    }
+
+    return burnDots(model, cycle);
+}
+
+uint32_t getHeadModelViolations(const HEAD_Model *model) {
+    uint32_t violations = 0;
+    uint32_t i;
+
+    for (i = 0; i < HEAD_NR_OF_CHECKS; i++) {
+        violations += model->violations[i];
+    }
+
+    return violations;
+}
+
+void printHeadModelReportToConsole(const HEAD_Model *model) {
+    uint32_t i;
+
+    printf("Printer head model:\n");
+    printf("  Paper lines             %u\n", model->nrOfPaperLines);
+    for (i = 0; i < HEAD_NR_OF_CHECKS; i++) {
+        if (!model->violations[i]) {
+            printf("  %-23s %12s\n", checks[i].name, "OK");
+        }
+        else {
+            printf("  %-23s %12u violations, worst %.1f %s (limit %.1f)\n",
+                    checks[i].name, model->violations[i],
+                    model->worstValue[i], checks[i].unit, checks[i].limit);
+        }
+    }
+}
+
+// Save the printed paper as a monochrome PNG image with burned dots in black.
+// The image covers all lines the paper got advanced by or printed on.
+bool saveHeadModelImage(const HEAD_Model *model, const char *fileName) {
+    const uint32_t height = model->nrOfPaperLines ? model->nrOfPaperLines : 1;
+    uint8_t row[PRINTER_BYTES_PER_LINE];
+    png_structp png_ptr;
+    png_infop info_ptr;
+    FILE *fp;
+    uint32_t y;
+    uint32_t i;
+
+    fp = fopen(fileName, "wb");
+    if (!fp) {
+        fprintf(stderr, "File could not be opened for writing!\n");
+        return false;
+    }
+
+    png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    if (!png_ptr) {
+        fprintf(stderr, "Error during during PNG initialization!\n");
+        fclose(fp);
+        return false;
+    }
+
+    info_ptr = png_create_info_struct(png_ptr);
+    if (!info_ptr) {
+        fprintf(stderr, "Error during during PNG initialization!\n");
+        png_destroy_write_struct(&png_ptr, NULL);
+        fclose(fp);
+        return false;
+    }
+
+    if (setjmp(png_jmpbuf(png_ptr))) {
+        fprintf(stderr, "Error writing PNG image!\n");
+        png_destroy_write_struct(&png_ptr, &info_ptr);
+        fclose(fp);
+        return false;
+    }
+
+    png_init_io(png_ptr, fp);
+    png_set_IHDR(png_ptr, info_ptr, PRINTER_DOTS_PER_LINE, height, 1,
+            PNG_COLOR_TYPE_GRAY, PNG_INTERLACE_NONE,
+            PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_write_info(png_ptr, info_ptr);
+
+    // In a monochrome PNG image a '0' is black while the paper holds a '1' for
+    // each burned dot
+    for (y = 0; y < height; y++) {
+        for (i = 0; i < PRINTER_BYTES_PER_LINE; i++) {
+            row[i] = ~model->paper[y * PRINTER_BYTES_PER_LINE + i];
+        }
+        png_write_row(png_ptr, row);
+    }
+
+    png_write_end(png_ptr, NULL);
+    png_destroy_write_struct(&png_ptr, &info_ptr);
+    fclose(fp);
+
+    return true;
+}
+
+// Shift a dot into the shift register, moving all others one dot closer to
+// dot 1
+static void shiftInDot(HEAD_Model *model, const bool dot) {
+    uint32_t i;
+
+    for (i = 0; i < PRINTER_BYTES_PER_LINE - 1; i++) {
+        model->shiftRegister[i] = (model->shiftRegister[i] << 1) |
+                (model->shiftRegister[i + 1] >> 7);
+    }
+    model->shiftRegister[i] = (model->shiftRegister[i] << 1) | dot;
+}
+
+// Burn the latched dots of all sections currently strobed into the current
+// paper line and check that not too many dots get energized at once
+static bool burnDots(HEAD_Model *model, const uint64_t cycle) {
+    uint8_t *line;
+    uint8_t *paper;
+    uint32_t capacity;
+    uint32_t dots = 0;
+    uint32_t i;
+    uint32_t j;
+
+    if (model->outputs & printerFwSignals.powerN) {
+        return true;
+    }
+
+    for (i = 0; i < PRINTER_FW_NR_OF_STROBES; i++) {
+        if (model->outputs & printerFwSignals.strobeN[i]) {
+            continue;
+        }
+
+        // Grow the paper as needed
+        if (model->paperLine >= model->paperCapacity) {
+            capacity = model->paperLine + HEAD_PAPER_CHUNK_LINES;
+            paper = realloc(model->paper, capacity * PRINTER_BYTES_PER_LINE);
+            if (!paper) {
+                fprintf(stderr, "Error allocating memory for the printed "
+                        "paper!\n");
+                return false;
+            }
+            memset(paper + model->paperCapacity * PRINTER_BYTES_PER_LINE, 0,
+                    (capacity - model->paperCapacity) *
+                            PRINTER_BYTES_PER_LINE);
+            model->paper = paper;
+            model->paperCapacity = capacity;
+        }
+
+        line = model->paper + model->paperLine * PRINTER_BYTES_PER_LINE;
+        for (j = strobeSections[i].firstByte;
+                j < strobeSections[i].firstByte + strobeSections[i].nrOfBytes;
+                j++) {
+            line[j] |= model->latch[j];
+            dots += __builtin_popcount(model->latch[j]);
+        }
+    }
+
+    if (dots > PRINTER_MAX_BLACK_DOTS_PER_LINE) {
+        reportViolation(model, HEAD_CHECK_BLACK_DOTS, cycle, dots);
+    }
+
+    // The paper extends up to the current line once it gets printed on, and
+    // up to the line before it once the paper got advanced
+    if (model->paperLine + (dots ? 1 : 0) > model->nrOfPaperLines) {
+        model->nrOfPaperLines = model->paperLine + (dots ? 1 : 0);
+    }
+
+    return true;
+}
+
+// Check that at least the check's limit has passed between the given cycles.
+// There is nothing to check if the earlier edge didn't occur yet.
+static void checkMinTime(HEAD_Model *model, const HEAD_Check check,
+        const uint64_t cycle, const uint64_t sinceCycle) {
+    double ns;
+
+    if (sinceCycle == HEAD_NEVER) {
+        return;
+    }
+
+    ns = (double)(cycle - sinceCycle) * 1E09 / model->clockHz;
+    if (ns < checks[check].limit) {
+        reportViolation(model, check, cycle, ns);
+    }
+}
+
+static void reportViolation(HEAD_Model *model, const HEAD_Check check,
+        const uint64_t cycle, const double value) {
+    // Timing violations are worst when shortest and black dot violations
+    // when largest
+    if (!model->violations[check] ||
+            ((check == HEAD_CHECK_BLACK_DOTS) ?
+                    (value > model->worstValue[check]) :
+                    (value < model->worstValue[check]))) {
+        model->worstValue[check] = value;
+    }
+    model->violations[check]++;
+
+    if (model->reportFile) {
+        fprintf(model->reportFile, "%16.3f us  %-12s %10.1f %-4s (limit "
+                "%.1f)\n", (double)cycle * 1E06 / model->clockHz,
+                checks[check].name, value, checks[check].unit,
+                checks[check].limit);
+    }
+}
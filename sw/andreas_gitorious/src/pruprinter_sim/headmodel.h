@@ -0,0 +1,88 @@
+/*
+ * headmodel.h
+ *
+ * Model of the FTP-628 thermal printer head fed with the printer interface
+ * signals as the firmware drives them, be it from the PRU simulation or from
+ * a recorded R30 trace. The model reconstructs what ends up on the paper and
+ * checks the signal timing against the limits given in the datasheet.
+ *
+ * The head is modeled as follows:
+ *
+ * - MOSI gets shifted into a 384-bit shift register on each rising edge of
+ *   CLK. The first bit shifted in ends up at dot 1 after a full line.
+ * - The shift register gets copied into the latch while LAT_N is low.
+ * - While a strobe signal is low, the latched dots of its section of the head
+ *   get burned into the current paper line, provided the head is powered.
+ * - Each half step of the stepper motor advances the paper by one line.
+ *
+ * Every edge gets checked against the datasheet limits behind the DELAY_TW_CLK,
+ * DELAY_TSETUP_DI, DELAY_THOLD_DI, DELAY_TSETUP_LAT, DELAY_TW_LAT and
+ * DELAY_TSETUP_STB definitions of the firmware, and each strobe against
+ * PRINTER_MAX_BLACK_DOTS_PER_LINE. The limits are kept separately from the
+ * firmware definitions on purpose so that a change of the latter doesn't
+ * change what the firmware gets checked against.
+ *
+ * Copyright (C) 2014 Texas Instruments Incorporated - http://www.ti.com/
+ * ALL RIGHTS RESERVED
+ */
+
+#ifndef HEADMODEL_H_
+#define HEADMODEL_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "fwsim.h"
+
+// Datasheet timing limits of the printer head in nanoseconds
+#define HEAD_MIN_TW_CLK_NS          62.5    // Max. clock frequency of 8MHz
+#define HEAD_MIN_TSETUP_DI_NS       70.0
+#define HEAD_MIN_THOLD_DI_NS        30.0
+#define HEAD_MIN_TSETUP_LAT_NS      300.0
+#define HEAD_MIN_TW_LAT_NS          200.0
+#define HEAD_MIN_TSETUP_STB_NS      300.0
+
+// Checks performed by the model
+typedef enum {
+    HEAD_CHECK_TW_CLK,
+    HEAD_CHECK_TSETUP_DI,
+    HEAD_CHECK_THOLD_DI,
+    HEAD_CHECK_TSETUP_LAT,
+    HEAD_CHECK_TW_LAT,
+    HEAD_CHECK_TSETUP_STB,
+    HEAD_CHECK_BLACK_DOTS,
+    HEAD_NR_OF_CHECKS
+} HEAD_Check;
+
+// State of the printer head and the paper printed on so far. Time stamps are
+// in PRU cycles. The report file, if any, receives a line per violation.
+typedef struct {
+    uint32_t clockHz;
+    FILE *reportFile;
+    uint32_t outputs;
+    uint8_t shiftRegister[PRINTER_BYTES_PER_LINE];
+    uint8_t latch[PRINTER_BYTES_PER_LINE];
+    uint8_t *paper;
+    uint32_t paperCapacity;
+    uint32_t paperLine;
+    uint32_t nrOfPaperLines;
+    uint64_t clkRiseCycle;
+    uint64_t clkFallCycle;
+    uint64_t mosiChangeCycle;
+    uint64_t latFallCycle;
+    uint64_t latRiseCycle;
+    uint32_t violations[HEAD_NR_OF_CHECKS];
+    double worstValue[HEAD_NR_OF_CHECKS];
+} HEAD_Model;
+
+bool initHeadModel(HEAD_Model *model, const uint32_t clockHz,
+        const uint32_t outputs, FILE *reportFile);
+void freeHeadModel(HEAD_Model *model);
+bool updateHeadModel(HEAD_Model *model, const uint64_t cycle,
+        const uint32_t outputs);
+uint32_t getHeadModelViolations(const HEAD_Model *model);
+void printHeadModelReportToConsole(const HEAD_Model *model);
+bool saveHeadModelImage(const HEAD_Model *model, const char *fileName);
+
+#endif /* HEADMODEL_H_ */
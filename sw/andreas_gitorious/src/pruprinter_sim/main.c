@@ -0,0 +1,464 @@
+/*
+ * main.c
+ *
+ * AM335x PRU-based Thermal Printer Firmware Simulator
+ *
+ * This is a command line program that runs saved print jobs (see the -o
+ * option of pruprint) through the printer firmware built for the host rather
+ * than the PRU, with the program taking the part of the host. It reports the
+ * simulated PRU cycles each job takes along with how they break down into
+ * shifting out line data, strobing the printer head and stepping the motor.
+ * This allows evaluating firmware changes without any PRU hardware.
+ *
+ * The printer interface signals also drive a model of the printer head (see
+ * headmodel.h), which reconstructs the printed paper and checks the signal
+ * timing against the head's datasheet. Any timing violation makes the program
+ * fail so that firmware timing changes can be proven safe before they ever
+ * reach a real printer.
+ *
+ * Jobs that don't fit into the printer queue are handed to the firmware in
+ * chunks, split between items outside of any loop, as if the host had always
+ * refilled the queue in time.
+ *
+ * Copyright (C) 2014 Texas Instruments Incorporated - http://www.ti.com/
+ * ALL RIGHTS RESERVED
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+// Interface to the PRU-based printer driver firmware "pruprinter_fw"
+#include "pruprinter.h"
+
+// Host-side print job handling of the "pruprint" project
+#include "printjob.h"
+#include "linedict.h"
+#include "jobfile.h"
+
+#include "prusim.h"
+#include "fwsim.h"
+#include "headmodel.h"
+
+#define USAGE_STRING                                                    \
+    "Usage: %s [OPTION]... JOBFILE...\n"                                \
+    "Runs the print jobs saved in JOBFILE through the printer firmware\n"\
+    "built for the host and reports the simulated PRU cycles they take\n"\
+    "\n"                                                                \
+    "  -n COPIES    Number of times to run each job\n"                  \
+    "  -l CYCLES    Give up after CYCLES simulated PRU cycles\n"        \
+    "  -P           Simulate the paper running out\n"                   \
+    "  -A           Simulate a thermal alarm of the motor driver\n"    \
+    "  -o PNGFILE   Save the printed paper as PNG image to PNGFILE\n"   \
+    "  -r REPORT    Write printer head timing violations to REPORT\n"
+
+// Give up after ten minutes of simulated PRU time by default. The test signal
+// generation for example never ends.
+#define SIM_DEFAULT_CYCLE_LIMIT     (600ULL * 200000000)
+
+// Statistics gathered while running a job. The shift time of a pass is taken
+// from its first clock pulse up to the latch pulse, and the strobe time of a
+// line from the beginning of its first up to the end of its last strobe pulse.
+typedef struct {
+    uint64_t startCycle;
+    uint64_t endCycle;
+    uint32_t linesPrinted;
+    uint32_t status;
+    uint32_t passes;
+    uint64_t shiftCycles;
+    uint64_t shiftStartCycle;
+    bool shifting;
+    uint32_t strobes;
+    uint64_t strobeCycles;
+    uint64_t strobeStartCycle;
+    uint32_t strobePulses;
+    uint32_t halfSteps;
+    uint64_t lastHalfStepCycle;
+    uint64_t minHalfStepCycles;
+} SIM_Stats;
+
+// Type holding the state of the simulated host. Each job file is run the
+// requested number of times, one chunk at a time.
+typedef struct {
+    char **fileNames;
+    uint32_t nrOfFiles;
+    uint32_t nextFile;
+    uint32_t nrOfCopies;
+    uint32_t remainingCopies;
+    const char *fileName;
+    PRINTER_JobFile jobFile;
+    bool jobFileOpen;
+    bool runActive;
+    uint32_t jobOffset;
+    bool chunkRunning;
+    bool halting;
+    bool failed;
+    SIM_Stats stats;
+    HEAD_Model head;
+} SIM_Host;
+
+static void pollHost(const uint64_t cycle, void *userData);
+static bool startNextRun(SIM_Host *host, const uint64_t cycle);
+static uint32_t getChunkSize(const PRINTER_Job *job, const uint32_t offset);
+static void submitChunk(SIM_Host *host, const uint8_t items[],
+        const uint32_t size);
+static void onEventRaised(const uint64_t cycle, const uint32_t sysEvent,
+        void *userData);
+static void onOutputsChanged(const uint64_t cycle, const uint32_t oldOutputs,
+        const uint32_t newOutputs, void *userData);
+static void printStatsToConsole(const SIM_Host *host);
+static void printCyclesToConsole(const char *label, const uint64_t cycles,
+        const uint32_t count);
+
+int main(int argc, char *argv[]) {
+    int opt;
+    uint64_t cycleLimit = SIM_DEFAULT_CYCLE_LIMIT;
+    uint32_t inputs = printerFwSignals.alarmN;
+    PRUSIM_Hooks hooks;
+    PRUSIM_Result result;
+    SIM_Host host;
+    const char *imageFile = NULL;
+    const char *reportFileName = NULL;
+    FILE *reportFile = NULL;
+
+    memset(&host, 0, sizeof(host));
+    host.nrOfCopies = 1;
+
+    while ((opt = getopt(argc, argv, "n:l:PAo:r:")) != -1) {
+        switch (opt) {
+        case 'n':
+            host.nrOfCopies = atoi(optarg);
+            break;
+        case 'l':
+            cycleLimit = strtoull(optarg, NULL, 0);
+            break;
+        case 'P':
+            inputs |= printerFwSignals.paperOut;
+            break;
+        case 'A':
+            inputs &= ~printerFwSignals.alarmN;
+            break;
+        case 'o':
+            imageFile = optarg;
+            break;
+        case 'r':
+            reportFileName = optarg;
+            break;
+        default:
+            fprintf(stderr, USAGE_STRING, argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (optind >= argc) {
+        fprintf(stderr, USAGE_STRING, argv[0]);
+        return EXIT_FAILURE;
+    }
+    host.fileNames = &argv[optind];
+    host.nrOfFiles = argc - optind;
+
+    if (reportFileName) {
+        reportFile = fopen(reportFileName, "w");
+        if (!reportFile) {
+            fprintf(stderr, "Could not open report file %s!\n",
+                    reportFileName);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // The printer head sees the outputs as they come out of reset
+    if (!initHeadModel(&host.head, printerFwSignals.clockHz, 0, reportFile)) {
+        if (reportFile) {
+            fclose(reportFile);
+        }
+        return EXIT_FAILURE;
+    }
+
+    // Run the firmware from reset. The simulated host hands it one job after
+    // the other and finally asks it to halt.
+    memset(&hooks, 0, sizeof(hooks));
+    hooks.outputsChanged = onOutputsChanged;
+    hooks.eventRaised = onEventRaised;
+    hooks.hostPoll = pollHost;
+    hooks.userData = &host;
+    initPruSim(&hooks, inputs);
+    setPruSimCycleLimit(cycleLimit);
+
+    result = runPruSim(runPrinterFirmware);
+
+    if (host.jobFileOpen) {
+        closeJobFile(&host.jobFile);
+    }
+
+    // Whatever made it onto the paper is of interest even if the simulation
+    // didn't end the way it should have
+    printHeadModelReportToConsole(&host.head);
+    if (getHeadModelViolations(&host.head)) {
+        host.failed = true;
+    }
+    if (imageFile && !saveHeadModelImage(&host.head, imageFile)) {
+        host.failed = true;
+    }
+    freeHeadModel(&host.head);
+    if (reportFile) {
+        fclose(reportFile);
+    }
+
+    if (result == PRUSIM_RESULT_CYCLE_LIMIT) {
+        fprintf(stderr, "Cycle limit reached after %llu cycles!\n",
+                (unsigned long long)getPruSimCycles());
+        return EXIT_FAILURE;
+    }
+
+    if (!host.halting) {
+        fprintf(stderr, "Printer firmware halted unexpectedly!\n");
+        return EXIT_FAILURE;
+    }
+
+    return host.failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// Invoked while the firmware waits for a job. Hands it the next chunk of the
+// current run, or a job asking it to halt once all runs are done.
+static void pollHost(const uint64_t cycle, void *userData) {
+    SIM_Host *host = userData;
+    const PRINTER_Job *job = &host->jobFile.job;
+    const uint32_t haltJob[] = { PRINTER_CMD_REQUEST_PRU_HALT, 0 };
+    uint32_t size;
+
+    if (host->chunkRunning || host->halting) {
+        return;
+    }
+
+    if (!host->runActive && !startNextRun(host, cycle)) {
+        host->halting = true;
+        submitChunk(host, (const uint8_t *)haltJob, sizeof(haltJob));
+        return;
+    }
+
+    size = getChunkSize(job, host->jobOffset);
+    if (!size) {
+        fprintf(stderr, "Print job contains a loop too large for the "
+                "queue!\n");
+        host->failed = true;
+        host->halting = true;
+        submitChunk(host, (const uint8_t *)haltJob, sizeof(haltJob));
+        return;
+    }
+
+    submitChunk(host, job->data + host->jobOffset, size);
+    host->jobOffset += size;
+}
+
+// Start another copy of the current job file, or the next job file once all
+// copies are done. Returns false if there is nothing left to run.
+static bool startNextRun(SIM_Host *host, const uint64_t cycle) {
+    while (!host->remainingCopies || !host->jobFile.job.size) {
+        if (host->jobFileOpen) {
+            closeJobFile(&host->jobFile);
+            host->jobFileOpen = false;
+        }
+
+        if (host->nextFile >= host->nrOfFiles) {
+            return false;
+        }
+
+        host->fileName = host->fileNames[host->nextFile++];
+        if (!openJobFile(host->fileName, &host->jobFile)) {
+            fprintf(stderr, "Could not load job file %s!\n", host->fileName);
+            host->failed = true;
+            continue;
+        }
+        host->jobFileOpen = true;
+        host->remainingCopies = host->nrOfCopies;
+
+        // The line dictionary stays in place for all copies
+        uploadLineDictionary(&host->jobFile.lineDict, pruSimDataRam);
+    }
+
+    host->remainingCopies--;
+    host->runActive = true;
+    host->jobOffset = 0;
+    memset(&host->stats, 0, sizeof(host->stats));
+    host->stats.startCycle = cycle;
+
+    return true;
+}
+
+// Determine how much of the job starting at the given offset fits into the
+// printer queue alongside the terminating EOS item. Loops are never split up.
+// Returns zero if not even the first item or loop fits.
+static uint32_t getChunkSize(const PRINTER_Job *job, const uint32_t offset) {
+    const uint32_t maxSize = PRINTER_MAX_JOB_SIZE - PRINTER_JOB_ITEM_SIZE(0);
+    const PRINTER_JobItem *item;
+    uint32_t size = 0;
+    uint32_t unitSize = 0;
+    uint32_t level = 0;
+
+    for (item = (const PRINTER_JobItem *)(job->data + offset); item;
+            item = getNextJobItem(job, item)) {
+        unitSize += PRINTER_JOB_ITEM_SIZE(item->length);
+        if (item->command == PRINTER_CMD_LOOP) {
+            level++;
+        }
+        else if ((item->command == PRINTER_CMD_END_LOOP) && level) {
+            level--;
+        }
+
+        if (level) {
+            continue;
+        }
+        if (size + unitSize > maxSize) {
+            break;
+        }
+        size += unitSize;
+        unitSize = 0;
+    }
+
+    return size;
+}
+
+// Place the given items into the printer queue, terminated by an EOS item,
+// and kick off the firmware. The entire queue counts as published as the
+// items are not streamed.
+static void submitChunk(SIM_Host *host, const uint8_t items[],
+        const uint32_t size) {
+    PRINTER_Queue *queue = getPrinterFirmwareQueue();
+    PRINTER_JobItem *eosItem;
+
+    memcpy(queue->jobItems, items, size);
+    eosItem = (PRINTER_JobItem *)((uint8_t *)queue->jobItems + size);
+    eosItem->command = PRINTER_CMD_EOS;
+    eosItem->length = 0;
+
+    queue->progress.producedBytes = sizeof(queue->jobItems);
+    queue->progress.consumedBytes = 0;
+    queue->progress.lowWatermark = 0;
+    queue->progress.keepWarmMs = 0;
+    queue->progress.linesPrinted = 0;
+    queue->progress.busyPoll = 0;
+
+    host->chunkRunning = true;
+    raisePruSimEvent(PRUSIM_SYSEVT_ARM_PRU1);
+}
+
+static void onEventRaised(const uint64_t cycle, const uint32_t sysEvent,
+        void *userData) {
+    SIM_Host *host = userData;
+    PRINTER_Queue *queue = getPrinterFirmwareQueue();
+
+    if ((sysEvent != PRUSIM_SYSEVT_PRU1_ARM) || !host->chunkRunning) {
+        return;
+    }
+    host->chunkRunning = false;
+
+    if (!host->runActive) {
+        return;
+    }
+
+    // Pick up the results of the chunk. The printer status is reset at the
+    // beginning of each job only, the same way the print daemon does it.
+    host->stats.linesPrinted += queue->progress.linesPrinted;
+    host->stats.status |= queue->status.all;
+    queue->status.all = 0;
+
+    if (host->jobOffset >= host->jobFile.job.size) {
+        host->stats.endCycle = cycle;
+        host->runActive = false;
+        printStatsToConsole(host);
+    }
+}
+
+// Track the printer interface signals to find out where the cycles go
+static void onOutputsChanged(const uint64_t cycle, const uint32_t oldOutputs,
+        const uint32_t newOutputs, void *userData) {
+    SIM_Host *host = userData;
+    SIM_Stats *stats = &host->stats;
+    const uint32_t changed = oldOutputs ^ newOutputs;
+    const uint32_t fallen = changed & oldOutputs;
+    const uint32_t risen = changed & newOutputs;
+    uint32_t i;
+
+    if (!updateHeadModel(&host->head, cycle, newOutputs)) {
+        host->failed = true;
+    }
+
+    if (!host->runActive) {
+        return;
+    }
+
+    if ((risen & printerFwSignals.clk) && !stats->shifting) {
+        stats->shiftStartCycle = cycle;
+        stats->shifting = true;
+    }
+    if ((fallen & printerFwSignals.latN) && stats->shifting) {
+        stats->shiftCycles += cycle - stats->shiftStartCycle;
+        stats->passes++;
+        stats->shifting = false;
+    }
+
+    for (i = 0; i < PRINTER_FW_NR_OF_STROBES; i++) {
+        if ((fallen & printerFwSignals.strobeN[i]) && !stats->strobePulses) {
+            stats->strobeStartCycle = cycle;
+        }
+        if (risen & printerFwSignals.strobeN[i]) {
+            if (++stats->strobePulses == PRINTER_FW_NR_OF_STROBES) {
+                stats->strobeCycles += cycle - stats->strobeStartCycle;
+                stats->strobes++;
+                stats->strobePulses = 0;
+            }
+        }
+    }
+
+    // Turning off the motor doesn't count as a step
+    if ((changed & printerFwSignals.motor) &&
+            (newOutputs & printerFwSignals.motor)) {
+        if (stats->halfSteps && (!stats->minHalfStepCycles ||
+                (cycle - stats->lastHalfStepCycle <
+                        stats->minHalfStepCycles))) {
+            stats->minHalfStepCycles = cycle - stats->lastHalfStepCycle;
+        }
+        stats->lastHalfStepCycle = cycle;
+        stats->halfSteps++;
+    }
+}
+
+static void printStatsToConsole(const SIM_Host *host) {
+    const SIM_Stats *stats = &host->stats;
+
+    printf("%s:\n", host->fileName);
+    printf("  Lines printed           %u\n", stats->linesPrinted);
+    printf("  Passes shifted out      %u\n", stats->passes);
+    printf("  Strobe sequences        %u\n", stats->strobes);
+    printf("  Half steps              %u\n", stats->halfSteps);
+    printCyclesToConsole("Total", stats->endCycle - stats->startCycle, 1);
+    printCyclesToConsole("Per line", stats->endCycle - stats->startCycle,
+            stats->linesPrinted);
+    printCyclesToConsole("Shift per pass", stats->shiftCycles,
+            stats->passes);
+    printCyclesToConsole("Strobe per sequence", stats->strobeCycles,
+            stats->strobes);
+    printCyclesToConsole("Min. half-step interval",
+            stats->minHalfStepCycles, stats->halfSteps > 1);
+    if (stats->status) {
+        printf("  Printer status          0x%08x\n", stats->status);
+    }
+}
+
+// Print the average number of cycles and the time they correspond to
+static void printCyclesToConsole(const char *label, const uint64_t cycles,
+        const uint32_t count) {
+    double average;
+
+    if (!count) {
+        printf("  %-23s -\n", label);
+        return;
+    }
+
+    average = (double)cycles / count;
+    printf("  %-23s %12.0f cycles %12.3f us\n", label, average,
+            average * 1E06 / printerFwSignals.clockHz);
+}
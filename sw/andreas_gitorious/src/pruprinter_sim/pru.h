@@ -0,0 +1,67 @@
+/*
+ * pru.h
+ *
+ * Stand-in for the PRU register header of the "pruprinter_fw" project that
+ * allows building the firmware natively on the host. It shares the include
+ * guard of the original header so that it takes the place of the latter when
+ * included first.
+ *
+ * The core registers and the peripherals are routed through accessor
+ * functions of the PRU simulation (see prusim.h), which model their behavior
+ * and keep track of the PRU cycles spent. The PRU-local data memories and the
+ * shared RAM are regular host memory.
+ *
+ * Copyright (C) 2014 Texas Instruments Incorporated - http://www.ti.com/
+ * ALL RIGHTS RESERVED
+ */
+
+#ifndef PRU_H_
+#define PRU_H_
+
+#include <stdint.h>
+
+#include "prusim.h"
+
+/*
+ * PRU-to-ARM events as defined by the original header. Writing one of these to
+ * R31 raises system interrupt 20 (completion) or 19 (watermark).
+ */
+#define PRU1_ARM_INTERRUPT      (20 - 16 + 32)
+#define PRU1_ARM_WATERMARK_INTERRUPT    (19 - 16 + 32)
+
+/* The PRU-local data memories are located in host memory */
+#define PRU_LOCAL_DATARAM_BASE  ((uintptr_t)pruSimDataRam)
+
+/* Constant table programmable pointer register 0 has no effect */
+#define CTPPR0                  (pruSimCtppr0)
+
+/* Strip the PRU compiler specific storage qualifiers and attributes */
+#define far
+#define near
+#define cregister(name, type)   unused
+#define peripheral              unused
+
+/*
+ * Strip PRU assembly and ignore the PRU compiler specific pragmas. The firmware
+ * only uses assembly for memory reads that are measured but otherwise have no
+ * effect.
+ */
+#define __asm(text)
+#pragma GCC diagnostic ignored "-Wunknown-pragmas"
+
+/* Core registers and peripherals. See prusim.h for their behavior. */
+#define __R30                   (*pruSimR30())
+#define __R31                   (*pruSimR31())
+#define CT_INTC                 (*pruSimIntc())
+#define CT_CFG                  (*pruSimCfg())
+#define CT_IEP                  (*pruSimIep())
+#define PRU_CTRL                (*pruSimCtrl())
+
+/* Control register bits as defined by the original header */
+#define PRU_CTRL_COUNTER_ENABLE (1 << 3)
+
+/* Compiler intrinsics */
+#define __delay_cycles(cycles)  pruSimDelayCycles(cycles)
+#define __halt()                pruSimHalt()
+
+#endif /* PRU_H_ */
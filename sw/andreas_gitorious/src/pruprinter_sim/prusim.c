@@ -0,0 +1,319 @@
+/*
+ * prusim.c
+ *
+ * Simulation of the PRU subsystem. See prusim.h for details.
+ *
+ * Copyright (C) 2014 Texas Instruments Incorporated - http://www.ti.com/
+ * ALL RIGHTS RESERVED
+ */
+
+#include <string.h>
+#include <setjmp.h>
+
+#include "prusim.h"
+
+// Strobe bit and event number field of the R31 event interface
+#define R31_EVENT_STROBE            (1 << 5)
+#define R31_EVENT_NUMBER_MASK       0x0F
+#define R31_EVENT_BASE              16
+
+// IEP GLOBAL_CFG counter enable bit and default increment field
+#define IEP_CNT_ENABLE              (1 << 0)
+#define IEP_DEFAULT_INC_SHIFT       4
+#define IEP_DEFAULT_INC_MASK        0x0F
+
+// Number of IEP compare blocks used by the firmware
+#define IEP_NR_OF_COMPARES          2
+
+// CTRL cycle counter enable bit and the value the counter stops at
+#define CTRL_COUNTER_ENABLE         (1 << 3)
+#define CTRL_COUNTER_MAX            0xFFFFFFFFULL
+
+// Registers as presented to the firmware along with the values they had when
+// they were last presented. A difference between the two means the firmware
+// wrote the register in the meantime.
+typedef struct {
+    PRUSIM_Hooks hooks;
+    uint32_t inputs;
+    uint64_t cycles;
+    uint64_t cycleLimit;
+    jmp_buf exitJump;
+    uint32_t r30;
+    uint32_t r30Presented;
+    uint32_t r31;
+    uint32_t r31Presented;
+    uint64_t eventStatus;
+    pruIntc intc;
+    pruCfg cfg;
+    pruIep iep;
+    pruIep iepPresented;
+    uint32_t iepConfig;
+    uint32_t iepCountBase;
+    uint64_t iepCycleBase;
+    uint32_t iepArmCount[IEP_NR_OF_COMPARES];
+    pruCtrl ctrl;
+    pruCtrl ctrlPresented;
+    uint32_t ctrlConfig;
+    uint32_t cycleCountBase;
+    uint64_t cycleCountCycleBase;
+} PRUSIM_State;
+
+uint8_t pruSimDataRam[PRUSIM_DATARAM_SIZE] __attribute__((aligned(8)));
+uint32_t pruSimCtppr0;
+
+static PRUSIM_State sim;
+
+static void syncPruSim(void);
+static void spendCycles(const uint64_t cycles);
+static uint32_t getR31Value(void);
+static void presentIntc(void);
+static uint32_t getIepCount(void);
+static void presentIep(void);
+static uint32_t getCycleCount(void);
+static void presentCtrl(void);
+
+void initPruSim(const PRUSIM_Hooks *hooks, const uint32_t inputs) {
+    // Start out like a PRU subsystem that just came out of reset
+    memset(&sim, 0, sizeof(sim));
+    memset(pruSimDataRam, 0, sizeof(pruSimDataRam));
+    pruSimCtppr0 = 0;
+
+    if (hooks) {
+        sim.hooks = *hooks;
+    }
+    sim.inputs = inputs;
+    sim.r31 = sim.r31Presented = getR31Value();
+}
+
+void setPruSimInputs(const uint32_t inputs) {
+    sim.inputs = inputs;
+}
+
+void setPruSimCycleLimit(const uint64_t cycleLimit) {
+    sim.cycleLimit = cycleLimit;
+}
+
+uint64_t getPruSimCycles(void) {
+    return sim.cycles;
+}
+
+void raisePruSimEvent(const uint32_t sysEvent) {
+    sim.eventStatus |= 1ULL << sysEvent;
+}
+
+// Run the firmware until it halts or the cycle limit is reached, whichever
+// comes first
+PRUSIM_Result runPruSim(int (*entryPoint)(void)) {
+    int result;
+
+    result = setjmp(sim.exitJump);
+    if (!result) {
+        entryPoint();
+        return PRUSIM_RESULT_HALTED;
+    }
+
+    return (PRUSIM_Result)(result - 1);
+}
+
+volatile uint32_t *pruSimR30(void) {
+    syncPruSim();
+    spendCycles(PRUSIM_REGISTER_ACCESS_CYCLES);
+
+    return &sim.r30;
+}
+
+volatile uint32_t *pruSimR31(void) {
+    syncPruSim();
+    spendCycles(PRUSIM_REGISTER_ACCESS_CYCLES);
+
+    // Give the host a chance to act while the firmware is idle
+    if (!(sim.eventStatus & (1ULL << PRUSIM_SYSEVT_ARM_PRU1)) &&
+            sim.hooks.hostPoll) {
+        sim.hooks.hostPoll(sim.cycles, sim.hooks.userData);
+    }
+
+    sim.r31 = sim.r31Presented = getR31Value();
+
+    return &sim.r31;
+}
+
+volatile pruIntc *pruSimIntc(void) {
+    syncPruSim();
+    spendCycles(PRUSIM_PERIPHERAL_ACCESS_CYCLES);
+    presentIntc();
+
+    return &sim.intc;
+}
+
+volatile pruCfg *pruSimCfg(void) {
+    syncPruSim();
+    spendCycles(PRUSIM_PERIPHERAL_ACCESS_CYCLES);
+
+    return &sim.cfg;
+}
+
+volatile pruIep *pruSimIep(void) {
+    syncPruSim();
+    spendCycles(PRUSIM_PERIPHERAL_ACCESS_CYCLES);
+    presentIep();
+
+    return &sim.iep;
+}
+
+volatile pruCtrl *pruSimCtrl(void) {
+    syncPruSim();
+    spendCycles(PRUSIM_PERIPHERAL_ACCESS_CYCLES);
+    presentCtrl();
+
+    return &sim.ctrl;
+}
+
+void pruSimDelayCycles(const uint32_t cycles) {
+    syncPruSim();
+    spendCycles(cycles);
+}
+
+void pruSimHalt(void) {
+    syncPruSim();
+    longjmp(sim.exitJump, PRUSIM_RESULT_HALTED + 1);
+}
+
+// Pick up whatever the firmware wrote to the registers since they were last
+// presented to it
+static void syncPruSim(void) {
+    uint32_t sysEvent;
+    uint32_t i;
+
+    if (sim.r30 != sim.r30Presented) {
+        if (sim.hooks.outputsChanged) {
+            sim.hooks.outputsChanged(sim.cycles, sim.r30Presented, sim.r30,
+                    sim.hooks.userData);
+        }
+        sim.r30Presented = sim.r30;
+    }
+
+    if (sim.r31 != sim.r31Presented) {
+        if (sim.r31 & R31_EVENT_STROBE) {
+            sysEvent = (sim.r31 & R31_EVENT_NUMBER_MASK) + R31_EVENT_BASE;
+            sim.eventStatus |= 1ULL << sysEvent;
+            if (sim.hooks.eventRaised) {
+                sim.hooks.eventRaised(sim.cycles, sysEvent,
+                        sim.hooks.userData);
+            }
+        }
+        sim.r31 = sim.r31Presented = getR31Value();
+    }
+
+    // Status registers are write-1-to-set and clear registers write-1-to-
+    // clear. Both are presented as zero.
+    sim.eventStatus |= (uint64_t)sim.intc.srsr1 << 32 | sim.intc.srsr0;
+    sim.eventStatus &= ~((uint64_t)sim.intc.secr1 << 32 | sim.intc.secr0);
+    presentIntc();
+
+    // The counter continues from where it was when it gets enabled, disabled
+    // or reconfigured. Writing the counter clears the bits written as '1'.
+    if (sim.iep.global_cfg != sim.iepPresented.global_cfg) {
+        sim.iepCountBase = getIepCount();
+        sim.iepCycleBase = sim.cycles;
+        sim.iepConfig = sim.iep.global_cfg;
+    }
+    if (sim.iep.count != sim.iepPresented.count) {
+        sim.iepCountBase = getIepCount() & ~sim.iep.count;
+        sim.iepCycleBase = sim.cycles;
+    }
+
+    // Compare blocks count from the time their compare value was written
+    for (i = 0; i < IEP_NR_OF_COMPARES; i++) {
+        if ((&sim.iep.cmp0)[i] != (&sim.iepPresented.cmp0)[i]) {
+            sim.iepArmCount[i] = getIepCount();
+        }
+    }
+    presentIep();
+
+    // The cycle counter continues from where it was when it gets enabled or
+    // disabled, or from the value written to it
+    if (sim.ctrl.cycle != sim.ctrlPresented.cycle) {
+        sim.cycleCountBase = sim.ctrl.cycle;
+        sim.cycleCountCycleBase = sim.cycles;
+    }
+    else if (sim.ctrl.ctrl != sim.ctrlPresented.ctrl) {
+        sim.cycleCountBase = getCycleCount();
+        sim.cycleCountCycleBase = sim.cycles;
+    }
+    sim.ctrlConfig = sim.ctrl.ctrl;
+    presentCtrl();
+}
+
+static void spendCycles(const uint64_t cycles) {
+    sim.cycles += cycles;
+
+    if (sim.cycleLimit && (sim.cycles > sim.cycleLimit)) {
+        longjmp(sim.exitJump, PRUSIM_RESULT_CYCLE_LIMIT + 1);
+    }
+}
+
+static uint32_t getR31Value(void) {
+    uint32_t value = sim.inputs & ~PRUSIM_R31_HOST1_INT;
+
+    if (sim.eventStatus & (1ULL << PRUSIM_SYSEVT_ARM_PRU1)) {
+        value |= PRUSIM_R31_HOST1_INT;
+    }
+
+    return value;
+}
+
+static void presentIntc(void) {
+    sim.intc.srsr0 = (uint32_t)sim.eventStatus;
+    sim.intc.srsr1 = (uint32_t)(sim.eventStatus >> 32);
+    sim.intc.secr0 = 0;
+    sim.intc.secr1 = 0;
+}
+
+static uint32_t getIepCount(void) {
+    uint32_t increment;
+
+    if (!(sim.iepConfig & IEP_CNT_ENABLE)) {
+        return sim.iepCountBase;
+    }
+
+    increment = (sim.iepConfig >> IEP_DEFAULT_INC_SHIFT) & IEP_DEFAULT_INC_MASK;
+
+    return sim.iepCountBase +
+            (uint32_t)((sim.cycles - sim.iepCycleBase) * increment);
+}
+
+static void presentIep(void) {
+    const uint32_t count = getIepCount();
+    uint32_t status = 0;
+    uint32_t i;
+
+    for (i = 0; i < IEP_NR_OF_COMPARES; i++) {
+        if ((sim.iep.cmp_cfg & (1 << (i + 1))) &&
+                (count - sim.iepArmCount[i] >=
+                        (&sim.iep.cmp0)[i] - sim.iepArmCount[i])) {
+            status |= 1 << i;
+        }
+    }
+
+    sim.iep.count = count;
+    sim.iep.cmp_status = status;
+    sim.iepPresented = sim.iep;
+}
+
+static uint32_t getCycleCount(void) {
+    uint64_t count;
+
+    if (!(sim.ctrlConfig & CTRL_COUNTER_ENABLE)) {
+        return sim.cycleCountBase;
+    }
+
+    count = sim.cycleCountBase + (sim.cycles - sim.cycleCountCycleBase);
+
+    return count < CTRL_COUNTER_MAX ? (uint32_t)count : CTRL_COUNTER_MAX;
+}
+
+static void presentCtrl(void) {
+    sim.ctrl.cycle = getCycleCount();
+    sim.ctrl.stall = 0;
+    sim.ctrlPresented = sim.ctrl;
+}
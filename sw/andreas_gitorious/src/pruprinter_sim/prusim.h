@@ -0,0 +1,158 @@
+/*
+ * prusim.h
+ *
+ * Simulation of the parts of the AM335x PRU subsystem that are used by the
+ * printer firmware, allowing the firmware to be run natively on the host. The
+ * stand-in pru.h of this project routes all accesses of the core registers and
+ * the peripherals through the accessor functions declared here.
+ *
+ * The simulation keeps track of the PRU cycles spent. __delay_cycles() advances
+ * the cycle count by the requested number of cycles, each access of R30/R31
+ * accounts for a single cycle and each peripheral access for a few cycles.
+ * Other instructions are not accounted for, so the cycle counts are a lower
+ * bound of what the real PRU spends, although a close one as the firmware
+ * spends almost all of its time in delays and peripheral polling.
+ *
+ * The peripherals are modeled as follows:
+ *
+ * - R30: Changes of the outputs are reported through a hook along with the
+ *   cycle at which they took place.
+ * - R31: Reads return the inputs set through setPruSimInputs() plus the host
+ *   interrupt 1 flag (bit 31), which reflects the status of system event 22
+ *   (ARM_PRU1_INTERRUPT) as the firmware's INTC configuration maps it to
+ *   channel 1/host 1. Writes with the strobe bit set raise system events 16 to
+ *   31, which are reported through a hook.
+ * - CT_INTC: The system event status can be read through SRSR0/SRSR1 and
+ *   cleared through SECR0/SECR1. Channel and host mapping are not modeled.
+ * - CT_IEP: The counter runs off the PRU clock using the increment configured
+ *   in GLOBAL_CFG. Compare blocks 0 and 1 report a match in CMP_STATUS once the
+ *   counter has reached the compare value, counted from the time the compare
+ *   value was written. Writes of CMP_STATUS have no effect as the status is
+ *   derived from the counter. The counter reset on compare 0 is not modeled.
+ * - CT_CFG: Plain registers without any effect.
+ * - PRU_CTRL: The cycle counter counts the simulated cycles while it is
+ *   enabled in CTRL and stops at 0xFFFFFFFF. Writes of the counter take effect
+ *   regardless of whether it is enabled. Stalls are not modeled, so the stall
+ *   counter stays at zero.
+ *
+ * Accessor writes are picked up with the next access of any register or the
+ * next delay, which is when the output changes get their time stamps.
+ *
+ * Copyright (C) 2014 Texas Instruments Incorporated - http://www.ti.com/
+ * ALL RIGHTS RESERVED
+ */
+
+#ifndef PRUSIM_H_
+#define PRUSIM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Cycles accounted for each access of a core register and a peripheral
+#define PRUSIM_REGISTER_ACCESS_CYCLES       1
+#define PRUSIM_PERIPHERAL_ACCESS_CYCLES     4
+
+// Size of the PRU-local data memory map which holds the data RAM of the PRU
+// itself at offset 0x0000 and the one of the other PRU at offset 0x2000
+#define PRUSIM_DATARAM_SIZE                 0x4000
+
+// System events the simulation cares about
+#define PRUSIM_SYSEVT_ARM_PRU1              22
+#define PRUSIM_SYSEVT_PRU1_ARM              20
+#define PRUSIM_SYSEVT_PRU0_ARM              19
+
+// Host interrupt 1 flag in R31
+#define PRUSIM_R31_HOST1_INT                (1U << 31)
+
+// PRU INTC registers used by the firmware
+typedef struct {
+    uint32_t srsr0;
+    uint32_t srsr1;
+    uint32_t secr0;
+    uint32_t secr1;
+} pruIntc;
+
+// PRU CFG register set
+typedef struct {
+    uint32_t revid;
+    uint32_t syscfg;
+    uint32_t gpcfg0;
+    uint32_t gpcfg1;
+    uint32_t cgr;
+    uint32_t isrp;
+    uint32_t isp;
+    uint32_t iesp;
+    uint32_t iecp;
+    uint32_t rsvd24;
+    uint32_t pmao;
+    uint32_t mii_rt;
+    uint32_t iepclk;
+    uint32_t spp;
+    uint32_t rsvd38;
+    uint32_t rsvd40;
+    uint32_t pin_mx;
+} pruCfg;
+
+// PRU IEP register set
+typedef struct {
+    uint32_t global_cfg;
+    uint32_t global_status;
+    uint32_t compen;
+    uint32_t count;
+    uint32_t cmp_cfg;
+    uint32_t cmp_status;
+    uint32_t cmp0;
+    uint32_t cmp1;
+} pruIep;
+
+// PRU control register set
+typedef struct {
+    uint32_t ctrl;
+    uint32_t sts;
+    uint32_t wakeup_en;
+    uint32_t cycle;
+    uint32_t stall;
+} pruCtrl;
+
+// Hooks through which the simulation reports to the simulated host. Any of
+// them may be NULL. The host poll hook is invoked whenever R31 is read while
+// host interrupt 1 isn't pending, which allows the simulated host to kick off
+// the next job once the firmware sits idle. The hooks may call
+// raisePruSimEvent() and access the PRU memories.
+typedef struct {
+    void (*outputsChanged)(const uint64_t cycle, const uint32_t oldOutputs,
+            const uint32_t newOutputs, void *userData);
+    void (*eventRaised)(const uint64_t cycle, const uint32_t sysEvent,
+            void *userData);
+    void (*hostPoll)(const uint64_t cycle, void *userData);
+    void *userData;
+} PRUSIM_Hooks;
+
+// Ways a simulation run can end
+typedef enum {
+    PRUSIM_RESULT_HALTED,
+    PRUSIM_RESULT_CYCLE_LIMIT
+} PRUSIM_Result;
+
+// PRU-local data memory map and constant table pointer register
+extern uint8_t pruSimDataRam[PRUSIM_DATARAM_SIZE];
+extern uint32_t pruSimCtppr0;
+
+void initPruSim(const PRUSIM_Hooks *hooks, const uint32_t inputs);
+void setPruSimInputs(const uint32_t inputs);
+void setPruSimCycleLimit(const uint64_t cycleLimit);
+uint64_t getPruSimCycles(void);
+void raisePruSimEvent(const uint32_t sysEvent);
+PRUSIM_Result runPruSim(int (*entryPoint)(void));
+
+// Accessors and intrinsics used by the stand-in pru.h
+volatile uint32_t *pruSimR30(void);
+volatile uint32_t *pruSimR31(void);
+volatile pruIntc *pruSimIntc(void);
+volatile pruCfg *pruSimCfg(void);
+volatile pruIep *pruSimIep(void);
+volatile pruCtrl *pruSimCtrl(void);
+void pruSimDelayCycles(const uint32_t cycles);
+void pruSimHalt(void) __attribute__((noreturn));
+
+#endif /* PRUSIM_H_ */